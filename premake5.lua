@@ -119,6 +119,7 @@ filter("platforms:Windows")
     "opengl32",
     "comctl32",
     "shlwapi",
+    "synchronization",  -- WaitOnAddress and friends.
   })
 
 -- Create scratch/ path and dummy flags file if needed.
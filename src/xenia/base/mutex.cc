@@ -9,11 +9,77 @@
 
 #include "xenia/base/mutex.h"
 
+#include "xenia/base/assert.h"
+#include "xenia/base/threading.h"
+
 namespace xe {
 
-std::recursive_mutex& global_critical_region::mutex() {
-  static std::recursive_mutex global_mutex;
-  return global_mutex;
+uintptr_t global_mutex::current_thread_token() {
+  // Distinct for every live thread, and cheaper to get than the thread ID.
+  static thread_local uint8_t token;
+  return reinterpret_cast<uintptr_t>(&token);
+}
+
+void global_mutex::lock() {
+  uintptr_t self = current_thread_token();
+  if (owner.load(std::memory_order_relaxed) == self) {
+    ++recursion_count;
+    return;
+  }
+  uint32_t state_value = kUnlocked;
+  if (!state.compare_exchange_strong(state_value, kLocked,
+                                     std::memory_order_acquire)) {
+    LockContended(state_value);
+  }
+  owner.store(self, std::memory_order_relaxed);
+  recursion_count = 1;
+}
+
+void global_mutex::LockContended(uint32_t state_value) {
+  // Mark the mutex contended so the owner wakes us, then sleep until we are
+  // the ones to take it from kUnlocked.
+  if (state_value != kLockedContended) {
+    state_value = state.exchange(kLockedContended, std::memory_order_acquire);
+  }
+  while (state_value != kUnlocked) {
+    xe::threading::FutexWait(&state, kLockedContended);
+    state_value = state.exchange(kLockedContended, std::memory_order_acquire);
+  }
+}
+
+bool global_mutex::try_lock() {
+  uintptr_t self = current_thread_token();
+  if (owner.load(std::memory_order_relaxed) == self) {
+    ++recursion_count;
+    return true;
+  }
+  uint32_t state_value = kUnlocked;
+  if (!state.compare_exchange_strong(state_value, kLocked,
+                                     std::memory_order_acquire)) {
+    return false;
+  }
+  owner.store(self, std::memory_order_relaxed);
+  recursion_count = 1;
+  return true;
+}
+
+void global_mutex::unlock() {
+  assert_true(owner.load(std::memory_order_relaxed) == current_thread_token());
+  if (--recursion_count) {
+    return;
+  }
+  owner.store(0, std::memory_order_relaxed);
+  if (state.exchange(kUnlocked, std::memory_order_release) ==
+      kLockedContended) {
+    WakeWaiter();
+  }
+}
+
+void global_mutex::WakeWaiter() { xe::threading::FutexWake(&state); }
+
+global_mutex& global_critical_region::mutex() {
+  static global_mutex instance;
+  return instance;
 }
 
 }  // namespace xe
@@ -10,10 +10,47 @@
 #ifndef XENIA_BASE_MUTEX_H_
 #define XENIA_BASE_MUTEX_H_
 
+#include <atomic>
+#include <cstdint>
 #include <mutex>
 
 namespace xe {
 
+// Recursive mutex behind the global critical region.
+// The owning thread and recursion count are plain fields so that generated
+// code can take and release the lock inline when no other thread holds it,
+// only calling lock() or unlock() when it has to wait or wake a waiter.
+// Contended threads sleep on state with a futex.
+class global_mutex {
+ public:
+  // Unlocked, locked, and locked with threads (possibly) waiting.
+  enum : uint32_t {
+    kUnlocked = 0,
+    kLocked = 1,
+    kLockedContended = 2,
+  };
+
+  // Nonzero value identifying the calling thread as an owner.
+  static uintptr_t current_thread_token();
+
+  void lock();
+  bool try_lock();
+  void unlock();
+
+  // Wakes a thread waiting for the mutex after it was released from the
+  // kLockedContended state without unlock().
+  void WakeWaiter();
+
+  // Everything below is also accessed by generated code.
+  std::atomic<uint32_t> state = {kUnlocked};
+  // Only touched by the owner.
+  uint32_t recursion_count = 0;
+  std::atomic<uintptr_t> owner = {0};
+
+ private:
+  void LockContended(uint32_t state_value);
+};
+
 // The global critical region mutex singleton.
 // This must guard any operation that may suspend threads or be sensitive to
 // being suspended such as global table locks and such.
@@ -54,25 +91,25 @@ namespace xe {
 // };
 class global_critical_region {
  public:
-  static std::recursive_mutex& mutex();
+  static global_mutex& mutex();
 
   // Acquires a lock on the global critical section.
   // Use this when keeping an instance is not possible. Otherwise, prefer
   // to keep an instance of global_critical_region near the members requiring
   // it to keep things readable.
-  static std::unique_lock<std::recursive_mutex> AcquireDirect() {
-    return std::unique_lock<std::recursive_mutex>(mutex());
+  static std::unique_lock<global_mutex> AcquireDirect() {
+    return std::unique_lock<global_mutex>(mutex());
   }
 
   // Acquires a lock on the global critical section.
-  inline std::unique_lock<std::recursive_mutex> Acquire() {
-    return std::unique_lock<std::recursive_mutex>(mutex());
+  inline std::unique_lock<global_mutex> Acquire() {
+    return std::unique_lock<global_mutex>(mutex());
   }
 
   // Tries to acquire a lock on the glboal critical section.
   // Check owns_lock() to see if the lock was successfully acquired.
-  inline std::unique_lock<std::recursive_mutex> TryAcquire() {
-    return std::unique_lock<std::recursive_mutex>(mutex(), std::try_to_lock);
+  inline std::unique_lock<global_mutex> TryAcquire() {
+    return std::unique_lock<global_mutex>(mutex(), std::try_to_lock);
   }
 };
 
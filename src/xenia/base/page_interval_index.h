@@ -0,0 +1,196 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_PAGE_INTERVAL_INDEX_H_
+#define XENIA_BASE_PAGE_INTERVAL_INDEX_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/assert.h"
+
+namespace xe {
+
+// Page Interval Index: finds the items covering ranges of pages.
+// Items are stored in a segment tree over the pages, at the O(log pages) nodes
+// that together exactly make up their range. Inserting, removing and finding
+// the items covering a page are all O(log pages) plus the number of items
+// involved, no matter how many items there are in total.
+// Not threadsafe.
+template <typename T>
+class PageIntervalIndex {
+ public:
+  explicit PageIntervalIndex(uint32_t page_count) {
+    while (leaf_count_ < page_count) {
+      leaf_count_ <<= 1;
+    }
+    subtree_counts_.resize(leaf_count_ * 2, 0);
+  }
+
+  uint32_t page_count() const { return leaf_count_; }
+
+  // Adds an item covering [first_page, first_page + page_count).
+  void Insert(T item, uint32_t first_page, uint32_t page_count) {
+    assert_true(page_count && first_page + page_count <= leaf_count_);
+    Update(1, 0, leaf_count_, first_page, first_page + page_count, item, true);
+  }
+
+  // Removes an item with the same range it was inserted with.
+  void Remove(T item, uint32_t first_page, uint32_t page_count) {
+    assert_true(page_count && first_page + page_count <= leaf_count_);
+    Update(1, 0, leaf_count_, first_page, first_page + page_count, item,
+           false);
+  }
+
+  // Appends the items covering the page.
+  void FindCovering(uint32_t page, std::vector<T>* out_items) const {
+    uint32_t node = 1;
+    uint32_t lo = 0;
+    uint32_t hi = leaf_count_;
+    while (subtree_counts_[node]) {
+      AppendItems(node, out_items);
+      if (hi - lo == 1) {
+        break;
+      }
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (page < mid) {
+        node = node * 2;
+        hi = mid;
+      } else {
+        node = node * 2 + 1;
+        lo = mid;
+      }
+    }
+  }
+
+  // Appends the items covering any of the pages, each once.
+  void FindOverlapping(uint32_t first_page, uint32_t page_count,
+                       std::vector<T>* out_items) const {
+    size_t start = out_items->size();
+    FindOverlapping(1, 0, leaf_count_, first_page, first_page + page_count,
+                    out_items);
+    // Items made up of several nodes are found once per node.
+    std::sort(out_items->begin() + start, out_items->end());
+    out_items->erase(std::unique(out_items->begin() + start, out_items->end()),
+                     out_items->end());
+  }
+
+  // Calls fn(first_page, page_count) for each maximal run of pages in the
+  // range that no item covers, in ascending order.
+  template <typename F>
+  void ForEachUncoveredRun(uint32_t first_page, uint32_t page_count,
+                           F fn) const {
+    uint32_t run_start = 0;
+    uint32_t run_end = 0;
+    auto extend_run = [&](uint32_t lo, uint32_t hi) {
+      if (run_end != lo) {
+        if (run_end != run_start) {
+          fn(run_start, run_end - run_start);
+        }
+        run_start = lo;
+      }
+      run_end = hi;
+    };
+    ForEachUncovered(1, 0, leaf_count_, first_page, first_page + page_count,
+                     extend_run);
+    if (run_end != run_start) {
+      fn(run_start, run_end - run_start);
+    }
+  }
+
+ private:
+  uint32_t own_count(uint32_t node) const {
+    auto it = node_items_.find(node);
+    return it != node_items_.end() ? uint32_t(it->second.size()) : 0;
+  }
+
+  void AppendItems(uint32_t node, std::vector<T>* out_items) const {
+    auto it = node_items_.find(node);
+    if (it != node_items_.end()) {
+      out_items->insert(out_items->end(), it->second.begin(),
+                        it->second.end());
+    }
+  }
+
+  void Update(uint32_t node, uint32_t lo, uint32_t hi, uint32_t first,
+              uint32_t last, T item, bool insert) {
+    if (last <= lo || hi <= first) {
+      return;
+    }
+    if (first <= lo && hi <= last) {
+      auto& items = node_items_[node];
+      if (insert) {
+        items.push_back(item);
+      } else {
+        auto it = std::find(items.begin(), items.end(), item);
+        assert_true(it != items.end());
+        *it = items.back();
+        items.pop_back();
+        if (items.empty()) {
+          node_items_.erase(node);
+        }
+      }
+    } else {
+      uint32_t mid = lo + (hi - lo) / 2;
+      Update(node * 2, lo, mid, first, last, item, insert);
+      Update(node * 2 + 1, mid, hi, first, last, item, insert);
+    }
+    subtree_counts_[node] = own_count(node);
+    if (hi - lo > 1) {
+      subtree_counts_[node] +=
+          subtree_counts_[node * 2] + subtree_counts_[node * 2 + 1];
+    }
+  }
+
+  void FindOverlapping(uint32_t node, uint32_t lo, uint32_t hi, uint32_t first,
+                       uint32_t last, std::vector<T>* out_items) const {
+    if (last <= lo || hi <= first || !subtree_counts_[node]) {
+      return;
+    }
+    AppendItems(node, out_items);
+    if (hi - lo > 1) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      FindOverlapping(node * 2, lo, mid, first, last, out_items);
+      FindOverlapping(node * 2 + 1, mid, hi, first, last, out_items);
+    }
+  }
+
+  template <typename F>
+  void ForEachUncovered(uint32_t node, uint32_t lo, uint32_t hi,
+                        uint32_t first, uint32_t last, F& fn) const {
+    if (last <= lo || hi <= first) {
+      return;
+    }
+    if (!subtree_counts_[node]) {
+      fn(std::max(lo, first), std::min(hi, last));
+      return;
+    }
+    if (own_count(node) || hi - lo == 1) {
+      // Everything below is covered.
+      return;
+    }
+    uint32_t mid = lo + (hi - lo) / 2;
+    ForEachUncovered(node * 2, lo, mid, first, last, fn);
+    ForEachUncovered(node * 2 + 1, mid, hi, first, last, fn);
+  }
+
+  // Power of two number of pages, so the tree is complete. Node 1 is the root
+  // and node n has children 2n and 2n + 1.
+  uint32_t leaf_count_ = 1;
+  // Items stored at each node and all of its descendants.
+  std::vector<uint32_t> subtree_counts_;
+  // Most nodes are empty, so items are only stored for those that aren't.
+  std::unordered_map<uint32_t, std::vector<T>> node_items_;
+};
+
+}  // namespace xe
+
+#endif  // XENIA_BASE_PAGE_INTERVAL_INDEX_H_
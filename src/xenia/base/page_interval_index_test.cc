@@ -0,0 +1,74 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/page_interval_index.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace {
+
+std::vector<int> Covering(const xe::PageIntervalIndex<int>& index,
+                          uint32_t page) {
+  std::vector<int> items;
+  index.FindCovering(page, &items);
+  std::sort(items.begin(), items.end());
+  return items;
+}
+
+typedef std::vector<std::pair<uint32_t, uint32_t>> Runs;
+
+Runs UncoveredRuns(const xe::PageIntervalIndex<int>& index,
+                   uint32_t first_page, uint32_t page_count) {
+  Runs runs;
+  index.ForEachUncoveredRun(first_page, page_count,
+                            [&runs](uint32_t first, uint32_t count) {
+                              runs.emplace_back(first, count);
+                            });
+  return runs;
+}
+
+}  // namespace
+
+TEST_CASE("page_interval_index_covering", "Page Interval Index") {
+  xe::PageIntervalIndex<int> index(100);
+  REQUIRE(index.page_count() == 128);
+  index.Insert(1, 0, 10);
+  index.Insert(2, 5, 20);
+  index.Insert(3, 9, 1);
+  REQUIRE(Covering(index, 0) == std::vector<int>{1});
+  REQUIRE(Covering(index, 9) == (std::vector<int>{1, 2, 3}));
+  REQUIRE(Covering(index, 10) == std::vector<int>{2});
+  REQUIRE(Covering(index, 25).empty());
+
+  index.Remove(2, 5, 20);
+  REQUIRE(Covering(index, 9) == (std::vector<int>{1, 3}));
+  REQUIRE(Covering(index, 10).empty());
+
+  std::vector<int> items;
+  index.FindOverlapping(8, 50, &items);
+  REQUIRE(items == (std::vector<int>{1, 3}));
+}
+
+TEST_CASE("page_interval_index_uncovered_runs", "Page Interval Index") {
+  xe::PageIntervalIndex<int> index(64);
+  index.Insert(1, 4, 4);
+  index.Insert(2, 6, 6);
+  index.Insert(3, 20, 1);
+  Runs expected = {{0, 4}, {12, 8}, {21, 11}};
+  REQUIRE(UncoveredRuns(index, 0, 32) == expected);
+  REQUIRE(UncoveredRuns(index, 5, 5).empty());
+
+  // Removing a watch only uncovers the pages nothing else covers.
+  index.Remove(2, 6, 6);
+  expected = {{8, 4}};
+  REQUIRE(UncoveredRuns(index, 6, 6) == expected);
+}
@@ -76,6 +76,13 @@ void MaybeYield();
 // Memory barrier (request - may be ignored).
 void SyncMemory();
 
+// Blocks the current thread while the value at the address is still
+// expected_value, until FutexWake is called on the address. May return
+// spuriously, so callers must check the value again.
+void FutexWait(std::atomic<uint32_t>* address, uint32_t expected_value);
+// Wakes one thread blocked in FutexWait on the address, if any.
+void FutexWake(std::atomic<uint32_t>* address);
+
 // Sleeps the current thread for at least as long as the given duration.
 void Sleep(std::chrono::microseconds duration);
 template <typename Rep, typename Period>
@@ -9,13 +9,25 @@
 
 #include "xenia/base/threading.h"
 
+#include <linux/futex.h>
 #include <pthread.h>
+#include <sys/syscall.h>
 #include <time.h>
+#include <unistd.h>
 
 namespace xe {
 namespace threading {
 
 void MaybeYield() { pthread_yield(); }
 
+void FutexWait(std::atomic<uint32_t>* address, uint32_t expected_value) {
+  syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected_value, nullptr,
+          nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* address) {
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
 }  // namespace threading
 }  // namespace xe
@@ -32,6 +32,24 @@ void set_name(std::thread::native_handle_type handle, const std::string& name) {
 
 void MaybeYield() { pthread_yield_np(); }
 
+// The syscalls behind os_unfair_lock, present since 10.12 but not in any
+// public header.
+extern "C" int __ulock_wait(uint32_t operation, void* address, uint64_t value,
+                            uint32_t timeout_us);
+extern "C" int __ulock_wake(uint32_t operation, void* address,
+                            uint64_t wake_value);
+const uint32_t UL_COMPARE_AND_WAIT = 1;
+const uint32_t ULF_NO_ERRNO = 0x01000000;
+
+void FutexWait(std::atomic<uint32_t>* address, uint32_t expected_value) {
+  // A timeout of 0 waits forever.
+  __ulock_wait(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, address, expected_value, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* address) {
+  __ulock_wake(UL_COMPARE_AND_WAIT | ULF_NO_ERRNO, address, 0);
+}
+
 void Sleep(std::chrono::microseconds duration) {
   timespec rqtp = {duration.count() / 1000000, duration.count() % 1000};
   nanosleep(&rqtp, nullptr);
@@ -70,6 +70,15 @@ void MaybeYield() {
 
 void SyncMemory() { MemoryBarrier(); }
 
+// WaitOnAddress and friends need Windows 8, and synchronization.lib.
+void FutexWait(std::atomic<uint32_t>* address, uint32_t expected_value) {
+  ::WaitOnAddress(address, &expected_value, sizeof(expected_value), INFINITE);
+}
+
+void FutexWake(std::atomic<uint32_t>* address) {
+  ::WakeByAddressSingle(address);
+}
+
 void Sleep(std::chrono::microseconds duration) {
   if (duration.count() < 100) {
     MaybeYield();
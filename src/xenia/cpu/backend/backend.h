@@ -54,6 +54,19 @@ class Backend {
   virtual std::unique_ptr<GuestFunction> CreateGuestFunction(
       Module* module, uint32_t address) = 0;
 
+  // Notifies the backend that a module has been loaded into memory. The image
+  // hash identifies the module contents across runs.
+  virtual void OnModuleLoaded(Module* module, uint64_t image_hash) {}
+
+  // Attempts to define the function from a previously persisted translation.
+  // Returns false if the function must be translated.
+  virtual bool RestoreFunction(GuestFunction* function) { return false; }
+
+  // Frees the space of replaced code, recompiling live code out of sparsely
+  // used parts of the code cache first if it is running out of room. Called
+  // while the compiler is otherwise idle.
+  virtual void CompactCodeCache() {}
+
   // Calculates the next host instruction based on the current thread state and
   // current PC. This will look for branches and other control flow
   // instructions.
@@ -33,6 +33,17 @@ class CodeCache {
 
   // Finds platform-specific function unwind info for the given host PC.
   virtual void* LookupUnwindInfo(uint64_t host_pc) = 0;
+  // Finds the base address that the addresses in the unwind info for the
+  // given host PC are relative to.
+  virtual uint64_t LookupUnwindBase(uint64_t host_pc) = 0;
+
+  // Steps out of the generated function containing the host PC, given the
+  // stack pointer at it, to the return address and the stack pointer after
+  // returning. Returns false if the PC is not within a function that can be
+  // unwound. Safe to call from signal handlers.
+  virtual bool UnwindFrame(uint64_t* host_pc, uint64_t* host_sp) {
+    return false;
+  }
 };
 
 }  // namespace backend
@@ -0,0 +1,1127 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/interpreter/interpreter.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/hir/block.h"
+#include "xenia/cpu/hir/instr.h"
+#include "xenia/cpu/hir/label.h"
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/thread_state.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interpreter {
+
+using namespace xe::cpu::hir;
+
+using xe::cpu::ppc::PPCContext;
+
+typedef InterpreterProgram::Slot Slot;
+
+// The semantics below follow the x64 backend (x64_sequences.cc) wherever the
+// HIR leaves them open, so that a function behaves the same before and after
+// it is compiled.
+
+namespace {
+
+bool IsIntType(TypeName type) { return type <= INT64_TYPE; }
+bool IsFloatType(TypeName type) {
+  return type == FLOAT32_TYPE || type == FLOAT64_TYPE;
+}
+
+template <typename T>
+inline T Get(const Slot* slots, uint32_t slot) {
+  T value;
+  std::memcpy(&value, &slots[slot], sizeof(T));
+  return value;
+}
+
+template <typename T>
+inline void Set(Slot* slots, uint32_t slot, T value) {
+  std::memcpy(&slots[slot], &value, sizeof(T));
+}
+
+// Any bit set, as vptest does for floats.
+inline bool IsTrue(const Slot* slots, uint32_t slot, TypeName type) {
+  switch (GetTypeSize(type)) {
+    case 1:
+      return slots[slot].u8 != 0;
+    case 2:
+      return slots[slot].u16 != 0;
+    case 4:
+      return slots[slot].u32 != 0;
+    default:
+      return slots[slot].u64 != 0;
+  }
+}
+
+inline uint64_t GetInt(const Slot* slots, uint32_t slot, TypeName type,
+                       bool sign_extend) {
+  switch (type) {
+    case INT8_TYPE:
+      return sign_extend ? uint64_t(int64_t(int8_t(slots[slot].u8)))
+                         : slots[slot].u8;
+    case INT16_TYPE:
+      return sign_extend ? uint64_t(int64_t(int16_t(slots[slot].u16)))
+                         : slots[slot].u16;
+    case INT32_TYPE:
+      return sign_extend ? uint64_t(int64_t(int32_t(slots[slot].u32)))
+                         : slots[slot].u32;
+    default:
+      return slots[slot].u64;
+  }
+}
+
+inline void SetInt(Slot* slots, uint32_t slot, TypeName type, uint64_t value) {
+  switch (type) {
+    case INT8_TYPE:
+      slots[slot].u8 = uint8_t(value);
+      break;
+    case INT16_TYPE:
+      slots[slot].u16 = uint16_t(value);
+      break;
+    case INT32_TYPE:
+      slots[slot].u32 = uint32_t(value);
+      break;
+    default:
+      slots[slot].u64 = value;
+      break;
+  }
+}
+
+// Calls fn with a value of the unsigned integer type of the given size, to
+// select the template instantiation to run.
+template <typename F>
+inline void DispatchInt(TypeName type, F&& fn) {
+  switch (type) {
+    case INT8_TYPE:
+      fn(uint8_t(0));
+      break;
+    case INT16_TYPE:
+      fn(uint16_t(0));
+      break;
+    case INT32_TYPE:
+      fn(uint32_t(0));
+      break;
+    case INT64_TYPE:
+      fn(uint64_t(0));
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+template <typename F>
+inline void DispatchFloat(TypeName type, F&& fn) {
+  switch (type) {
+    case FLOAT32_TYPE:
+      fn(float(0));
+      break;
+    case FLOAT64_TYPE:
+      fn(double(0));
+      break;
+    default:
+      assert_unhandled_case(type);
+      break;
+  }
+}
+
+// Shift counts are masked to 5 bits, or 6 for 64-bit values, and shifting
+// smaller values past their width clears them, as the x64 shifts do.
+template <typename T>
+inline uint32_t MaskShift(uint8_t count) {
+  return count & (sizeof(T) == 8 ? 63 : 31);
+}
+
+template <typename T>
+inline T ShiftLeft(T value, uint8_t count) {
+  uint32_t n = MaskShift<T>(count);
+  return n >= sizeof(T) * 8 ? T(0) : T(uint64_t(value) << n);
+}
+
+template <typename T>
+inline T ShiftRight(T value, uint8_t count) {
+  uint32_t n = MaskShift<T>(count);
+  return n >= sizeof(T) * 8 ? T(0) : T(uint64_t(value) >> n);
+}
+
+template <typename T>
+inline T ShiftRightArithmetic(T value, uint8_t count) {
+  typedef typename std::make_signed<T>::type S;
+  uint32_t n = MaskShift<T>(count);
+  if (n >= sizeof(T) * 8) {
+    n = sizeof(T) * 8 - 1;
+  }
+  return T(S(value) >> n);
+}
+
+template <typename T>
+inline T RotateLeft(T value, uint8_t count) {
+  uint32_t n = MaskShift<T>(count) % (sizeof(T) * 8);
+  if (!n) {
+    return value;
+  }
+  return T((uint64_t(value) << n) | (uint64_t(value) >> (sizeof(T) * 8 - n)));
+}
+
+template <typename T>
+inline uint8_t CountLeadingZeros(T value) {
+  if (!value) {
+    return uint8_t(sizeof(T) * 8);
+  }
+  return uint8_t(xe::lzcnt(uint64_t(value)) - (64 - sizeof(T) * 8));
+}
+
+template <typename T>
+inline T MulHi(T a, T b, bool is_unsigned) {
+  typedef typename std::make_signed<T>::type S;
+  const uint32_t bits = sizeof(T) * 8;
+  if (is_unsigned) {
+    return T((uint64_t(a) * uint64_t(b)) >> bits);
+  }
+  return T(uint64_t(int64_t(S(a)) * int64_t(S(b))) >> bits);
+}
+template <>
+inline uint64_t MulHi(uint64_t a, uint64_t b, bool is_unsigned) {
+#if XE_COMPILER_MSVC
+  if (is_unsigned) {
+    return __umulh(a, b);
+  }
+  return uint64_t(__mulh(int64_t(a), int64_t(b)));
+#else
+  if (is_unsigned) {
+    return uint64_t((unsigned __int128)(a) * (unsigned __int128)(b) >> 64);
+  }
+  return uint64_t((__int128)(int64_t(a)) * (__int128)(int64_t(b)) >> 64);
+#endif  // XE_COMPILER_MSVC
+}
+
+// x64 leaves the result of a division by zero unspecified (the frontend
+// handles that case itself) and faults on signed overflow, so both are given
+// a harmless result here.
+template <typename T>
+inline T Divide(T a, T b, bool is_unsigned) {
+  typedef typename std::make_signed<T>::type S;
+  if (!b) {
+    return T(0);
+  }
+  if (is_unsigned) {
+    return T(a / b);
+  }
+  if (S(b) == -1) {
+    return T(uint64_t(0) - uint64_t(a));
+  }
+  return T(S(a) / S(b));
+}
+
+template <typename T>
+inline bool CompareInt(Opcode opcode, T a, T b) {
+  typedef typename std::make_signed<T>::type S;
+  switch (opcode) {
+    case OPCODE_COMPARE_EQ:
+      return a == b;
+    case OPCODE_COMPARE_NE:
+      return a != b;
+    case OPCODE_COMPARE_SLT:
+      return S(a) < S(b);
+    case OPCODE_COMPARE_SLE:
+      return S(a) <= S(b);
+    case OPCODE_COMPARE_SGT:
+      return S(a) > S(b);
+    case OPCODE_COMPARE_SGE:
+      return S(a) >= S(b);
+    case OPCODE_COMPARE_ULT:
+      return a < b;
+    case OPCODE_COMPARE_ULE:
+      return a <= b;
+    case OPCODE_COMPARE_UGT:
+      return a > b;
+    case OPCODE_COMPARE_UGE:
+      return a >= b;
+    default:
+      assert_unhandled_case(opcode);
+      return false;
+  }
+}
+
+// comiss/comisd report unordered operands as both equal and less than, and
+// the conditions x64 tests pass those through.
+template <typename T>
+inline bool CompareFloat(Opcode opcode, T a, T b) {
+  bool unordered = std::isnan(a) || std::isnan(b);
+  switch (opcode) {
+    case OPCODE_COMPARE_EQ:
+      return unordered || a == b;
+    case OPCODE_COMPARE_NE:
+      return !unordered && a != b;
+    case OPCODE_COMPARE_SLT:
+    case OPCODE_COMPARE_ULT:
+      return unordered || a < b;
+    case OPCODE_COMPARE_SLE:
+    case OPCODE_COMPARE_ULE:
+      return unordered || a <= b;
+    case OPCODE_COMPARE_SGT:
+    case OPCODE_COMPARE_UGT:
+      return a > b;
+    case OPCODE_COMPARE_SGE:
+    case OPCODE_COMPARE_UGE:
+      return a >= b;
+    default:
+      assert_unhandled_case(opcode);
+      return false;
+  }
+}
+
+// NaN and out of range values give the "integer indefinite" value, as cvt*
+// does.
+template <typename I, typename F>
+inline I ConvertToInt(F value) {
+  const F limit = -F(std::numeric_limits<I>::min());
+  if (!(value >= -limit && value < limit)) {
+    return std::numeric_limits<I>::min();
+  }
+  return I(value);
+}
+
+template <typename T>
+inline T Round(T value, uint16_t round_mode) {
+  switch (round_mode) {
+    case ROUND_TO_ZERO:
+      return std::trunc(value);
+    case ROUND_TO_NEAREST:
+      return std::nearbyint(value);
+    case ROUND_TO_MINUS_INFINITY:
+      return std::floor(value);
+    case ROUND_TO_POSITIVE_INFINITY:
+      return std::ceil(value);
+    default:
+      assert_unhandled_case(round_mode);
+      return value;
+  }
+}
+
+bool IsSupportedConversion(TypeName dest_type, TypeName src_type) {
+  // Those the x64 backend implements.
+  switch (dest_type) {
+    case INT32_TYPE:
+      return src_type == FLOAT32_TYPE || src_type == FLOAT64_TYPE;
+    case INT64_TYPE:
+      return src_type == FLOAT64_TYPE;
+    case FLOAT32_TYPE:
+      return src_type == INT32_TYPE || src_type == FLOAT64_TYPE;
+    case FLOAT64_TYPE:
+      return src_type == INT64_TYPE || src_type == FLOAT32_TYPE;
+    default:
+      return false;
+  }
+}
+
+// Accesses to MMIO ranges go through the range callbacks, like those the x64
+// backend makes from sites it knows to touch MMIO. Only 32-bit accesses are
+// supported by the ranges. Values are in guest memory order.
+MMIORange* LookupMmioRange(uint32_t address) {
+  auto mmio_handler = MMIOHandler::global_handler();
+  return mmio_handler ? mmio_handler->LookupRange(address) : nullptr;
+}
+
+// Slots of the programs running on a thread, one set per nested call. Sets
+// are kept once a call returns, so that calls at the same depth reuse them
+// instead of allocating.
+struct ThreadFrames {
+  std::vector<std::vector<Slot>> frames;
+  size_t depth = 0;
+};
+thread_local ThreadFrames thread_frames;
+
+// Claims the slots for a call made at the current depth, sized to and filled
+// with the initial slots of the program, until it returns.
+class FrameScope {
+ public:
+  explicit FrameScope(const std::vector<Slot>& initial_slots) {
+    if (thread_frames.frames.size() <= thread_frames.depth) {
+      thread_frames.frames.emplace_back();
+    }
+    // Moving the set when the list grows keeps its storage in place, so
+    // callers still running hold on to theirs.
+    auto& frame = thread_frames.frames[thread_frames.depth++];
+    frame.assign(initial_slots.begin(), initial_slots.end());
+    slots_ = frame.data();
+  }
+  ~FrameScope() { --thread_frames.depth; }
+
+  Slot* slots() const { return slots_; }
+
+ private:
+  Slot* slots_ = nullptr;
+};
+
+}  // namespace
+
+InterpreterProgram::InterpreterProgram(GuestFunction* function)
+    : function_(function) {}
+
+std::unique_ptr<InterpreterProgram> InterpreterProgram::Lower(
+    HIRBuilder* builder, GuestFunction* function) {
+  std::unique_ptr<InterpreterProgram> program(
+      new InterpreterProgram(function));
+  Slot zero;
+  zero.u64 = 0;
+  program->initial_slots_.resize(builder->max_value_ordinal(), zero);
+
+  // Branches are pointed at their target blocks once all have been placed.
+  std::unordered_map<const Block*, uint32_t> block_starts;
+  std::vector<std::pair<size_t, Block*>> branches;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    block_starts[block] = uint32_t(program->instrs_.size());
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      if (!program->LowerInstr(instr, &branches)) {
+        return nullptr;
+      }
+    }
+  }
+
+  // Running off the end returns.
+  Instr ret = {};
+  ret.opcode = OPCODE_RETURN;
+  program->instrs_.push_back(ret);
+
+  for (auto& branch : branches) {
+    program->instrs_[branch.first].target = block_starts[branch.second];
+  }
+  return program;
+}
+
+bool InterpreterProgram::LowerValue(const Value* value, uint32_t* out_slot) {
+  if (value->type == VEC128_TYPE) {
+    return false;
+  }
+  assert_true(value->ordinal < initial_slots_.size());
+  if (value->IsConstant()) {
+    std::memcpy(&initial_slots_[value->ordinal], &value->constant,
+                sizeof(Slot));
+  }
+  *out_slot = value->ordinal;
+  return true;
+}
+
+bool InterpreterProgram::LowerInstr(
+    const hir::Instr* instr,
+    std::vector<std::pair<size_t, Block*>>* branches) {
+  Instr i = {};
+  i.opcode = instr->opcode->num;
+  i.flags = instr->flags;
+  if (instr->dest) {
+    if (!LowerValue(instr->dest, &i.dest)) {
+      return false;
+    }
+    i.type = instr->dest->type;
+  }
+
+  uint32_t signature = instr->opcode->signature;
+  const OpcodeSignatureType src_sig_types[] = {
+      GET_OPCODE_SIG_TYPE_SRC1(signature), GET_OPCODE_SIG_TYPE_SRC2(signature),
+      GET_OPCODE_SIG_TYPE_SRC3(signature),
+  };
+  const hir::Instr::Op* srcs[] = {&instr->src1, &instr->src2, &instr->src3};
+  uint32_t* src_slots[] = {&i.src1, &i.src2, &i.src3};
+  for (size_t n = 0; n < 3; ++n) {
+    switch (src_sig_types[n]) {
+      case OPCODE_SIG_TYPE_V:
+        if (!LowerValue(srcs[n]->value, src_slots[n])) {
+          return false;
+        }
+        if (!n) {
+          i.src_type = srcs[n]->value->type;
+        }
+        if (!instr->dest) {
+          i.type = srcs[n]->value->type;
+        }
+        break;
+      case OPCODE_SIG_TYPE_L:
+        branches->push_back({instrs_.size(), srcs[n]->label->block});
+        break;
+      case OPCODE_SIG_TYPE_S:
+        i.symbol = srcs[n]->symbol;
+        break;
+      case OPCODE_SIG_TYPE_O:
+        i.offset = uint32_t(srcs[n]->offset);
+        break;
+      default:
+        break;
+    }
+  }
+
+  bool supported = false;
+  switch (i.opcode) {
+    case OPCODE_COMMENT:
+    case OPCODE_NOP:
+    case OPCODE_SOURCE_OFFSET:
+    case OPCODE_CONTEXT_BARRIER:
+    case OPCODE_PREFETCH:
+      // Nothing to do at runtime.
+      return true;
+    case OPCODE_CALL:
+    case OPCODE_CALL_TRUE:
+      supported = i.symbol->is_guest();
+      break;
+    case OPCODE_CALL_INDIRECT:
+    case OPCODE_CALL_INDIRECT_TRUE:
+    case OPCODE_CALL_EXTERN:
+    case OPCODE_RETURN:
+    case OPCODE_RETURN_TRUE:
+    case OPCODE_SET_RETURN_ADDRESS:
+    case OPCODE_BRANCH:
+    case OPCODE_BRANCH_TRUE:
+    case OPCODE_BRANCH_FALSE:
+    case OPCODE_ASSIGN:
+    case OPCODE_LOAD_CLOCK:
+    case OPCODE_LOAD_CONTEXT:
+    case OPCODE_STORE_CONTEXT:
+    case OPCODE_MEMSET:
+    case OPCODE_MEMORY_BARRIER:
+    case OPCODE_MIN:
+    case OPCODE_SELECT:
+    case OPCODE_IS_TRUE:
+    case OPCODE_IS_FALSE:
+    case OPCODE_COMPARE_EQ:
+    case OPCODE_COMPARE_NE:
+    case OPCODE_COMPARE_SLT:
+    case OPCODE_COMPARE_SLE:
+    case OPCODE_COMPARE_SGT:
+    case OPCODE_COMPARE_SGE:
+    case OPCODE_COMPARE_ULT:
+    case OPCODE_COMPARE_ULE:
+    case OPCODE_COMPARE_UGT:
+    case OPCODE_COMPARE_UGE:
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_DIV:
+    case OPCODE_NEG:
+      supported = true;
+      break;
+    case OPCODE_CAST:
+      supported = GetTypeSize(i.type) == GetTypeSize(i.src_type);
+      break;
+    case OPCODE_ZERO_EXTEND:
+    case OPCODE_SIGN_EXTEND:
+    case OPCODE_TRUNCATE:
+      supported = IsIntType(i.type) && IsIntType(i.src_type);
+      break;
+    case OPCODE_CONVERT:
+      supported = IsSupportedConversion(i.type, i.src_type);
+      break;
+    case OPCODE_ROUND:
+    case OPCODE_MAX:
+    case OPCODE_MUL_ADD:
+    case OPCODE_MUL_SUB:
+    case OPCODE_ABS:
+    case OPCODE_SQRT:
+      supported = IsFloatType(i.type);
+      break;
+    case OPCODE_LOAD:
+    case OPCODE_STORE:
+      // Swapped float accesses aren't implemented by x64 either.
+      supported = IsIntType(i.type) || !(i.flags & LOAD_STORE_BYTE_SWAP);
+      break;
+    case OPCODE_ADD_CARRY:
+    case OPCODE_MUL_HI:
+    case OPCODE_AND:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_NOT:
+    case OPCODE_SHL:
+    case OPCODE_SHR:
+    case OPCODE_SHA:
+    case OPCODE_ROTATE_LEFT:
+      supported = IsIntType(i.type);
+      break;
+    case OPCODE_BYTE_SWAP:
+      supported = IsIntType(i.type) && i.type != INT8_TYPE;
+      break;
+    case OPCODE_CNTLZ:
+      supported = IsIntType(i.src_type);
+      break;
+    case OPCODE_ATOMIC_COMPARE_EXCHANGE:
+      // Operates at the type of the values compared rather than the result.
+      i.src_type = instr->src2.value->type;
+      supported = i.src_type == INT32_TYPE || i.src_type == INT64_TYPE;
+      break;
+    default:
+      // Vector operations, traps, debug breaks, and anything only produced by
+      // the optimization passes.
+      break;
+  }
+  if (!supported) {
+    return false;
+  }
+  instrs_.push_back(i);
+  return true;
+}
+
+Interpreter::Interpreter(Processor* processor) : processor_(processor) {}
+
+Interpreter::~Interpreter() = default;
+
+InterpreterProgram* Interpreter::AddProgram(
+    std::unique_ptr<InterpreterProgram> program) {
+  auto result = program.get();
+  std::lock_guard<std::mutex> lock(programs_mutex_);
+  programs_.push_back(std::move(program));
+  ++program_count_;
+  return result;
+}
+
+void Interpreter::Execute(InterpreterProgram* program, PPCContext* context) {
+  // Hand the function off to be compiled once it crosses the threshold. Only
+  // the call that crosses it does so. Functions are never interpreted with a
+  // threshold below 1.
+  if (++program->call_count_ == uint64_t(FLAGS_interpreter_threshold) &&
+      program->function()) {
+    ++promoted_count_;
+    processor_->TierUpFunction(program->function());
+  }
+
+  FrameScope frame(program->initial_slots_);
+  Run(program, context, frame.slots());
+}
+
+void Interpreter::CallGuest(PPCContext* context, uint32_t address,
+                            uint32_t return_address) {
+  auto function = processor_->ResolveFunction(address);
+  if (!function) {
+    XELOGE("Interpreter unable to resolve function %.8X", address);
+    return;
+  }
+  function->Call(context->thread_state, return_address);
+}
+
+void Interpreter::CallExtern(PPCContext* context, Function* function) {
+  if (function->behavior() == Function::Behavior::kBuiltin) {
+    auto builtin_function = static_cast<BuiltinFunction*>(function);
+    if (builtin_function->handler()) {
+      builtin_function->handler()(context, builtin_function->arg0(),
+                                  builtin_function->arg1());
+      return;
+    }
+  } else if (function->behavior() == Function::Behavior::kExtern) {
+    auto extern_function = static_cast<GuestFunction*>(function);
+    if (extern_function->extern_handler()) {
+      extern_function->extern_handler()(context, context->kernel_state);
+      return;
+    }
+  }
+  XELOGE("undefined extern call to %.8X %s", function->address(),
+         function->name().c_str());
+}
+
+void Interpreter::Run(const InterpreterProgram* program, PPCContext* context,
+                      Slot* slots) {
+  // The generated code compares possible returns with the return address it
+  // was called with. Callers always set the link register to that, so it
+  // stands in here.
+  uint32_t return_address = uint32_t(context->lr);
+  // Set by SET_RETURN_ADDRESS for the next call.
+  uint32_t call_return_address = 0;
+  uint8_t* membase = context->virtual_membase;
+  auto context_ptr = reinterpret_cast<uint8_t*>(context);
+
+  // Returns true if the call ended the function.
+  auto call_indirect = [&](const Instr& i, uint32_t target) {
+    if ((i.flags & CALL_POSSIBLE_RETURN) && target == return_address) {
+      return true;
+    }
+    if (i.flags & CALL_TAIL) {
+      CallGuest(context, target, return_address);
+      return true;
+    }
+    CallGuest(context, target, call_return_address);
+    return false;
+  };
+
+  const Instr* instrs = program->instrs_.data();
+  size_t ip = 0;
+  while (true) {
+    const Instr& i = instrs[ip++];
+    switch (i.opcode) {
+      case OPCODE_CALL_TRUE:
+        if (!IsTrue(slots, i.src1, i.src_type)) {
+          break;
+        }
+        if (i.flags & CALL_TAIL) {
+          CallGuest(context, i.symbol->address(), return_address);
+          return;
+        }
+        CallGuest(context, i.symbol->address(), call_return_address);
+        break;
+      case OPCODE_CALL:
+        if (i.flags & CALL_TAIL) {
+          CallGuest(context, i.symbol->address(), return_address);
+          return;
+        }
+        CallGuest(context, i.symbol->address(), call_return_address);
+        break;
+      case OPCODE_CALL_INDIRECT:
+        if (call_indirect(i, slots[i.src1].u32)) {
+          return;
+        }
+        break;
+      case OPCODE_CALL_INDIRECT_TRUE:
+        if (IsTrue(slots, i.src1, i.src_type) &&
+            call_indirect(i, slots[i.src2].u32)) {
+          return;
+        }
+        break;
+      case OPCODE_CALL_EXTERN:
+        CallExtern(context, i.symbol);
+        break;
+      case OPCODE_RETURN:
+        return;
+      case OPCODE_RETURN_TRUE:
+        if (IsTrue(slots, i.src1, i.src_type)) {
+          return;
+        }
+        break;
+      case OPCODE_SET_RETURN_ADDRESS:
+        call_return_address = slots[i.src1].u32;
+        break;
+      case OPCODE_BRANCH:
+        ip = i.target;
+        break;
+      case OPCODE_BRANCH_TRUE:
+        if (IsTrue(slots, i.src1, i.src_type)) {
+          ip = i.target;
+        }
+        break;
+      case OPCODE_BRANCH_FALSE:
+        if (!IsTrue(slots, i.src1, i.src_type)) {
+          ip = i.target;
+        }
+        break;
+
+      case OPCODE_ASSIGN:
+      case OPCODE_CAST:
+        slots[i.dest] = slots[i.src1];
+        break;
+      case OPCODE_ZERO_EXTEND:
+      case OPCODE_TRUNCATE:
+        SetInt(slots, i.dest, i.type, GetInt(slots, i.src1, i.src_type, false));
+        break;
+      case OPCODE_SIGN_EXTEND:
+        SetInt(slots, i.dest, i.type, GetInt(slots, i.src1, i.src_type, true));
+        break;
+      case OPCODE_CONVERT:
+        switch (i.type) {
+          case INT32_TYPE:
+            if (i.src_type == FLOAT32_TYPE) {
+              // cvtss2si rounds in the current mode rather than truncating.
+              Set<int32_t>(slots, i.dest, ConvertToInt<int32_t>(std::nearbyint(
+                                              slots[i.src1].f32)));
+            } else {
+              Set<int32_t>(slots, i.dest,
+                           ConvertToInt<int32_t>(slots[i.src1].f64));
+            }
+            break;
+          case INT64_TYPE:
+            Set<int64_t>(slots, i.dest,
+                         ConvertToInt<int64_t>(slots[i.src1].f64));
+            break;
+          case FLOAT32_TYPE:
+            slots[i.dest].f32 =
+                i.src_type == INT32_TYPE
+                    ? float(Get<int32_t>(slots, i.src1))
+                    : float(slots[i.src1].f64);
+            break;
+          case FLOAT64_TYPE:
+            slots[i.dest].f64 =
+                i.src_type == INT64_TYPE
+                    ? double(Get<int64_t>(slots, i.src1))
+                    : double(slots[i.src1].f32);
+            break;
+          default:
+            assert_unhandled_case(i.type);
+            break;
+        }
+        break;
+      case OPCODE_ROUND:
+        DispatchFloat(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          Set<T>(slots, i.dest, Round(Get<T>(slots, i.src1), i.flags));
+        });
+        break;
+
+      case OPCODE_LOAD_CLOCK:
+        slots[i.dest].u64 = Clock::QueryGuestTickCount();
+        break;
+      case OPCODE_LOAD_CONTEXT:
+        std::memcpy(&slots[i.dest], context_ptr + i.offset,
+                    GetTypeSize(i.type));
+        break;
+      case OPCODE_STORE_CONTEXT:
+        std::memcpy(context_ptr + i.offset, &slots[i.src2],
+                    GetTypeSize(i.type));
+        break;
+      case OPCODE_LOAD: {
+        uint32_t address = slots[i.src1].u32;
+        bool byte_swap = (i.flags & LOAD_STORE_BYTE_SWAP) != 0;
+        switch (i.type) {
+          case INT8_TYPE:
+            slots[i.dest].u8 = membase[address];
+            break;
+          case INT16_TYPE: {
+            auto value = xe::load<uint16_t>(membase + address);
+            slots[i.dest].u16 = byte_swap ? xe::byte_swap(value) : value;
+            break;
+          }
+          case INT32_TYPE: {
+            uint32_t value;
+            auto range = LookupMmioRange(address);
+            if (range) {
+              value = xe::byte_swap(uint32_t(
+                  range->read(context, range->callback_context, address)));
+            } else {
+              value = xe::load<uint32_t>(membase + address);
+            }
+            slots[i.dest].u32 = byte_swap ? xe::byte_swap(value) : value;
+            break;
+          }
+          case INT64_TYPE: {
+            auto value = xe::load<uint64_t>(membase + address);
+            slots[i.dest].u64 = byte_swap ? xe::byte_swap(value) : value;
+            break;
+          }
+          case FLOAT32_TYPE:
+            slots[i.dest].f32 = xe::load<float>(membase + address);
+            break;
+          case FLOAT64_TYPE:
+            slots[i.dest].f64 = xe::load<double>(membase + address);
+            break;
+          default:
+            assert_unhandled_case(i.type);
+            break;
+        }
+        break;
+      }
+      case OPCODE_STORE: {
+        uint32_t address = slots[i.src1].u32;
+        bool byte_swap = (i.flags & LOAD_STORE_BYTE_SWAP) != 0;
+        switch (i.type) {
+          case INT8_TYPE:
+            membase[address] = slots[i.src2].u8;
+            break;
+          case INT16_TYPE: {
+            auto value = slots[i.src2].u16;
+            xe::store(membase + address, byte_swap ? xe::byte_swap(value)
+                                                   : value);
+            break;
+          }
+          case INT32_TYPE: {
+            auto value = slots[i.src2].u32;
+            if (byte_swap) {
+              value = xe::byte_swap(value);
+            }
+            auto range = LookupMmioRange(address);
+            if (range) {
+              range->write(context, range->callback_context, address,
+                           xe::byte_swap(value));
+            } else {
+              xe::store(membase + address, value);
+            }
+            break;
+          }
+          case INT64_TYPE: {
+            auto value = slots[i.src2].u64;
+            xe::store(membase + address, byte_swap ? xe::byte_swap(value)
+                                                   : value);
+            break;
+          }
+          case FLOAT32_TYPE:
+            xe::store(membase + address, slots[i.src2].f32);
+            break;
+          case FLOAT64_TYPE:
+            xe::store(membase + address, slots[i.src2].f64);
+            break;
+          default:
+            assert_unhandled_case(i.type);
+            break;
+        }
+        break;
+      }
+      case OPCODE_MEMSET:
+        std::memset(membase + slots[i.src1].u32, slots[i.src2].u8,
+                    size_t(slots[i.src3].u64));
+        break;
+      case OPCODE_MEMORY_BARRIER:
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        break;
+      case OPCODE_ATOMIC_COMPARE_EXCHANGE: {
+        auto host_address = membase + slots[i.src1].u32;
+        bool exchanged;
+        if (i.src_type == INT32_TYPE) {
+          exchanged = xe::atomic_cas(
+              Get<int32_t>(slots, i.src2), Get<int32_t>(slots, i.src3),
+              reinterpret_cast<volatile int32_t*>(host_address));
+        } else {
+          exchanged = xe::atomic_cas(
+              Get<int64_t>(slots, i.src2), Get<int64_t>(slots, i.src3),
+              reinterpret_cast<volatile int64_t*>(host_address));
+        }
+        slots[i.dest].u8 = exchanged ? 1 : 0;
+        break;
+      }
+
+      case OPCODE_MAX:
+        // maxss/maxsd return the second operand unless the first is greater.
+        DispatchFloat(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          T a = Get<T>(slots, i.src1);
+          T b = Get<T>(slots, i.src2);
+          Set<T>(slots, i.dest, a > b ? a : b);
+        });
+        break;
+      case OPCODE_MIN:
+        if (IsFloatType(i.type)) {
+          DispatchFloat(i.type, [&](auto zero) {
+            typedef decltype(zero) T;
+            T a = Get<T>(slots, i.src1);
+            T b = Get<T>(slots, i.src2);
+            Set<T>(slots, i.dest, a < b ? a : b);
+          });
+        } else {
+          int64_t a = int64_t(GetInt(slots, i.src1, i.type, true));
+          int64_t b = int64_t(GetInt(slots, i.src2, i.type, true));
+          SetInt(slots, i.dest, i.type, uint64_t(a < b ? a : b));
+        }
+        break;
+      case OPCODE_SELECT:
+        slots[i.dest] = IsTrue(slots, i.src1, i.src_type) ? slots[i.src2]
+                                                          : slots[i.src3];
+        break;
+      case OPCODE_IS_TRUE:
+        slots[i.dest].u8 = IsTrue(slots, i.src1, i.src_type) ? 1 : 0;
+        break;
+      case OPCODE_IS_FALSE:
+        slots[i.dest].u8 = IsTrue(slots, i.src1, i.src_type) ? 0 : 1;
+        break;
+      case OPCODE_COMPARE_EQ:
+      case OPCODE_COMPARE_NE:
+      case OPCODE_COMPARE_SLT:
+      case OPCODE_COMPARE_SLE:
+      case OPCODE_COMPARE_SGT:
+      case OPCODE_COMPARE_SGE:
+      case OPCODE_COMPARE_ULT:
+      case OPCODE_COMPARE_ULE:
+      case OPCODE_COMPARE_UGT:
+      case OPCODE_COMPARE_UGE: {
+        bool result = false;
+        if (IsFloatType(i.src_type)) {
+          DispatchFloat(i.src_type, [&](auto zero) {
+            typedef decltype(zero) T;
+            result = CompareFloat(i.opcode, Get<T>(slots, i.src1),
+                                  Get<T>(slots, i.src2));
+          });
+        } else {
+          DispatchInt(i.src_type, [&](auto zero) {
+            typedef decltype(zero) T;
+            result = CompareInt(i.opcode, Get<T>(slots, i.src1),
+                                Get<T>(slots, i.src2));
+          });
+        }
+        slots[i.dest].u8 = result ? 1 : 0;
+        break;
+      }
+
+      case OPCODE_ADD:
+        if (IsFloatType(i.type)) {
+          DispatchFloat(i.type, [&](auto zero) {
+            typedef decltype(zero) T;
+            Set<T>(slots, i.dest,
+                   T(Get<T>(slots, i.src1) + Get<T>(slots, i.src2)));
+          });
+        } else {
+          SetInt(slots, i.dest, i.type, slots[i.src1].u64 + slots[i.src2].u64);
+        }
+        break;
+      case OPCODE_ADD_CARRY:
+        // The carry is the low bit of src3, as sahf takes it.
+        SetInt(slots, i.dest, i.type,
+               slots[i.src1].u64 + slots[i.src2].u64 + (slots[i.src3].u8 & 1));
+        break;
+      case OPCODE_SUB:
+        if (IsFloatType(i.type)) {
+          DispatchFloat(i.type, [&](auto zero) {
+            typedef decltype(zero) T;
+            Set<T>(slots, i.dest,
+                   T(Get<T>(slots, i.src1) - Get<T>(slots, i.src2)));
+          });
+        } else {
+          SetInt(slots, i.dest, i.type, slots[i.src1].u64 - slots[i.src2].u64);
+        }
+        break;
+      case OPCODE_MUL:
+        if (IsFloatType(i.type)) {
+          DispatchFloat(i.type, [&](auto zero) {
+            typedef decltype(zero) T;
+            Set<T>(slots, i.dest,
+                   T(Get<T>(slots, i.src1) * Get<T>(slots, i.src2)));
+          });
+        } else {
+          SetInt(slots, i.dest, i.type, slots[i.src1].u64 * slots[i.src2].u64);
+        }
+        break;
+      case OPCODE_MUL_HI:
+        DispatchInt(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          Set<T>(slots, i.dest,
+                 MulHi(Get<T>(slots, i.src1), Get<T>(slots, i.src2),
+                       (i.flags & ARITHMETIC_UNSIGNED) != 0));
+        });
+        break;
+      case OPCODE_DIV:
+        if (IsFloatType(i.type)) {
+          DispatchFloat(i.type, [&](auto zero) {
+            typedef decltype(zero) T;
+            Set<T>(slots, i.dest,
+                   T(Get<T>(slots, i.src1) / Get<T>(slots, i.src2)));
+          });
+        } else {
+          DispatchInt(i.type, [&](auto zero) {
+            typedef decltype(zero) T;
+            Set<T>(slots, i.dest,
+                   Divide(Get<T>(slots, i.src1), Get<T>(slots, i.src2),
+                          (i.flags & ARITHMETIC_UNSIGNED) != 0));
+          });
+        }
+        break;
+      case OPCODE_MUL_ADD:
+      case OPCODE_MUL_SUB:
+        DispatchFloat(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          T a = Get<T>(slots, i.src1);
+          T b = Get<T>(slots, i.src2);
+          T c = Get<T>(slots, i.src3);
+          if (i.opcode == OPCODE_MUL_SUB) {
+            c = -c;
+          }
+          if (i.flags & ARITHMETIC_FUSED) {
+            Set<T>(slots, i.dest, T(std::fma(a, b, c)));
+          } else {
+            T product = a * b;
+            Set<T>(slots, i.dest, T(product + c));
+          }
+        });
+        break;
+      case OPCODE_NEG:
+        // Floats only have their sign flipped, NaNs included.
+        if (i.type == FLOAT32_TYPE) {
+          slots[i.dest].u32 = slots[i.src1].u32 ^ 0x80000000u;
+        } else if (i.type == FLOAT64_TYPE) {
+          slots[i.dest].u64 = slots[i.src1].u64 ^ 0x8000000000000000ull;
+        } else {
+          SetInt(slots, i.dest, i.type, uint64_t(0) - slots[i.src1].u64);
+        }
+        break;
+      case OPCODE_ABS:
+        if (i.type == FLOAT32_TYPE) {
+          slots[i.dest].u32 = slots[i.src1].u32 & 0x7FFFFFFFu;
+        } else {
+          slots[i.dest].u64 = slots[i.src1].u64 & 0x7FFFFFFFFFFFFFFFull;
+        }
+        break;
+      case OPCODE_SQRT:
+        if (i.type == FLOAT32_TYPE) {
+          slots[i.dest].f32 = std::sqrt(slots[i.src1].f32);
+        } else {
+          slots[i.dest].f64 = std::sqrt(slots[i.src1].f64);
+        }
+        break;
+
+      case OPCODE_AND:
+        SetInt(slots, i.dest, i.type, slots[i.src1].u64 & slots[i.src2].u64);
+        break;
+      case OPCODE_OR:
+        SetInt(slots, i.dest, i.type, slots[i.src1].u64 | slots[i.src2].u64);
+        break;
+      case OPCODE_XOR:
+        SetInt(slots, i.dest, i.type, slots[i.src1].u64 ^ slots[i.src2].u64);
+        break;
+      case OPCODE_NOT:
+        SetInt(slots, i.dest, i.type, ~slots[i.src1].u64);
+        break;
+      case OPCODE_SHL:
+        DispatchInt(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          Set<T>(slots, i.dest,
+                 ShiftLeft(Get<T>(slots, i.src1), slots[i.src2].u8));
+        });
+        break;
+      case OPCODE_SHR:
+        DispatchInt(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          Set<T>(slots, i.dest,
+                 ShiftRight(Get<T>(slots, i.src1), slots[i.src2].u8));
+        });
+        break;
+      case OPCODE_SHA:
+        DispatchInt(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          Set<T>(slots, i.dest,
+                 ShiftRightArithmetic(Get<T>(slots, i.src1), slots[i.src2].u8));
+        });
+        break;
+      case OPCODE_ROTATE_LEFT:
+        DispatchInt(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          Set<T>(slots, i.dest,
+                 RotateLeft(Get<T>(slots, i.src1), slots[i.src2].u8));
+        });
+        break;
+      case OPCODE_BYTE_SWAP:
+        DispatchInt(i.type, [&](auto zero) {
+          typedef decltype(zero) T;
+          Set<T>(slots, i.dest, xe::byte_swap(Get<T>(slots, i.src1)));
+        });
+        break;
+      case OPCODE_CNTLZ:
+        DispatchInt(i.src_type, [&](auto zero) {
+          typedef decltype(zero) T;
+          slots[i.dest].u8 = CountLeadingZeros(Get<T>(slots, i.src1));
+        });
+        break;
+
+      default:
+        // Rejected when lowering.
+        assert_unhandled_case(i.opcode);
+        return;
+    }
+  }
+}
+
+}  // namespace interpreter
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
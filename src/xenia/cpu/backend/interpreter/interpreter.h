@@ -0,0 +1,138 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKEND_INTERPRETER_INTERPRETER_H_
+#define XENIA_CPU_BACKEND_INTERPRETER_INTERPRETER_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+namespace xe {
+namespace cpu {
+class Processor;
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace interpreter {
+
+// The HIR of a guest function flattened into a list of instructions that can
+// be run without generating any code for them.
+// Only scalar integer and floating-point code is supported; anything using
+// vectors, traps, or debug breaks must be compiled.
+class InterpreterProgram {
+ public:
+  // One per HIR value. Values are read and written at their own type, so
+  // anything above that is ignored.
+  union Slot {
+    uint8_t u8;
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+    float f32;
+    double f64;
+  };
+
+  struct Instr {
+    hir::Opcode opcode;
+    uint16_t flags;
+    // Type of the result, or of the value operated on if there is none.
+    hir::TypeName type;
+    // Type of src1, for conversions and comparisons.
+    hir::TypeName src_type;
+    uint32_t dest;
+    uint32_t src1;
+    uint32_t src2;
+    uint32_t src3;
+    // Instruction index branched to.
+    uint32_t target;
+    // Context offset, or memset length.
+    uint32_t offset;
+    Function* symbol;
+  };
+
+  // Lowers the HIR of the function as emitted by the frontend, before any
+  // passes have run. Returns null if it uses anything unsupported.
+  // The function may be null for programs that are never to be compiled.
+  static std::unique_ptr<InterpreterProgram> Lower(hir::HIRBuilder* builder,
+                                                   GuestFunction* function);
+
+  GuestFunction* function() const { return function_; }
+  size_t instr_count() const { return instrs_.size(); }
+  uint64_t call_count() const { return call_count_; }
+
+ private:
+  friend class Interpreter;
+
+  explicit InterpreterProgram(GuestFunction* function);
+
+  bool LowerInstr(const hir::Instr* instr,
+                  std::vector<std::pair<size_t, hir::Block*>>* branches);
+  bool LowerValue(const hir::Value* value, uint32_t* out_slot);
+
+  GuestFunction* function_ = nullptr;
+  std::vector<Instr> instrs_;
+  // Slots as they are on entry, with all constants filled in.
+  std::vector<Slot> initial_slots_;
+  std::atomic<uint64_t> call_count_ = {0};
+};
+
+// Runs programs in place of the generated code of cold functions. Calls made
+// by a program go through the normal function resolution, so interpreted and
+// compiled functions can call each other freely, and functions are handed to
+// the processor to be compiled once they have been called often enough.
+class Interpreter {
+ public:
+  explicit Interpreter(Processor* processor);
+  ~Interpreter();
+
+  // Takes ownership of a program. Programs are never freed, as threads may
+  // still be running them after their functions have been compiled.
+  InterpreterProgram* AddProgram(std::unique_ptr<InterpreterProgram> program);
+
+  // Runs the program with the context of the calling thread. The return
+  // address of the function is taken from the link register.
+  void Execute(InterpreterProgram* program, ppc::PPCContext* context);
+
+  uint32_t program_count() const { return uint32_t(program_count_); }
+  uint32_t promoted_count() const { return uint32_t(promoted_count_); }
+
+ private:
+  typedef InterpreterProgram::Slot Slot;
+  typedef InterpreterProgram::Instr Instr;
+
+  void Run(const InterpreterProgram* program, ppc::PPCContext* context,
+           Slot* slots);
+  void CallGuest(ppc::PPCContext* context, uint32_t address,
+                 uint32_t return_address);
+  void CallExtern(ppc::PPCContext* context, Function* function);
+
+  Processor* processor_ = nullptr;
+
+  std::mutex programs_mutex_;
+  std::vector<std::unique_ptr<InterpreterProgram>> programs_;
+  std::atomic<uint32_t> program_count_ = {0};
+  std::atomic<uint32_t> promoted_count_ = {0};
+};
+
+}  // namespace interpreter
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_INTERPRETER_INTERPRETER_H_
@@ -19,6 +19,7 @@
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/backend/x64/x64_persistent_cache.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/hir/label.h"
@@ -94,12 +95,31 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   static_cast<X64Function*>(function)->Setup(
       reinterpret_cast<uint8_t*>(machine_code), code_size);
 
-  // Install into indirection table.
+  // Persist for later runs, if enabled.
+  if (emitter_->is_persistable()) {
+    auto persistent_cache =
+        x64_backend_->LookupPersistentCache(function->module());
+    if (persistent_cache) {
+      persistent_cache->StoreFunction(
+          static_cast<X64Function*>(function), machine_code, code_size,
+          emitter_->stack_size(), emitter_->relocations());
+    }
+  }
+
+  // Link calls made by this function. This must come after the code has been
+  // persisted, as linking rewrites it, and before it can run.
+  auto code_cache = reinterpret_cast<X64CodeCache*>(backend_->code_cache());
+  code_cache->AddCallSites(reinterpret_cast<uint8_t*>(machine_code),
+                           emitter_->relocations());
+
+  // Install into indirection table, now that the function is complete.
+  // Copies running the guest code of replaced functions must not take over
+  // calls to the address.
   uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
   assert_true((host_address >> 32) == 0);
-  reinterpret_cast<X64CodeCache*>(backend_->code_cache())
-      ->AddIndirection(function->address(),
-                       static_cast<uint32_t>(host_address));
+  if (!function->is_private_copy()) {
+    code_cache->PublishGuestCode(function->address(), machine_code);
+  }
 
   return true;
 }
@@ -9,22 +9,34 @@
 
 #include "xenia/cpu/backend/x64/x64_backend.h"
 
+#include <cinttypes>
+
 #include "third_party/capstone/include/capstone.h"
 #include "third_party/capstone/include/x86.h"
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/string.h"
 #include "xenia/cpu/backend/x64/x64_assembler.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/backend/x64/x64_persistent_cache.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/stack_walker.h"
+#include "xenia/cpu/thread_state.h"
 
 DEFINE_bool(
     enable_haswell_instructions, true,
     "Uses the AVX2/FMA/etc instructions on Haswell processors, if available.");
+DEFINE_int32(x64_extension_mask, -1,
+             "Mask of X64EmitterFeatureFlags the x64 backend may use, for "
+             "testing the fallback paths. Read when the backend is created.");
+DEFINE_string(jit_cache_dir, "",
+              "Directory to persist generated code in, to skip translation on "
+              "later runs. Leave empty to disable.");
 
 namespace xe {
 namespace cpu {
@@ -38,10 +50,14 @@ class X64ThunkEmitter : public X64Emitter {
   HostToGuestThunk EmitHostToGuestThunk();
   GuestToHostThunk EmitGuestToHostThunk();
   ResolveFunctionThunk EmitResolveFunctionThunk();
+  void* EmitCallSiteThunk();
 };
 
 X64Backend::X64Backend(Processor* processor)
-    : Backend(processor), code_cache_(nullptr), emitter_data_(0) {
+    : Backend(processor),
+      code_cache_(nullptr),
+      emitter_data_(0),
+      emitter_feature_mask_(uint32_t(FLAGS_x64_extension_mask)) {
   if (cs_open(CS_ARCH_X86, CS_MODE_64, &capstone_handle_) != CS_ERR_OK) {
     assert_always("Failed to initialize capstone");
   }
@@ -103,18 +119,24 @@ bool X64Backend::Initialize() {
   host_to_guest_thunk_ = thunk_emitter.EmitHostToGuestThunk();
   guest_to_host_thunk_ = thunk_emitter.EmitGuestToHostThunk();
   resolve_function_thunk_ = thunk_emitter.EmitResolveFunctionThunk();
+  emitter_feature_flags_ = thunk_emitter.feature_flags();
 
   // Set the code cache to use the ResolveFunction thunk for default
   // indirections.
   assert_zero(uint64_t(resolve_function_thunk_) & 0xFFFFFFFF00000000ull);
   code_cache_->set_indirection_default(
       uint32_t(uint64_t(resolve_function_thunk_)));
+  code_cache_->set_call_site_thunk(thunk_emitter.EmitCallSiteThunk());
 
   // Allocate some special indirections.
   code_cache_->CommitExecutableRange(0x9FFF0000, 0x9FFFFFFF);
 
   // Allocate emitter constant data.
   emitter_data_ = X64Emitter::PlaceData(processor()->memory());
+  if (!emitter_data_) {
+    XELOGE("Unable to place emitter constant data");
+    return false;
+  }
 
   // Setup exception callback
   ExceptionHandler::Install(&ExceptionCallbackThunk, this);
@@ -122,6 +144,15 @@ bool X64Backend::Initialize() {
   return true;
 }
 
+void* X64Backend::AllocThreadData() {
+  return code_cache_->RegisterGuestThread();
+}
+
+void X64Backend::FreeThreadData(void* thread_data) {
+  code_cache_->UnregisterGuestThread(
+      reinterpret_cast<X64CodeCache::GuestThread*>(thread_data));
+}
+
 void X64Backend::CommitExecutableRange(uint32_t guest_low,
                                        uint32_t guest_high) {
   code_cache_->CommitExecutableRange(guest_low, guest_high);
@@ -136,6 +167,71 @@ std::unique_ptr<GuestFunction> X64Backend::CreateGuestFunction(
   return std::make_unique<X64Function>(module, address);
 }
 
+void X64Backend::OnModuleLoaded(Module* module, uint64_t image_hash) {
+  if (FLAGS_jit_cache_dir.empty()) {
+    // Cache disabled.
+    return;
+  }
+
+  auto cache_dir = xe::to_absolute_path(xe::to_wstring(FLAGS_jit_cache_dir));
+  auto path = xe::join_paths(
+      cache_dir, xe::format_string(L"%.16" PRIX64 ".xjit", image_hash));
+  auto cache = std::make_unique<X64PersistentCache>(
+      this, image_hash, module->float_precision_mode());
+  if (!cache->Initialize(path)) {
+    return;
+  }
+
+  auto global_lock = global_critical_region_.Acquire();
+  persistent_caches_[module] = std::move(cache);
+}
+
+X64PersistentCache* X64Backend::LookupPersistentCache(Module* module) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto it = persistent_caches_.find(module);
+  return it != persistent_caches_.end() ? it->second.get() : nullptr;
+}
+
+bool X64Backend::RestoreFunction(GuestFunction* function) {
+  auto cache = LookupPersistentCache(function->module());
+  if (!cache) {
+    return false;
+  }
+  return cache->RestoreFunction(static_cast<X64Function*>(function));
+}
+
+void X64Backend::CompactCodeCache() {
+  // Recompiling live code costs as much as compiling it did, so it is only
+  // worth doing once few segments are left. Segments where less than this
+  // fraction of the code is live are emptied.
+  const uint32_t kMinFreeSegmentCount = 4;
+  const double kMaxLiveFraction = 0.25;
+
+  std::unique_lock<std::mutex> lock(compact_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+  // Segments emptied before are reclaimed first, once threads allow it, so
+  // that nothing more is evacuated while they can't be.
+  if (!code_cache_->ReclaimRetiredCode()) {
+    return;
+  }
+  if (code_cache_->free_segment_count() < kMinFreeSegmentCount) {
+    // Retranslated functions are published as new functions, and their old
+    // code is retired like any other replaced code. Only segments that could
+    // be reclaimed right now are evacuated.
+    for (auto address :
+         code_cache_->QueryEvacuationCandidates(kMaxLiveFraction)) {
+      auto function = processor()->QueryFunction(address);
+      if (function && function->is_guest() &&
+          function->behavior() != Function::Behavior::kExtern) {
+        processor()->RetranslateFunction(static_cast<GuestFunction*>(function));
+      }
+    }
+  }
+  code_cache_->ReclaimRetiredCode();
+}
+
 uint64_t ReadCapstoneReg(X64Context* context, x86_reg reg) {
   switch (reg) {
     case X86_REG_RAX:
@@ -458,6 +554,21 @@ HostToGuestThunk X64ThunkEmitter::EmitHostToGuestThunk() {
   return (HostToGuestThunk)fn;
 }
 
+// Called by the thunks guest code calls out to host code through, with their
+// stack pointer.
+void ParkThread(void* raw_context, uint64_t thunk_sp) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto thread = reinterpret_cast<X64CodeCache::GuestThread*>(
+      thread_state->backend_data());
+  X64CodeCache::ParkGuestThread(thread, thunk_sp);
+}
+void UnparkThread(void* raw_context, uint64_t thunk_sp) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto thread = reinterpret_cast<X64CodeCache::GuestThread*>(
+      thread_state->backend_data());
+  X64CodeCache::UnparkGuestThread(thread, thunk_sp);
+}
+
 GuestToHostThunk X64ThunkEmitter::EmitGuestToHostThunk() {
   // rcx = context
   // rdx = target function
@@ -483,12 +594,29 @@ GuestToHostThunk X64ThunkEmitter::EmitGuestToHostThunk() {
 
   // TODO(benvanik): save things? XMM0-5?
 
-  mov(rax, rdx);
-  mov(rdx, r8);
-  mov(r8, r9);
-  mov(r9, r10);
+  // The thread is parked while in host code, which may block for any length
+  // of time. The target and arguments are kept in saved registers meanwhile.
+  mov(rbx, rdx);
+  mov(rsi, r8);
+  mov(rdi, r9);
+  mov(rbp, r10);
+  mov(rdx, rsp);
+  mov(rax, uint64_t(&ParkThread));
   call(rax);
 
+  mov(rcx, qword[rsp + 56]);
+  mov(rdx, rsi);
+  mov(r8, rdi);
+  mov(r9, rbp);
+  call(rbx);
+
+  mov(rbx, rax);
+  mov(rcx, qword[rsp + 56]);
+  mov(rdx, rsp);
+  mov(rax, uint64_t(&UnparkThread));
+  call(rax);
+  mov(rax, rbx);
+
   mov(rbx, qword[rsp + 48]);
   mov(rcx, qword[rsp + 56]);
   mov(rbp, qword[rsp + 64]);
@@ -531,10 +659,21 @@ ResolveFunctionThunk X64ThunkEmitter::EmitResolveFunctionThunk() {
   mov(qword[rsp + 104], r14);
   mov(qword[rsp + 112], r15);
 
+  // Compiling may reclaim retired code, so the thread is parked meanwhile.
+  mov(rdx, rsp);
+  mov(rax, uint64_t(&ParkThread));
+  call(rax);
+
+  mov(rcx, qword[rsp + 56]);
   mov(rdx, rbx);
   mov(rax, uint64_t(&ResolveFunction));
   call(rax);
 
+  mov(rcx, qword[rsp + 56]);
+  mov(rdx, rsp);
+  mov(rax, uint64_t(&UnparkThread));
+  call(rax);
+
   mov(rbx, qword[rsp + 48]);
   mov(rcx, qword[rsp + 56]);
   mov(rbp, qword[rsp + 64]);
@@ -548,12 +687,25 @@ ResolveFunctionThunk X64ThunkEmitter::EmitResolveFunctionThunk() {
   add(rsp, stack_size);
   mov(rcx, qword[rsp + 8 * 1]);
   mov(rdx, qword[rsp + 8 * 2]);
+  // The code resolved may have been replaced, and reclaimed, while parked.
+  // Resolved functions are in the indirection table, which is current.
+  mov(eax, dword[rbx]);
   jmp(rax);
 
   void* fn = Emplace(stack_size);
   return (ResolveFunctionThunk)fn;
 }
 
+void* X64ThunkEmitter::EmitCallSiteThunk() {
+  // ebx = target PPC address
+  // Jumps rather than calls so that the target returns straight to the call
+  // site, or to its caller for tail calls.
+  mov(eax, dword[rbx]);
+  jmp(rax);
+
+  return Emplace(0);
+}
+
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
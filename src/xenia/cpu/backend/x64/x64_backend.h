@@ -13,10 +13,15 @@
 #include <gflags/gflags.h>
 
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
+#include "xenia/base/mutex.h"
 #include "xenia/cpu/backend/backend.h"
 
 DECLARE_bool(enable_haswell_instructions);
+DECLARE_int32(x64_extension_mask);
+DECLARE_string(jit_cache_dir);
 
 namespace xe {
 class Exception;
@@ -27,6 +32,7 @@ namespace backend {
 namespace x64 {
 
 class X64CodeCache;
+class X64PersistentCache;
 
 #define XENIA_HAS_X64_BACKEND 1
 
@@ -43,6 +49,8 @@ class X64Backend : public Backend {
 
   X64CodeCache* code_cache() const { return code_cache_.get(); }
   uint32_t emitter_data() const { return emitter_data_; }
+  uint32_t emitter_feature_flags() const { return emitter_feature_flags_; }
+  uint32_t emitter_feature_mask() const { return emitter_feature_mask_; }
 
   // Call a generated function, saving all stack parameters.
   HostToGuestThunk host_to_guest_thunk() const { return host_to_guest_thunk_; }
@@ -55,6 +63,10 @@ class X64Backend : public Backend {
 
   bool Initialize() override;
 
+  // X64CodeCache::GuestThread of the thread.
+  void* AllocThreadData() override;
+  void FreeThreadData(void* thread_data) override;
+
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high) override;
 
   std::unique_ptr<Assembler> CreateAssembler() override;
@@ -62,6 +74,13 @@ class X64Backend : public Backend {
   std::unique_ptr<GuestFunction> CreateGuestFunction(Module* module,
                                                      uint32_t address) override;
 
+  void OnModuleLoaded(Module* module, uint64_t image_hash) override;
+  bool RestoreFunction(GuestFunction* function) override;
+  void CompactCodeCache() override;
+
+  // Returns the persistent code cache for the module, if caching is enabled.
+  X64PersistentCache* LookupPersistentCache(Module* module);
+
   uint64_t CalculateNextHostInstruction(ThreadDebugInfo* thread_info,
                                         uint64_t current_pc) override;
 
@@ -78,6 +97,14 @@ class X64Backend : public Backend {
   std::unique_ptr<X64CodeCache> code_cache_;
 
   uint32_t emitter_data_;
+  uint32_t emitter_feature_flags_ = 0;
+  uint32_t emitter_feature_mask_ = ~0u;
+
+  xe::global_critical_region global_critical_region_;
+  std::unordered_map<Module*, std::unique_ptr<X64PersistentCache>>
+      persistent_caches_;
+  // Held while compacting, so that threads don't recompile the same code.
+  std::mutex compact_mutex_;
 
   HostToGuestThunk host_to_guest_thunk_;
   GuestToHostThunk guest_to_host_thunk_;
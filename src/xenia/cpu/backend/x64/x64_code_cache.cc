@@ -9,14 +9,21 @@
 
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+#include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/backend/x64/x64_stack_layout.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/function.h"
 
 namespace xe {
@@ -26,7 +33,14 @@ namespace x64 {
 
 X64CodeCache::X64CodeCache() = default;
 
+// Upper bound of the unwind info reserved for a function on any platform.
+static const size_t kMaximumUnwindInfoSize = 64;
+
 X64CodeCache::~X64CodeCache() {
+  if (FLAGS_compile_stats && generated_code_base_) {
+    LogStatistics();
+  }
+
   if (indirection_table_base_) {
     xe::memory::DeallocFixed(indirection_table_base_, 0,
                              xe::memory::DeallocationType::kRelease);
@@ -78,8 +92,11 @@ bool X64CodeCache::Initialize() {
     return false;
   }
 
-  // Preallocate the function map to a large, reasonable size.
-  generated_code_map_.reserve(kMaximumFunctionCount);
+  for (size_t i = 0; i < kSegmentCount; ++i) {
+    segments_[i].base_offset = i * kSegmentSize;
+    segments_[i].size =
+        std::min(kSegmentSize, size_t(kGeneratedCodeSize) - i * kSegmentSize);
+  }
 
   return true;
 }
@@ -92,9 +109,11 @@ void X64CodeCache::AddIndirection(uint32_t guest_address,
                                   uint32_t host_address) {
   assert_not_null(indirection_table_base_);
 
-  uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
+  // Slots may be swapped while other threads are calling through them (such as
+  // when a function is recompiled), so the update must be a single store.
+  auto indirection_slot = reinterpret_cast<volatile int32_t*>(
       indirection_table_base_ + (guest_address - kIndirectionTableBase));
-  *indirection_slot = host_address;
+  xe::atomic_exchange(int32_t(host_address), indirection_slot);
 }
 
 void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
@@ -129,48 +148,41 @@ void* X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
                                    GuestFunction* function_info) {
   // Hold a lock while we bump the pointers up. This is important as the
   // unwind table requires entries AND code to be sorted in order.
-  size_t low_mark;
-  size_t high_mark;
   uint8_t* code_address = nullptr;
   UnwindReservation unwind_reservation;
   {
     auto global_lock = global_critical_region_.Acquire();
 
-    low_mark = generated_code_offset_;
+    // Always move the code to land on 16b alignment.
+    size_t code_reservation = xe::round_up(code_size, 16);
+    auto segment = AcquireSegment(code_reservation + kMaximumUnwindInfoSize);
+    if (!segment) {
+      return nullptr;
+    }
 
     // Reserve code.
-    // Always move the code to land on 16b alignment.
-    code_address = generated_code_base_ + generated_code_offset_;
-    generated_code_offset_ += xe::round_up(code_size, 16);
+    code_address = AllocateCode(segment, code_reservation);
 
     // Reserve unwind info.
     // We go on the high size of the unwind info as we don't know how big we
     // need it, and a few extra bytes of padding isn't the worst thing.
-    unwind_reservation =
-        RequestUnwindReservation(generated_code_base_ + generated_code_offset_);
-    generated_code_offset_ += unwind_reservation.data_size;
-
-    high_mark = generated_code_offset_;
-
-    // Store in map. It is maintained in sorted order of host PC dependent on
-    // us also being append-only.
-    generated_code_map_.emplace_back(
-        (uint64_t(code_address - generated_code_base_) << 32) |
-            generated_code_offset_,
-        function_info);
-  }
-
-  // If we are going above the high water mark of committed memory, commit some
-  // more. It's ok if multiple threads do this, as redundant commits aren't
-  // harmful.
-  size_t old_commit_mark = generated_code_commit_mark_;
-  if (high_mark > old_commit_mark) {
-    size_t new_commit_mark = old_commit_mark + 16 * 1024 * 1024;
-    xe::memory::AllocFixed(generated_code_base_, new_commit_mark,
-                           xe::memory::AllocationType::kCommit,
-                           xe::memory::PageAccess::kExecuteReadWrite);
-    generated_code_commit_mark_.compare_exchange_strong(old_commit_mark,
-                                                        new_commit_mark);
+    unwind_reservation = RequestUnwindReservation(
+        segment - segments_, code_address + code_reservation);
+    AllocateCode(segment, unwind_reservation.data_size);
+
+    // Store in the segment map. It is maintained in sorted order of host PC
+    // dependent on us also being append-only within the segment.
+    auto& entry = segment->entries[segment->entry_count];
+    entry.key = (uint64_t(code_address - generated_code_base_) << 32) |
+                (segment->base_offset + segment->used_size);
+    entry.function = function_info;
+    entry.stack_size = stack_size;
+    entry.is_retired = false;
+    ++segment->entry_count;
+    segment->live_size += code_reservation + unwind_reservation.data_size;
+    if (!function_info) {
+      segment->has_permanent_code = true;
+    }
   }
 
   // Copy code.
@@ -178,79 +190,529 @@ void* X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
 
   // Notify subclasses of placed code.
   PlaceCode(guest_address, machine_code, code_size, stack_size, code_address,
-            unwind_reservation);
+            unwind_reservation, function_info);
+
+  return code_address;
+}
 
-  // Now that everything is ready, fix up the indirection table.
-  // Note that we do support code that doesn't have an indirection fixup, so
-  // ignore those when we see them.
-  if (guest_address && indirection_table_base_) {
-    uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
-        indirection_table_base_ + (guest_address - kIndirectionTableBase));
-    *indirection_slot = uint32_t(reinterpret_cast<uint64_t>(code_address));
+void X64CodeCache::PublishGuestCode(uint32_t guest_address,
+                                    void* code_address) {
+  auto host_address = uint32_t(reinterpret_cast<uint64_t>(code_address));
+  auto global_lock = global_critical_region_.Acquire();
+  uint64_t old_host_pc = call_targets_[guest_address].host_address;
+  if (indirection_table_base_) {
+    AddIndirection(guest_address, host_address);
+  }
+  LinkCallSites(guest_address, host_address);
+
+  // Whatever code was entered at the address until now is replaced. Threads
+  // already running it carry on, which is why it is only retired.
+  if (old_host_pc && old_host_pc != host_address) {
+    auto old_entry = const_cast<GeneratedCodeEntry*>(LookupEntry(old_host_pc));
+    if (old_entry && !old_entry->is_retired) {
+      RetireEntry(LookupSegment(old_host_pc), old_entry);
+    }
   }
+}
 
-  return code_address;
+X64CodeCache::Segment* X64CodeCache::AcquireSegment(size_t size) {
+  auto segment = filling_segment_;
+  if (segment) {
+    if (segment->used_size + size <= segment->size &&
+        segment->entry_count < kSegmentFunctionCount) {
+      return segment;
+    }
+    segment->state = SegmentState::kFull;
+    filling_segment_ = nullptr;
+  }
+
+  // Continue in the lowest free segment. If none are free, retired code is
+  // reclaimed to make room, as long as no thread is running guest code.
+  for (bool reclaimed = false;; reclaimed = true) {
+    for (size_t i = 0; i < kSegmentCount; ++i) {
+      segment = &segments_[i];
+      if (segment->state != SegmentState::kFree || size > segment->size) {
+        continue;
+      }
+      if (!segment->is_committed) {
+        if (!xe::memory::AllocFixed(
+                generated_code_base_ + segment->base_offset, segment->size,
+                xe::memory::AllocationType::kCommit,
+                xe::memory::PageAccess::kExecuteReadWrite)) {
+          XELOGE("Unable to commit code cache segment %zu", i);
+          return nullptr;
+        }
+        segment->is_committed = true;
+      }
+      if (!segment->entries) {
+        segment->entries.reset(new GeneratedCodeEntry[kSegmentFunctionCount]);
+      }
+      if (!OnSegmentOpened(i)) {
+        return nullptr;
+      }
+      segment->state = SegmentState::kFilling;
+      filling_segment_ = segment;
+      return segment;
+    }
+    if (reclaimed || !ReclaimRetiredCode()) {
+      break;
+    }
+  }
+
+  auto statistics = QueryStatistics();
+  XELOGE("Code cache is full: %zu KB live, %zu KB retired",
+         statistics.live_size / 1024, statistics.retired_size / 1024);
+  return nullptr;
+}
+
+uint8_t* X64CodeCache::AllocateCode(Segment* segment, size_t size) {
+  assert_true(segment->used_size + size <= segment->size);
+  uint8_t* address =
+      generated_code_base_ + segment->base_offset + segment->used_size;
+  segment->used_size += size;
+  return address;
+}
+
+void X64CodeCache::RetireEntry(Segment* segment, GeneratedCodeEntry* entry) {
+  size_t size = uint32_t(entry->key) - (entry->key >> 32);
+  entry->is_retired = true;
+  segment->live_size -= size;
+  segment->retired_size += size;
+}
+
+std::vector<uint32_t> X64CodeCache::QueryEvacuationCandidates(
+    double max_live_fraction) {
+  auto global_lock = global_critical_region_.Acquire();
+  std::vector<uint32_t> guest_addresses;
+  if (!ClaimGuestThreads()) {
+    return guest_addresses;
+  }
+  bool pinned[kSegmentCount] = {false};
+  FindPinnedSegments(pinned);
+  ReleaseGuestThreads();
+
+  for (size_t i = 0; i < kSegmentCount; ++i) {
+    auto& segment = segments_[i];
+    if (segment.state != SegmentState::kFull || segment.has_permanent_code ||
+        !segment.live_size || pinned[i] ||
+        double(segment.live_size) >
+            max_live_fraction * double(segment.used_size)) {
+      continue;
+    }
+    for (size_t j = 0; j < segment.entry_count; ++j) {
+      auto& entry = segment.entries[j];
+      // Private copies are only ever called through their own object, so
+      // nothing would take over from their code.
+      if (!entry.is_retired && !entry.function->is_private_copy()) {
+        guest_addresses.push_back(entry.function->address());
+      }
+    }
+  }
+  return guest_addresses;
+}
+
+X64CodeCache::GuestThread* X64CodeCache::RegisterGuestThread() {
+  auto global_lock = global_critical_region_.Acquire();
+  guest_threads_.emplace_back(new GuestThread());
+  return guest_threads_.back().get();
+}
+
+void X64CodeCache::UnregisterGuestThread(GuestThread* thread) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto it = std::find_if(
+      guest_threads_.begin(), guest_threads_.end(),
+      [thread](const std::unique_ptr<GuestThread>& guest_thread) {
+        return guest_thread.get() == thread;
+      });
+  if (it != guest_threads_.end()) {
+    guest_threads_.erase(it);
+  }
+}
+
+bool X64CodeCache::EnterGuestCode(GuestThread* thread) {
+  // Only the thread itself moves out of host code, so this only waits while
+  // a reclaim has it claimed.
+  uint32_t state = GuestThread::kInHost;
+  while (!thread->state.compare_exchange_weak(state, GuestThread::kInGuest,
+                                              std::memory_order_acquire)) {
+    if (state == GuestThread::kInGuest) {
+      return false;
+    }
+    state = GuestThread::kInHost;
+    xe::threading::MaybeYield();
+  }
+  return true;
+}
+
+void X64CodeCache::LeaveGuestCode(GuestThread* thread) {
+  thread->state.store(GuestThread::kInHost, std::memory_order_release);
+}
+
+void X64CodeCache::ParkGuestThread(GuestThread* thread, uint64_t thunk_sp) {
+  // The link is only read by reclaims, once the thread is claimed.
+  *reinterpret_cast<uint64_t*>(thunk_sp + StackLayout::THUNK_PARK_LINK) =
+      thread->park_sp;
+  thread->park_sp = thunk_sp;
+  LeaveGuestCode(thread);
+}
+
+void X64CodeCache::UnparkGuestThread(GuestThread* thread, uint64_t thunk_sp) {
+  EnterGuestCode(thread);
+  thread->park_sp =
+      *reinterpret_cast<uint64_t*>(thunk_sp + StackLayout::THUNK_PARK_LINK);
+}
+
+bool X64CodeCache::IsCurrentCode(const GuestFunction* function,
+                                 const void* code) const {
+  // Code can't be reclaimed, nor its space reused, while the thread is in
+  // guest code.
+  auto entry = LookupEntry(reinterpret_cast<uint64_t>(code));
+  return entry && entry->function == function && !entry->is_retired &&
+         generated_code_base_ + (entry->key >> 32) == code;
+}
+
+bool X64CodeCache::ClaimGuestThreads() {
+  for (size_t i = 0; i < guest_threads_.size(); ++i) {
+    uint32_t state = GuestThread::kInHost;
+    if (!guest_threads_[i]->state.compare_exchange_strong(
+            state, GuestThread::kClaimed, std::memory_order_acquire)) {
+      while (i--) {
+        LeaveGuestCode(guest_threads_[i].get());
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+void X64CodeCache::ReleaseGuestThreads() {
+  for (auto& thread : guest_threads_) {
+    LeaveGuestCode(thread.get());
+  }
+}
+
+void X64CodeCache::FindPinnedSegments(bool* pinned) {
+  for (auto& thread : guest_threads_) {
+    for (uint64_t thunk_sp = thread->park_sp; thunk_sp;
+         thunk_sp = *reinterpret_cast<const uint64_t*>(
+             thunk_sp + StackLayout::THUNK_PARK_LINK)) {
+      // Guest code called the thunk, or jumped to it in a tail call, so it
+      // returns into guest code. Frames end at the thunk that entered it.
+      uint64_t host_sp = thunk_sp + StackLayout::THUNK_STACK_SIZE;
+      uint64_t host_pc = *reinterpret_cast<const uint64_t*>(host_sp);
+      host_sp += 8;
+      do {
+        auto segment = LookupSegment(host_pc);
+        if (segment) {
+          pinned[segment - segments_] = true;
+        }
+      } while (UnwindFrame(&host_pc, &host_sp));
+    }
+  }
+}
+
+bool X64CodeCache::IsReclaimable(const Segment& segment) const {
+  return segment.state == SegmentState::kFull && !segment.live_size &&
+         !segment.has_permanent_code;
+}
+
+bool X64CodeCache::ReclaimRetiredCode() {
+  auto global_lock = global_critical_region_.Acquire();
+  if (std::none_of(segments_, segments_ + kSegmentCount,
+                   [this](const Segment& segment) {
+                     return IsReclaimable(segment);
+                   })) {
+    return true;
+  }
+  // Threads are only ever parked in thunks, which no code is reclaimed from,
+  // and new calls only reach live code. Until released, none can leave host
+  // code to run what is reclaimed.
+  if (!ClaimGuestThreads()) {
+    return false;
+  }
+  bool pinned[kSegmentCount] = {false};
+  FindPinnedSegments(pinned);
+
+  for (size_t i = 0; i < kSegmentCount; ++i) {
+    auto& segment = segments_[i];
+    if (!IsReclaimable(segment) || pinned[i]) {
+      continue;
+    }
+
+    // Call sites in the retired code must not be patched once the space is
+    // reused. Functions whose code this was keep pointing at it, but are
+    // only called through after checking it is still their current code.
+    uint64_t segment_low = uint64_t(generated_code_base_) + segment.base_offset;
+    uint64_t segment_high = segment_low + segment.size;
+    for (auto& it : call_targets_) {
+      auto& call_sites = it.second.call_sites;
+      call_sites.erase(
+          std::remove_if(call_sites.begin(), call_sites.end(),
+                         [segment_low, segment_high](const CallSite& site) {
+                           return site.host_address >= segment_low &&
+                                  site.host_address < segment_high;
+                         }),
+          call_sites.end());
+    }
+
+    OnSegmentReclaimed(i);
+    segment.entry_count = 0;
+    segment.used_size = 0;
+    segment.retired_size = 0;
+    segment.state = SegmentState::kFree;
+  }
+
+  ReleaseGuestThreads();
+  return true;
+}
+
+uint32_t X64CodeCache::free_segment_count() {
+  auto global_lock = global_critical_region_.Acquire();
+  uint32_t count = 0;
+  for (auto& segment : segments_) {
+    if (segment.state == SegmentState::kFree) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+X64CodeCache::Statistics X64CodeCache::QueryStatistics() {
+  auto global_lock = global_critical_region_.Acquire();
+  Statistics statistics;
+  size_t used_size = 0;
+  size_t stranded_size = 0;
+  for (auto& segment : segments_) {
+    ++statistics.segment_count;
+    if (segment.state == SegmentState::kFree) {
+      ++statistics.free_segment_count;
+    }
+    if (segment.is_committed) {
+      statistics.committed_size += segment.size;
+    }
+    statistics.live_size += segment.live_size;
+    statistics.retired_size += segment.retired_size;
+    used_size += segment.used_size;
+    if (segment.live_size) {
+      stranded_size += segment.retired_size;
+    }
+    for (size_t i = 0; i < segment.entry_count; ++i) {
+      auto& entry = segment.entries[i];
+      if (entry.function && !entry.is_retired) {
+        ++statistics.live_function_count;
+      }
+    }
+  }
+  statistics.fragmentation =
+      used_size ? double(stranded_size) / double(used_size) : 0;
+  return statistics;
+}
+
+void X64CodeCache::LogStatistics() {
+  auto statistics = QueryStatistics();
+  XELOGI("Code cache: %u of %u segments free, %zu KB committed",
+         statistics.free_segment_count, statistics.segment_count,
+         statistics.committed_size / 1024);
+  XELOGI("  %zu KB live in %u functions, %zu KB retired, %.1f%% fragmented",
+         statistics.live_size / 1024, statistics.live_function_count,
+         statistics.retired_size / 1024, statistics.fragmentation * 100.0);
+}
+
+void X64CodeCache::AddCallSite(uint32_t target_guest_address,
+                               uint8_t* site_address, bool is_tail) {
+  CallSite call_site;
+  call_site.host_address = uint32_t(reinterpret_cast<uint64_t>(site_address));
+  call_site.is_tail = is_tail;
+
+  auto global_lock = global_critical_region_.Acquire();
+  auto& call_target = call_targets_[target_guest_address];
+  call_target.call_sites.push_back(call_site);
+  PatchCallSite(call_site, call_target.host_address);
+}
+
+void X64CodeCache::AddCallSites(
+    uint8_t* code_address, const std::vector<X64Relocation>& relocations) {
+  for (auto& relocation : relocations) {
+    if (relocation.type == X64RelocationType::kCallSite ||
+        relocation.type == X64RelocationType::kTailCallSite) {
+      AddCallSite(relocation.target, code_address + relocation.code_offset,
+                  relocation.type == X64RelocationType::kTailCallSite);
+    }
+  }
+}
+
+void X64CodeCache::LinkCallSites(uint32_t target_guest_address,
+                                 uint32_t target_host_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto& call_target = call_targets_[target_guest_address];
+  call_target.host_address = target_host_address;
+  for (auto& call_site : call_target.call_sites) {
+    PatchCallSite(call_site, target_host_address);
+  }
+}
+
+void X64CodeCache::UnlinkCallSites(uint32_t target_guest_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto it = call_targets_.find(target_guest_address);
+  if (it == call_targets_.end()) {
+    return;
+  }
+  it->second.host_address = 0;
+  for (auto& call_site : it->second.call_sites) {
+    PatchCallSite(call_site, 0);
+  }
+}
+
+void X64CodeCache::PatchCallSite(const CallSite& call_site,
+                                 uint32_t target_host_address) {
+  // Sites are 8b aligned so the whole site can be swapped with one store while
+  // other threads may be executing it. Linked or not, a site is the same
+  // single call/jmp followed by the same nop, only to a different target, so
+  // a thread between instructions of the site, or returning to it from the
+  // call, finds the same instruction boundaries in either.
+  // call/jmp rel32
+  // nop (3b)
+  if (!target_host_address) {
+    target_host_address = call_site_thunk_;
+  }
+  int32_t displacement =
+      int32_t(target_host_address - (call_site.host_address + 5));
+  uint64_t site_bytes = (call_site.is_tail ? 0xE9ull : 0xE8ull) |
+                        (uint64_t(uint32_t(displacement)) << 8) |
+                        (0x001F0Full << 40);
+  auto site = reinterpret_cast<volatile int64_t*>(
+      uint64_t(call_site.host_address));
+  xe::atomic_exchange(int64_t(site_bytes), site);
 }
 
 uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
   // Hold a lock while we bump the pointers up.
-  size_t high_mark;
   uint8_t* data_address = nullptr;
   {
     auto global_lock = global_critical_region_.Acquire();
 
-    // Reserve code.
-    // Always move the code to land on 16b alignment.
-    data_address = generated_code_base_ + generated_code_offset_;
-    generated_code_offset_ += xe::round_up(length, 16);
-
-    high_mark = generated_code_offset_;
-  }
-
-  // If we are going above the high water mark of committed memory, commit some
-  // more. It's ok if multiple threads do this, as redundant commits aren't
-  // harmful.
-  size_t old_commit_mark = generated_code_commit_mark_;
-  if (high_mark > old_commit_mark) {
-    size_t new_commit_mark = old_commit_mark + 16 * 1024 * 1024;
-    xe::memory::AllocFixed(generated_code_base_, new_commit_mark,
-                           xe::memory::AllocationType::kCommit,
-                           xe::memory::PageAccess::kExecuteReadWrite);
-    generated_code_commit_mark_.compare_exchange_strong(old_commit_mark,
-                                                        new_commit_mark);
+    // Always move the data to land on 16b alignment.
+    size_t data_reservation = xe::round_up(length, 16);
+    auto segment = AcquireSegment(data_reservation);
+    if (!segment) {
+      return 0;
+    }
+    data_address = AllocateCode(segment, data_reservation);
+    segment->live_size += data_reservation;
+    segment->has_permanent_code = true;
   }
 
-  // Copy code.
+  // Copy data.
   std::memcpy(data_address, data, length);
 
   return uint32_t(uintptr_t(data_address));
 }
 
-GuestFunction* X64CodeCache::LookupFunction(uint64_t host_pc) {
+X64CodeCache::Segment* X64CodeCache::LookupSegment(uint64_t host_pc) {
+  return const_cast<Segment*>(
+      static_cast<const X64CodeCache*>(this)->LookupSegment(host_pc));
+}
+
+const X64CodeCache::Segment* X64CodeCache::LookupSegment(
+    uint64_t host_pc) const {
+  if (host_pc < kGeneratedCodeBase ||
+      host_pc >= kGeneratedCodeBase + kGeneratedCodeSize) {
+    return nullptr;
+  }
+  return &segments_[(host_pc - kGeneratedCodeBase) / kSegmentSize];
+}
+
+const X64CodeCache::GeneratedCodeEntry* X64CodeCache::LookupEntry(
+    uint64_t host_pc) const {
+  auto segment = LookupSegment(host_pc);
+  if (!segment) {
+    return nullptr;
+  }
+  size_t entry_count = segment->entry_count;
+  if (!entry_count) {
+    return nullptr;
+  }
   uint32_t key = uint32_t(host_pc - kGeneratedCodeBase);
-  void* fn_entry = std::bsearch(
-      &key, generated_code_map_.data(), generated_code_map_.size() + 1,
-      sizeof(std::pair<uint32_t, Function*>),
+  return reinterpret_cast<const GeneratedCodeEntry*>(std::bsearch(
+      &key, segment->entries.get(), entry_count, sizeof(GeneratedCodeEntry),
       [](const void* key_ptr, const void* element_ptr) {
         auto key = *reinterpret_cast<const uint32_t*>(key_ptr);
-        auto element =
-            reinterpret_cast<const std::pair<uint64_t, GuestFunction*>*>(
-                element_ptr);
-        if (key < (element->first >> 32)) {
+        auto element = reinterpret_cast<const GeneratedCodeEntry*>(element_ptr);
+        if (key < (element->key >> 32)) {
           return -1;
-        } else if (key > uint32_t(element->first)) {
+        } else if (key > uint32_t(element->key)) {
           return 1;
         } else {
           return 0;
         }
-      });
-  if (fn_entry) {
-    return reinterpret_cast<const std::pair<uint64_t, GuestFunction*>*>(
-               fn_entry)
-        ->second;
-  } else {
+      }));
+}
+
+GuestFunction* X64CodeCache::LookupFunction(uint64_t host_pc) {
+  auto entry = LookupEntry(host_pc);
+  return entry ? entry->function : nullptr;
+}
+
+void* X64CodeCache::LookupUnwindInfo(uint64_t host_pc) {
+  auto segment = LookupSegment(host_pc);
+  if (!segment) {
     return nullptr;
   }
+  return LookupSegmentUnwindInfo(
+      segment - segments_,
+      uint32_t(host_pc - kGeneratedCodeBase - segment->base_offset));
+}
+
+uint64_t X64CodeCache::LookupUnwindBase(uint64_t host_pc) {
+  // Each segment has its own unwind table.
+  auto segment = LookupSegment(host_pc);
+  return segment ? kGeneratedCodeBase + segment->base_offset : 0;
+}
+
+bool X64CodeCache::UnwindFrame(uint64_t* host_pc, uint64_t* host_sp) {
+  auto entry = LookupEntry(*host_pc);
+  if (!entry) {
+    return false;
+  }
+  auto code_start = generated_code_base_ + (entry->key >> 32);
+  auto code = reinterpret_cast<const uint8_t*>(*host_pc);
+  size_t frame_size = entry->stack_size;
+  if (!entry->function) {
+    // Unlinked call sites call or jump to the call site thunk, which only
+    // jumps on. Other host code has no known frame, and thunks are where
+    // guest stacks begin and end anyway.
+    if (uint64_t(code_start) != call_site_thunk_) {
+      return false;
+    }
+    frame_size = 0;
+  } else if (code == code_start || code[0] == 0xC3 ||
+             IsStackPop(code_start, code, entry->stack_size)) {
+    // Emitted functions keep a fixed frame from the end of the prolog
+    // (sub rsp, N) until the epilog or a tail call pops it (add rsp, N) just
+    // before leaving through ret or jmp rel32.
+    frame_size = 0;
+  }
+
+  auto sp = *host_sp + frame_size;
+  *host_pc = *reinterpret_cast<const uint64_t*>(sp);
+  *host_sp = sp + 8;
+  return true;
+}
+
+bool X64CodeCache::IsStackPop(const uint8_t* code_start, const uint8_t* code,
+                              size_t stack_size) {
+  // add rsp, imm8 / add rsp, imm32 immediately before the code.
+  if (stack_size < 0x80) {
+    return code - code_start >= 4 && code[-4] == 0x48 && code[-3] == 0x83 &&
+           code[-2] == 0xC4 && code[-1] == stack_size;
+  }
+  if (code - code_start < 7) {
+    return false;
+  }
+  uint32_t imm;
+  std::memcpy(&imm, code - 4, sizeof(imm));
+  return code[-7] == 0x48 && code[-6] == 0x81 && code[-5] == 0xC4 &&
+         imm == stack_size;
 }
 
 }  // namespace x64
@@ -13,6 +13,7 @@
 #include <atomic>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -25,8 +26,32 @@ namespace cpu {
 namespace backend {
 namespace x64 {
 
+struct X64Relocation;
+
+// Generated code is placed into fixed-size segments of one executable region.
+// Each segment is filled in order, so that code and its lookup tables within
+// a segment stay sorted by host address, and is only reused once all code in
+// it has been retired.
+// Code is retired when it is replaced, such as when a function is recompiled
+// at another tier. Retired code stays in place, as threads may still be
+// running it or have return addresses into it, until it is reclaimed at a
+// point where every thread is in host code, and none will return into it.
 class X64CodeCache : public CodeCache {
  public:
+  struct Statistics {
+    uint32_t segment_count = 0;
+    uint32_t free_segment_count = 0;
+    size_t committed_size = 0;
+    // Code that can still be entered, including host code and data.
+    size_t live_size = 0;
+    uint32_t live_function_count = 0;
+    // Replaced or invalidated code waiting to be reclaimed.
+    size_t retired_size = 0;
+    // Retired code in segments that also hold live code, which can't be
+    // reclaimed until the rest of the segment is, relative to all code placed.
+    double fragmentation = 0;
+  };
+
   ~X64CodeCache() override;
 
   static std::unique_ptr<X64CodeCache> Create();
@@ -43,6 +68,12 @@ class X64CodeCache : public CodeCache {
 
   bool has_indirection_table() { return indirection_table_base_ != nullptr; }
   void set_indirection_default(uint32_t default_value);
+  // Code that calls through the indirection table entry of the guest address
+  // in ebx, which unlinked call sites call or jump to.
+  uint32_t call_site_thunk() const { return call_site_thunk_; }
+  void set_call_site_thunk(void* thunk) {
+    call_site_thunk_ = uint32_t(reinterpret_cast<uint64_t>(thunk));
+  }
   void AddIndirection(uint32_t guest_address, uint32_t host_address);
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high);
@@ -53,8 +84,79 @@ class X64CodeCache : public CodeCache {
                        size_t code_size, size_t stack_size,
                        GuestFunction* function_info);
   uint32_t PlaceData(const void* data, size_t length);
+  // Makes placed code the code entered for the guest address, through the
+  // indirection table and linked calls, and retires the code it replaces.
+  // Called once the function the code belongs to is fully set up, as other
+  // threads may run the code and look the function up by it right away.
+  void PublishGuestCode(uint32_t guest_address, void* code_address);
+
+  // Registers a call site emitted by X64Emitter::EmitCallSite in placed code.
+  // The site is linked directly to the target function's code now if it has
+  // been compiled, or as soon as it is. Sites must be registered before the
+  // code can run.
+  void AddCallSite(uint32_t target_guest_address, uint8_t* site_address,
+                   bool is_tail);
+  // Registers all kCallSite/kTailCallSite relocations of placed code.
+  void AddCallSites(uint8_t* code_address,
+                    const std::vector<X64Relocation>& relocations);
+  // Restores all call sites targeting the function to call through the
+  // indirection table, such as when its code is discarded.
+  void UnlinkCallSites(uint32_t target_guest_address);
+
+  // Returns the guest addresses of the live functions in full segments where
+  // less than the given fraction of the code placed is still live. Code can't
+  // be moved, as threads may be running it, so this is how scattered live code
+  // is compacted: the functions are recompiled into the segment being filled,
+  // which retires their code here so that the segments can be reclaimed.
+  // Segments guest frames of parked threads are in are skipped, as are all
+  // segments while any thread is running guest code, as their code couldn't
+  // be reclaimed anyway.
+  std::vector<uint32_t> QueryEvacuationCandidates(double max_live_fraction);
+  // Makes the space of segments holding only retired code available again.
+  // Only does so while every thread is in host code, which they are while
+  // blocked in calls out of guest code, and leaves segments with guest frames
+  // of those threads in place. Threads entering guest code meanwhile wait for
+  // it to finish. Returns false if any thread was running guest code.
+  bool ReclaimRetiredCode();
+  uint32_t free_segment_count();
+
+  // Whether a thread may be running guest code, kept per thread so that
+  // entering and leaving guest code touches nothing shared.
+  struct GuestThread {
+    enum : uint32_t {
+      kInHost,
+      kInGuest,
+      // In host code, and held there until the reclaim in progress is done.
+      kClaimed,
+    };
+    std::atomic<uint32_t> state = {kInHost};
+    // Stack pointer of the thunk the innermost call out of guest code is
+    // parked in, or 0. Each parked thunk links to the one before it, so that
+    // the guest frames of all nested calls into guest code can be found.
+    uint64_t park_sp = 0;
+  };
+  GuestThread* RegisterGuestThread();
+  void UnregisterGuestThread(GuestThread* thread);
+  // Brackets calls from host code into guest code. Returns false, with
+  // nothing to undo, if the thread is already in guest code.
+  static bool EnterGuestCode(GuestThread* thread);
+  static void LeaveGuestCode(GuestThread* thread);
+  // Brackets calls from guest code out to host code, given the stack pointer
+  // of the thunk making them.
+  static void ParkGuestThread(GuestThread* thread, uint64_t thunk_sp);
+  static void UnparkGuestThread(GuestThread* thread, uint64_t thunk_sp);
+  // Whether the code is the current code of the function, rather than code
+  // since replaced, which may have been reclaimed. Only valid in guest code.
+  bool IsCurrentCode(const GuestFunction* function, const void* code) const;
+
+  Statistics QueryStatistics();
+  void LogStatistics();
 
   GuestFunction* LookupFunction(uint64_t host_pc) override;
+  // Async-signal-safe.
+  bool UnwindFrame(uint64_t* host_pc, uint64_t* host_sp) override;
+  void* LookupUnwindInfo(uint64_t host_pc) override;
+  uint64_t LookupUnwindBase(uint64_t host_pc) override;
 
  protected:
   // All executable code falls within 0x80000000 to 0x9FFFFFFF, so we can
@@ -67,26 +169,116 @@ class X64CodeCache : public CodeCache {
   static const uint64_t kGeneratedCodeBase = 0xA0000000;
   static const uint64_t kGeneratedCodeSize = 0x0FFFFFFF;
 
-  // This is picked to be high enough to cover whatever we can reasonably
-  // expect. If we hit issues with this it probably means some corner case
-  // in analysis triggering.
-  static const size_t kMaximumFunctionCount = 50000;
+  // Segments are committed whole when first filled.
+  static const size_t kSegmentSize = 16 * 1024 * 1024;
+  static const size_t kSegmentCount =
+      (kGeneratedCodeSize + kSegmentSize - 1) / kSegmentSize;
+  // Functions placed in a single segment. The segment is considered full once
+  // reached, so this only needs to be high enough not to waste much space
+  // when functions are small.
+  static const size_t kSegmentFunctionCount = 32768;
 
   struct UnwindReservation {
     size_t data_size = 0;
+    size_t segment_index = 0;
     size_t table_slot = 0;
     uint8_t* entry_address = 0;
   };
 
   X64CodeCache();
 
-  virtual UnwindReservation RequestUnwindReservation(uint8_t* entry_address) {
+  struct CallSite {
+    uint32_t host_address;
+    bool is_tail;
+  };
+  struct CallTarget {
+    // Address of the current code of the target function, or 0 if it has
+    // none.
+    uint32_t host_address = 0;
+    std::vector<CallSite> call_sites;
+  };
+  struct GeneratedCodeEntry {
+    // [start address | end address], as offsets from the code base.
+    uint64_t key;
+    // Null for host code.
+    GuestFunction* function;
+    // Bytes the prolog reserves below the return address.
+    size_t stack_size;
+    // Replaced or invalidated. Still found by lookups, as threads may be
+    // running the code.
+    bool is_retired;
+  };
+  enum class SegmentState {
+    kFree,
+    kFilling,
+    kFull,
+  };
+  struct Segment {
+    // Offset of the segment from the code base.
+    size_t base_offset = 0;
+    size_t size = 0;
+    SegmentState state = SegmentState::kFree;
+    bool is_committed = false;
+    // Bytes placed so far, from the start of the segment.
+    size_t used_size = 0;
+    // Bytes of live and of retired code. Code that is never retired, such as
+    // host code and data, has the segment never be reclaimed.
+    size_t live_size = 0;
+    size_t retired_size = 0;
+    bool has_permanent_code = false;
+    // Sorted by host PC, as code in a segment is only ever appended. Never
+    // reallocated while the segment is in use, so that lookups can be made
+    // without holding the lock, such as from signal handlers.
+    std::unique_ptr<GeneratedCodeEntry[]> entries;
+    std::atomic<size_t> entry_count = {0};
+  };
+
+  // Rewrites the call site to call the given code directly, or through the
+  // indirection table if the address is 0.
+  void PatchCallSite(const CallSite& call_site, uint32_t target_host_address);
+  void LinkCallSites(uint32_t target_guest_address,
+                     uint32_t target_host_address);
+
+  // Returns the segment with room for the given bytes and one more function,
+  // starting to fill another if needed. Must be called with the lock held.
+  Segment* AcquireSegment(size_t size);
+  // Reserves space in the segment. Must be called with the lock held.
+  uint8_t* AllocateCode(Segment* segment, size_t size);
+  void RetireEntry(Segment* segment, GeneratedCodeEntry* entry);
+  Segment* LookupSegment(uint64_t host_pc);
+  const Segment* LookupSegment(uint64_t host_pc) const;
+  const GeneratedCodeEntry* LookupEntry(uint64_t host_pc) const;
+  // Holds all threads in host code, or returns false if any is running guest
+  // code. Must be called with the lock held.
+  bool ClaimGuestThreads();
+  void ReleaseGuestThreads();
+  // Flags the segments holding guest frames that claimed threads will return
+  // to, by walking their stacks up from each parked thunk.
+  void FindPinnedSegments(bool* pinned);
+  bool IsReclaimable(const Segment& segment) const;
+  // Whether the instruction ending at code pops a frame of the given size.
+  static bool IsStackPop(const uint8_t* code_start, const uint8_t* code,
+                         size_t stack_size);
+
+  virtual UnwindReservation RequestUnwindReservation(size_t segment_index,
+                                                     uint8_t* entry_address) {
     return UnwindReservation();
   }
+  // Called when a segment starts being filled, and when it is reclaimed.
+  virtual bool OnSegmentOpened(size_t segment_index) { return true; }
+  virtual void OnSegmentReclaimed(size_t segment_index) {}
+  // Finds the unwind info of code in a segment, given as an offset from it.
+  virtual void* LookupSegmentUnwindInfo(size_t segment_index,
+                                        uint32_t segment_offset) {
+    return nullptr;
+  }
+  // Called once code has been copied into place. function_info is null for
+  // host code, such as thunks.
   virtual void PlaceCode(uint32_t guest_address, void* machine_code,
                          size_t code_size, size_t stack_size,
                          void* code_address,
-                         UnwindReservation unwind_reservation) {}
+                         UnwindReservation unwind_reservation,
+                         GuestFunction* function_info) {}
 
   std::wstring file_name_;
   xe::memory::FileMappingHandle mapping_ = nullptr;
@@ -97,6 +289,7 @@ class X64CodeCache : public CodeCache {
 
   // Value that the indirection table will be initialized with upon commit.
   uint32_t indirection_default_value_ = 0xFEEDF00D;
+  uint32_t call_site_thunk_ = 0;
 
   // Fixed at kIndirectionTableBase in host space, holding 4 byte pointers into
   // the generated code table that correspond to the PPC functions in guest
@@ -105,14 +298,13 @@ class X64CodeCache : public CodeCache {
   // Fixed at kGeneratedCodeBase and holding all generated code, growing as
   // needed.
   uint8_t* generated_code_base_ = nullptr;
-  // Current offset to empty space in generated code.
-  size_t generated_code_offset_ = 0;
-  // Current high water mark of COMMITTED code.
-  std::atomic<size_t> generated_code_commit_mark_ = {0};
-  // Sorted map by host PC base offsets to source function info.
-  // This can be used to bsearch on host PC to find the guest function.
-  // The key is [start address | end address].
-  std::vector<std::pair<uint64_t, GuestFunction*>> generated_code_map_;
+  Segment segments_[kSegmentCount];
+  // Segment code is currently placed in, or null before any has been.
+  Segment* filling_segment_ = nullptr;
+  // Patchable call sites in generated code, by target guest address.
+  std::unordered_map<uint32_t, CallTarget> call_targets_;
+  // Threads that may run guest code, by their backend thread data.
+  std::vector<std::unique_ptr<GuestThread>> guest_threads_;
 };
 
 }  // namespace x64
@@ -0,0 +1,220 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+
+#include <gflags/gflags.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "xenia/base/logging.h"
+#include "xenia/cpu/function.h"
+
+DEFINE_bool(perf_map, false,
+            "Write /tmp/perf-<pid>.map naming all generated code, so `perf "
+            "report` can attribute samples to guest functions.");
+DEFINE_bool(perf_jitdump, false,
+            "Write /tmp/jit-<pid>.dump with all generated code, for "
+            "`perf inject --jit` (record with `perf record -k mono`).");
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// Linux perf jitdump format, as documented in
+// tools/perf/Documentation/jitdump-specification.txt in the kernel tree.
+struct JitdumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+struct JitdumpCodeLoad {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+  // Followed by the null terminated name and the code bytes.
+};
+struct JitdumpCodeClose {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+};
+static const uint32_t kJitdumpMagic = 0x4A695444;
+static const uint32_t kJitdumpCodeLoad = 0;
+static const uint32_t kJitdumpCodeClose = 3;
+static const uint32_t kElfMachineX64 = 62;
+
+class PosixX64CodeCache : public X64CodeCache {
+ public:
+  PosixX64CodeCache();
+  ~PosixX64CodeCache() override;
+
+  bool Initialize() override;
+
+ private:
+  void PlaceCode(uint32_t guest_address, void* machine_code, size_t code_size,
+                 size_t stack_size, void* code_address,
+                 UnwindReservation unwind_reservation,
+                 GuestFunction* function_info) override;
+
+  // Timestamps must come from the clock perf record was told to use.
+  static uint64_t QueryMonotonicTime();
+
+  // Serializes the writes of functions placed by different threads.
+  std::mutex perf_mutex_;
+  FILE* perf_map_file_ = nullptr;
+  FILE* jitdump_file_ = nullptr;
+  // perf record notices the jitdump file by this executable mapping of it.
+  void* jitdump_marker_ = nullptr;
+  uint64_t jitdump_code_index_ = 0;
+};
+
+std::unique_ptr<X64CodeCache> X64CodeCache::Create() {
+  return std::make_unique<PosixX64CodeCache>();
+}
+
+PosixX64CodeCache::PosixX64CodeCache() = default;
+
+PosixX64CodeCache::~PosixX64CodeCache() {
+  if (jitdump_file_) {
+    JitdumpCodeClose record;
+    record.id = kJitdumpCodeClose;
+    record.total_size = sizeof(record);
+    record.timestamp = QueryMonotonicTime();
+    std::fwrite(&record, sizeof(record), 1, jitdump_file_);
+    if (jitdump_marker_) {
+      munmap(jitdump_marker_, sysconf(_SC_PAGESIZE));
+    }
+    std::fclose(jitdump_file_);
+  }
+  if (perf_map_file_) {
+    std::fclose(perf_map_file_);
+  }
+}
+
+bool PosixX64CodeCache::Initialize() {
+  if (!X64CodeCache::Initialize()) {
+    return false;
+  }
+
+  // Failing to open these is not fatal, we just won't have symbols.
+  auto pid = uint32_t(getpid());
+  if (FLAGS_perf_map) {
+    auto path = "/tmp/perf-" + std::to_string(pid) + ".map";
+    perf_map_file_ = std::fopen(path.c_str(), "w");
+    if (!perf_map_file_) {
+      XELOGE("Unable to open perf map %s", path.c_str());
+    }
+  }
+  if (FLAGS_perf_jitdump) {
+    auto path = "/tmp/jit-" + std::to_string(pid) + ".dump";
+    jitdump_file_ = std::fopen(path.c_str(), "w+");
+    if (!jitdump_file_) {
+      XELOGE("Unable to open perf jitdump %s", path.c_str());
+    } else {
+      jitdump_marker_ =
+          mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC,
+               MAP_PRIVATE, fileno(jitdump_file_), 0);
+      if (jitdump_marker_ == MAP_FAILED) {
+        XELOGE("Unable to map perf jitdump %s", path.c_str());
+        jitdump_marker_ = nullptr;
+      }
+      JitdumpHeader header;
+      header.magic = kJitdumpMagic;
+      header.version = 1;
+      header.total_size = sizeof(header);
+      header.elf_mach = kElfMachineX64;
+      header.pad1 = 0;
+      header.pid = pid;
+      header.timestamp = QueryMonotonicTime();
+      header.flags = 0;
+      std::fwrite(&header, sizeof(header), 1, jitdump_file_);
+      std::fflush(jitdump_file_);
+    }
+  }
+
+  return true;
+}
+
+void PosixX64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
+                                  size_t code_size, size_t stack_size,
+                                  void* code_address,
+                                  UnwindReservation unwind_reservation,
+                                  GuestFunction* function_info) {
+  if (!perf_map_file_ && !jitdump_file_) {
+    return;
+  }
+
+  // Copies of replaced functions have a function but no guest address, so
+  // name from the function.
+  char name[256];
+  if (!function_info) {
+    std::snprintf(name, sizeof(name), "xe_host_code");
+  } else if (function_info->name().empty()) {
+    std::snprintf(name, sizeof(name), "sub_%.8X", function_info->address());
+  } else {
+    std::snprintf(name, sizeof(name), "%s_%.8X",
+                  function_info->name().c_str(), function_info->address());
+  }
+
+  std::lock_guard<std::mutex> lock(perf_mutex_);
+  if (perf_map_file_) {
+    std::fprintf(perf_map_file_, "%" PRIxPTR " %zx %s\n",
+                 reinterpret_cast<uintptr_t>(code_address), code_size, name);
+    std::fflush(perf_map_file_);
+  }
+  if (jitdump_file_) {
+    size_t name_size = std::strlen(name) + 1;
+    JitdumpCodeLoad record;
+    record.id = kJitdumpCodeLoad;
+    record.total_size = uint32_t(sizeof(record) + name_size + code_size);
+    record.timestamp = QueryMonotonicTime();
+    record.pid = uint32_t(getpid());
+    record.tid = uint32_t(syscall(SYS_gettid));
+    record.vma = reinterpret_cast<uintptr_t>(code_address);
+    record.code_addr = record.vma;
+    record.code_size = code_size;
+    record.code_index = jitdump_code_index_++;
+    std::fwrite(&record, sizeof(record), 1, jitdump_file_);
+    std::fwrite(name, name_size, 1, jitdump_file_);
+    std::fwrite(code_address, code_size, 1, jitdump_file_);
+    std::fflush(jitdump_file_);
+  }
+}
+
+uint64_t PosixX64CodeCache::QueryMonotonicTime() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return uint64_t(time.tv_sec) * 1000000000ull + uint64_t(time.tv_nsec);
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -20,10 +20,6 @@
 #include "xenia/base/platform_win.h"
 #include "xenia/cpu/function.h"
 
-// When enabled, this will use Windows 8 APIs to get unwind info.
-// TODO(benvanik): figure out why the callback variant doesn't work.
-#define USE_GROWABLE_FUNCTION_TABLE
-
 namespace xe {
 namespace cpu {
 namespace backend {
@@ -40,24 +36,35 @@ class Win32X64CodeCache : public X64CodeCache {
 
   bool Initialize() override;
 
-  void* LookupUnwindInfo(uint64_t host_pc) override;
-
  private:
-  UnwindReservation RequestUnwindReservation(uint8_t* entry_address) override;
+  // Each segment has its own table, so that it can be dropped when the
+  // segment is reclaimed.
+  struct UnwindTable {
+    // Growable function table system handle.
+    void* handle = nullptr;
+    // Actual unwind table entries.
+    std::vector<RUNTIME_FUNCTION> entries;
+    // Current number of entries in the table.
+    std::atomic<uint32_t> count = {0};
+  };
+
+  UnwindReservation RequestUnwindReservation(size_t segment_index,
+                                             uint8_t* entry_address) override;
+  bool OnSegmentOpened(size_t segment_index) override;
+  void OnSegmentReclaimed(size_t segment_index) override;
+  void* LookupSegmentUnwindInfo(size_t segment_index,
+                                uint32_t segment_offset) override;
   void PlaceCode(uint32_t guest_address, void* machine_code, size_t code_size,
                  size_t stack_size, void* code_address,
-                 UnwindReservation unwind_reservation) override;
+                 UnwindReservation unwind_reservation,
+                 GuestFunction* function_info) override;
 
   void InitializeUnwindEntry(uint8_t* unwind_entry_address,
-                             size_t unwind_table_slot, void* code_address,
-                             size_t code_size, size_t stack_size);
-
-  // Growable function table system handle.
-  void* unwind_table_handle_ = nullptr;
-  // Actual unwind table entries.
-  std::vector<RUNTIME_FUNCTION> unwind_table_;
-  // Current number of entries in the table.
-  std::atomic<uint32_t> unwind_table_count_ = {0};
+                             size_t segment_index, size_t unwind_table_slot,
+                             void* code_address, size_t code_size,
+                             size_t stack_size);
+
+  UnwindTable unwind_tables_[kSegmentCount];
 };
 
 std::unique_ptr<X64CodeCache> X64CodeCache::Create() {
@@ -67,84 +74,79 @@ std::unique_ptr<X64CodeCache> X64CodeCache::Create() {
 Win32X64CodeCache::Win32X64CodeCache() = default;
 
 Win32X64CodeCache::~Win32X64CodeCache() {
-#ifdef USE_GROWABLE_FUNCTION_TABLE
-  if (unwind_table_handle_) {
-    RtlDeleteGrowableFunctionTable(unwind_table_handle_);
-  }
-#else
-  if (generated_code_base_) {
-    RtlDeleteFunctionTable(reinterpret_cast<PRUNTIME_FUNCTION>(
-        reinterpret_cast<DWORD64>(generated_code_base_) | 0x3));
+  for (auto& unwind_table : unwind_tables_) {
+    if (unwind_table.handle) {
+      RtlDeleteGrowableFunctionTable(unwind_table.handle);
+    }
   }
-#endif  // USE_GROWABLE_FUNCTION_TABLE
 }
 
 bool Win32X64CodeCache::Initialize() {
   if (!X64CodeCache::Initialize()) {
     return false;
   }
+  // Unwind info is registered with the system per segment as it is opened.
+  return true;
+}
 
-  // Compute total number of unwind entries we should allocate.
-  // We don't support reallocing right now, so this should be high.
-  unwind_table_.resize(kMaximumFunctionCount);
+Win32X64CodeCache::UnwindReservation
+Win32X64CodeCache::RequestUnwindReservation(size_t segment_index,
+                                            uint8_t* entry_address) {
+  UnwindReservation unwind_reservation;
+  unwind_reservation.data_size = xe::round_up(kUnwindInfoSize, 16);
+  unwind_reservation.segment_index = segment_index;
+  unwind_reservation.table_slot = unwind_tables_[segment_index].count++;
+  unwind_reservation.entry_address = entry_address;
+  assert_true(unwind_reservation.table_slot < kSegmentFunctionCount);
+
+  return unwind_reservation;
+}
+
+bool Win32X64CodeCache::OnSegmentOpened(size_t segment_index) {
+  auto& unwind_table = unwind_tables_[segment_index];
+  unwind_table.entries.resize(kSegmentFunctionCount);
+  unwind_table.count = 0;
 
-#ifdef USE_GROWABLE_FUNCTION_TABLE
   // Create table and register with the system. It's empty now, but we'll grow
   // it as functions are added.
+  auto& segment = segments_[segment_index];
+  auto segment_base = generated_code_base_ + segment.base_offset;
   if (RtlAddGrowableFunctionTable(
-          &unwind_table_handle_, unwind_table_.data(), unwind_table_count_,
-          DWORD(unwind_table_.size()),
-          reinterpret_cast<ULONG_PTR>(generated_code_base_),
-          reinterpret_cast<ULONG_PTR>(generated_code_base_ +
-                                      kGeneratedCodeSize))) {
+          &unwind_table.handle, unwind_table.entries.data(), 0,
+          DWORD(unwind_table.entries.size()),
+          reinterpret_cast<ULONG_PTR>(segment_base),
+          reinterpret_cast<ULONG_PTR>(segment_base + segment.size))) {
     XELOGE("Unable to create unwind function table");
     return false;
   }
-#else
-  // Install a callback that the debugger will use to lookup unwind info on
-  // demand.
-  if (!RtlInstallFunctionTableCallback(
-          reinterpret_cast<DWORD64>(generated_code_base_) | 0x3,
-          reinterpret_cast<DWORD64>(generated_code_base_), kGeneratedCodeSize,
-          [](uintptr_t control_pc, void* context) {
-            auto code_cache = reinterpret_cast<X64CodeCache*>(context);
-            return reinterpret_cast<PRUNTIME_FUNCTION>(
-                code_cache->LookupUnwindEntry(control_pc));
-          },
-          this, nullptr)) {
-    XELOGE("Unable to install function table callback");
-    return false;
-  }
-#endif  // USE_GROWABLE_FUNCTION_TABLE
 
   return true;
 }
 
-Win32X64CodeCache::UnwindReservation
-Win32X64CodeCache::RequestUnwindReservation(uint8_t* entry_address) {
-  UnwindReservation unwind_reservation;
-  unwind_reservation.data_size = xe::round_up(kUnwindInfoSize, 16);
-  unwind_reservation.table_slot = ++unwind_table_count_;
-  unwind_reservation.entry_address = entry_address;
-  assert_false(unwind_table_count_ >= kMaximumFunctionCount);
-
-  return unwind_reservation;
+void Win32X64CodeCache::OnSegmentReclaimed(size_t segment_index) {
+  auto& unwind_table = unwind_tables_[segment_index];
+  if (unwind_table.handle) {
+    RtlDeleteGrowableFunctionTable(unwind_table.handle);
+    unwind_table.handle = nullptr;
+  }
+  unwind_table.count = 0;
 }
 
 void Win32X64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
                                   size_t code_size, size_t stack_size,
                                   void* code_address,
-                                  UnwindReservation unwind_reservation) {
+                                  UnwindReservation unwind_reservation,
+                                  GuestFunction* function_info) {
   // Add unwind info.
   InitializeUnwindEntry(unwind_reservation.entry_address,
+                        unwind_reservation.segment_index,
                         unwind_reservation.table_slot, code_address, code_size,
                         stack_size);
 
-#ifdef USE_GROWABLE_FUNCTION_TABLE
   // Notify that the unwind table has grown.
   // We do this outside of the lock, but with the latest total count.
-  RtlGrowFunctionTable(unwind_table_handle_, unwind_table_count_);
-#endif  // USE_GROWABLE_FUNCTION_TABLE
+  auto& unwind_table = unwind_tables_[unwind_reservation.segment_index];
+  RtlGrowFunctionTable(unwind_table.handle, unwind_table.count);
 
   // This isn't needed on x64 (probably), but is convention.
   FlushInstructionCache(GetCurrentProcess(), code_address, code_size);
@@ -210,6 +212,7 @@ typedef struct _UNWIND_INFO {
 } UNWIND_INFO, *PUNWIND_INFO;
 
 void Win32X64CodeCache::InitializeUnwindEntry(uint8_t* unwind_entry_address,
+                                              size_t segment_index,
                                               size_t unwind_table_slot,
                                               void* code_address,
                                               size_t code_size,
@@ -267,21 +270,24 @@ void Win32X64CodeCache::InitializeUnwindEntry(uint8_t* unwind_entry_address,
     unwind_code.FrameOffset = (USHORT)(stack_size) / 8;
   }
 
-  // Add entry.
-  auto& fn_entry = unwind_table_[unwind_table_slot];
+  // Add entry. Addresses are relative to the segment the table covers.
+  auto segment_base =
+      generated_code_base_ + segments_[segment_index].base_offset;
+  auto& fn_entry = unwind_tables_[segment_index].entries[unwind_table_slot];
   fn_entry.BeginAddress =
-      (DWORD)(reinterpret_cast<uint8_t*>(code_address) - generated_code_base_);
+      (DWORD)(reinterpret_cast<uint8_t*>(code_address) - segment_base);
   fn_entry.EndAddress = (DWORD)(fn_entry.BeginAddress + code_size);
-  fn_entry.UnwindData = (DWORD)(unwind_entry_address - generated_code_base_);
+  fn_entry.UnwindData = (DWORD)(unwind_entry_address - segment_base);
 }
 
-void* Win32X64CodeCache::LookupUnwindInfo(uint64_t host_pc) {
+void* Win32X64CodeCache::LookupSegmentUnwindInfo(size_t segment_index,
+                                                 uint32_t segment_offset) {
+  auto& unwind_table = unwind_tables_[segment_index];
   return std::bsearch(
-      &host_pc, unwind_table_.data(), unwind_table_count_ + 1,
+      &segment_offset, unwind_table.entries.data(), unwind_table.count,
       sizeof(RUNTIME_FUNCTION),
       [](const void* key_ptr, const void* element_ptr) {
-        auto key =
-            *reinterpret_cast<const uintptr_t*>(key_ptr) - kGeneratedCodeBase;
+        auto key = *reinterpret_cast<const uint32_t*>(key_ptr);
         auto element = reinterpret_cast<const RUNTIME_FUNCTION*>(element_ptr);
         if (key < element->BeginAddress) {
           return -1;
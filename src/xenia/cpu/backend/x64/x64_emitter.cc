@@ -20,6 +20,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/mutex.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/vec128.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
@@ -30,6 +31,7 @@
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_debug_info.h"
+#include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/symbol.h"
 #include "xenia/cpu/thread_state.h"
@@ -76,7 +78,16 @@ X64Emitter::X64Emitter(X64Backend* backend, XbyakAllocator* allocator)
     feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tBMI2) ? kX64EmitBMI2 : 0;
     feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tF16C) ? kX64EmitF16C : 0;
     feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tMOVBE) ? kX64EmitMovbe : 0;
+    if (cpu_.has(Xbyak::util::Cpu::tAVX512F) &&
+        cpu_.has(Xbyak::util::Cpu::tAVX512BW) &&
+        cpu_.has(Xbyak::util::Cpu::tAVX512VL)) {
+      feature_flags_ |= kX64EmitAVX512BW;
+      feature_flags_ |= cpu_.has(Xbyak::util::Cpu::tAVX512_VBMI)
+                            ? kX64EmitAVX512VBMI
+                            : 0;
+    }
   }
+  feature_flags_ &= backend->emitter_feature_mask();
 
   if (!cpu_.has(Xbyak::util::Cpu::tAVX)) {
     xe::FatalError(
@@ -99,6 +110,25 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   debug_info_flags_ = debug_info_flags;
   trace_data_ = &function->trace_data();
   source_map_arena_.Reset();
+  relocations_.clear();
+  flags_compare_ = nullptr;
+
+  // Baseline code counts its calls so that it can be recompiled once hot.
+  baseline_function_ =
+      function->tier() == CompilationTier::kBaseline && trace_data_->is_valid()
+          ? function
+          : nullptr;
+
+  // Only plain optimized functions can be persisted - debug info, tracing, and
+  // call counters embed pointers to per-process data we can't relocate.
+  // Nor are functions involved in host replacement, so that changes to the
+  // known signatures take effect on the next run, or interpreter thunks, which
+  // embed their program.
+  persistable_ = !debug_info_flags && !baseline_function_ &&
+                 function->tier() != CompilationTier::kInterpreted &&
+                 !function->host_replacement() &&
+                 !function->is_private_copy() &&
+                 backend_->LookupPersistentCache(function->module()) != nullptr;
 
   // Fill the generator with code.
   size_t stack_size = 0;
@@ -109,6 +139,9 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   // Copy the final code to the cache and relocate it.
   *out_code_size = getSize();
   *out_code_address = Emplace(stack_size, function);
+  if (!*out_code_address) {
+    return false;
+  }
 
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
@@ -124,11 +157,20 @@ void* X64Emitter::Emplace(size_t stack_size, GuestFunction* function) {
   uint8_t* old_address = top_;
   void* new_address;
   if (function) {
-    new_address = code_cache_->PlaceGuestCode(function->address(), top_, size_,
+    // Copies running the guest code of replaced functions must not take over
+    // calls to the address.
+    uint32_t guest_address =
+        function->is_private_copy() ? 0 : function->address();
+    new_address = code_cache_->PlaceGuestCode(guest_address, top_, size_,
                                               stack_size, function);
   } else {
     new_address = code_cache_->PlaceHostCode(0, top_, size_, stack_size);
   }
+  if (!new_address) {
+    // The code cache is full; drop the code.
+    reset();
+    return nullptr;
+  }
   top_ = reinterpret_cast<uint8_t*>(new_address);
   ready();
   top_ = old_address;
@@ -136,6 +178,14 @@ void* X64Emitter::Emplace(size_t stack_size, GuestFunction* function) {
   return new_address;
 }
 
+// Called by baseline code once it has become hot.
+uint64_t TierUpFunction(void* raw_context, void* function_ptr) {
+  auto thread_state = *reinterpret_cast<ThreadState**>(raw_context);
+  auto function = reinterpret_cast<GuestFunction*>(function_ptr);
+  thread_state->processor()->TierUpFunction(function);
+  return 0;
+}
+
 bool X64Emitter::Emit(HIRBuilder* builder, size_t* out_stack_size) {
   Xbyak::Label epilog_label;
   epilog_label_ = &epilog_label;
@@ -202,6 +252,21 @@ bool X64Emitter::Emit(HIRBuilder* builder, size_t* out_stack_size) {
     EmitGetCurrentThreadId();
     lock();
     bts(qword[low_address(&trace_header->function_thread_use)], rax);
+  } else if (baseline_function_) {
+    // Count the call and hand the function off to be optimized when it crosses
+    // the threshold. xadd ensures exactly one caller sees the crossing.
+    auto trace_header = trace_data_->header();
+    Xbyak::Label skip_tier_up;
+    mov(rax, reinterpret_cast<uint64_t>(trace_header));
+    mov(edx, 1);
+    lock();
+    xadd(qword[rax + offsetof(FunctionTraceData::Header, function_call_count)],
+         rdx);
+    cmp(rdx, uint32_t(FLAGS_tiered_compilation_threshold - 1));
+    jne(skip_tier_up, T_NEAR);
+    mov(r8, reinterpret_cast<uint64_t>(baseline_function_));
+    CallNativeSafe(reinterpret_cast<void*>(TierUpFunction));
+    L(skip_tier_up);
   }
 
   // Load membase.
@@ -358,24 +423,34 @@ extern "C" uint64_t ResolveFunction(void* raw_context,
 
 void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   assert_not_null(function);
-  auto fn = static_cast<X64Function*>(function);
-  // Resolve address to the function to call and store in rax.
-  if (fn->machine_code()) {
-    // TODO(benvanik): is it worth it to do this? It removes the need for
-    // a ResolveFunction call, but makes the table less useful.
-    assert_zero(uint64_t(fn->machine_code()) & 0xFFFFFFFF00000000);
-    mov(eax, uint32_t(uint64_t(fn->machine_code())));
-  } else if (code_cache_->has_indirection_table()) {
-    // Load the pointer to the indirection table maintained in X64CodeCache.
-    // The target dword will either contain the address of the generated code
-    // or a thunk to ResolveAddress.
+  if (code_cache_->has_indirection_table()) {
+    // Call through the indirection table maintained in X64CodeCache. The
+    // target dword will either contain the address of the generated code or a
+    // thunk to ResolveAddress (which takes the guest address in ebx).
+    // The code cache rewrites the site into a direct call once the target is
+    // compiled, and back again if the target code is replaced.
     mov(ebx, function->address());
-    mov(eax, dword[ebx]);
+    if (instr->flags & hir::CALL_TAIL) {
+      // Since we skip the prolog we need to mark the return here.
+      EmitTraceUserCallReturn();
+
+      // Pass the callers return address over.
+      mov(rdx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+
+      add(rsp, static_cast<uint32_t>(stack_size()));
+      EmitCallSite(function->address(), true);
+    } else {
+      // Return address is from the previous SET_RETURN_ADDRESS.
+      mov(rdx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+
+      EmitCallSite(function->address(), false);
+    }
+    return;
   } else {
     // Old-style resolve.
     // Not too important because indirection table is almost always available.
     // TODO: Overwrite the call-site with a straight call.
-    mov(rax, reinterpret_cast<uint64_t>(ResolveFunction));
+    MovHostPointer(rax, reinterpret_cast<void*>(ResolveFunction));
     mov(rdx, function->address());
     call(rax);
     ReloadECX();
@@ -420,7 +495,7 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
     // Old-style resolve.
     // Not too important because indirection table is almost always available.
     mov(edx, reg.cvt32());
-    mov(rax, reinterpret_cast<uint64_t>(ResolveFunction));
+    MovHostPointer(rax, reinterpret_cast<void*>(ResolveFunction));
     call(rax);
     ReloadECX();
     ReloadEDX();
@@ -455,25 +530,116 @@ uint64_t UndefinedCallExtern(void* raw_context, uint64_t function_ptr) {
   }
   return 0;
 }
+void WakeGlobalLockWaiter(void* raw_context, uint64_t mutex_ptr) {
+  reinterpret_cast<xe::global_mutex*>(mutex_ptr)->WakeWaiter();
+}
+bool X64Emitter::EmitGlobalLockFastPath(const BuiltinFunction* function,
+                                        Xbyak::Label& done) {
+  auto builtins = processor_->frontend()->builtins();
+  if (function != builtins->check_global_lock &&
+      function != builtins->enter_global_lock &&
+      function != builtins->leave_global_lock) {
+    return false;
+  }
+  auto mutex_owner = qword[r8 + offsetof(xe::global_mutex, owner)];
+  auto mutex_recursion_count =
+      dword[r8 + offsetof(xe::global_mutex, recursion_count)];
+  auto mutex_state = dword[r8 + offsetof(xe::global_mutex, state)];
+  auto global_lock_count = dword[r9];
+
+  // r8 = mutex, r9 = guest lock count, as the builtin gets them.
+  MovRelocated(r8, reinterpret_cast<uint64_t>(function->arg0()),
+               X64RelocationType::kBuiltinArg0, function->address());
+  MovRelocated(r9, reinterpret_cast<uint64_t>(function->arg1()),
+               X64RelocationType::kBuiltinArg1, function->address());
+  mov(rax, qword[rcx + offsetof(ppc::PPCContext, host_thread_token)]);
+
+  if (function == builtins->check_global_lock) {
+    // Whether this thread holds the guest lock is known without taking it.
+    // Otherwise only an unheld lock is answered inline; the builtin waits for
+    // a held one as before.
+    Xbyak::Label not_owner;
+    cmp(mutex_owner, rax);
+    jne(not_owner);
+    xor_(eax, eax);
+    mov(r10d, 0x8000);
+    cmp(global_lock_count, 0);
+    cmove(eax, r10d);
+    mov(qword[rcx + offsetof(ppc::PPCContext, scratch)], rax);
+    jmp(done, T_NEAR);
+    L(not_owner);
+    Xbyak::Label slow_path;
+    cmp(mutex_state, xe::global_mutex::kUnlocked);
+    jne(slow_path);
+    mov(qword[rcx + offsetof(ppc::PPCContext, scratch)], 0x8000);
+    jmp(done, T_NEAR);
+    L(slow_path);
+    return false;
+  } else if (function == builtins->enter_global_lock) {
+    // Recurse if we own it, otherwise take it if nobody does. Waiting is left
+    // to the builtin.
+    Xbyak::Label not_owner;
+    Xbyak::Label locked;
+    Xbyak::Label slow_path;
+    cmp(mutex_owner, rax);
+    jne(not_owner);
+    inc(mutex_recursion_count);
+    jmp(locked);
+    L(not_owner);
+    mov(r10, rax);
+    xor_(eax, eax);
+    mov(r11d, xe::global_mutex::kLocked);
+    lock();
+    cmpxchg(mutex_state, r11d);
+    jne(slow_path);
+    mov(mutex_owner, r10);
+    mov(mutex_recursion_count, 1);
+    L(locked);
+    inc(global_lock_count);
+    jmp(done, T_NEAR);
+    L(slow_path);
+    return false;
+  } else {
+    // Releasing never waits, so only waking a waiter needs a call.
+    dec(global_lock_count);
+    dec(mutex_recursion_count);
+    jnz(done, T_NEAR);
+    mov(mutex_owner, 0);
+    mov(eax, xe::global_mutex::kUnlocked);
+    xchg(mutex_state, eax);
+    cmp(eax, xe::global_mutex::kLockedContended);
+    jne(done, T_NEAR);
+    CallNativeSafe(reinterpret_cast<void*>(WakeGlobalLockWaiter));
+    return true;
+  }
+}
+
 void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
   bool undefined = true;
   if (function->behavior() == Function::Behavior::kBuiltin) {
     auto builtin_function = static_cast<const BuiltinFunction*>(function);
     if (builtin_function->handler()) {
       undefined = false;
-      // rcx = context
-      // rdx = target host function
-      // r8  = arg0
-      // r9  = arg1
-      mov(rdx, reinterpret_cast<uint64_t>(builtin_function->handler()));
-      mov(r8, reinterpret_cast<uint64_t>(builtin_function->arg0()));
-      mov(r9, reinterpret_cast<uint64_t>(builtin_function->arg1()));
-      auto thunk = backend()->guest_to_host_thunk();
-      mov(rax, reinterpret_cast<uint64_t>(thunk));
-      call(rax);
-      ReloadECX();
-      ReloadEDX();
-      // rax = host return
+      Xbyak::Label done;
+      if (!EmitGlobalLockFastPath(builtin_function, done)) {
+        // rcx = context
+        // rdx = target host function
+        // r8  = arg0
+        // r9  = arg1
+        MovHostPointer(rdx,
+                       reinterpret_cast<void*>(builtin_function->handler()));
+        MovRelocated(r8, reinterpret_cast<uint64_t>(builtin_function->arg0()),
+                     X64RelocationType::kBuiltinArg0, function->address());
+        MovRelocated(r9, reinterpret_cast<uint64_t>(builtin_function->arg1()),
+                     X64RelocationType::kBuiltinArg1, function->address());
+        auto thunk = backend()->guest_to_host_thunk();
+        mov(rax, reinterpret_cast<uint64_t>(thunk));
+        call(rax);
+        ReloadECX();
+        ReloadEDX();
+        // rax = host return
+      }
+      L(done);
     }
   } else if (function->behavior() == Function::Behavior::kExtern) {
     auto extern_function = static_cast<const GuestFunction*>(function);
@@ -481,7 +647,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       undefined = false;
       // rcx = context
       // rdx = target host function
-      mov(rdx, reinterpret_cast<uint64_t>(extern_function->extern_handler()));
+      MovHostPointer(
+          rdx, reinterpret_cast<void*>(extern_function->extern_handler()));
       mov(r8, qword[rcx + offsetof(ppc::PPCContext, kernel_state)]);
       auto thunk = backend()->guest_to_host_thunk();
       mov(rax, reinterpret_cast<uint64_t>(thunk));
@@ -492,26 +659,28 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
     }
   }
   if (undefined) {
-    CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(function));
+    MovRelocated(rdx, reinterpret_cast<uint64_t>(function),
+                 X64RelocationType::kFunction, function->address());
+    CallNative(UndefinedCallExtern);
   }
 }
 
 void X64Emitter::CallNative(void* fn) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rax, fn);
   call(rax);
   ReloadECX();
   ReloadEDX();
 }
 
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context)) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rax, reinterpret_cast<void*>(fn));
   call(rax);
   ReloadECX();
   ReloadEDX();
 }
 
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0)) {
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rax, reinterpret_cast<void*>(fn));
   call(rax);
   ReloadECX();
   ReloadEDX();
@@ -520,7 +689,7 @@ void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0)) {
 void X64Emitter::CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0),
                             uint64_t arg0) {
   mov(rdx, arg0);
-  mov(rax, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rax, reinterpret_cast<void*>(fn));
   call(rax);
   ReloadECX();
   ReloadEDX();
@@ -532,7 +701,7 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // r8  = arg0
   // r9  = arg1
   // r10 = arg2
-  mov(rdx, reinterpret_cast<uint64_t>(fn));
+  MovHostPointer(rdx, fn);
   auto thunk = backend()->guest_to_host_thunk();
   mov(rax, reinterpret_cast<uint64_t>(thunk));
   call(rax);
@@ -541,6 +710,52 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // rax = host return
 }
 
+void X64Emitter::EmitCallSite(uint32_t guest_address, bool is_tail) {
+  // Sites are patched with a single 8b store, so they must not straddle an 8b
+  // boundary. Code is always placed 16b aligned.
+  while (getSize() % 8) {
+    nop();
+  }
+
+  X64Relocation relocation;
+  relocation.code_offset = static_cast<uint32_t>(getSize());
+  relocation.type =
+      is_tail ? X64RelocationType::kTailCallSite : X64RelocationType::kCallSite;
+  relocation.target = guest_address;
+  relocations_.push_back(relocation);
+
+  // Filled in by X64CodeCache::AddCallSite once placed, as the site is
+  // relative to where it ends up.
+  db(0x0F);  // ud2
+  db(0x0B);
+  db(0x66);  // 6b nop
+  db(0x0F);
+  db(0x1F);
+  db(0x44);
+  db(0x00);
+  db(0x00);
+}
+
+void X64Emitter::MovRelocated(const Xbyak::Reg64& dest, uint64_t value,
+                              X64RelocationType type, uint32_t target) {
+  // Always use the full mov r64, imm64 encoding so the immediate sits at a
+  // known location and has room for any value it may be relocated to.
+  db(0x48 | (dest.getIdx() >= 8 ? 0x01 : 0x00));
+  db(0xB8 | (dest.getIdx() & 0x7));
+  dq(value);
+
+  X64Relocation relocation;
+  relocation.code_offset = static_cast<uint32_t>(getSize() - 8);
+  relocation.type = type;
+  relocation.target = target;
+  relocations_.push_back(relocation);
+}
+
+void X64Emitter::MovHostPointer(const Xbyak::Reg64& dest, const void* ptr) {
+  MovRelocated(dest, reinterpret_cast<uint64_t>(ptr),
+               X64RelocationType::kHostImage);
+}
+
 void X64Emitter::SetReturnAddress(uint64_t value) {
   mov(rax, value);
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], rax);
@@ -677,6 +892,21 @@ uint32_t X64Emitter::PlaceData(Memory* memory) {
                                            0x80000000u, 0x80000000u),
       /* XMMShortMinPS          */ vec128f(SHRT_MIN),
       /* XMMShortMaxPS          */ vec128f(SHRT_MAX),
+      /* XMMShiftMaskPI8        */ vec128b(0x07),
+      /* XMMShiftMaskPI16       */ vec128s(0x000F),
+      /* XMMMaskEvenPI8         */ vec128s(0x00FF),
+      /* XMMPackUINT_2101010_MinUnpacked */
+      vec128i(0x403FFE01u, 0x403FFE01u, 0x403FFE01u, 0x40400000u),
+      /* XMMPackUINT_2101010_MaxUnpacked */
+      vec128i(0x404001FFu, 0x404001FFu, 0x404001FFu, 0x40400003u),
+      /* XMMPackUINT_2101010_MaskUnpacked */
+      vec128i(0x3FFu, 0x3FFu, 0x3FFu, 0x3u),
+      /* XMMPackUINT_2101010_Shift */ vec128i(0, 10, 20, 30),
+      /* XMMPackUINT_2101010_Multiplier */
+      vec128i(1u, 1u << 10, 1u << 20, 1u << 30),
+      /* XMMPackUINT_2101010_NaN */ vec128i(0x200u, 0x200u, 0x200u, 0u),
+      /* XMMUnpackFLOAT16_3     */ vec128i(0x0F0E0908u, 0xFFFF0D0Cu,
+                                           0xFFFFFFFFu, 0xFFFFFFFFu),
   };
   uint32_t ptr = memory->SystemHeapAlloc(sizeof(xmm_consts));
   std::memcpy(memory->TranslateVirtual(ptr), xmm_consts, sizeof(xmm_consts));
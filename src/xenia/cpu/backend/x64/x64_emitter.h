@@ -89,6 +89,16 @@ enum XmmConst {
   XMMSignMaskF32,
   XMMShortMinPS,
   XMMShortMaxPS,
+  XMMShiftMaskPI8,
+  XMMShiftMaskPI16,
+  XMMMaskEvenPI8,
+  XMMPackUINT_2101010_MinUnpacked,
+  XMMPackUINT_2101010_MaxUnpacked,
+  XMMPackUINT_2101010_MaskUnpacked,
+  XMMPackUINT_2101010_Shift,
+  XMMPackUINT_2101010_Multiplier,
+  XMMPackUINT_2101010_NaN,
+  XMMUnpackFLOAT16_3,
 };
 
 // Unfortunately due to the design of xbyak we have to pass this to the ctor.
@@ -104,6 +114,38 @@ enum X64EmitterFeatureFlags {
   kX64EmitBMI2 = 1 << 4,
   kX64EmitF16C = 1 << 5,
   kX64EmitMovbe = 1 << 6,
+  // AVX-512 F/BW/VL: EVEX word shifts and truncations on xmm/ymm registers.
+  kX64EmitAVX512BW = 1 << 7,
+  // AVX-512 VBMI/VL: byte permutes (vpermb, vpermi2b).
+  kX64EmitAVX512VBMI = 1 << 8,
+};
+
+// Describes how an absolute 64-bit immediate embedded in generated code must be
+// fixed up when the code is restored from the persistent cache in a later
+// process.
+enum class X64RelocationType : uint32_t {
+  // Pointer into the host executable image (functions, static tables).
+  kHostImage = 0,
+  // Pointer to the Function declared at the target guest address.
+  kFunction,
+  // arg0/arg1 of the BuiltinFunction at the target guest address.
+  kBuiltinArg0,
+  kBuiltinArg1,
+  // Callback context of the MMIO range containing the target guest address.
+  kMmioContext,
+  // Patchable call/tail call site to the function at the target guest
+  // address. The code is left untouched; the site is registered with the code
+  // cache once placed so it can be linked.
+  kCallSite,
+  kTailCallSite,
+};
+
+struct X64Relocation {
+  // Offset of the 8b immediate from the start of the function code.
+  uint32_t code_offset;
+  X64RelocationType type;
+  // Guest address used to resolve non-host image relocations.
+  uint32_t target;
 };
 
 class X64Emitter : public Xbyak::CodeGenerator {
@@ -168,6 +210,14 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void CallNative(uint64_t (*fn)(void* raw_context, uint64_t arg0),
                   uint64_t arg0);
   void CallNativeSafe(void* fn);
+  // Emits a call (or jump, for tail calls) through the indirection table entry
+  // in ebx that X64CodeCache can later patch into a direct call.
+  void EmitCallSite(uint32_t guest_address, bool is_tail);
+  // Moves a host pointer into the register using a fixed-size encoding and
+  // records a relocation for it so the code can be persisted.
+  void MovRelocated(const Xbyak::Reg64& dest, uint64_t value,
+                    X64RelocationType type, uint32_t target = 0);
+  void MovHostPointer(const Xbyak::Reg64& dest, const void* ptr);
   void SetReturnAddress(uint64_t value);
   void ReloadECX();
   void ReloadEDX();
@@ -186,19 +236,42 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void LoadConstantXmm(Xbyak::Xmm dest, const vec128_t& v);
   Xbyak::Address StashXmm(int index, const Xbyak::Xmm& r);
 
+  uint32_t feature_flags() const { return feature_flags_; }
   bool IsFeatureEnabled(uint32_t feature_flag) const {
     return (feature_flags_ & feature_flag) != 0;
   }
 
   FunctionDebugInfo* debug_info() const { return debug_info_; }
+  uint32_t debug_info_flags() const { return debug_info_flags_; }
+
+  // The last compare emitted, if the host flags still hold its result. Later
+  // branches on compares of the same operands jump on the flags directly.
+  const hir::Instr* flags_compare() const { return flags_compare_; }
+  void set_flags_compare(const hir::Instr* compare) {
+    flags_compare_ = compare;
+  }
 
   size_t stack_size() const { return stack_size_; }
 
+  // True if the last emitted function only references host memory through
+  // recorded relocations and may be written to the persistent cache.
+  bool is_persistable() const { return persistable_; }
+  // Called by sequences that embed pointers no relocation can fix up.
+  void MarkUnpersistable() { persistable_ = false; }
+  const std::vector<X64Relocation>& relocations() const {
+    return relocations_;
+  }
+
  protected:
   void* Emplace(size_t stack_size, GuestFunction* function = nullptr);
   bool Emit(hir::HIRBuilder* builder, size_t* out_stack_size);
   void EmitGetCurrentThreadId();
   void EmitTraceUserCallReturn();
+  // Emits the uncontended paths of the guest global lock builtins inline,
+  // jumping to done when they are taken. Returns false if the builtin call
+  // must follow for when they are not.
+  bool EmitGlobalLockFastPath(const BuiltinFunction* function,
+                              Xbyak::Label& done);
 
  protected:
   Processor* processor_ = nullptr;
@@ -211,14 +284,20 @@ class X64Emitter : public Xbyak::CodeGenerator {
   Xbyak::Label* epilog_label_ = nullptr;
 
   hir::Instr* current_instr_ = nullptr;
+  const hir::Instr* flags_compare_ = nullptr;
 
   FunctionDebugInfo* debug_info_ = nullptr;
   uint32_t debug_info_flags_ = 0;
   FunctionTraceData* trace_data_ = nullptr;
+  // Set when emitting a baseline function that counts its calls.
+  GuestFunction* baseline_function_ = nullptr;
   Arena source_map_arena_;
 
   size_t stack_size_ = 0;
 
+  bool persistable_ = false;
+  std::vector<X64Relocation> relocations_;
+
   static const uint32_t gpr_reg_map_[GPR_COUNT];
   static const uint32_t xmm_reg_map_[XMM_COUNT];
 };
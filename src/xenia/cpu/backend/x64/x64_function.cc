@@ -10,6 +10,7 @@
 #include "xenia/cpu/backend/x64/x64_function.h"
 
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/thread_state.h"
 
@@ -33,9 +34,25 @@ void X64Function::Setup(uint8_t* machine_code, size_t machine_code_length) {
 bool X64Function::CallImpl(ThreadState* thread_state, uint32_t return_address) {
   auto backend =
       reinterpret_cast<X64Backend*>(thread_state->processor()->backend());
+  auto code_cache = backend->code_cache();
+  auto thread = reinterpret_cast<X64CodeCache::GuestThread*>(
+      thread_state->backend_data());
+  bool entered = X64CodeCache::EnterGuestCode(thread);
+  if (!code_cache->IsCurrentCode(this, machine_code_)) {
+    // The function was replaced, and its code may have been reclaimed since.
+    if (entered) {
+      X64CodeCache::LeaveGuestCode(thread);
+    }
+    auto function = thread_state->processor()->ResolveFunction(address());
+    return function && function != this &&
+           function->Call(thread_state, return_address);
+  }
   auto thunk = backend->host_to_guest_thunk();
   thunk(machine_code_, thread_state->context(),
         reinterpret_cast<void*>(uintptr_t(return_address)));
+  if (entered) {
+    X64CodeCache::LeaveGuestCode(thread);
+  }
   return true;
 }
 
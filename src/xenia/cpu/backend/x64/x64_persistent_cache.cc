@@ -0,0 +1,374 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_persistent_cache.h"
+
+#include <cinttypes>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/processor.h"
+
+#include "third_party/xxhash/xxhash.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// Defined in x64_emitter.cc. Used as an anchor into the host image.
+extern "C" uint64_t ResolveFunction(void* raw_context, uint32_t target_address);
+
+X64PersistentCache::X64PersistentCache(
+    X64Backend* backend, uint64_t module_hash,
+    FloatPrecisionMode float_precision_mode)
+    : backend_(backend),
+      module_hash_(module_hash),
+      float_precision_mode_(float_precision_mode) {}
+
+X64PersistentCache::~X64PersistentCache() {
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+X64PersistentCache::FileHeader X64PersistentCache::BuildHeader() const {
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = xe::byte_swap('XJIT');
+  header.version = kVersion;
+  header.module_hash = module_hash_;
+  header.emitter_feature_flags = backend_->emitter_feature_flags();
+  header.emitter_data = backend_->emitter_data();
+  header.float_precision_mode = static_cast<uint32_t>(float_precision_mode_);
+  header.guest_to_host_thunk =
+      reinterpret_cast<uint64_t>(backend_->guest_to_host_thunk());
+  header.resolve_function_thunk =
+      reinterpret_cast<uint64_t>(backend_->resolve_function_thunk());
+  header.host_image_anchor = reinterpret_cast<uint64_t>(ResolveFunction);
+  // Debug info and tracing keep functions from being persisted or restored
+  // at all, but are kept apart anyway so that a traced run starts clean.
+  if (FLAGS_inline_calls) {
+    header.codegen_flags |= kCodegenInlineCalls;
+  }
+  if (FLAGS_learn_mmio_sites) {
+    header.codegen_flags |= kCodegenLearnMmioSites;
+  }
+  if (FLAGS_mmio_access_stats) {
+    header.codegen_flags |= kCodegenMmioAccessStats;
+  }
+  if (FLAGS_trace_functions) {
+    header.codegen_flags |= kCodegenTraceFunctions;
+  }
+  if (FLAGS_trace_function_coverage) {
+    header.codegen_flags |= kCodegenTraceFunctionCoverage;
+  }
+  if (FLAGS_trace_function_references) {
+    header.codegen_flags |= kCodegenTraceFunctionReferences;
+  }
+  if (FLAGS_trace_function_data) {
+    header.codegen_flags |= kCodegenTraceFunctionData;
+  }
+  header.break_on_instruction = FLAGS_break_on_instruction;
+  header.inline_max_instructions = uint32_t(FLAGS_inline_max_instructions);
+  return header;
+}
+
+bool X64PersistentCache::Initialize(const std::wstring& path) {
+  auto header = BuildHeader();
+
+  // Read any existing file and validate it against our environment.
+  bool is_valid = false;
+  auto file = xe::filesystem::OpenFile(path, "rb");
+  if (file) {
+    fseek(file, 0, SEEK_END);
+    file_data_.resize(static_cast<size_t>(ftell(file)));
+    fseek(file, 0, SEEK_SET);
+    if (file_data_.size() >= sizeof(FileHeader) &&
+        fread(file_data_.data(), file_data_.size(), 1, file) == 1) {
+      auto file_header = reinterpret_cast<FileHeader*>(file_data_.data());
+      // The host image may have been relocated, which we can fix up. Anything
+      // else changing invalidates the whole file.
+      FileHeader compare_header = *file_header;
+      compare_header.host_image_anchor = header.host_image_anchor;
+      is_valid = std::memcmp(&compare_header, &header, sizeof(header)) == 0;
+      host_image_delta_ =
+          header.host_image_anchor - file_header->host_image_anchor;
+    }
+    fclose(file);
+  }
+
+  if (is_valid) {
+    // Index all records. Later records replace earlier ones for the same
+    // address (the guest code may have changed between runs).
+    size_t offset = sizeof(FileHeader);
+    while (offset + sizeof(FunctionRecord) <= file_data_.size()) {
+      auto record =
+          reinterpret_cast<const FunctionRecord*>(file_data_.data() + offset);
+      if (record->record_size < sizeof(FunctionRecord) ||
+          offset + record->record_size > file_data_.size()) {
+        // Truncated write from a previous run; ignore the tail.
+        break;
+      }
+      if (IsRecordValid(record)) {
+        records_[record->address] = record;
+      }
+      offset += record->record_size;
+    }
+    XELOGI("Persistent code cache %.16" PRIX64 ": %d functions available",
+           module_hash_, int(records_.size()));
+    file_ = xe::filesystem::OpenFile(path, "ab");
+  } else {
+    // Missing or stale - start a new file.
+    file_data_.clear();
+    xe::filesystem::CreateParentFolder(path);
+    file_ = xe::filesystem::OpenFile(path, "wb");
+    if (file_) {
+      fwrite(&header, sizeof(header), 1, file_);
+      fflush(file_);
+    }
+  }
+
+  if (!file_) {
+    XELOGE("Unable to open persistent code cache file");
+    return false;
+  }
+  return true;
+}
+
+bool X64PersistentCache::IsRecordValid(const FunctionRecord* record) const {
+  if (record->end_address < record->address) {
+    return false;
+  }
+  // Counts come from the file, so they are summed in 64 bits to keep a
+  // corrupt record from wrapping around into a small size.
+  uint64_t contents_size =
+      sizeof(FunctionRecord) +
+      uint64_t(sizeof(GuestCodeRange)) * record->inlined_range_count +
+      uint64_t(sizeof(SourceMapEntry)) * record->source_map_count +
+      uint64_t(sizeof(X64Relocation)) * record->relocation_count +
+      record->code_size;
+  if (contents_size > record->record_size) {
+    return false;
+  }
+  auto inlined_ranges = reinterpret_cast<const GuestCodeRange*>(record + 1);
+  for (uint32_t i = 0; i < record->inlined_range_count; ++i) {
+    if (inlined_ranges[i].end_address < inlined_ranges[i].address) {
+      return false;
+    }
+  }
+  auto relocations = reinterpret_cast<const X64Relocation*>(
+      reinterpret_cast<const uint8_t*>(inlined_ranges +
+                                       record->inlined_range_count) +
+      sizeof(SourceMapEntry) * record->source_map_count);
+  for (uint32_t i = 0; i < record->relocation_count; ++i) {
+    if (uint64_t(relocations[i].code_offset) + sizeof(uint64_t) >
+        record->code_size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t X64PersistentCache::HashGuestCode(
+    uint32_t address, uint32_t end_address,
+    const GuestCodeRange* inlined_ranges, size_t inlined_range_count) const {
+  auto memory = backend_->processor()->memory();
+  uint64_t hash = XXH64(memory->TranslateVirtual(address),
+                        end_address - address + 4, 0);
+  // Code copied from callees changes with them.
+  for (size_t i = 0; i < inlined_range_count; ++i) {
+    auto& range = inlined_ranges[i];
+    hash = XXH64(memory->TranslateVirtual(range.address),
+                 range.end_address - range.address + 4, hash);
+  }
+  return hash;
+}
+
+bool X64PersistentCache::ApplyRelocation(const X64Relocation& relocation,
+                                         uint8_t* code) const {
+  auto processor = backend_->processor();
+  uint8_t* immediate = code + relocation.code_offset;
+  uint64_t value = xe::load<uint64_t>(immediate);
+  switch (relocation.type) {
+    case X64RelocationType::kHostImage: {
+      value += host_image_delta_;
+    } break;
+    case X64RelocationType::kFunction: {
+      auto function = processor->LookupFunction(relocation.target);
+      if (!function) {
+        return false;
+      }
+      value = reinterpret_cast<uint64_t>(function);
+    } break;
+    case X64RelocationType::kBuiltinArg0:
+    case X64RelocationType::kBuiltinArg1: {
+      auto symbol = processor->builtin_module()->LookupSymbol(
+          relocation.target, false);
+      if (!symbol || symbol->type() != Symbol::Type::kFunction) {
+        return false;
+      }
+      auto function = static_cast<Function*>(symbol);
+      if (function->behavior() != Function::Behavior::kBuiltin) {
+        return false;
+      }
+      auto builtin_function = static_cast<BuiltinFunction*>(function);
+      value = reinterpret_cast<uint64_t>(
+          relocation.type == X64RelocationType::kBuiltinArg0
+              ? builtin_function->arg0()
+              : builtin_function->arg1());
+    } break;
+    case X64RelocationType::kMmioContext: {
+      auto mmio_range =
+          processor->memory()->LookupVirtualMappedRange(relocation.target);
+      if (!mmio_range) {
+        return false;
+      }
+      value = reinterpret_cast<uint64_t>(mmio_range->callback_context);
+    } break;
+    case X64RelocationType::kCallSite:
+    case X64RelocationType::kTailCallSite:
+      // Filled in by the code cache once placed.
+      return true;
+    default:
+      assert_unhandled_case(relocation.type);
+      return false;
+  }
+  xe::store<uint64_t>(immediate, value);
+  return true;
+}
+
+bool X64PersistentCache::RestoreFunction(X64Function* function) {
+  const FunctionRecord* record = nullptr;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    auto it = records_.find(function->address());
+    if (it == records_.end()) {
+      return false;
+    }
+    record = it->second;
+  }
+
+  // The module may have been patched since we wrote the entry.
+  auto module = function->module();
+  auto inlined_ranges = reinterpret_cast<const GuestCodeRange*>(record + 1);
+  if (!module->ContainsAddress(record->end_address)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < record->inlined_range_count; ++i) {
+    if (!module->ContainsAddress(inlined_ranges[i].address) ||
+        !module->ContainsAddress(inlined_ranges[i].end_address)) {
+      return false;
+    }
+  }
+  if (HashGuestCode(record->address, record->end_address, inlined_ranges,
+                    record->inlined_range_count) != record->guest_code_hash) {
+    return false;
+  }
+
+  auto data = reinterpret_cast<const uint8_t*>(inlined_ranges +
+                                               record->inlined_range_count);
+  auto source_map = reinterpret_cast<const SourceMapEntry*>(data);
+  data += sizeof(SourceMapEntry) * record->source_map_count;
+  auto relocations = reinterpret_cast<const X64Relocation*>(data);
+  data += sizeof(X64Relocation) * record->relocation_count;
+
+  // Fix up a copy of the code before it is placed and becomes callable.
+  std::vector<uint8_t> code(data, data + record->code_size);
+  for (uint32_t i = 0; i < record->relocation_count; ++i) {
+    if (!ApplyRelocation(relocations[i], code.data())) {
+      return false;
+    }
+  }
+
+  auto code_cache = backend_->code_cache();
+  auto machine_code = reinterpret_cast<uint8_t*>(code_cache->PlaceGuestCode(
+      function->address(), code.data(), code.size(), record->stack_size,
+      function));
+  if (!machine_code) {
+    return false;
+  }
+  function->set_end_address(record->end_address);
+  function->source_map().assign(source_map,
+                                source_map + record->source_map_count);
+  function->inlined_ranges().assign(
+      inlined_ranges, inlined_ranges + record->inlined_range_count);
+  function->Setup(machine_code, code.size());
+  code_cache->AddCallSites(
+      machine_code, std::vector<X64Relocation>(
+                        relocations, relocations + record->relocation_count));
+  code_cache->PublishGuestCode(function->address(), machine_code);
+  return true;
+}
+
+void X64PersistentCache::StoreFunction(
+    X64Function* function, const void* machine_code, size_t code_size,
+    size_t stack_size, const std::vector<X64Relocation>& relocations) {
+  auto& source_map = function->source_map();
+  auto& inlined_ranges = function->inlined_ranges();
+  if (function->end_address() < function->address()) {
+    return;
+  }
+  // Only code within the module is hashed when restoring.
+  auto module = function->module();
+  for (auto& range : inlined_ranges) {
+    if (!module->ContainsAddress(range.address) ||
+        !module->ContainsAddress(range.end_address)) {
+      return;
+    }
+  }
+
+  FunctionRecord record;
+  std::memset(&record, 0, sizeof(record));
+  record.address = function->address();
+  record.end_address = function->end_address();
+  record.code_size = static_cast<uint32_t>(code_size);
+  record.stack_size = static_cast<uint32_t>(stack_size);
+  record.source_map_count = static_cast<uint32_t>(source_map.size());
+  record.relocation_count = static_cast<uint32_t>(relocations.size());
+  record.inlined_range_count = static_cast<uint32_t>(inlined_ranges.size());
+  record.guest_code_hash =
+      HashGuestCode(function->address(), function->end_address(),
+                    inlined_ranges.data(), inlined_ranges.size());
+  size_t unaligned_size = sizeof(record) +
+                          sizeof(GuestCodeRange) * inlined_ranges.size() +
+                          sizeof(SourceMapEntry) * source_map.size() +
+                          sizeof(X64Relocation) * relocations.size() +
+                          code_size;
+  record.record_size = static_cast<uint32_t>(xe::round_up(unaligned_size, 8));
+  static const uint8_t padding[8] = {0};
+
+  auto global_lock = global_critical_region_.Acquire();
+  if (!file_) {
+    return;
+  }
+  fwrite(&record, sizeof(record), 1, file_);
+  fwrite(inlined_ranges.data(), sizeof(GuestCodeRange), inlined_ranges.size(),
+         file_);
+  fwrite(source_map.data(), sizeof(SourceMapEntry), source_map.size(), file_);
+  fwrite(relocations.data(), sizeof(X64Relocation), relocations.size(),
+         file_);
+  fwrite(machine_code, 1, code_size, file_);
+  fwrite(padding, 1, record.record_size - unaligned_size, file_);
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,139 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKEND_X64_X64_PERSISTENT_CACHE_H_
+#define XENIA_CPU_BACKEND_X64_X64_PERSISTENT_CACHE_H_
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/module.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+class X64Backend;
+class X64Function;
+
+// On-disk cache of generated guest function code for a single module.
+// Code is written as it is generated and restored on later runs instead of
+// retranslating the function, as long as the guest code, the translator
+// version, and the host environment all still match.
+class X64PersistentCache {
+ public:
+  // Bump whenever the translator, compiler passes, or emitter change in a way
+  // that affects generated code.
+  static const uint32_t kVersion = 14;
+
+  X64PersistentCache(X64Backend* backend, uint64_t module_hash,
+                     FloatPrecisionMode float_precision_mode);
+  ~X64PersistentCache();
+
+  uint64_t module_hash() const { return module_hash_; }
+
+  // Opens (or creates) the cache file at the given path. Any existing file that
+  // doesn't match the current host environment is discarded.
+  bool Initialize(const std::wstring& path);
+
+  // Attempts to restore a previously persisted translation of the function.
+  // Returns false if the entry is missing or stale and the function must be
+  // translated.
+  bool RestoreFunction(X64Function* function);
+
+  // Appends the generated code for the function to the cache file.
+  void StoreFunction(X64Function* function, const void* machine_code,
+                     size_t code_size, size_t stack_size,
+                     const std::vector<X64Relocation>& relocations);
+
+ private:
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t module_hash;
+    // Host values that generated code embeds without relocations. If any of
+    // these differ the whole file is stale.
+    uint32_t emitter_feature_flags;
+    uint32_t emitter_data;
+    // Module setting that changes which sequences are emitted.
+    uint32_t float_precision_mode;
+    // CodegenFlags and other flags that change the code translated from the
+    // same guest code.
+    uint32_t codegen_flags;
+    uint64_t guest_to_host_thunk;
+    uint64_t resolve_function_thunk;
+    // Address of a known host function, used to rebase kHostImage relocations.
+    uint64_t host_image_anchor;
+    uint64_t break_on_instruction;
+    uint32_t inline_max_instructions;
+    uint32_t reserved;
+  };
+
+  enum CodegenFlags : uint32_t {
+    kCodegenInlineCalls = 1 << 0,
+    kCodegenLearnMmioSites = 1 << 1,
+    kCodegenTraceFunctions = 1 << 2,
+    kCodegenTraceFunctionCoverage = 1 << 3,
+    kCodegenTraceFunctionReferences = 1 << 4,
+    kCodegenTraceFunctionData = 1 << 5,
+    kCodegenMmioAccessStats = 1 << 6,
+  };
+
+  struct FunctionRecord {
+    uint32_t record_size;
+    uint32_t address;
+    uint32_t end_address;
+    uint32_t code_size;
+    uint32_t stack_size;
+    uint32_t source_map_count;
+    uint32_t relocation_count;
+    uint32_t inlined_range_count;
+    // Hash of the guest instructions in [address, end_address] and in the
+    // inlined ranges.
+    uint64_t guest_code_hash;
+    // GuestCodeRange inlined_ranges[inlined_range_count];
+    // SourceMapEntry source_map[source_map_count];
+    // X64Relocation relocations[relocation_count];
+    // uint8_t code[code_size];
+  };
+
+  FileHeader BuildHeader() const;
+  // Checks that the contents of a record read from the file fit within it.
+  bool IsRecordValid(const FunctionRecord* record) const;
+  uint64_t HashGuestCode(uint32_t address, uint32_t end_address,
+                         const GuestCodeRange* inlined_ranges,
+                         size_t inlined_range_count) const;
+  bool ApplyRelocation(const X64Relocation& relocation, uint8_t* code) const;
+
+  X64Backend* backend_ = nullptr;
+  uint64_t module_hash_ = 0;
+  FloatPrecisionMode float_precision_mode_ = FloatPrecisionMode::kFast;
+  uint64_t host_image_delta_ = 0;
+
+  xe::global_critical_region global_critical_region_;
+  // Contents of the file as it was when opened. New records are only
+  // appended to the file and restored on the next run.
+  std::vector<uint8_t> file_data_;
+  std::unordered_map<uint32_t, const FunctionRecord*> records_;
+  FILE* file_ = nullptr;
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_X64_X64_PERSISTENT_CACHE_H_
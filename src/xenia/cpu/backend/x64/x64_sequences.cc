@@ -25,6 +25,7 @@
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <unordered_map>
 
@@ -34,7 +35,9 @@
 #include "xenia/base/threading.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_tracers.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/mmio_handler.h"
 #include "xenia/cpu/processor.h"
 
 // For OPCODE_PACK/OPCODE_UNPACK
@@ -671,6 +674,7 @@ struct COMMENT : Sequence<COMMENT, I<OPCODE_COMMENT, VoidOp, OffsetOp>> {
       // TODO(benvanik): pass through.
       // TODO(benvanik): don't just leak this memory.
       auto str_copy = strdup(str);
+      e.MarkUnpersistable();
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
     }
@@ -1049,12 +1053,265 @@ struct RETURN : Sequence<RETURN, I<OPCODE_RETURN, VoidOp>> {
 };
 EMITTER_OPCODE_TABLE(OPCODE_RETURN, RETURN);
 
+// ============================================================================
+// Compare and branch fusion
+// ============================================================================
+// Compares leave the host flags set by their cmp/comis, and conditional
+// branches and returns on their results can jump on those flags instead of
+// testing the result. This is common, as the frontend turns guest compares
+// and record forms into a compare per CR bit all on the same operands, which
+// context promotion then forwards directly into the branch reading the bit.
+// When the branch is the only use of a compare its result isn't set at all.
+
+bool IsCompareOpcode(uint32_t opcode) {
+  return opcode >= OPCODE_COMPARE_EQ && opcode <= OPCODE_COMPARE_UGE;
+}
+
+// Whether the flags left by the compare sequence are known. Float compares
+// against a constant src1 may be emitted with their operands swapped.
+bool IsFlagsCompare(const Instr* i) {
+  if (!IsCompareOpcode(i->opcode->num)) {
+    return false;
+  }
+  auto type = i->src1.value->type;
+  if (i->src1.value->IsConstant() && i->src2.value->IsConstant()) {
+    return false;
+  }
+  if (type == FLOAT32_TYPE || type == FLOAT64_TYPE) {
+    return !i->src1.value->IsConstant();
+  }
+  return type <= INT64_TYPE;
+}
+
+// Whether the sequence of the instruction leaves the host flags untouched.
+bool PreservesHostFlags(const X64Emitter& e, const Instr* i) {
+  switch (i->opcode->num) {
+    case OPCODE_COMMENT:
+      return !IsTracingInstr();
+    case OPCODE_SOURCE_OFFSET:
+      // Coverage counting uses lock inc.
+      return !(e.debug_info_flags() &
+               DebugInfoFlags::kDebugInfoTraceFunctionCoverage);
+    case OPCODE_STORE_CONTEXT:
+      return !IsTracingData() && i->src2.value->type <= INT64_TYPE;
+    case OPCODE_LOAD_LOCAL:
+    case OPCODE_STORE_LOCAL:
+      return true;
+    default:
+      return false;
+  }
+}
+
+enum class FlagsCondition {
+  kEqual,
+  kNotEqual,
+  kLess,
+  kLessEqual,
+  kGreater,
+  kGreaterEqual,
+  kBelow,
+  kBelowEqual,
+  kAbove,
+  kAboveEqual,
+};
+
+// The condition the compare sequence tests the flags for.
+FlagsCondition GetFlagsCondition(const Instr* compare) {
+  auto type = compare->src1.value->type;
+  if (type == FLOAT32_TYPE || type == FLOAT64_TYPE) {
+    switch (compare->opcode->num) {
+      case OPCODE_COMPARE_EQ:
+        return FlagsCondition::kEqual;
+      case OPCODE_COMPARE_NE:
+        return FlagsCondition::kNotEqual;
+      case OPCODE_COMPARE_SLT:
+      case OPCODE_COMPARE_ULT:
+        return FlagsCondition::kBelow;
+      case OPCODE_COMPARE_SLE:
+      case OPCODE_COMPARE_ULE:
+        return FlagsCondition::kBelowEqual;
+      case OPCODE_COMPARE_SGT:
+      case OPCODE_COMPARE_UGT:
+        return FlagsCondition::kAbove;
+      default:
+        return FlagsCondition::kAboveEqual;
+    }
+  }
+  // Integer compares against a constant src1 compare src2 with the constant,
+  // and test the inverse condition.
+  bool inverse = compare->src1.value->IsConstant();
+  switch (compare->opcode->num) {
+    case OPCODE_COMPARE_EQ:
+      return FlagsCondition::kEqual;
+    case OPCODE_COMPARE_NE:
+      return FlagsCondition::kNotEqual;
+    case OPCODE_COMPARE_SLT:
+      return inverse ? FlagsCondition::kGreater : FlagsCondition::kLess;
+    case OPCODE_COMPARE_SLE:
+      return inverse ? FlagsCondition::kGreaterEqual
+                     : FlagsCondition::kLessEqual;
+    case OPCODE_COMPARE_SGT:
+      return inverse ? FlagsCondition::kLess : FlagsCondition::kGreater;
+    case OPCODE_COMPARE_SGE:
+      return inverse ? FlagsCondition::kLessEqual
+                     : FlagsCondition::kGreaterEqual;
+    case OPCODE_COMPARE_ULT:
+      return inverse ? FlagsCondition::kAbove : FlagsCondition::kBelow;
+    case OPCODE_COMPARE_ULE:
+      return inverse ? FlagsCondition::kAboveEqual
+                     : FlagsCondition::kBelowEqual;
+    case OPCODE_COMPARE_UGT:
+      return inverse ? FlagsCondition::kBelow : FlagsCondition::kAbove;
+    default:
+      return inverse ? FlagsCondition::kBelowEqual
+                     : FlagsCondition::kAboveEqual;
+  }
+}
+
+FlagsCondition NegateFlagsCondition(FlagsCondition condition) {
+  switch (condition) {
+    case FlagsCondition::kEqual:
+      return FlagsCondition::kNotEqual;
+    case FlagsCondition::kNotEqual:
+      return FlagsCondition::kEqual;
+    case FlagsCondition::kLess:
+      return FlagsCondition::kGreaterEqual;
+    case FlagsCondition::kLessEqual:
+      return FlagsCondition::kGreater;
+    case FlagsCondition::kGreater:
+      return FlagsCondition::kLessEqual;
+    case FlagsCondition::kGreaterEqual:
+      return FlagsCondition::kLess;
+    case FlagsCondition::kBelow:
+      return FlagsCondition::kAboveEqual;
+    case FlagsCondition::kBelowEqual:
+      return FlagsCondition::kAbove;
+    case FlagsCondition::kAbove:
+      return FlagsCondition::kBelowEqual;
+    default:
+      return FlagsCondition::kBelow;
+  }
+}
+
+// Returns the compare producing the value if the host flags currently hold
+// the comparison of its operands.
+const Instr* GetFlagsCompare(const X64Emitter& e, const Instr* i,
+                             const Value* value) {
+  auto flags_compare = e.flags_compare();
+  auto compare = value->def;
+  if (!flags_compare || !compare || flags_compare->block != i->block ||
+      !IsFlagsCompare(compare) ||
+      compare->src1.value != flags_compare->src1.value ||
+      compare->src2.value != flags_compare->src2.value) {
+    return nullptr;
+  }
+  return compare;
+}
+
+bool IsFlagsBranchOpcode(uint32_t opcode) {
+  return opcode == OPCODE_BRANCH_TRUE || opcode == OPCODE_BRANCH_FALSE ||
+         opcode == OPCODE_RETURN_TRUE;
+}
+
+// Whether the only use of the compare result is a branch it can be fused
+// with, so that the result itself need not be set.
+bool IsFusedCompare(const X64Emitter& e, const Instr* compare) {
+  auto use = compare->dest->use_head;
+  if (!use || use->next || !IsFlagsCompare(compare)) {
+    return false;
+  }
+  auto branch = use->instr;
+  if (!IsFlagsBranchOpcode(branch->opcode->num) ||
+      branch->block != compare->block) {
+    return false;
+  }
+  // Compares of the same operands in between leave the same flags.
+  for (auto i = compare->next; i != branch; i = i->next) {
+    if (!i) {
+      return false;
+    }
+    if (IsFlagsCompare(i)) {
+      if (i->src1.value != compare->src1.value ||
+          i->src2.value != compare->src2.value) {
+        return false;
+      }
+    } else if (!PreservesHostFlags(e, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Jumps to the label if the value is true (or false) by the host flags, when
+// they hold the compare producing it. Returns false if the value has to be
+// tested instead.
+template <typename T>
+bool EmitFlagsJump(X64Emitter& e, const Instr* i, const Value* value,
+                   bool if_true, const T& label) {
+  auto compare = GetFlagsCompare(e, i, value);
+  if (!compare) {
+    return false;
+  }
+  auto condition = GetFlagsCondition(compare);
+  if (!if_true) {
+    condition = NegateFlagsCondition(condition);
+  }
+  switch (condition) {
+    case FlagsCondition::kEqual:
+      e.je(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kNotEqual:
+      e.jne(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kLess:
+      e.jl(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kLessEqual:
+      e.jle(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kGreater:
+      e.jg(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kGreaterEqual:
+      e.jge(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kBelow:
+      e.jb(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kBelowEqual:
+      e.jbe(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kAbove:
+      e.ja(label, e.T_NEAR);
+      break;
+    case FlagsCondition::kAboveEqual:
+      e.jae(label, e.T_NEAR);
+      break;
+  }
+  return true;
+}
+
+// Tracks the flags left by an emitted instruction.
+void UpdateFlagsCompare(X64Emitter& e, const Instr* i) {
+  if (IsFlagsCompare(i)) {
+    e.set_flags_compare(i);
+  } else if (IsFlagsBranchOpcode(i->opcode->num) &&
+             GetFlagsCompare(e, i, i->src1.value)) {
+    // Jumped on the flags, leaving them as they were.
+  } else if (!PreservesHostFlags(e, i)) {
+    e.set_flags_compare(nullptr);
+  }
+}
+
 // ============================================================================
 // OPCODE_RETURN_TRUE
 // ============================================================================
 struct RETURN_TRUE_I8
     : Sequence<RETURN_TRUE_I8, I<OPCODE_RETURN_TRUE, VoidOp, I8Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (EmitFlagsJump(e, i.instr, i.src1.value, true, e.epilog_label())) {
+      return;
+    }
     e.test(i.src1, i.src1);
     e.jnz(e.epilog_label(), CodeGenerator::T_NEAR);
   }
@@ -1115,6 +1372,13 @@ EMITTER_OPCODE_TABLE(OPCODE_SET_RETURN_ADDRESS, SET_RETURN_ADDRESS);
 // ============================================================================
 struct BRANCH : Sequence<BRANCH, I<OPCODE_BRANCH, VoidOp, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    // Blocks are emitted in order, so a branch ending a block that targets
+    // the next one can just fall through.
+    auto block = i.instr->block;
+    if (!i.instr->next && block->next &&
+        i.src1.value->block == block->next) {
+      return;
+    }
     e.jmp(i.src1.value->name, e.T_NEAR);
   }
 };
@@ -1126,6 +1390,9 @@ EMITTER_OPCODE_TABLE(OPCODE_BRANCH, BRANCH);
 struct BRANCH_TRUE_I8
     : Sequence<BRANCH_TRUE_I8, I<OPCODE_BRANCH_TRUE, VoidOp, I8Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (EmitFlagsJump(e, i.instr, i.src1.value, true, i.src2.value->name)) {
+      return;
+    }
     e.test(i.src1, i.src1);
     e.jnz(i.src2.value->name, e.T_NEAR);
   }
@@ -1175,6 +1442,9 @@ EMITTER_OPCODE_TABLE(OPCODE_BRANCH_TRUE, BRANCH_TRUE_I8, BRANCH_TRUE_I16,
 struct BRANCH_FALSE_I8
     : Sequence<BRANCH_FALSE_I8, I<OPCODE_BRANCH_FALSE, VoidOp, I8Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (EmitFlagsJump(e, i.instr, i.src1.value, false, i.src2.value->name)) {
+      return;
+    }
     e.test(i.src1, i.src1);
     e.jz(i.src2.value->name, e.T_NEAR);
   }
@@ -1599,14 +1869,14 @@ struct LOAD_VECTOR_SHL_I8
     if (i.src1.is_constant) {
       auto sh = i.src1.constant();
       assert_true(sh < xe::countof(lvsl_table));
-      e.mov(e.rax, (uintptr_t)&lvsl_table[sh]);
+      e.MovHostPointer(e.rax, &lvsl_table[sh]);
       e.vmovaps(i.dest, e.ptr[e.rax]);
     } else {
       // TODO(benvanik): find a cheaper way of doing this.
       e.movzx(e.rdx, i.src1);
       e.and_(e.dx, 0xF);
       e.shl(e.dx, 4);
-      e.mov(e.rax, (uintptr_t)lvsl_table);
+      e.MovHostPointer(e.rax, lvsl_table);
       e.vmovaps(i.dest, e.ptr[e.rax + e.rdx]);
       e.ReloadEDX();
     }
@@ -1641,14 +1911,14 @@ struct LOAD_VECTOR_SHR_I8
     if (i.src1.is_constant) {
       auto sh = i.src1.constant();
       assert_true(sh < xe::countof(lvsr_table));
-      e.mov(e.rax, (uintptr_t)&lvsr_table[sh]);
+      e.MovHostPointer(e.rax, &lvsr_table[sh]);
       e.vmovaps(i.dest, e.ptr[e.rax]);
     } else {
       // TODO(benvanik): find a cheaper way of doing this.
       e.movzx(e.rdx, i.src1);
       e.and_(e.dx, 0xF);
       e.shl(e.dx, 4);
-      e.mov(e.rax, (uintptr_t)lvsr_table);
+      e.MovHostPointer(e.rax, lvsr_table);
       e.vmovaps(i.dest, e.ptr[e.rax + e.rdx]);
       e.ReloadEDX();
     }
@@ -2020,6 +2290,17 @@ EMITTER_OPCODE_TABLE(OPCODE_CONTEXT_BARRIER, CONTEXT_BARRIER);
 // ============================================================================
 // OPCODE_LOAD_MMIO
 // ============================================================================
+// Counts an MMIO access that didn't need a fault, if requested. Flags are dead
+// here.
+void EmitMmioDirectAccessCount(X64Emitter& e) {
+  if (!FLAGS_mmio_access_stats) {
+    return;
+  }
+  e.MovHostPointer(e.rax, &MMIOHandler::access_counters()->direct);
+  e.lock();
+  e.inc(e.qword[e.rax]);
+}
+
 // Note: all types are always aligned in the context.
 struct LOAD_MMIO_I32
     : Sequence<LOAD_MMIO_I32, I<OPCODE_LOAD_MMIO, I32Op, OffsetOp, OffsetOp>> {
@@ -2027,11 +2308,13 @@ struct LOAD_MMIO_I32
     // uint64_t (context, addr)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto read_address = uint32_t(i.src2.value);
-    e.mov(e.r8, uint64_t(mmio_range->callback_context));
+    e.MovRelocated(e.r8, uint64_t(mmio_range->callback_context),
+                   X64RelocationType::kMmioContext, read_address);
     e.mov(e.r9d, read_address);
     e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read));
     e.bswap(e.eax);
     e.mov(i.dest, e.eax);
+    EmitMmioDirectAccessCount(e);
     if (IsTracingData()) {
       e.mov(e.r8, i.dest);
       e.mov(e.edx, read_address);
@@ -2052,7 +2335,8 @@ struct STORE_MMIO_I32
     // void (context, addr, value)
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto write_address = uint32_t(i.src2.value);
-    e.mov(e.r8, uint64_t(mmio_range->callback_context));
+    e.MovRelocated(e.r8, uint64_t(mmio_range->callback_context),
+                   X64RelocationType::kMmioContext, write_address);
     e.mov(e.r9d, write_address);
     if (i.src3.is_constant) {
       e.mov(e.r10d, xe::byte_swap(i.src3.constant()));
@@ -2061,6 +2345,7 @@ struct STORE_MMIO_I32
       e.bswap(e.r10d);
     }
     e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->write));
+    EmitMmioDirectAccessCount(e);
     if (IsTracingData()) {
       if (i.src3.is_constant) {
         e.mov(e.r8d, i.src3.constant());
@@ -2078,6 +2363,51 @@ EMITTER_OPCODE_TABLE(OPCODE_STORE_MMIO, STORE_MMIO_I32);
 // OPCODE_LOAD
 // ============================================================================
 // Note: most *should* be aligned, but needs to be checked!
+
+// Accesses made by guest instructions that have faulted on MMIO before
+// (LOAD_STORE_MMIO). The address is usually, but not always, in a range.
+// Values are in guest memory order, as a plain load or store sees them.
+uint32_t LoadMmioSiteI32(void* raw_context, uint64_t address) {
+  auto guest_address = static_cast<uint32_t>(address);
+  auto mmio_handler = MMIOHandler::global_handler();
+  auto range =
+      mmio_handler ? mmio_handler->LookupRange(guest_address) : nullptr;
+  if (range) {
+    if (FLAGS_mmio_access_stats) {
+      ++MMIOHandler::access_counters()->direct;
+    }
+    return xe::byte_swap(static_cast<uint32_t>(
+        range->read(raw_context, range->callback_context, guest_address)));
+  }
+  auto context = reinterpret_cast<ppc::PPCContext*>(raw_context);
+  return xe::load<uint32_t>(context->virtual_membase + guest_address);
+}
+void StoreMmioSiteI32(void* raw_context, uint64_t address, uint64_t value) {
+  auto guest_address = static_cast<uint32_t>(address);
+  auto mmio_handler = MMIOHandler::global_handler();
+  auto range =
+      mmio_handler ? mmio_handler->LookupRange(guest_address) : nullptr;
+  if (range) {
+    if (FLAGS_mmio_access_stats) {
+      ++MMIOHandler::access_counters()->direct;
+    }
+    range->write(raw_context, range->callback_context, guest_address,
+                 xe::byte_swap(static_cast<uint32_t>(value)));
+    return;
+  }
+  auto context = reinterpret_cast<ppc::PPCContext*>(raw_context);
+  xe::store<uint32_t>(context->virtual_membase + guest_address,
+                      static_cast<uint32_t>(value));
+}
+template <typename T>
+void LoadMmioSiteAddress(X64Emitter& e, const T& guest) {
+  if (guest.is_constant) {
+    e.mov(e.r8d, static_cast<uint32_t>(guest.constant()));
+  } else {
+    e.mov(e.r8d, guest.reg().cvt32());
+  }
+}
+
 template <typename T>
 RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
   if (guest.is_constant) {
@@ -2126,6 +2456,15 @@ struct LOAD_I16 : Sequence<LOAD_I16, I<OPCODE_LOAD, I16Op, I64Op>> {
 };
 struct LOAD_I32 : Sequence<LOAD_I32, I<OPCODE_LOAD, I32Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (i.instr->flags & LoadStoreFlags::LOAD_STORE_MMIO) {
+      LoadMmioSiteAddress(e, i.src1);
+      e.CallNativeSafe(reinterpret_cast<void*>(LoadMmioSiteI32));
+      e.mov(i.dest, e.eax);
+      if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
+        e.bswap(i.dest);
+      }
+      return;
+    }
     auto addr = ComputeMemoryAddress(e, i.src1);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       if (e.IsFeatureEnabled(kX64EmitMovbe)) {
@@ -2258,6 +2597,23 @@ struct STORE_I16 : Sequence<STORE_I16, I<OPCODE_STORE, VoidOp, I64Op, I16Op>> {
 };
 struct STORE_I32 : Sequence<STORE_I32, I<OPCODE_STORE, VoidOp, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (i.instr->flags & LoadStoreFlags::LOAD_STORE_MMIO) {
+      LoadMmioSiteAddress(e, i.src1);
+      if (i.src2.is_constant) {
+        uint32_t value = static_cast<uint32_t>(i.src2.constant());
+        if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
+          value = xe::byte_swap(value);
+        }
+        e.mov(e.r9d, value);
+      } else {
+        e.mov(e.r9d, i.src2);
+        if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
+          e.bswap(e.r9d);
+        }
+      }
+      e.CallNativeSafe(reinterpret_cast<void*>(StoreMmioSiteI32));
+      return;
+    }
     auto addr = ComputeMemoryAddress(e, i.src1);
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src2.is_constant);
@@ -2919,7 +3275,9 @@ struct COMPARE_EQ_I8
                                       const Reg8& src2) { e.cmp(src1, src2); },
                              [](X64Emitter& e, const Reg8& src1,
                                 int32_t constant) { e.cmp(src1, constant); });
-    e.sete(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.sete(i.dest);
+    }
   }
 };
 struct COMPARE_EQ_I16
@@ -2929,7 +3287,9 @@ struct COMPARE_EQ_I16
                                       const Reg16& src2) { e.cmp(src1, src2); },
                              [](X64Emitter& e, const Reg16& src1,
                                 int32_t constant) { e.cmp(src1, constant); });
-    e.sete(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.sete(i.dest);
+    }
   }
 };
 struct COMPARE_EQ_I32
@@ -2939,7 +3299,9 @@ struct COMPARE_EQ_I32
                                       const Reg32& src2) { e.cmp(src1, src2); },
                              [](X64Emitter& e, const Reg32& src1,
                                 int32_t constant) { e.cmp(src1, constant); });
-    e.sete(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.sete(i.dest);
+    }
   }
 };
 struct COMPARE_EQ_I64
@@ -2949,7 +3311,9 @@ struct COMPARE_EQ_I64
                                       const Reg64& src2) { e.cmp(src1, src2); },
                              [](X64Emitter& e, const Reg64& src1,
                                 int32_t constant) { e.cmp(src1, constant); });
-    e.sete(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.sete(i.dest);
+    }
   }
 };
 struct COMPARE_EQ_F32
@@ -2959,7 +3323,9 @@ struct COMPARE_EQ_F32
         e, i, [&i](X64Emitter& e, I8Op dest, const Xmm& src1, const Xmm& src2) {
           e.vcomiss(src1, src2);
         });
-    e.sete(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.sete(i.dest);
+    }
   }
 };
 struct COMPARE_EQ_F64
@@ -2969,7 +3335,9 @@ struct COMPARE_EQ_F64
         e, i, [&i](X64Emitter& e, I8Op dest, const Xmm& src1, const Xmm& src2) {
           e.vcomisd(src1, src2);
         });
-    e.sete(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.sete(i.dest);
+    }
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_COMPARE_EQ, COMPARE_EQ_I8, COMPARE_EQ_I16,
@@ -2986,7 +3354,9 @@ struct COMPARE_NE_I8
                                       const Reg8& src2) { e.cmp(src1, src2); },
                              [](X64Emitter& e, const Reg8& src1,
                                 int32_t constant) { e.cmp(src1, constant); });
-    e.setne(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.setne(i.dest);
+    }
   }
 };
 struct COMPARE_NE_I16
@@ -2996,7 +3366,9 @@ struct COMPARE_NE_I16
                                       const Reg16& src2) { e.cmp(src1, src2); },
                              [](X64Emitter& e, const Reg16& src1,
                                 int32_t constant) { e.cmp(src1, constant); });
-    e.setne(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.setne(i.dest);
+    }
   }
 };
 struct COMPARE_NE_I32
@@ -3006,7 +3378,9 @@ struct COMPARE_NE_I32
                                       const Reg32& src2) { e.cmp(src1, src2); },
                              [](X64Emitter& e, const Reg32& src1,
                                 int32_t constant) { e.cmp(src1, constant); });
-    e.setne(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.setne(i.dest);
+    }
   }
 };
 struct COMPARE_NE_I64
@@ -3016,21 +3390,27 @@ struct COMPARE_NE_I64
                                       const Reg64& src2) { e.cmp(src1, src2); },
                              [](X64Emitter& e, const Reg64& src1,
                                 int32_t constant) { e.cmp(src1, constant); });
-    e.setne(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.setne(i.dest);
+    }
   }
 };
 struct COMPARE_NE_F32
     : Sequence<COMPARE_NE_F32, I<OPCODE_COMPARE_NE, I8Op, F32Op, F32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.vcomiss(i.src1, i.src2);
-    e.setne(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.setne(i.dest);
+    }
   }
 };
 struct COMPARE_NE_F64
     : Sequence<COMPARE_NE_F64, I<OPCODE_COMPARE_NE, I8Op, F64Op, F64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.vcomisd(i.src1, i.src2);
-    e.setne(i.dest);
+    if (!IsFusedCompare(e, i.instr)) {
+      e.setne(i.dest);
+    }
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_COMPARE_NE, COMPARE_NE_I8, COMPARE_NE_I16,
@@ -3046,20 +3426,29 @@ EMITTER_OPCODE_TABLE(OPCODE_COMPARE_NE, COMPARE_NE_I8, COMPARE_NE_I16,
       : Sequence<COMPARE_##op##_##type,                                 \
                  I<OPCODE_COMPARE_##op, I8Op, type, type>> {            \
     static void Emit(X64Emitter& e, const EmitArgType& i) {             \
+      bool set_dest = !IsFusedCompare(e, i.instr);                      \
       EmitAssociativeCompareOp(                                         \
           e, i,                                                         \
-          [](X64Emitter& e, const Reg8& dest, const reg_type& src1,     \
-             const reg_type& src2, bool inverse) {                      \
+          [set_dest](X64Emitter& e, const Reg8& dest,                   \
+                     const reg_type& src1, const reg_type& src2,        \
+                     bool inverse) {                                    \
             e.cmp(src1, src2);                                          \
+            if (!set_dest) {                                            \
+              return;                                                   \
+            }                                                           \
             if (!inverse) {                                             \
               e.instr(dest);                                            \
             } else {                                                    \
               e.inverse_instr(dest);                                    \
             }                                                           \
           },                                                            \
-          [](X64Emitter& e, const Reg8& dest, const reg_type& src1,     \
-             int32_t constant, bool inverse) {                          \
+          [set_dest](X64Emitter& e, const Reg8& dest,                   \
+                     const reg_type& src1, int32_t constant,            \
+                     bool inverse) {                                    \
             e.cmp(src1, constant);                                      \
+            if (!set_dest) {                                            \
+              return;                                                   \
+            }                                                           \
             if (!inverse) {                                             \
               e.instr(dest);                                            \
             } else {                                                    \
@@ -3092,7 +3481,9 @@ EMITTER_ASSOCIATIVE_COMPARE_XX(UGE, setae, setbe);
                  I<OPCODE_COMPARE_##op, I8Op, F32Op, F32Op>> {        \
     static void Emit(X64Emitter& e, const EmitArgType& i) {           \
       e.vcomiss(i.src1, i.src2);                                      \
-      e.instr(i.dest);                                                \
+      if (!IsFusedCompare(e, i.instr)) {                              \
+        e.instr(i.dest);                                              \
+      }                                                               \
     }                                                                 \
   };                                                                  \
   struct COMPARE_##op##_F64                                           \
@@ -3108,7 +3499,9 @@ EMITTER_ASSOCIATIVE_COMPARE_XX(UGE, setae, setbe);
       } else {                                                        \
         e.vcomisd(i.src1, i.src2);                                    \
       }                                                               \
-      e.instr(i.dest);                                                \
+      if (!IsFusedCompare(e, i.instr)) {                              \
+        e.instr(i.dest);                                              \
+      }                                                               \
     }                                                                 \
   };                                                                  \
   EMITTER_OPCODE_TABLE(OPCODE_COMPARE_##op##_FLT, COMPARE_##op##_F32, \
@@ -4379,6 +4772,25 @@ EMITTER_OPCODE_TABLE(OPCODE_DIV, DIV_I8, DIV_I16, DIV_I32, DIV_I64, DIV_F32,
 // ============================================================================
 // OPCODE_MUL_ADD
 // ============================================================================
+// Without FMA a fused multiply-add has to call out to the C library to keep
+// the single rounding of the guest instruction.
+template <typename T>
+Xmm LoadFusedMulAddOperand(X64Emitter& e, const T& op, const Xmm& temp) {
+  if (op.is_constant) {
+    e.LoadConstantXmm(temp, op.constant());
+    return temp;
+  }
+  return op;
+}
+template <typename ARGS>
+void EmitFusedMulAddCall(X64Emitter& e, const ARGS& i, void* fn) {
+  e.lea(e.r8, e.StashXmm(0, LoadFusedMulAddOperand(e, i.src1, e.xmm0)));
+  e.lea(e.r9, e.StashXmm(1, LoadFusedMulAddOperand(e, i.src2, e.xmm1)));
+  e.lea(e.r10, e.StashXmm(2, LoadFusedMulAddOperand(e, i.src3, e.xmm2)));
+  e.CallNativeSafe(fn);
+  e.vmovaps(i.dest, e.xmm0);
+}
+
 // d = 1 * 2 + 3
 // $0 = $1x$0 + $2
 // Forms of vfmadd/vfmsub:
@@ -4387,10 +4799,21 @@ EMITTER_OPCODE_TABLE(OPCODE_DIV, DIV_I8, DIV_I16, DIV_I32, DIV_I64, DIV_F32,
 // - 231 -> $1 = $2 * $3 + $1
 struct MUL_ADD_F32
     : Sequence<MUL_ADD_F32, I<OPCODE_MUL_ADD, F32Op, F32Op, F32Op, F32Op>> {
+  static __m128 EmulateFusedMulAdd(void*, __m128 src1, __m128 src2,
+                                   __m128 src3) {
+    float a, b, c;
+    _mm_store_ss(&a, src1);
+    _mm_store_ss(&b, src2);
+    _mm_store_ss(&c, src3);
+    float result = std::fma(a, b, c);
+    return _mm_load_ss(&result);
+  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // Calculate the multiply part if it's constant.
+    // Calculate the multiply part if it's constant. This rounds twice, so it
+    // is only done when the instruction doesn't need to be fused.
     // TODO: Do this in the constant propagation pass.
-    if (i.src1.is_constant && i.src2.is_constant) {
+    if (i.src1.is_constant && i.src2.is_constant &&
+        !(i.instr->flags & ARITHMETIC_FUSED)) {
       float mul = i.src1.constant() * i.src2.constant();
 
       e.LoadConstantXmm(e.xmm0, mul);
@@ -4418,6 +4841,8 @@ struct MUL_ADD_F32
           e.vfmadd213ss(i.dest, src2, src3);
         }
       });
+    } else if (i.instr->flags & ARITHMETIC_FUSED) {
+      EmitFusedMulAddCall(e, i, reinterpret_cast<void*>(EmulateFusedMulAdd));
     } else {
       Xmm src3;
       if (i.src3.is_constant) {
@@ -4444,10 +4869,21 @@ struct MUL_ADD_F32
 };
 struct MUL_ADD_F64
     : Sequence<MUL_ADD_F64, I<OPCODE_MUL_ADD, F64Op, F64Op, F64Op, F64Op>> {
+  static __m128d EmulateFusedMulAdd(void*, __m128d src1, __m128d src2,
+                                    __m128d src3) {
+    double a, b, c;
+    _mm_store_sd(&a, src1);
+    _mm_store_sd(&b, src2);
+    _mm_store_sd(&c, src3);
+    double result = std::fma(a, b, c);
+    return _mm_load_sd(&result);
+  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // Calculate the multiply part if it's constant.
+    // Calculate the multiply part if it's constant. This rounds twice, so it
+    // is only done when the instruction doesn't need to be fused.
     // TODO: Do this in the constant propagation pass.
-    if (i.src1.is_constant && i.src2.is_constant) {
+    if (i.src1.is_constant && i.src2.is_constant &&
+        !(i.instr->flags & ARITHMETIC_FUSED)) {
       double mul = i.src1.constant() * i.src2.constant();
 
       e.LoadConstantXmm(e.xmm0, mul);
@@ -4475,6 +4911,8 @@ struct MUL_ADD_F64
           e.vfmadd213sd(i.dest, src2, src3);
         }
       });
+    } else if (i.instr->flags & ARITHMETIC_FUSED) {
+      EmitFusedMulAddCall(e, i, reinterpret_cast<void*>(EmulateFusedMulAdd));
     } else {
       Xmm src3;
       if (i.src3.is_constant) {
@@ -4502,10 +4940,25 @@ struct MUL_ADD_F64
 struct MUL_ADD_V128
     : Sequence<MUL_ADD_V128,
                I<OPCODE_MUL_ADD, V128Op, V128Op, V128Op, V128Op>> {
+  static __m128 EmulateFusedMulAdd(void*, __m128 src1, __m128 src2,
+                                   __m128 src3) {
+    alignas(16) float a[4];
+    alignas(16) float b[4];
+    alignas(16) float c[4];
+    _mm_store_ps(a, src1);
+    _mm_store_ps(b, src2);
+    _mm_store_ps(c, src3);
+    for (size_t n = 0; n < 4; ++n) {
+      a[n] = std::fma(a[n], b[n], c[n]);
+    }
+    return _mm_load_ps(a);
+  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // Calculate the multiply part if it's constant.
+    // Calculate the multiply part if it's constant. This rounds twice, so it
+    // is only done when the instruction doesn't need to be fused.
     // TODO: Do this in the constant propagation pass.
-    if (i.src1.is_constant && i.src2.is_constant) {
+    if (i.src1.is_constant && i.src2.is_constant &&
+        !(i.instr->flags & ARITHMETIC_FUSED)) {
       vec128_t mul;
       for (int n = 0; n < 4; n++) {
         mul.f32[n] = i.src1.constant().f32[n] * i.src2.constant().f32[n];
@@ -4516,10 +4969,10 @@ struct MUL_ADD_V128
       return;
     }
 
-    // TODO(benvanik): the vfmadd sequence produces slightly different results
-    // than vmul+vadd and it'd be nice to know why. Until we know, it's
-    // disabled so tests pass.
-    if (false && e.IsFeatureEnabled(kX64EmitFMA)) {
+    // FMA extension
+    // vfmadd rounds once where vmul+vadd rounds twice; the guest vmaddfp
+    // rounds once as well.
+    if (e.IsFeatureEnabled(kX64EmitFMA)) {
       EmitCommutativeBinaryXmmOp(e, i, [&i](X64Emitter& e, const Xmm& dest,
                                             const Xmm& src1, const Xmm& src2) {
         Xmm src3 = i.src3.is_constant ? e.xmm1 : i.src3;
@@ -4538,6 +4991,8 @@ struct MUL_ADD_V128
           e.vfmadd213ps(i.dest, src2, src3);
         }
       });
+    } else if (i.instr->flags & ARITHMETIC_FUSED) {
+      EmitFusedMulAddCall(e, i, reinterpret_cast<void*>(EmulateFusedMulAdd));
     } else {
       Xmm src3;
       if (i.src3.is_constant) {
@@ -4578,10 +5033,21 @@ EMITTER_OPCODE_TABLE(OPCODE_MUL_ADD, MUL_ADD_F32, MUL_ADD_F64, MUL_ADD_V128);
 // - 231 -> $1 = $2 * $3 - $1
 struct MUL_SUB_F32
     : Sequence<MUL_SUB_F32, I<OPCODE_MUL_SUB, F32Op, F32Op, F32Op, F32Op>> {
+  static __m128 EmulateFusedMulSub(void*, __m128 src1, __m128 src2,
+                                   __m128 src3) {
+    float a, b, c;
+    _mm_store_ss(&a, src1);
+    _mm_store_ss(&b, src2);
+    _mm_store_ss(&c, src3);
+    float result = std::fma(a, b, -c);
+    return _mm_load_ss(&result);
+  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // Calculate the multiply part if it's constant.
+    // Calculate the multiply part if it's constant. This rounds twice, so it
+    // is only done when the instruction doesn't need to be fused.
     // TODO: Do this in the constant propagation pass.
-    if (i.src1.is_constant && i.src2.is_constant) {
+    if (i.src1.is_constant && i.src2.is_constant &&
+        !(i.instr->flags & ARITHMETIC_FUSED)) {
       float mul = i.src1.constant() * i.src2.constant();
 
       e.LoadConstantXmm(e.xmm0, mul);
@@ -4609,6 +5075,8 @@ struct MUL_SUB_F32
           e.vfmsub213ss(i.dest, src2, src3);
         }
       });
+    } else if (i.instr->flags & ARITHMETIC_FUSED) {
+      EmitFusedMulAddCall(e, i, reinterpret_cast<void*>(EmulateFusedMulSub));
     } else {
       Xmm src3;
       if (i.src3.is_constant) {
@@ -4635,10 +5103,21 @@ struct MUL_SUB_F32
 };
 struct MUL_SUB_F64
     : Sequence<MUL_SUB_F64, I<OPCODE_MUL_SUB, F64Op, F64Op, F64Op, F64Op>> {
+  static __m128d EmulateFusedMulSub(void*, __m128d src1, __m128d src2,
+                                    __m128d src3) {
+    double a, b, c;
+    _mm_store_sd(&a, src1);
+    _mm_store_sd(&b, src2);
+    _mm_store_sd(&c, src3);
+    double result = std::fma(a, b, -c);
+    return _mm_load_sd(&result);
+  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // Calculate the multiply part if it's constant.
+    // Calculate the multiply part if it's constant. This rounds twice, so it
+    // is only done when the instruction doesn't need to be fused.
     // TODO: Do this in the constant propagation pass.
-    if (i.src1.is_constant && i.src2.is_constant) {
+    if (i.src1.is_constant && i.src2.is_constant &&
+        !(i.instr->flags & ARITHMETIC_FUSED)) {
       double mul = i.src1.constant() * i.src2.constant();
 
       e.LoadConstantXmm(e.xmm0, mul);
@@ -4666,6 +5145,8 @@ struct MUL_SUB_F64
           e.vfmsub213sd(i.dest, src2, src3);
         }
       });
+    } else if (i.instr->flags & ARITHMETIC_FUSED) {
+      EmitFusedMulAddCall(e, i, reinterpret_cast<void*>(EmulateFusedMulSub));
     } else {
       Xmm src3;
       if (i.src3.is_constant) {
@@ -4693,10 +5174,25 @@ struct MUL_SUB_F64
 struct MUL_SUB_V128
     : Sequence<MUL_SUB_V128,
                I<OPCODE_MUL_SUB, V128Op, V128Op, V128Op, V128Op>> {
+  static __m128 EmulateFusedMulSub(void*, __m128 src1, __m128 src2,
+                                   __m128 src3) {
+    alignas(16) float a[4];
+    alignas(16) float b[4];
+    alignas(16) float c[4];
+    _mm_store_ps(a, src1);
+    _mm_store_ps(b, src2);
+    _mm_store_ps(c, src3);
+    for (size_t n = 0; n < 4; ++n) {
+      a[n] = std::fma(a[n], b[n], -c[n]);
+    }
+    return _mm_load_ps(a);
+  }
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // Calculate the multiply part if it's constant.
+    // Calculate the multiply part if it's constant. This rounds twice, so it
+    // is only done when the instruction doesn't need to be fused.
     // TODO: Do this in the constant propagation pass.
-    if (i.src1.is_constant && i.src2.is_constant) {
+    if (i.src1.is_constant && i.src2.is_constant &&
+        !(i.instr->flags & ARITHMETIC_FUSED)) {
       vec128_t mul;
       for (int n = 0; n < 4; n++) {
         mul.f32[n] = i.src1.constant().f32[n] * i.src2.constant().f32[n];
@@ -4727,6 +5223,8 @@ struct MUL_SUB_V128
           e.vfmsub213ps(i.dest, src2, src3);
         }
       });
+    } else if (i.instr->flags & ARITHMETIC_FUSED) {
+      EmitFusedMulAddCall(e, i, reinterpret_cast<void*>(EmulateFusedMulSub));
     } else {
       Xmm src3;
       if (i.src3.is_constant) {
@@ -5369,6 +5867,127 @@ struct SHA_I64 : Sequence<SHA_I64, I<OPCODE_SHA, I64Op, I64Op, I8Op>> {
 };
 EMITTER_OPCODE_TABLE(OPCODE_SHA, SHA_I8, SHA_I16, SHA_I32, SHA_I64);
 
+// ============================================================================
+// Per-element vector shifts of 8 and 16-bit elements
+// ============================================================================
+enum class VectorShiftKind {
+  kLeft,
+  kLogicalRight,
+  kArithmeticRight,
+};
+
+// x86 has no per-element shifts of bytes, and only AVX-512BW has them for
+// words. Without it the elements are widened to dwords and shifted with the
+// AVX2 vpsllvd/vpsrlvd/vpsravd. Counts are masked to the element size first.
+// Returns false if neither is available and the caller must emulate.
+static bool EmitVectorShiftVariable(X64Emitter& e, const Xmm& dest,
+                                    const Xmm& src1, const Xmm& src2,
+                                    TypeName type, VectorShiftKind kind) {
+  auto shift_words = [&](const Xmm& d, const Xmm& s, const Xmm& amt) {
+    switch (kind) {
+      case VectorShiftKind::kLeft:
+        e.vpsllvw(d, s, amt);
+        break;
+      case VectorShiftKind::kLogicalRight:
+        e.vpsrlvw(d, s, amt);
+        break;
+      case VectorShiftKind::kArithmeticRight:
+        e.vpsravw(d, s, amt);
+        break;
+    }
+  };
+  auto shift_dwords = [&](const Xmm& d, const Xmm& s, const Xmm& amt) {
+    switch (kind) {
+      case VectorShiftKind::kLeft:
+        e.vpsllvd(d, s, amt);
+        break;
+      case VectorShiftKind::kLogicalRight:
+        e.vpsrlvd(d, s, amt);
+        break;
+      case VectorShiftKind::kArithmeticRight:
+        e.vpsravd(d, s, amt);
+        break;
+    }
+  };
+  bool is_signed = kind == VectorShiftKind::kArithmeticRight;
+
+  if (type == INT16_TYPE) {
+    if (e.IsFeatureEnabled(kX64EmitAVX512BW)) {
+      e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMShiftMaskPI16));
+      shift_words(dest, src1, e.xmm1);
+      return true;
+    }
+    if (!e.IsFeatureEnabled(kX64EmitAVX2)) {
+      return false;
+    }
+    e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMShiftMaskPI16));
+    e.vpmovzxwd(e.ymm1, e.xmm1);
+    if (is_signed) {
+      e.vpmovsxwd(e.ymm0, src1);
+    } else {
+      e.vpmovzxwd(e.ymm0, src1);
+    }
+    shift_dwords(e.ymm0, e.ymm0, e.ymm1);
+    if (kind == VectorShiftKind::kLeft) {
+      // Drop what was shifted out so the pack doesn't saturate.
+      e.vpbroadcastd(e.ymm1, e.GetXmmConstPtr(XMMMaskEvenPI16));
+      e.vpand(e.ymm0, e.ymm0, e.ymm1);
+    }
+    e.vextracti128(e.xmm1, e.ymm0, 1);
+    if (is_signed) {
+      e.vpackssdw(dest, e.xmm0, e.xmm1);
+    } else {
+      e.vpackusdw(dest, e.xmm0, e.xmm1);
+    }
+    e.vzeroupper();
+    return true;
+  }
+
+  assert_true(type == INT8_TYPE);
+  if (e.IsFeatureEnabled(kX64EmitAVX512BW)) {
+    e.vpand(e.xmm1, src2, e.GetXmmConstPtr(XMMShiftMaskPI8));
+    e.vpmovzxbw(e.ymm1, e.xmm1);
+    if (is_signed) {
+      e.vpmovsxbw(e.ymm0, src1);
+    } else {
+      e.vpmovzxbw(e.ymm0, src1);
+    }
+    shift_words(e.ymm0, e.ymm0, e.ymm1);
+    e.vpmovwb(dest, e.ymm0);
+    e.vzeroupper();
+    return true;
+  }
+  if (!e.IsFeatureEnabled(kX64EmitAVX2)) {
+    return false;
+  }
+  // Bytes 0-7 in ymm0 and 8-15 in ymm1.
+  e.vpand(e.xmm2, src2, e.GetXmmConstPtr(XMMShiftMaskPI8));
+  e.vpsrldq(e.xmm3, src1, 8);
+  if (is_signed) {
+    e.vpmovsxbd(e.ymm0, src1);
+    e.vpmovsxbd(e.ymm1, e.xmm3);
+  } else {
+    e.vpmovzxbd(e.ymm0, src1);
+    e.vpmovzxbd(e.ymm1, e.xmm3);
+  }
+  e.vpmovzxbd(e.ymm3, e.xmm2);
+  shift_dwords(e.ymm0, e.ymm0, e.ymm3);
+  e.vpsrldq(e.xmm2, e.xmm2, 8);
+  e.vpmovzxbd(e.ymm3, e.xmm2);
+  shift_dwords(e.ymm1, e.ymm1, e.ymm3);
+  // Truncate to bytes and narrow. The packs work within 128-bit lanes, which
+  // leaves the dwords of the result in 0, 2, 1, 3 order.
+  e.vpbroadcastd(e.ymm2, e.GetXmmConstPtr(XMMShiftByteMask));
+  e.vpand(e.ymm0, e.ymm0, e.ymm2);
+  e.vpand(e.ymm1, e.ymm1, e.ymm2);
+  e.vpackusdw(e.ymm0, e.ymm0, e.ymm1);
+  e.vextracti128(e.xmm1, e.ymm0, 1);
+  e.vpackuswb(dest, e.xmm0, e.xmm1);
+  e.vpshufd(dest, dest, 0b11011000);
+  e.vzeroupper();
+  return true;
+}
+
 // ============================================================================
 // OPCODE_VECTOR_SHL
 // ============================================================================
@@ -5401,13 +6020,18 @@ struct VECTOR_SHL_V128
     return _mm_load_si128(reinterpret_cast<__m128i*>(value));
   }
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    Xmm src2;
     if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
+      src2 = e.xmm0;
+      e.LoadConstantXmm(src2, i.src2.constant());
     } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
+      src2 = i.src2;
+    }
+    if (EmitVectorShiftVariable(e, i.dest, i.src1, src2, INT8_TYPE,
+                                VectorShiftKind::kLeft)) {
+      return;
     }
+    e.lea(e.r9, e.StashXmm(1, src2));
     e.lea(e.r8, e.StashXmm(0, i.src1));
     e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShlI8));
     e.vmovaps(i.dest, e.xmm0);
@@ -5439,6 +6063,18 @@ struct VECTOR_SHL_V128
       }
     }
 
+    Xmm src2;
+    if (i.src2.is_constant) {
+      src2 = e.xmm0;
+      e.LoadConstantXmm(src2, i.src2.constant());
+    } else {
+      src2 = i.src2;
+    }
+    if (EmitVectorShiftVariable(e, i.dest, i.src1, src2, INT16_TYPE,
+                                VectorShiftKind::kLeft)) {
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -5460,12 +6096,7 @@ struct VECTOR_SHL_V128
 
     // TODO(benvanik): native version (with shift magic).
     e.L(emu);
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
+    e.lea(e.r9, e.StashXmm(1, src2));
     e.lea(e.r8, e.StashXmm(0, i.src1));
     e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShlI16));
     e.vmovaps(i.dest, e.xmm0);
@@ -5585,13 +6216,18 @@ struct VECTOR_SHR_V128
     return _mm_load_si128(reinterpret_cast<__m128i*>(value));
   }
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    Xmm src2;
     if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
+      src2 = e.xmm0;
+      e.LoadConstantXmm(src2, i.src2.constant());
     } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
+      src2 = i.src2;
     }
+    if (EmitVectorShiftVariable(e, i.dest, i.src1, src2, INT8_TYPE,
+                                VectorShiftKind::kLogicalRight)) {
+      return;
+    }
+    e.lea(e.r9, e.StashXmm(1, src2));
     e.lea(e.r8, e.StashXmm(0, i.src1));
     e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShrI8));
     e.vmovaps(i.dest, e.xmm0);
@@ -5623,6 +6259,18 @@ struct VECTOR_SHR_V128
       }
     }
 
+    Xmm src2;
+    if (i.src2.is_constant) {
+      src2 = e.xmm0;
+      e.LoadConstantXmm(src2, i.src2.constant());
+    } else {
+      src2 = i.src2;
+    }
+    if (EmitVectorShiftVariable(e, i.dest, i.src1, src2, INT16_TYPE,
+                                VectorShiftKind::kLogicalRight)) {
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -5644,12 +6292,7 @@ struct VECTOR_SHR_V128
 
     // TODO(benvanik): native version (with shift magic).
     e.L(emu);
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
+    e.lea(e.r9, e.StashXmm(1, src2));
     e.lea(e.r8, e.StashXmm(0, i.src1));
     e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShrI16));
     e.vmovaps(i.dest, e.xmm0);
@@ -5754,13 +6397,18 @@ struct VECTOR_SHA_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    Xmm src2;
     if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
+      src2 = e.xmm0;
+      e.LoadConstantXmm(src2, i.src2.constant());
     } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
+      src2 = i.src2;
+    }
+    if (EmitVectorShiftVariable(e, i.dest, i.src1, src2, INT8_TYPE,
+                                VectorShiftKind::kArithmeticRight)) {
+      return;
     }
+    e.lea(e.r9, e.StashXmm(1, src2));
     e.lea(e.r8, e.StashXmm(0, i.src1));
     e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShaI8));
     e.vmovaps(i.dest, e.xmm0);
@@ -5794,6 +6442,18 @@ struct VECTOR_SHA_V128
       }
     }
 
+    Xmm src2;
+    if (i.src2.is_constant) {
+      src2 = e.xmm0;
+      e.LoadConstantXmm(src2, i.src2.constant());
+    } else {
+      src2 = i.src2;
+    }
+    if (EmitVectorShiftVariable(e, i.dest, i.src1, src2, INT16_TYPE,
+                                VectorShiftKind::kArithmeticRight)) {
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -5815,12 +6475,7 @@ struct VECTOR_SHA_V128
 
     // TODO(benvanik): native version (with shift magic).
     e.L(emu);
-    if (i.src2.is_constant) {
-      e.LoadConstantXmm(e.xmm0, i.src2.constant());
-      e.lea(e.r9, e.StashXmm(1, e.xmm0));
-    } else {
-      e.lea(e.r9, e.StashXmm(1, i.src2));
-    }
+    e.lea(e.r9, e.StashXmm(1, src2));
     e.lea(e.r8, e.StashXmm(0, i.src1));
     e.CallNativeSafe(reinterpret_cast<void*>(EmulateVectorShaI16));
     e.vmovaps(i.dest, e.xmm0);
@@ -6438,7 +7093,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostPointer(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, i.src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -6650,6 +7305,30 @@ struct PERMUTE_V128
         e.vpcmpgtb(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMPermuteControl15));
         e.vpandn(i.dest, e.xmm0, i.dest);
       }
+    } else if (e.IsFeatureEnabled(kX64EmitAVX512VBMI)) {
+      // vpermi2b selects from the 32 bytes of src2:src3 by the low 5 bits of
+      // each control byte, which is exactly vperm. The control is swapped the
+      // same as below and overwritten with the result.
+      if (i.src1.is_constant) {
+        e.LoadConstantXmm(e.xmm2, i.src1.constant());
+        e.vxorps(e.xmm2, e.xmm2, e.GetXmmConstPtr(XMMSwapWordMask));
+      } else {
+        e.vxorps(e.xmm2, i.src1, e.GetXmmConstPtr(XMMSwapWordMask));
+      }
+      Xmm src2 = e.xmm0;
+      if (i.src2.is_constant) {
+        e.LoadConstantXmm(src2, i.src2.constant());
+      } else {
+        src2 = i.src2;
+      }
+      Xmm src3 = e.xmm1;
+      if (i.src3.is_constant) {
+        e.LoadConstantXmm(src3, i.src3.constant());
+      } else {
+        src3 = i.src3;
+      }
+      e.vpermi2b(e.xmm2, src2, src3);
+      e.vmovdqa(i.dest, e.xmm2);
     } else {
       // General permute.
       // Control mask needs to be shuffled.
@@ -6844,7 +7523,7 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
 
     if (e.IsFeatureEnabled(kX64EmitF16C)) {
       // 0|0|0|0|W|Z|Y|X
-      e.vcvtps2ph(i.dest, i.dest, 0b00000011);
+      e.vcvtps2ph(i.dest, i.src1, 0b00000011);
       // Shuffle to X|Y|0|0|0|0|0|0
       e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMPackFLOAT16_2));
     } else {
@@ -6888,110 +7567,69 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
     // Pack.
     e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMPackSHORT_2));
   }
-  static __m128i EmulatePackUINT_2101010(void*, __m128i src1) {
-    // https://www.opengl.org/registry/specs/ARB/vertex_type_2_10_10_10_rev.txt
-    union {
-      alignas(16) int32_t a_i[4];
-      alignas(16) uint32_t a_u[4];
-      alignas(16) float a_f[4];
-    };
-    alignas(16) uint32_t b[4];
-    alignas(16) uint32_t c[4];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a_u), src1);
-    // XYZ are 10 bits, signed and saturated.
-    for (int i = 0; i < 3; ++i) {
-      static const int32_t kMinValueXYZ = 0x403FFE01;  // 3 - 1FF / (1 << 22)
-      static const int32_t kMaxValueXYZ = 0x404001FF;  // 3 + 1FF / (1 << 22)
-      uint32_t exponent = (a_u[i] >> 23) & 0xFF;
-      uint32_t fractional = a_u[i] & 0x007FFFFF;
-      if ((exponent == 0xFF) && fractional) {
-        b[i] = 0x200;
-      } else if (a_i[i] > kMaxValueXYZ) {
-        b[i] = 0x1FF;  // INT_MAX
-      } else if (a_i[i] < kMinValueXYZ) {
-        b[i] = 0x201;  // -INT_MAX
-      } else {
-        b[i] = a_u[i] & 0x3FF;
-      }
-    }
-    // W is 2 bits, unsigned and saturated.
-    static const int32_t kMinValueW = 0x40400000;  // 3
-    static const int32_t kMaxValueW = 0x40400003;  // 3 + 3 / (1 << 22)
-    uint32_t w_exponent = (a_u[3] >> 23) & 0xFF;
-    uint32_t w_fractional = a_u[3] & 0x007FFFFF;
-    if ((w_exponent == 0xFF) && w_fractional) {
-      b[3] = 0x0;
-    } else if (a_i[3] > kMaxValueW) {
-      b[3] = 0x3;
-    } else if (a_i[3] < kMinValueW) {
-      b[3] = 0x0;
-    } else {
-      b[3] = a_u[3] & 0x3;
-    }
-    // Combine in 2101010 WZYX.
-    c[0] = c[1] = c[2] = 0;
-    c[3] = ((b[3] & 0x3) << 30) | ((b[2] & 0x3FF) << 20) |
-           ((b[1] & 0x3FF) << 10) | ((b[0] & 0x3FF));
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
-  }
   static void EmitUINT_2101010(X64Emitter& e, const EmitArgType& i) {
     assert_true(i.src2.value->IsConstantZero());
     // dest = [(b2(src1.w), b10(src1.z), b10(src1.y), b10(src1.x)), 0, 0, 0]
-    // TODO(benvanik): optimized version.
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulatePackUINT_2101010));
-    e.vmovaps(i.dest, e.xmm0);
-  }
-  static __m128i EmulatePack8_IN_16_UN_UN_SAT(void*, __m128i src1,
-                                              __m128i src2) {
-    alignas(16) uint16_t a[8];
-    alignas(16) uint16_t b[8];
-    alignas(16) uint8_t c[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (int i = 0; i < 8; ++i) {
-      c[i] = uint8_t(std::max(uint16_t(0), std::min(uint16_t(255), a[i])));
-      c[i + 8] = uint8_t(std::max(uint16_t(0), std::min(uint16_t(255), b[i])));
+    // https://www.opengl.org/registry/specs/ARB/vertex_type_2_10_10_10_rev.txt
+    // Inputs are 3.0 plus the value scaled by 2^-22, so the integer
+    // representation can be clamped directly: XYZ to 3 +/- 0x1FF (signed 10
+    // bits) and W to 3 + [0, 3] (unsigned 2 bits). Anything out of range,
+    // including infinities and negative floats, saturates. NaN gives 0x200
+    // for XYZ and 0 for W.
+    Xmm src;
+    if (i.src1.is_constant) {
+      src = e.xmm0;
+      e.LoadConstantXmm(src, i.src1.constant());
+    } else {
+      src = i.src1;
     }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
-  }
-  static __m128i EmulatePack8_IN_16_UN_UN(void*, __m128i src1, __m128i src2) {
-    alignas(16) uint8_t a[16];
-    alignas(16) uint8_t b[16];
-    alignas(16) uint8_t c[16];
-    _mm_store_si128(reinterpret_cast<__m128i*>(a), src1);
-    _mm_store_si128(reinterpret_cast<__m128i*>(b), src2);
-    for (int i = 0; i < 8; ++i) {
-      c[i] = a[i * 2];
-      c[i + 8] = b[i * 2];
+    e.vpmaxsd(e.xmm1, src,
+              e.GetXmmConstPtr(XMMPackUINT_2101010_MinUnpacked));
+    e.vpminsd(e.xmm1, e.xmm1,
+              e.GetXmmConstPtr(XMMPackUINT_2101010_MaxUnpacked));
+    e.vcmpunordps(e.xmm2, src, src);
+    e.vblendvps(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMPackUINT_2101010_NaN),
+                e.xmm2);
+    e.vpand(e.xmm1, e.xmm1,
+            e.GetXmmConstPtr(XMMPackUINT_2101010_MaskUnpacked));
+    // Shift each field into place and OR them all together into W.
+    if (e.IsFeatureEnabled(kX64EmitAVX2)) {
+      e.vpsllvd(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMPackUINT_2101010_Shift));
+    } else {
+      e.vpmulld(e.xmm1, e.xmm1,
+                e.GetXmmConstPtr(XMMPackUINT_2101010_Multiplier));
     }
-    return _mm_load_si128(reinterpret_cast<__m128i*>(c));
+    e.vpshufd(e.xmm2, e.xmm1, 0b01001110);
+    e.vpor(e.xmm1, e.xmm1, e.xmm2);
+    e.vpshufd(e.xmm2, e.xmm1, 0b10110001);
+    e.vpor(e.xmm1, e.xmm1, e.xmm2);
+    e.vpxor(e.xmm2, e.xmm2);
+    e.vpblendw(i.dest, e.xmm2, e.xmm1, 0b11000000);
   }
   static void Emit8_IN_16(X64Emitter& e, const EmitArgType& i, uint32_t flags) {
     // TODO(benvanik): handle src2 (or src1) being constant zero
     if (IsPackInUnsigned(flags)) {
       if (IsPackOutUnsigned(flags)) {
+        // Bring each word into [0, 255] so that PACKUSWB (which takes signed
+        // words) can't saturate.
+        Xmm src2;
+        if (i.src2.is_constant) {
+          src2 = e.xmm0;
+          e.LoadConstantXmm(src2, i.src2.constant());
+        } else {
+          src2 = i.src2;
+        }
         if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
-          if (i.src2.is_constant) {
-            e.LoadConstantXmm(e.xmm0, i.src2.constant());
-            e.lea(e.r9, e.StashXmm(1, e.xmm0));
-          } else {
-            e.lea(e.r9, e.StashXmm(1, i.src2));
-          }
-          e.lea(e.r8, e.StashXmm(0, i.src1));
-          e.CallNativeSafe(
-              reinterpret_cast<void*>(EmulatePack8_IN_16_UN_UN_SAT));
-          e.vmovaps(i.dest, e.xmm0);
-          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+          e.vpminuw(e.xmm1, i.src1, e.GetXmmConstPtr(XMMMaskEvenPI8));
+          e.vpminuw(e.xmm0, src2, e.GetXmmConstPtr(XMMMaskEvenPI8));
         } else {
           // unsigned -> unsigned
-          e.lea(e.r9, e.StashXmm(1, i.src2));
-          e.lea(e.r8, e.StashXmm(0, i.src1));
-          e.CallNativeSafe(reinterpret_cast<void*>(EmulatePack8_IN_16_UN_UN));
-          e.vmovaps(i.dest, e.xmm0);
-          e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
+          e.vpand(e.xmm1, i.src1, e.GetXmmConstPtr(XMMMaskEvenPI8));
+          e.vpand(e.xmm0, src2, e.GetXmmConstPtr(XMMMaskEvenPI8));
         }
+        e.vpackuswb(i.dest, e.xmm1, e.xmm0);
+        e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteOrderMask));
       } else {
         if (IsPackOutSaturate(flags)) {
           // unsigned -> signed + saturate
@@ -7037,28 +7675,13 @@ struct PACK : Sequence<PACK, I<OPCODE_PACK, V128Op, V128Op, V128Op>> {
       if (IsPackOutUnsigned(flags)) {
         if (IsPackOutSaturate(flags)) {
           // unsigned -> unsigned + saturate
-          // Construct a saturation mask
-          e.mov(e.eax, ~0xFFFFu);
-          e.vmovd(e.xmm0, e.eax);
-          e.vpshufd(e.xmm0, e.xmm0, 0b00000000);
-
-          e.vandps(e.xmm1, e.xmm0, i.src1);  // src1 & 0xFFFF0000
-          e.vpcmpeqd(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMZero));
-          e.vpxor(e.xmm1, e.xmm1, e.GetXmmConstPtr(XMMFFFF));
-          e.vpor(e.xmm1, e.xmm1, i.src1);  // Saturate src1
-          e.vpshuflw(e.xmm1, e.xmm1, 0b00100010);
-          e.vpshufhw(e.xmm1, e.xmm1, 0b00100010);
-          e.vpshufd(e.xmm1, e.xmm1, 0b00001000);
-
-          e.vandps(e.xmm0, e.xmm0, i.src2);  // src2 & 0xFFFF0000
-          e.vpcmpeqd(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMZero));
-          e.vpxor(e.xmm0, e.xmm0, e.GetXmmConstPtr(XMMFFFF));
-          e.vpor(i.dest, e.xmm0, i.src2);  // Saturate src2
-          e.vpshuflw(i.dest, i.dest, 0b00100010);
-          e.vpshufhw(i.dest, i.dest, 0b00100010);
-          e.vpshufd(i.dest, i.dest, 0b10000000);
-
-          e.vpblendw(i.dest, i.dest, e.xmm1, 0b00001111);
+          // Clamp to 0xFFFF so that PACKUSDW (which takes signed dwords)
+          // only sees values it won't saturate.
+          e.vpminud(e.xmm1, i.src1, e.GetXmmConstPtr(XMMMaskEvenPI16));
+          e.vpminud(e.xmm0, i.src2, e.GetXmmConstPtr(XMMMaskEvenPI16));
+          e.vpackusdw(i.dest, e.xmm1, e.xmm0);
+          e.vpshuflw(i.dest, i.dest, B10110001);
+          e.vpshufhw(i.dest, i.dest, B10110001);
         } else {
           // unsigned -> unsigned
           e.vmovaps(e.xmm0, i.src1);
@@ -7244,9 +7867,16 @@ struct UNPACK : Sequence<UNPACK, I<OPCODE_UNPACK, V128Op, V128Op>> {
     return _mm_load_ps(b);
   }
   static void EmitFLOAT16_3(X64Emitter& e, const EmitArgType& i) {
-    e.lea(e.r8, e.StashXmm(0, i.src1));
-    e.CallNativeSafe(reinterpret_cast<void*>(EmulateFLOAT16_3));
-    e.vmovaps(i.dest, e.xmm0);
+    if (e.IsFeatureEnabled(kX64EmitF16C)) {
+      // Shuffle to 0|0|0|0|0|Z|Y|X
+      e.vpshufb(i.dest, i.src1, e.GetXmmConstPtr(XMMUnpackFLOAT16_3));
+      e.vcvtph2ps(i.dest, i.dest);
+      e.vpor(i.dest, e.GetXmmConstPtr(XMM0001));
+    } else {
+      e.lea(e.r8, e.StashXmm(0, i.src1));
+      e.CallNativeSafe(reinterpret_cast<void*>(EmulateFLOAT16_3));
+      e.vmovaps(i.dest, e.xmm0);
+    }
   }
   static __m128 EmulateFLOAT16_4(void*, __m128i src1) {
     alignas(16) uint16_t a[8];
@@ -7617,6 +8247,7 @@ bool SelectSequence(X64Emitter* e, const Instr* i, const Instr** new_tail) {
   auto it = sequence_table.find(key);
   if (it != sequence_table.end()) {
     if (it->second(*e, i)) {
+      UpdateFlagsCompare(*e, i);
       *new_tail = i->next;
       return true;
     }
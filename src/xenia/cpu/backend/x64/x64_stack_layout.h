@@ -29,8 +29,9 @@ namespace x64 {
  *  |                  |
  *  |                  |
  *  +------------------+
- *  | scratch, 16b     | rsp + 32
- *  |                  |
+ *  | park link        | rsp + 32
+ *  +------------------+
+ *  | scratch, 8b      | rsp + 40
  *  +------------------+
  *  | rbx              | rsp + 48
  *  +------------------+
@@ -116,6 +117,9 @@ namespace x64 {
 class StackLayout {
  public:
   static const size_t THUNK_STACK_SIZE = 120;
+  // Stack pointer of the thunk the thread was parked in before, while a call
+  // out of guest code is in progress.
+  static const size_t THUNK_PARK_LINK = 32;
 
   static const size_t GUEST_STACK_SIZE = 104;
   static const size_t GUEST_RCX_HOME = 80;
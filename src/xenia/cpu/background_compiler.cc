@@ -0,0 +1,185 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/background_compiler.h"
+
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+#include "xenia/base/string.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/module.h"
+#include "xenia/cpu/ppc/ppc_scanner.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+
+// Set on background compiler threads so that call targets they discover don't
+// jump ahead of the ones found by guest threads.
+static thread_local bool is_background_compiler_thread = false;
+
+BackgroundCompiler::BackgroundCompiler(Processor* processor)
+    : processor_(processor) {}
+
+BackgroundCompiler::~BackgroundCompiler() { Shutdown(); }
+
+bool BackgroundCompiler::Initialize(uint32_t thread_count) {
+  work_event_ = xe::threading::Event::CreateManualResetEvent(false);
+  if (!work_event_) {
+    return false;
+  }
+
+  running_ = true;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    auto thread =
+        xe::threading::Thread::Create({}, [this]() { WorkerThread(); });
+    if (!thread) {
+      XELOGE("Unable to create background compiler thread");
+      Shutdown();
+      return false;
+    }
+    thread->set_name(xe::format_string("Background Compiler %u", i));
+    thread->set_priority(xe::threading::ThreadPriority::kBelowNormal);
+    threads_.push_back(std::move(thread));
+  }
+
+  XELOGI("Background compilation enabled with %u threads", thread_count);
+  return true;
+}
+
+void BackgroundCompiler::Shutdown() {
+  if (!running_) {
+    return;
+  }
+  {
+    // Under the queue lock so that a worker can't miss the wakeup between
+    // checking running_ and resetting the event.
+    auto global_lock = global_critical_region_.Acquire();
+    running_ = false;
+    work_event_->Set();
+  }
+  for (auto& thread : threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  threads_.clear();
+}
+
+void BackgroundCompiler::QueueModule(Module* module) {
+  std::vector<uint32_t> addresses;
+  module->ForEachFunction([&addresses](Function* function) {
+    if (function->is_guest()) {
+      addresses.push_back(function->address());
+    }
+  });
+  for (auto address : addresses) {
+    Queue(address, false);
+  }
+}
+
+void BackgroundCompiler::QueueCallTargets(Function* function) {
+  if (!function->is_guest()) {
+    return;
+  }
+  ppc::PPCScanner scanner(processor_->frontend());
+  auto call_targets =
+      scanner.FindCallTargets(static_cast<GuestFunction*>(function));
+  bool high_priority = !is_background_compiler_thread;
+  for (auto address : call_targets) {
+    Queue(address, high_priority);
+  }
+}
+
+void BackgroundCompiler::QueueOptimization(GuestFunction* function) {
+  auto global_lock = global_critical_region_.Acquire();
+  optimization_queue_.push_back(function);
+  work_event_->Set();
+}
+
+void BackgroundCompiler::QueueRetranslation(GuestFunction* function) {
+  auto global_lock = global_critical_region_.Acquire();
+  if (!pending_retranslations_.insert(function).second) {
+    return;
+  }
+  retranslation_queue_.push_back(function);
+  work_event_->Set();
+}
+
+void BackgroundCompiler::Queue(uint32_t address, bool high_priority) {
+  if (processor_->QueryFunction(address)) {
+    // Already resolved.
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  if (!queued_addresses_.insert(address).second) {
+    return;
+  }
+  if (high_priority) {
+    queue_.push_front(address);
+  } else {
+    queue_.push_back(address);
+  }
+  work_event_->Set();
+}
+
+void BackgroundCompiler::WorkerThread() {
+  is_background_compiler_thread = true;
+  while (running_) {
+    // Recorded by the exception handler, which can't queue work itself.
+    processor_->ProcessMmioAccessFaults();
+
+    uint32_t address = 0;
+    GuestFunction* hot_function = nullptr;
+    GuestFunction* stale_function = nullptr;
+    {
+      auto global_lock = global_critical_region_.Acquire();
+      if (!optimization_queue_.empty()) {
+        hot_function = optimization_queue_.front();
+        optimization_queue_.pop_front();
+      } else if (!retranslation_queue_.empty()) {
+        stale_function = retranslation_queue_.front();
+        retranslation_queue_.pop_front();
+        pending_retranslations_.erase(stale_function);
+      } else if (!queue_.empty()) {
+        address = queue_.front();
+        queue_.pop_front();
+      } else if (running_) {
+        work_event_->Reset();
+      }
+    }
+    if (hot_function) {
+      SCOPE_profile_cpu_i("cpu", "BackgroundCompiler::Optimize");
+      processor_->OptimizeFunction(hot_function);
+      continue;
+    }
+    if (stale_function) {
+      SCOPE_profile_cpu_i("cpu", "BackgroundCompiler::Retranslate");
+      processor_->RetranslateFunction(stale_function);
+      continue;
+    }
+    if (!address) {
+      processor_->backend()->CompactCodeCache();
+      // Nothing signals new MMIO access faults, so they are polled for.
+      xe::threading::Wait(work_event_.get(), false,
+                          std::chrono::milliseconds(50));
+      continue;
+    }
+
+    SCOPE_profile_cpu_i("cpu", "BackgroundCompiler::Compile");
+
+    // This will either translate the function on this thread or, if a guest
+    // thread got there first, wait for it to finish. Any call targets are
+    // queued by the processor once the function is defined.
+    if (processor_->ResolveFunction(address)) {
+      ++compiled_count_;
+    }
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
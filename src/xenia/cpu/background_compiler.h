@@ -0,0 +1,89 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKGROUND_COMPILER_H_
+#define XENIA_CPU_BACKGROUND_COMPILER_H_
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+class Function;
+class GuestFunction;
+class Module;
+class Processor;
+
+// Translates guest functions on a pool of host threads ahead of the guest
+// threads needing them.
+// Work is seeded with the functions modules declare at load time and grows by
+// following the direct call targets of every function that gets defined.
+// Results are published through the normal Processor::ResolveFunction path, so
+// a guest thread that calls a function already being compiled in the
+// background waits for it instead of compiling it a second time, and only
+// compiles synchronously if it gets ahead of the queue.
+class BackgroundCompiler {
+ public:
+  explicit BackgroundCompiler(Processor* processor);
+  ~BackgroundCompiler();
+
+  bool Initialize(uint32_t thread_count);
+  void Shutdown();
+
+  // Queues all guest functions currently declared in the module.
+  void QueueModule(Module* module);
+
+  // Queues the direct call targets of a newly defined function.
+  // Targets found from functions defined by guest threads are placed at the
+  // front of the queue, as those are the ones the guest will need next.
+  void QueueCallTargets(Function* function);
+
+  // Queues a hot baseline function to be recompiled with all optimizations.
+  // These take priority over everything else.
+  void QueueOptimization(GuestFunction* function);
+
+  // Queues a defined function to be translated again as something it depends
+  // on has changed. A function already waiting is only queued once.
+  void QueueRetranslation(GuestFunction* function);
+
+  // Number of functions resolved by the background threads so far.
+  uint32_t compiled_count() const { return compiled_count_; }
+
+ private:
+  void Queue(uint32_t address, bool high_priority);
+  void WorkerThread();
+
+  Processor* processor_ = nullptr;
+
+  std::atomic<bool> running_ = {false};
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads_;
+  // Signaled whenever there is work in the queue.
+  std::unique_ptr<xe::threading::Event> work_event_;
+
+  xe::global_critical_region global_critical_region_;
+  std::deque<uint32_t> queue_;
+  std::deque<GuestFunction*> optimization_queue_;
+  std::deque<GuestFunction*> retranslation_queue_;
+  std::unordered_set<GuestFunction*> pending_retranslations_;
+  // Every address ever queued, so that each is only visited once.
+  std::unordered_set<uint32_t> queued_addresses_;
+  std::atomic<uint32_t> compiled_count_ = {0};
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKGROUND_COMPILER_H_
@@ -9,30 +9,193 @@
 
 #include "xenia/cpu/compiler/compiler.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <mutex>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/string.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/cpu_flags.h"
 
 namespace xe {
 namespace cpu {
 namespace compiler {
 
+namespace {
+
+// Statistics of destroyed compilers, merged by pass name.
+std::mutex global_pass_stats_mutex;
+std::vector<Compiler::PassStats> global_pass_stats;
+
+void MergePassStats(const std::vector<Compiler::PassStats>& pass_stats) {
+  std::lock_guard<std::mutex> lock(global_pass_stats_mutex);
+  for (auto& stats : pass_stats) {
+    Compiler::PassStats* total = nullptr;
+    for (auto& existing : global_pass_stats) {
+      if (!std::strcmp(existing.name, stats.name)) {
+        total = &existing;
+        break;
+      }
+    }
+    if (!total) {
+      global_pass_stats.emplace_back();
+      total = &global_pass_stats.back();
+      total->name = stats.name;
+    }
+    total->run_count += stats.run_count;
+    total->change_count += stats.change_count;
+    total->host_ticks += stats.host_ticks;
+    total->instrs_before += stats.instrs_before;
+    total->instrs_after += stats.instrs_after;
+    total->scratch_arena_bytes += stats.scratch_arena_bytes;
+    total->hir_arena_bytes += stats.hir_arena_bytes;
+    for (size_t i = 0; i < Compiler::kTimeHistogramBucketCount; ++i) {
+      total->time_histogram[i] += stats.time_histogram[i];
+    }
+  }
+}
+
+uint64_t CountInstrs(hir::HIRBuilder* builder) {
+  uint64_t count = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+}  // namespace
+
+Compiler::PassScope::PassScope(Compiler* compiler, CompilerPass* pass,
+                               hir::HIRBuilder* builder)
+    : compiler_(compiler), pass_(pass), builder_(builder) {
+  compiler_->scratch_arena_.Reset();
+  if (FLAGS_compile_stats) {
+    instrs_before_ = CountInstrs(builder_);
+    hir_arena_before_ = builder_->arena()->CalculateSize();
+    parent_ = compiler_->active_pass_scope_;
+    compiler_->active_pass_scope_ = this;
+    start_ticks_ = Clock::QueryHostTickCount();
+  }
+}
+
+Compiler::PassScope::~PassScope() {
+  if (!FLAGS_compile_stats) {
+    return;
+  }
+  uint64_t total_ticks = Clock::QueryHostTickCount() - start_ticks_;
+  compiler_->active_pass_scope_ = parent_;
+  if (parent_) {
+    parent_->nested_ticks_ += total_ticks;
+  }
+  uint64_t ticks = total_ticks - std::min(nested_ticks_, total_ticks);
+  auto stats = compiler_->LookupPassStats(pass_);
+  ++stats->run_count;
+  if (changed_) {
+    ++stats->change_count;
+  }
+  stats->host_ticks += ticks;
+  uint64_t us = ticks * 1000000 / Clock::host_tick_frequency();
+  size_t bucket = 0;
+  while (us && bucket < kTimeHistogramBucketCount - 1) {
+    us >>= 1;
+    ++bucket;
+  }
+  ++stats->time_histogram[bucket];
+  stats->instrs_before += instrs_before_;
+  stats->instrs_after += CountInstrs(builder_);
+  stats->scratch_arena_bytes += compiler_->scratch_arena_.CalculateSize();
+  stats->hir_arena_bytes +=
+      builder_->arena()->CalculateSize() - hir_arena_before_;
+}
+
 Compiler::Compiler(Processor* processor) : processor_(processor) {}
 
-Compiler::~Compiler() { Reset(); }
+Compiler::~Compiler() {
+  Reset();
+  if (!pass_stats_.empty()) {
+    MergePassStats(pass_stats_);
+  }
+}
+
+Compiler::PassStats* Compiler::LookupPassStats(CompilerPass* pass) {
+  for (size_t i = 0; i < pass_stats_passes_.size(); ++i) {
+    if (pass_stats_passes_[i] == pass) {
+      return &pass_stats_[i];
+    }
+  }
+  pass_stats_passes_.push_back(pass);
+  pass_stats_.emplace_back();
+  pass_stats_.back().name = pass->name();
+  return &pass_stats_.back();
+}
+
+std::vector<Compiler::PassStats> Compiler::GlobalStatistics() {
+  std::lock_guard<std::mutex> lock(global_pass_stats_mutex);
+  return global_pass_stats;
+}
+
+void Compiler::LogStatistics() {
+  std::lock_guard<std::mutex> lock(global_pass_stats_mutex);
+  if (global_pass_stats.empty()) {
+    return;
+  }
+  XELOGI("Compiler pass statistics:");
+  XELOGI("  %-28s %8s %8s %10s %12s %12s %10s %10s", "pass", "runs",
+         "changed", "ms", "instrs in", "instrs out", "scratch KB", "HIR KB");
+  for (auto& stats : global_pass_stats) {
+    XELOGI("  %-28s %8" PRIu64 " %8" PRIu64 " %10.2f %12" PRIu64 " %12" PRIu64
+           " %10" PRIu64 " %10" PRIu64,
+           stats.name, stats.run_count, stats.change_count,
+           double(stats.host_ticks) * 1000.0 /
+               double(Clock::host_tick_frequency()),
+           stats.instrs_before, stats.instrs_after,
+           stats.scratch_arena_bytes / 1024, stats.hir_arena_bytes / 1024);
+  }
+
+  // Bucket n counts runs under 2^n us; the last is everything slower.
+  std::string header;
+  for (size_t i = 0; i < kTimeHistogramBucketCount - 1; ++i) {
+    header += xe::format_string(" %7s",
+                                xe::format_string("<%u", 1u << i).c_str());
+  }
+  header += xe::format_string(
+      " %7s",
+      xe::format_string(">=%u", 1u << (kTimeHistogramBucketCount - 2))
+          .c_str());
+  XELOGI("Compiler pass run times (us):");
+  XELOGI("  %-28s%s", "pass", header.c_str());
+  for (auto& stats : global_pass_stats) {
+    std::string buckets;
+    for (size_t i = 0; i < kTimeHistogramBucketCount; ++i) {
+      buckets += xe::format_string(" %7" PRIu64, stats.time_histogram[i]);
+    }
+    XELOGI("  %-28s%s", stats.name, buckets.c_str());
+  }
+}
 
 void Compiler::AddPass(std::unique_ptr<CompilerPass> pass) {
   pass->Initialize(this);
   passes_.push_back(std::move(pass));
 }
 
-void Compiler::Reset() {}
+void Compiler::Reset() { profile_ = nullptr; }
+
+bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder,
+                       const FunctionProfile* profile) {
+  profile_ = profile;
 
-bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
-  // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
-  //                 stop changing things, etc.
+  // TODO(benvanik): sophisticated stuff. Run passes in parallel, etc.
+  // Passes that should run until they stop changing things are grouped in a
+  // ConditionalGroupPass.
   for (size_t i = 0; i < passes_.size(); ++i) {
     auto& pass = passes_[i];
-    scratch_arena_.Reset();
+    PassScope pass_scope(this, pass.get(), builder);
     if (!pass->Run(builder)) {
       return false;
     }
@@ -18,6 +18,7 @@
 
 namespace xe {
 namespace cpu {
+class FunctionProfile;
 class Processor;
 }  // namespace cpu
 }  // namespace xe
@@ -30,6 +31,49 @@ class CompilerPass;
 
 class Compiler {
  public:
+  // Runs taking under 2^n microseconds are counted in bucket n, and anything
+  // slower in the last.
+  static const size_t kTimeHistogramBucketCount = 16;
+
+  // Statistics for a single pass, accumulated over every function compiled.
+  struct PassStats {
+    const char* name = nullptr;
+    uint64_t run_count = 0;
+    // Runs after which the pass reported having changed something, for passes
+    // that report it.
+    uint64_t change_count = 0;
+    uint64_t host_ticks = 0;
+    uint64_t instrs_before = 0;
+    uint64_t instrs_after = 0;
+    // Bytes of scratch arena used and of HIR arena added.
+    uint64_t scratch_arena_bytes = 0;
+    uint64_t hir_arena_bytes = 0;
+    uint64_t time_histogram[kTimeHistogramBucketCount] = {0};
+  };
+
+  // Runs a pass with statistics collection (if enabled). Passes running other
+  // passes use this so that each is accounted for individually: time spent in
+  // a nested scope is only counted for the inner pass, not the outer one.
+  class PassScope {
+   public:
+    PassScope(Compiler* compiler, CompilerPass* pass,
+              hir::HIRBuilder* builder);
+    ~PassScope();
+
+    void set_changed(bool changed) { changed_ = changed; }
+
+   private:
+    Compiler* compiler_;
+    CompilerPass* pass_;
+    hir::HIRBuilder* builder_;
+    PassScope* parent_ = nullptr;
+    bool changed_ = false;
+    uint64_t start_ticks_ = 0;
+    uint64_t nested_ticks_ = 0;
+    uint64_t instrs_before_ = 0;
+    size_t hir_arena_before_ = 0;
+  };
+
   explicit Compiler(Processor* processor);
   ~Compiler();
 
@@ -40,13 +84,33 @@ class Compiler {
 
   void Reset();
 
-  bool Compile(hir::HIRBuilder* builder);
+  // Profile of the function being compiled, if one was recorded.
+  const FunctionProfile* profile() const { return profile_; }
+
+  bool Compile(hir::HIRBuilder* builder,
+               const FunctionProfile* profile = nullptr);
+
+  // Statistics of this compiler's passes, in the order first run.
+  const std::vector<PassStats>& pass_stats() const { return pass_stats_; }
+
+  // Statistics of all compilers destroyed so far, merged by pass.
+  static std::vector<PassStats> GlobalStatistics();
+  // Logs the statistics of all compilers destroyed so far, merged by pass.
+  static void LogStatistics();
 
  private:
+  PassStats* LookupPassStats(CompilerPass* pass);
+
   Processor* processor_;
+  const FunctionProfile* profile_ = nullptr;
   Arena scratch_arena_;
 
   std::vector<std::unique_ptr<CompilerPass>> passes_;
+
+  std::vector<PassStats> pass_stats_;
+  std::vector<const CompilerPass*> pass_stats_passes_;
+  // Innermost pass running with statistics collection.
+  PassScope* active_pass_scope_ = nullptr;
 };
 
 }  // namespace compiler
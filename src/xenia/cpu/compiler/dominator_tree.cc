@@ -0,0 +1,154 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/dominator_tree.h"
+
+#include <utility>
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+
+Block* DominatorTree::GetBranchTarget(const Instr* i) {
+  if (i->opcode == &OPCODE_BRANCH_info) {
+    return i->src1.label->block;
+  } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+             i->opcode == &OPCODE_BRANCH_FALSE_info) {
+    return i->src2.label->block;
+  }
+  return nullptr;
+}
+
+void DominatorTree::Build(HIRBuilder* builder) {
+  blocks_.clear();
+  uint16_t block_ordinal = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    block->ordinal = block_ordinal++;
+    blocks_.push_back(block);
+  }
+  size_t block_count = blocks_.size();
+  successors_.assign(block_count, {});
+  predecessors_.assign(block_count, {});
+  dominated_.assign(block_count, {});
+  rpo_blocks_.clear();
+  rpo_numbers_.assign(block_count, -1);
+  idoms_.assign(block_count, -1);
+  if (!block_count) {
+    return;
+  }
+
+  for (auto block : blocks_) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      auto target = GetBranchTarget(i);
+      if (target) {
+        successors_[block->ordinal].push_back(target);
+      }
+    }
+  }
+
+  // Reverse postorder of everything reachable from the entry.
+  std::vector<bool> visited(block_count, false);
+  std::vector<std::pair<Block*, size_t>> stack;
+  std::vector<Block*> postorder;
+  visited[0] = true;
+  stack.emplace_back(blocks_[0], 0);
+  while (!stack.empty()) {
+    auto block = stack.back().first;
+    auto& successors = successors_[block->ordinal];
+    if (stack.back().second < successors.size()) {
+      auto successor = successors[stack.back().second++];
+      if (!visited[successor->ordinal]) {
+        visited[successor->ordinal] = true;
+        stack.emplace_back(successor, 0);
+      }
+    } else {
+      postorder.push_back(block);
+      stack.pop_back();
+    }
+  }
+  rpo_blocks_.assign(postorder.rbegin(), postorder.rend());
+  for (size_t n = 0; n < rpo_blocks_.size(); ++n) {
+    rpo_numbers_[rpo_blocks_[n]->ordinal] = static_cast<int32_t>(n);
+  }
+  for (auto block : rpo_blocks_) {
+    for (auto successor : successors_[block->ordinal]) {
+      predecessors_[successor->ordinal].push_back(block);
+    }
+  }
+
+  // Cooper, Harvey, Kennedy: "A Simple, Fast Dominance Algorithm".
+  idoms_[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t n = 1; n < rpo_blocks_.size(); ++n) {
+      auto block = rpo_blocks_[n];
+      int32_t new_idom = -1;
+      for (auto predecessor : predecessors_[block->ordinal]) {
+        int32_t p = predecessor->ordinal;
+        if (idoms_[p] == -1) {
+          continue;
+        }
+        new_idom = new_idom == -1 ? p : Intersect(p, new_idom);
+      }
+      if (idoms_[block->ordinal] != new_idom) {
+        idoms_[block->ordinal] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  for (size_t n = 1; n < rpo_blocks_.size(); ++n) {
+    auto block = rpo_blocks_[n];
+    dominated_[idoms_[block->ordinal]].push_back(block);
+  }
+}
+
+int32_t DominatorTree::Intersect(int32_t a, int32_t b) const {
+  while (a != b) {
+    while (rpo_numbers_[a] > rpo_numbers_[b]) {
+      a = idoms_[a];
+    }
+    while (rpo_numbers_[b] > rpo_numbers_[a]) {
+      b = idoms_[b];
+    }
+  }
+  return a;
+}
+
+Block* DominatorTree::immediate_dominator(const Block* block) const {
+  if (!block->ordinal || idoms_[block->ordinal] == -1) {
+    return nullptr;
+  }
+  return blocks_[idoms_[block->ordinal]];
+}
+
+bool DominatorTree::Dominates(const Block* dominator,
+                              const Block* block) const {
+  if (!IsReachable(dominator) || !IsReachable(block)) {
+    return false;
+  }
+  int32_t target = dominator->ordinal;
+  int32_t n = block->ordinal;
+  while (rpo_numbers_[n] > rpo_numbers_[target]) {
+    n = idoms_[n];
+  }
+  return n == target;
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
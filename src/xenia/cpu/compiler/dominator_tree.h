@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_DOMINATOR_TREE_H_
+#define XENIA_CPU_COMPILER_DOMINATOR_TREE_H_
+
+#include <vector>
+
+#include "xenia/cpu/hir/hir_builder.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Dominator tree of the blocks reachable from the function entry.
+// Edges are taken from the branch instructions themselves rather than the
+// CFG, so this is valid at any point in the pipeline, including on merged
+// blocks that branch out from the middle.
+// Building renumbers block ordinals in layout order; the tree is invalidated
+// by adding, removing, or retargeting blocks.
+class DominatorTree {
+ public:
+  // Returns the block the instruction branches to, if any.
+  static hir::Block* GetBranchTarget(const hir::Instr* i);
+
+  void Build(hir::HIRBuilder* builder);
+
+  hir::Block* entry_block() const { return blocks_.front(); }
+  // All blocks in layout order, indexed by ordinal.
+  const std::vector<hir::Block*>& blocks() const { return blocks_; }
+  // Reachable blocks in reverse postorder. Dominators come before the blocks
+  // they dominate.
+  const std::vector<hir::Block*>& reverse_postorder() const {
+    return rpo_blocks_;
+  }
+
+  bool IsReachable(const hir::Block* block) const {
+    return rpo_numbers_[block->ordinal] != -1;
+  }
+  const std::vector<hir::Block*>& successors(const hir::Block* block) const {
+    return successors_[block->ordinal];
+  }
+  // Only reachable predecessors are included.
+  const std::vector<hir::Block*>& predecessors(const hir::Block* block) const {
+    return predecessors_[block->ordinal];
+  }
+  // Immediate dominator, or null for the entry and unreachable blocks.
+  hir::Block* immediate_dominator(const hir::Block* block) const;
+  // Blocks immediately dominated by the given block.
+  const std::vector<hir::Block*>& dominated(const hir::Block* block) const {
+    return dominated_[block->ordinal];
+  }
+  bool Dominates(const hir::Block* dominator, const hir::Block* block) const;
+
+ private:
+  int32_t Intersect(int32_t a, int32_t b) const;
+
+  std::vector<hir::Block*> blocks_;
+  std::vector<hir::Block*> rpo_blocks_;
+  // By ordinal; -1 if unreachable.
+  std::vector<int32_t> rpo_numbers_;
+  std::vector<int32_t> idoms_;
+  std::vector<std::vector<hir::Block*>> successors_;
+  std::vector<std::vector<hir::Block*>> predecessors_;
+  std::vector<std::vector<hir::Block*>> dominated_;
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_DOMINATOR_TREE_H_
@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/loop_analysis.h"
+
+#include <algorithm>
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+using xe::cpu::hir::Block;
+
+void LoopAnalysis::Build(const DominatorTree& dominators) {
+  loops_.clear();
+  size_t block_count = dominators.blocks().size();
+
+  for (auto header : dominators.reverse_postorder()) {
+    std::unique_ptr<Loop> loop;
+    for (auto predecessor : dominators.predecessors(header)) {
+      if (!dominators.Dominates(header, predecessor)) {
+        continue;
+      }
+      if (!loop) {
+        loop.reset(new Loop());
+        loop->header = header;
+        loop->members.resize(block_count, false);
+        loop->members[header->ordinal] = true;
+        loop->parent = nullptr;
+        loop->depth = 0;
+      }
+      loop->latches.push_back(predecessor);
+    }
+    if (!loop) {
+      continue;
+    }
+
+    // Walk backwards from the latches until we hit the header.
+    std::vector<Block*> worklist;
+    for (auto latch : loop->latches) {
+      if (!loop->members[latch->ordinal]) {
+        loop->members[latch->ordinal] = true;
+        worklist.push_back(latch);
+      }
+    }
+    while (!worklist.empty()) {
+      auto block = worklist.back();
+      worklist.pop_back();
+      for (auto predecessor : dominators.predecessors(block)) {
+        if (!loop->members[predecessor->ordinal]) {
+          loop->members[predecessor->ordinal] = true;
+          worklist.push_back(predecessor);
+        }
+      }
+    }
+    for (auto block : dominators.reverse_postorder()) {
+      if (loop->members[block->ordinal]) {
+        loop->blocks.push_back(block);
+      }
+    }
+    loops_.push_back(std::move(loop));
+  }
+
+  // Natural loops are either disjoint or nested, so the smallest other loop
+  // containing a header is the parent.
+  std::stable_sort(loops_.begin(), loops_.end(),
+                   [](const std::unique_ptr<Loop>& a,
+                      const std::unique_ptr<Loop>& b) {
+                     return a->blocks.size() < b->blocks.size();
+                   });
+  for (size_t n = 0; n < loops_.size(); ++n) {
+    for (size_t m = n + 1; m < loops_.size(); ++m) {
+      if (Contains(loops_[m].get(), loops_[n]->header)) {
+        loops_[n]->parent = loops_[m].get();
+        break;
+      }
+    }
+  }
+  for (auto& loop : loops_) {
+    for (auto ancestor = loop.get(); ancestor; ancestor = ancestor->parent) {
+      ++loop->depth;
+    }
+  }
+}
+
+void LoopAnalysis::AddBlock(Loop* loop, Block* block, Block* before) {
+  for (; loop; loop = loop->parent) {
+    if (loop->members.size() <= block->ordinal) {
+      loop->members.resize(block->ordinal + 1, false);
+    }
+    loop->members[block->ordinal] = true;
+    auto it = std::find(loop->blocks.begin(), loop->blocks.end(), before);
+    loop->blocks.insert(it, block);
+  }
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
+#define XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
+
+#include <memory>
+#include <vector>
+
+#include "xenia/cpu/compiler/dominator_tree.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+// Natural loops: a back edge is a branch to a block that dominates the
+// branching block, and the loop is every block that can reach the back edge
+// without going through the header. Back edges sharing a header form a single
+// loop. Irreducible cycles are not reported.
+class LoopAnalysis {
+ public:
+  struct Loop {
+    hir::Block* header;
+    // Blocks branching back to the header.
+    std::vector<hir::Block*> latches;
+    // All blocks in the loop, including nested loops, with dominators first.
+    std::vector<hir::Block*> blocks;
+    // Membership by block ordinal.
+    std::vector<bool> members;
+    Loop* parent;
+    // 1 for outermost loops.
+    uint32_t depth;
+  };
+
+  void Build(const DominatorTree& dominators);
+
+  // Innermost loops come before the loops containing them.
+  const std::vector<std::unique_ptr<Loop>>& loops() const { return loops_; }
+
+  static bool Contains(const Loop* loop, const hir::Block* block) {
+    return block->ordinal < loop->members.size() &&
+           loop->members[block->ordinal];
+  }
+
+  // Adds a new block to the loop and all loops containing it, placing it just
+  // before an existing block. The block must already have a unique ordinal.
+  void AddBlock(Loop* loop, hir::Block* block, hir::Block* before);
+
+ private:
+  std::vector<std::unique_ptr<Loop>> loops_;
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_LOOP_ANALYSIS_H_
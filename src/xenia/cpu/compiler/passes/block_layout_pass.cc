@@ -0,0 +1,142 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/block_layout_pass.h"
+
+#include <vector>
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/function_profile.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Label;
+
+BlockLayoutPass::BlockLayoutPass() : CompilerPass() {}
+
+BlockLayoutPass::~BlockLayoutPass() {}
+
+bool BlockLayoutPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  auto profile = compiler_->profile();
+  if (!profile || !profile->has_instruction_counts()) {
+    return true;
+  }
+
+  // Weight each block by how often its first guest instruction executed.
+  // Blocks with no guest instructions inherit the weight of the block before,
+  // as do those starting within inlined callees, which have no counts here.
+  // Block ordinals are used as indices here; they are reassigned by register
+  // allocation later on.
+  std::vector<Block*> blocks;
+  std::vector<uint64_t> weights;
+  uint64_t weight = profile->call_count();
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode == &OPCODE_SOURCE_OFFSET_info) {
+        auto address = uint32_t(i->src1.offset);
+        if (address >= profile->address() &&
+            address <= profile->end_address()) {
+          weight = profile->instruction_count(address);
+        }
+        break;
+      }
+    }
+    block->ordinal = uint16_t(blocks.size());
+    blocks.push_back(block);
+    weights.push_back(weight);
+  }
+  if (blocks.size() < 2 || blocks.size() >= UINT16_MAX) {
+    return true;
+  }
+
+  // Greedily chain each block to its hottest unplaced successor, starting a
+  // new chain at the hottest remaining block when one runs out. The entry
+  // block always stays first.
+  std::vector<bool> placed(blocks.size(), false);
+  std::vector<Block*> order;
+  order.reserve(blocks.size());
+  Block* block = blocks[0];
+  while (block) {
+    placed[block->ordinal] = true;
+    order.push_back(block);
+
+    Block* next_block = nullptr;
+    for (auto i = block->instr_head; i; i = i->next) {
+      Label* label;
+      if (i->opcode == &OPCODE_BRANCH_info) {
+        label = i->src1.label;
+      } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &OPCODE_BRANCH_FALSE_info) {
+        label = i->src2.label;
+      } else {
+        continue;
+      }
+      Block* target = label->block;
+      if (!placed[target->ordinal] &&
+          (!next_block ||
+           weights[target->ordinal] > weights[next_block->ordinal])) {
+        next_block = target;
+      }
+    }
+    if (!next_block) {
+      for (size_t n = 0; n < blocks.size(); ++n) {
+        if (!placed[n] &&
+            (!next_block || weights[n] > weights[next_block->ordinal])) {
+          next_block = blocks[n];
+        }
+      }
+    }
+    block = next_block;
+  }
+  builder->ReorderBlocks(order);
+
+  // Blocks ending in a conditional branch to their new successor followed by
+  // an unconditional branch elsewhere can be inverted so that the hot path
+  // falls through.
+  for (block = builder->first_block(); block; block = block->next) {
+    Instr* tail = block->instr_tail;
+    if (!block->next || !tail || tail->opcode != &OPCODE_BRANCH_info) {
+      continue;
+    }
+    Instr* cond = tail->prev;
+    if (!cond || (cond->opcode != &OPCODE_BRANCH_TRUE_info &&
+                  cond->opcode != &OPCODE_BRANCH_FALSE_info)) {
+      continue;
+    }
+    if (cond->src2.label->block != block->next ||
+        tail->src1.label->block == block->next) {
+      continue;
+    }
+    Label* fall_through_label = cond->src2.label;
+    cond->src2.label = tail->src1.label;
+    tail->src1.label = fall_through_label;
+    cond->opcode = cond->opcode == &OPCODE_BRANCH_TRUE_info
+                       ? &OPCODE_BRANCH_FALSE_info
+                       : &OPCODE_BRANCH_TRUE_info;
+  }
+
+  return true;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,40 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_BLOCK_LAYOUT_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_BLOCK_LAYOUT_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Reorders blocks using a recorded profile so that the hottest successor of
+// each block is laid out directly after it, and flips conditional branches so
+// that the hot path falls through. Never-executed blocks end up at the end of
+// the function.
+// Does nothing if no profile with instruction counts is available.
+class BlockLayoutPass : public CompilerPass {
+ public:
+  BlockLayoutPass();
+  ~BlockLayoutPass() override;
+
+  const char* name() const override { return "block_layout"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_BLOCK_LAYOUT_PASS_H_
@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/conditional_group_pass.h"
+
+#include <algorithm>
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/cpu_flags.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+using xe::cpu::hir::HIRBuilder;
+
+ConditionalGroupPass::ConditionalGroupPass() : CompilerPass() {}
+
+ConditionalGroupPass::~ConditionalGroupPass() = default;
+
+bool ConditionalGroupPass::Initialize(Compiler* compiler) {
+  if (!CompilerPass::Initialize(compiler)) {
+    return false;
+  }
+
+  for (auto& pass : passes_) {
+    if (!pass->Initialize(compiler)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void ConditionalGroupPass::AddPass(
+    std::unique_ptr<ConditionalGroupSubpass> pass) {
+  if (compiler_) {
+    pass->Initialize(compiler_);
+  }
+  passes_.push_back(std::move(pass));
+}
+
+bool ConditionalGroupPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  int32_t max_iterations = std::max(1, FLAGS_max_pass_group_iterations);
+  bool changed = true;
+  for (int32_t iteration = 0; changed && iteration < max_iterations;
+       ++iteration) {
+    changed = false;
+    for (auto& pass : passes_) {
+      Compiler::PassScope pass_scope(compiler_, pass.get(), builder);
+      bool pass_changed = false;
+      if (!pass->Run(builder, pass_changed)) {
+        return false;
+      }
+      pass_scope.set_changed(pass_changed);
+      changed |= pass_changed;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
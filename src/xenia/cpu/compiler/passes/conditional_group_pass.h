@@ -0,0 +1,48 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_CONDITIONAL_GROUP_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_CONDITIONAL_GROUP_PASS_H_
+
+#include <memory>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/passes/conditional_group_subpass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Runs a sequence of subpasses repeatedly until none of them changes anything,
+// up to --max_pass_group_iterations times.
+class ConditionalGroupPass : public CompilerPass {
+ public:
+  ConditionalGroupPass();
+  ~ConditionalGroupPass() override;
+
+  bool Initialize(Compiler* compiler) override;
+
+  const char* name() const override { return "conditional_group"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+  void AddPass(std::unique_ptr<ConditionalGroupSubpass> pass);
+
+ private:
+  std::vector<std::unique_ptr<ConditionalGroupSubpass>> passes_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_CONDITIONAL_GROUP_PASS_H_
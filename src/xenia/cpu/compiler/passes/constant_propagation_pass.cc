@@ -30,11 +30,12 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::TypeName;
 using xe::cpu::hir::Value;
 
-ConstantPropagationPass::ConstantPropagationPass() : CompilerPass() {}
+ConstantPropagationPass::ConstantPropagationPass()
+    : ConditionalGroupSubpass() {}
 
 ConstantPropagationPass::~ConstantPropagationPass() {}
 
-bool ConstantPropagationPass::Run(HIRBuilder* builder) {
+bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& changed) {
   // Once ContextPromotion has run there will likely be a whole slew of
   // constants that can be pushed through the function.
   // Example:
@@ -62,11 +63,18 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
   //   v1 = 19
   //   v2 = 0
 
+  // Every rewrite replaces or removes the instruction being looked at, so
+  // changes are detected by comparing it against how it was before.
+  changed = false;
   auto block = builder->first_block();
   while (block) {
     auto i = block->instr_head;
     while (i) {
       auto v = i->dest;
+      auto opcode = i->opcode;
+      auto src1 = i->src1;
+      auto src2 = i->src2;
+      auto src3 = i->src3;
       switch (i->opcode->num) {
         case OPCODE_DEBUG_BREAK_TRUE:
           if (i->src1.value->IsConstant()) {
@@ -636,6 +644,10 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder) {
           // Ignored.
           break;
       }
+      if (i->opcode != opcode || i->src1.value != src1.value ||
+          i->src2.value != src2.value || i->src3.value != src3.value) {
+        changed = true;
+      }
       i = i->next;
     }
 
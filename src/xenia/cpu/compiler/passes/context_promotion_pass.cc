@@ -67,10 +67,30 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   // instead as it may be faster (at least on the block-level).
 
   // Promote loads to values.
-  // Process each block independently, for now.
+  // Blocks are processed as extended basic blocks: a block with a single
+  // predecessor starts out with the values known where that predecessor
+  // branched to it, as the predecessor dominates it. This requires the CFG.
+  entry_block_ = builder->first_block();
+  uint16_t block_ordinal = 0;
   auto block = builder->first_block();
   while (block) {
-    PromoteBlock(block);
+    block->ordinal = block_ordinal++;
+    block = block->next;
+  }
+  block_promoted_.assign(block_ordinal, false);
+  block = builder->first_block();
+  while (block) {
+    if (!block_promoted_[block->ordinal] && !HasSinglePredecessor(block)) {
+      PromoteExtendedBlock(block);
+    }
+    block = block->next;
+  }
+  // Anything left over is only reachable from itself.
+  block = builder->first_block();
+  while (block) {
+    if (!block_promoted_[block->ordinal]) {
+      PromoteExtendedBlock(block);
+    }
     block = block->next;
   }
 
@@ -88,13 +108,62 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   return true;
 }
 
+bool ContextPromotionPass::HasSinglePredecessor(Block* block) const {
+  // The entry block is also reached from the caller.
+  return block != entry_block_ && block->incoming_edge_head &&
+         !block->incoming_edge_head->incoming_next &&
+         block->incoming_edge_head->src != block;
+}
+
+void ContextPromotionPass::PromoteExtendedBlock(Block* block) {
+  context_validity_.reset();
+  block_promoted_[block->ordinal] = true;
+  PromoteBlock(block);
+  while (!pending_blocks_.empty()) {
+    auto pending = std::move(pending_blocks_.back());
+    pending_blocks_.pop_back();
+    context_validity_.reset();
+    for (auto& entry : pending.values) {
+      context_values_[entry.first] = entry.second;
+      context_validity_.set(entry.first);
+    }
+    PromoteBlock(pending.block);
+  }
+}
+
 void ContextPromotionPass::PromoteBlock(Block* block) {
   auto& validity = context_validity_;
-  validity.reset();
 
   Instr* i = block->instr_head;
   while (i) {
     auto next = i->next;
+    if (i->opcode->flags & OPCODE_FLAG_BRANCH) {
+      // Hand the current values to successors only reachable from here.
+      Block* target = nullptr;
+      if (i->opcode == &OPCODE_BRANCH_info) {
+        target = i->src1.label->block;
+      } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &OPCODE_BRANCH_FALSE_info) {
+        target = i->src2.label->block;
+      }
+      if (target && !block_promoted_[target->ordinal] &&
+          HasSinglePredecessor(target)) {
+        block_promoted_[target->ordinal] = true;
+        PendingBlock pending;
+        pending.block = target;
+        for (int offset = validity.find_first(); offset != -1;
+             offset = validity.find_next(offset)) {
+          pending.values.emplace_back(offset, context_values_[offset]);
+        }
+        pending_blocks_.push_back(std::move(pending));
+      }
+      if (target) {
+        // Branches don't touch the context (conditional ones are only marked
+        // volatile so that they are never removed).
+        i = next;
+        continue;
+      }
+    }
     if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
       // Volatile instruction - requires all context values be flushed.
       validity.reset();
@@ -11,6 +11,7 @@
 #define XENIA_CPU_COMPILER_PASSES_CONTEXT_PROMOTION_PASS_H_
 
 #include <cmath>
+#include <utility>
 #include <vector>
 
 #include "xenia/base/platform.h"
@@ -38,15 +39,29 @@ class ContextPromotionPass : public CompilerPass {
 
   bool Initialize(Compiler* compiler) override;
 
+  const char* name() const override { return "context_promotion"; }
+
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
+  // A block waiting to be promoted with the context values known on entry.
+  struct PendingBlock {
+    hir::Block* block;
+    std::vector<std::pair<uint32_t, hir::Value*>> values;
+  };
+
+  bool HasSinglePredecessor(hir::Block* block) const;
+  void PromoteExtendedBlock(hir::Block* block);
   void PromoteBlock(hir::Block* block);
   void RemoveDeadStoresBlock(hir::Block* block);
 
  private:
   std::vector<hir::Value*> context_values_;
   llvm::BitVector context_validity_;
+
+  hir::Block* entry_block_ = nullptr;
+  std::vector<bool> block_promoted_;
+  std::vector<PendingBlock> pending_blocks_;
 };
 
 }  // namespace passes
@@ -23,11 +23,12 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
 
-DeadCodeEliminationPass::DeadCodeEliminationPass() : CompilerPass() {}
+DeadCodeEliminationPass::DeadCodeEliminationPass()
+    : ConditionalGroupSubpass() {}
 
 DeadCodeEliminationPass::~DeadCodeEliminationPass() {}
 
-bool DeadCodeEliminationPass::Run(HIRBuilder* builder) {
+bool DeadCodeEliminationPass::Run(HIRBuilder* builder, bool& changed) {
   // ContextPromotion/DSE will likely leave around a lot of dead statements.
   // Code generated for comparison/testing produces many unused statements and
   // with proper use analysis it should be possible to remove most of them:
@@ -66,6 +67,7 @@ bool DeadCodeEliminationPass::Run(HIRBuilder* builder) {
 
   bool any_instr_removed = false;
   bool any_locals_removed = false;
+  bool any_assignment_removed = false;
   auto block = builder->first_block();
   while (block) {
     // Walk instructions in reverse.
@@ -83,6 +85,7 @@ bool DeadCodeEliminationPass::Run(HIRBuilder* builder) {
         // Assignment. These are useless, so just try to remove by completely
         // replacing the value.
         ReplaceAssignment(i);
+        any_assignment_removed = true;
       }
 
       i = prev;
@@ -143,6 +146,7 @@ bool DeadCodeEliminationPass::Run(HIRBuilder* builder) {
     }
   }
 
+  changed = any_instr_removed || any_locals_removed || any_assignment_removed;
   return true;
 }
 
@@ -0,0 +1,320 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/dead_store_elimination_pass.h"
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/processor.h"
+
+DECLARE_bool(debug);
+DECLARE_bool(store_all_context_values);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+DeadStoreEliminationPass::DeadStoreEliminationPass() : CompilerPass() {}
+
+DeadStoreEliminationPass::~DeadStoreEliminationPass() {}
+
+bool DeadStoreEliminationPass::Initialize(Compiler* compiler) {
+  if (!CompilerPass::Initialize(compiler)) {
+    return false;
+  }
+
+  offset_indices_.resize(sizeof(ppc::PPCContext));
+  live_.resize(static_cast<uint32_t>(sizeof(ppc::PPCContext)));
+
+  return true;
+}
+
+bool DeadStoreEliminationPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  blocks_.clear();
+  uint16_t block_ordinal = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_ordinal++;
+    blocks_.push_back(block);
+    block = block->next;
+  }
+
+  IndexContextAccesses(builder);
+  if (offsets_.empty()) {
+    return true;
+  }
+
+  // Promote loads of values available on all incoming paths. Block-local
+  // cases have already been handled by ContextPromotionPass, so this mostly
+  // catches values flowing around loops and into join points.
+  PromoteLoads(builder);
+
+  // Remove stores that are never observed.
+  // Like ContextPromotionPass this loses values we could otherwise recover
+  // when debugging.
+  if (!FLAGS_debug && !FLAGS_store_all_context_values) {
+    RemoveDeadStores(builder);
+  }
+
+  return true;
+}
+
+Block* DeadStoreEliminationPass::GetBranchTarget(const Instr* i) {
+  if (i->opcode == &OPCODE_BRANCH_info) {
+    return i->src1.label->block;
+  } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+             i->opcode == &OPCODE_BRANCH_FALSE_info) {
+    return i->src2.label->block;
+  }
+  return nullptr;
+}
+
+bool DeadStoreEliminationPass::IsContextEscape(const Instr* i) {
+  // Anything volatile (calls, returns, traps) may read or write the whole
+  // context. Barriers ask for the same treatment explicitly.
+  return (i->opcode->flags & OPCODE_FLAG_VOLATILE) ||
+         i->opcode == &OPCODE_CONTEXT_BARRIER_info;
+}
+
+void DeadStoreEliminationPass::IndexContextAccesses(HIRBuilder* builder) {
+  std::fill(offset_indices_.begin(), offset_indices_.end(), -1);
+  offsets_.clear();
+  offset_sizes_.clear();
+  for (auto block : blocks_) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      uint32_t offset;
+      uint32_t size;
+      if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+        offset = static_cast<uint32_t>(i->src1.offset);
+        size = static_cast<uint32_t>(GetTypeSize(i->dest->type));
+      } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        offset = static_cast<uint32_t>(i->src1.offset);
+        size = static_cast<uint32_t>(GetTypeSize(i->src2.value->type));
+      } else {
+        continue;
+      }
+      int32_t index = offset_indices_[offset];
+      if (index == -1) {
+        index = static_cast<int32_t>(offsets_.size());
+        offset_indices_[offset] = index;
+        offsets_.push_back(offset);
+        offset_sizes_.push_back(size);
+      } else {
+        offset_sizes_[index] = std::max(offset_sizes_[index], size);
+      }
+    }
+  }
+}
+
+void DeadStoreEliminationPass::PromoteLoads(HIRBuilder* builder) {
+  // Forward must-availability over the tracked offsets. A null entry means no
+  // single value is known. Blocks start out unreached so that loop back edges
+  // don't pessimize headers before the loop body has been seen; once an entry
+  // is found to be null it stays null, which guarantees termination.
+  size_t block_count = blocks_.size();
+  std::vector<Value*> unknown(offsets_.size(), nullptr);
+  block_values_.assign(block_count, unknown);
+  incoming_values_.assign(block_count, unknown);
+  block_reached_.assign(block_count, false);
+  // The entry block is also reached from the caller, with nothing known.
+  block_reached_[0] = true;
+
+  std::vector<Value*> values;
+  bool changed = true;
+  while (changed) {
+    incoming_reached_.assign(block_count, false);
+    for (auto block : blocks_) {
+      if (block_reached_[block->ordinal]) {
+        values = block_values_[block->ordinal];
+        PromoteBlock(block, values, false);
+      }
+    }
+    changed = false;
+    for (size_t n = 1; n < block_count; ++n) {
+      if (!incoming_reached_[n]) {
+        continue;
+      }
+      auto& incoming = incoming_values_[n];
+      auto& current = block_values_[n];
+      if (block_reached_[n]) {
+        for (size_t k = 0; k < incoming.size(); ++k) {
+          if (!current[k]) {
+            incoming[k] = nullptr;
+          }
+        }
+        if (incoming == current) {
+          continue;
+        }
+      }
+      block_reached_[n] = true;
+      current = incoming;
+      changed = true;
+    }
+  }
+
+  // Rewrite using the final entry values. Blocks never reached from the entry
+  // are left alone.
+  for (auto block : blocks_) {
+    if (block_reached_[block->ordinal]) {
+      values = block_values_[block->ordinal];
+      PromoteBlock(block, values, true);
+    }
+  }
+}
+
+void DeadStoreEliminationPass::PromoteBlock(Block* block,
+                                            std::vector<Value*>& values,
+                                            bool rewrite) {
+  for (auto i = block->instr_head; i; i = i->next) {
+    auto target = GetBranchTarget(i);
+    if (target) {
+      // Branches don't touch the context (conditional ones are only marked
+      // volatile so that they are never removed).
+      if (!rewrite) {
+        MergeIncoming(target, values);
+      }
+    } else if (IsContextEscape(i)) {
+      std::fill(values.begin(), values.end(), nullptr);
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      int32_t index = offset_indices_[i->src1.offset];
+      Value* previous_value = values[index];
+      if (previous_value && previous_value->type == i->dest->type) {
+        if (rewrite) {
+          i->opcode = &hir::OPCODE_ASSIGN_info;
+          i->set_src1(previous_value);
+        }
+      } else {
+        values[index] = i->dest;
+      }
+    } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+      uint32_t offset = static_cast<uint32_t>(i->src1.offset);
+      Value* value = i->src2.value;
+      InvalidateOverlapping(values, offset,
+                            static_cast<uint32_t>(GetTypeSize(value->type)));
+      values[offset_indices_[offset]] = value;
+    }
+  }
+}
+
+void DeadStoreEliminationPass::MergeIncoming(
+    Block* target, const std::vector<Value*>& values) {
+  auto ordinal = target->ordinal;
+  auto& incoming = incoming_values_[ordinal];
+  if (!incoming_reached_[ordinal]) {
+    incoming_reached_[ordinal] = true;
+    incoming = values;
+    return;
+  }
+  for (size_t k = 0; k < incoming.size(); ++k) {
+    if (incoming[k] != values[k]) {
+      incoming[k] = nullptr;
+    }
+  }
+}
+
+void DeadStoreEliminationPass::InvalidateOverlapping(
+    std::vector<Value*>& values, uint32_t offset, uint32_t size) const {
+  // No access is wider than a vector, so only offsets up to 15 bytes before
+  // the store can overlap it.
+  uint32_t first = offset > 15 ? offset - 15 : 0;
+  for (uint32_t n = first; n < offset + size; ++n) {
+    int32_t index = offset_indices_[n];
+    if (index != -1 && n + offset_sizes_[index] > offset) {
+      values[index] = nullptr;
+    }
+  }
+}
+
+void DeadStoreEliminationPass::RemoveDeadStores(HIRBuilder* builder) {
+  // Backward may-liveness of context bytes. Stores are removed only once the
+  // fixpoint is reached, as removing one changes nothing for the others.
+  live_in_.assign(blocks_.size(), llvm::BitVector(static_cast<uint32_t>(
+                                      sizeof(ppc::PPCContext))));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = blocks_.rbegin(); it != blocks_.rend(); ++it) {
+      changed |= ComputeLiveness(*it, false);
+    }
+  }
+  for (auto block : blocks_) {
+    ComputeLiveness(block, true);
+  }
+}
+
+bool DeadStoreEliminationPass::ComputeLiveness(Block* block, bool remove) {
+  auto& live = live_;
+  live.reset();
+  // Blocks normally end in a branch or a return. Be conservative if not.
+  if (!block->instr_tail || block->instr_tail->opcode != &OPCODE_BRANCH_info) {
+    live.set();
+  }
+
+  Instr* i = block->instr_tail;
+  while (i) {
+    Instr* prev = i->prev;
+    auto target = GetBranchTarget(i);
+    if (target) {
+      live |= live_in_[target->ordinal];
+    } else if (IsContextEscape(i)) {
+      live.set();
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      uint32_t offset = static_cast<uint32_t>(i->src1.offset);
+      live.set(offset,
+               offset + static_cast<uint32_t>(GetTypeSize(i->dest->type)));
+    } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+      uint32_t offset = static_cast<uint32_t>(i->src1.offset);
+      uint32_t end =
+          offset + static_cast<uint32_t>(GetTypeSize(i->src2.value->type));
+      if (remove) {
+        bool is_live = false;
+        for (uint32_t n = offset; n < end; ++n) {
+          if (live.test(n)) {
+            is_live = true;
+            break;
+          }
+        }
+        if (!is_live) {
+          // Overwritten on all paths before anyone could see it.
+          i->Remove();
+        }
+      }
+      live.reset(offset, end);
+    }
+    i = prev;
+  }
+
+  auto& live_in = live_in_[block->ordinal];
+  if (live == live_in) {
+    return false;
+  }
+  live_in = live;
+  return true;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
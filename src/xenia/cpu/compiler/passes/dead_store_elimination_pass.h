@@ -0,0 +1,94 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+
+#include <vector>
+
+#include "xenia/base/platform.h"
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Function-wide version of the block-local context promotion:
+//   - loads of context values known on every path reaching them are replaced
+//     with the value, including at merge points and loop headers.
+//   - stores to context that is overwritten on every path before being read
+//     or escaping (calls, returns, traps) are removed.
+// Control flow is followed through branch instructions so this works on
+// merged blocks and does not need the CFG to be current.
+class DeadStoreEliminationPass : public CompilerPass {
+ public:
+  DeadStoreEliminationPass();
+  ~DeadStoreEliminationPass() override;
+
+  bool Initialize(Compiler* compiler) override;
+
+  const char* name() const override { return "dead_store_elimination"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  static hir::Block* GetBranchTarget(const hir::Instr* i);
+  static bool IsContextEscape(const hir::Instr* i);
+
+  void IndexContextAccesses(hir::HIRBuilder* builder);
+  void PromoteLoads(hir::HIRBuilder* builder);
+  void PromoteBlock(hir::Block* block, std::vector<hir::Value*>& values,
+                    bool rewrite);
+  void MergeIncoming(hir::Block* target,
+                     const std::vector<hir::Value*>& values);
+  void InvalidateOverlapping(std::vector<hir::Value*>& values, uint32_t offset,
+                             uint32_t size) const;
+  void RemoveDeadStores(hir::HIRBuilder* builder);
+  bool ComputeLiveness(hir::Block* block, bool remove);
+
+ private:
+  std::vector<hir::Block*> blocks_;
+
+  // Context offsets accessed in the function, by a compact index, and the
+  // largest access at each.
+  std::vector<int32_t> offset_indices_;
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> offset_sizes_;
+
+  // Values available on entry to each block and what is being merged into
+  // them for the next iteration. A block is only processed once some path
+  // from the entry reaches it.
+  std::vector<std::vector<hir::Value*>> block_values_;
+  std::vector<std::vector<hir::Value*>> incoming_values_;
+  std::vector<bool> block_reached_;
+  std::vector<bool> incoming_reached_;
+
+  // Context bytes that may be read before being written, on entry to each
+  // block.
+  std::vector<llvm::BitVector> live_in_;
+  llvm::BitVector live_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
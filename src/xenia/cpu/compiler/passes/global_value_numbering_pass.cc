@@ -0,0 +1,252 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/global_value_numbering_pass.h"
+
+#include <cstring>
+#include <utility>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::OpcodeSignatureType;
+using xe::cpu::hir::Value;
+
+GlobalValueNumberingPass::Stats& GlobalValueNumberingPass::stats() {
+  static Stats stats;
+  return stats;
+}
+
+GlobalValueNumberingPass::GlobalValueNumberingPass() : CompilerPass() {}
+
+GlobalValueNumberingPass::~GlobalValueNumberingPass() {}
+
+size_t GlobalValueNumberingPass::ExpressionHasher::operator()(
+    const Expression& expression) const {
+  size_t hash = std::hash<const void*>()(expression.opcode);
+  auto combine = [&hash](uint64_t value) {
+    hash ^= std::hash<uint64_t>()(value) + 0x9E3779B9 + (hash << 6) +
+            (hash >> 2);
+  };
+  combine(expression.flags);
+  combine(expression.memory_epoch);
+  for (auto& operand : expression.operands) {
+    combine(operand.value);
+    combine(operand.low);
+    combine(operand.high);
+  }
+  return hash;
+}
+
+bool GlobalValueNumberingPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  if (!builder->first_block()) {
+    return true;
+  }
+  dominators_.Build(builder);
+
+  instrs_scanned_ = 0;
+  instrs_eliminated_ = 0;
+  loads_eliminated_ = 0;
+
+  // Walk the dominator tree, keeping the expressions computed in dominating
+  // blocks available.
+  struct Frame {
+    Block* block;
+    size_t mark;
+    size_t next_child;
+  };
+  std::vector<Frame> frames;
+  auto enter_block = [&](Block* block) {
+    size_t mark = expression_stack_.size();
+    PopExpressions(NumberBlock(block));
+    frames.push_back({block, mark, 0});
+  };
+  enter_block(dominators_.entry_block());
+  while (!frames.empty()) {
+    auto& frame = frames.back();
+    auto& children = dominators_.dominated(frame.block);
+    if (frame.next_child < children.size()) {
+      enter_block(children[frame.next_child++]);
+    } else {
+      PopExpressions(frame.mark);
+      frames.pop_back();
+    }
+  }
+  assert_true(expressions_.empty());
+
+  auto& totals = stats();
+  totals.instrs_scanned += instrs_scanned_;
+  totals.instrs_eliminated += instrs_eliminated_;
+  totals.loads_eliminated += loads_eliminated_;
+
+  return true;
+}
+
+bool GlobalValueNumberingPass::WritesMemory(const Instr* i) {
+  if (!(i->opcode->flags & OPCODE_FLAG_MEMORY)) {
+    return false;
+  }
+  return i->opcode != &OPCODE_LOAD_info && i->opcode != &OPCODE_PREFETCH_info;
+}
+
+bool GlobalValueNumberingPass::IsCandidate(const Instr* i) {
+  if (!i->dest) {
+    return false;
+  }
+  if (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH |
+                          OPCODE_FLAG_IGNORE | OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  if (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    // Something (like DID_SATURATE) depends on this exact instruction.
+    return false;
+  }
+  if (i->opcode == &OPCODE_ASSIGN_info ||
+      i->opcode == &OPCODE_LOAD_CLOCK_info ||
+      i->opcode == &OPCODE_LOAD_LOCAL_info ||
+      i->opcode == &OPCODE_LOAD_CONTEXT_info ||
+      i->opcode == &OPCODE_LOAD_MMIO_info) {
+    // Context loads are handled by ContextPromotionPass and
+    // DeadStoreEliminationPass, and the others may change underneath us.
+    return false;
+  }
+  if ((i->opcode->flags & OPCODE_FLAG_MEMORY) &&
+      i->opcode != &OPCODE_LOAD_info) {
+    return false;
+  }
+  if (i->flags & LOAD_STORE_MMIO) {
+    // Device registers may read differently each time.
+    return false;
+  }
+  uint32_t signature = i->opcode->signature;
+  OpcodeSignatureType src_types[] = {GET_OPCODE_SIG_TYPE_SRC1(signature),
+                                     GET_OPCODE_SIG_TYPE_SRC2(signature),
+                                     GET_OPCODE_SIG_TYPE_SRC3(signature)};
+  for (auto src_type : src_types) {
+    if (src_type == OPCODE_SIG_TYPE_L || src_type == OPCODE_SIG_TYPE_S) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t GlobalValueNumberingPass::NumberBlock(Block* block) {
+  // Memory may be written by other blocks on the way here.
+  ++memory_epoch_;
+
+  // Only what is computed before the first branch out of the block is
+  // available in the blocks it dominates: merged blocks may branch out from
+  // the middle.
+  size_t export_mark = 0;
+  bool exported = false;
+  for (auto i = block->instr_head; i; i = i->next) {
+    if (DominatorTree::GetBranchTarget(i)) {
+      if (!exported) {
+        export_mark = expression_stack_.size();
+        exported = true;
+      }
+      continue;
+    }
+    if ((i->opcode->flags & OPCODE_FLAG_VOLATILE) || WritesMemory(i)) {
+      ++memory_epoch_;
+      continue;
+    }
+    if (!IsCandidate(i)) {
+      continue;
+    }
+    ++instrs_scanned_;
+    auto expression = BuildExpression(i);
+    auto it = expressions_.find(expression);
+    if (it == expressions_.end()) {
+      expressions_.emplace(expression, i->dest);
+      expression_stack_.push_back(expression);
+      continue;
+    }
+    if (i->opcode == &OPCODE_LOAD_info) {
+      ++loads_eliminated_;
+    }
+    ++instrs_eliminated_;
+    i->Replace(&OPCODE_ASSIGN_info, 0);
+    i->set_src1(it->second);
+  }
+  return exported ? export_mark : expression_stack_.size();
+}
+
+GlobalValueNumberingPass::Expression GlobalValueNumberingPass::BuildExpression(
+    const Instr* i) const {
+  Expression expression;
+  std::memset(&expression, 0, sizeof(expression));
+  expression.opcode = i->opcode;
+  expression.flags = i->flags | (uint32_t(i->dest->type) << 16);
+  if (i->opcode == &OPCODE_LOAD_info) {
+    expression.memory_epoch = memory_epoch_;
+  }
+
+  uint32_t signature = i->opcode->signature;
+  OpcodeSignatureType src_types[] = {GET_OPCODE_SIG_TYPE_SRC1(signature),
+                                     GET_OPCODE_SIG_TYPE_SRC2(signature),
+                                     GET_OPCODE_SIG_TYPE_SRC3(signature)};
+  const Instr::Op* srcs[] = {&i->src1, &i->src2, &i->src3};
+  for (size_t n = 0; n < 3; ++n) {
+    auto& operand = expression.operands[n];
+    if (src_types[n] == OPCODE_SIG_TYPE_O) {
+      operand.low = srcs[n]->offset;
+      operand.high = 1;
+    } else if (src_types[n] == OPCODE_SIG_TYPE_V) {
+      // Look through copies, which SimplificationPass hasn't removed yet.
+      Value* value = srcs[n]->value;
+      while (value->def && value->def->opcode == &OPCODE_ASSIGN_info) {
+        value = value->def->src1.value;
+      }
+      if (value->IsConstant()) {
+        // Only the bytes of the type are meaningful.
+        size_t size = GetTypeSize(value->type);
+        operand.value = uintptr_t(value->type) + 1;
+        operand.low = value->constant.v128.low;
+        operand.high = size == 16 ? value->constant.v128.high : 0;
+        if (size < 8) {
+          operand.low &= (1ull << (size * 8)) - 1;
+        }
+      } else {
+        operand.value = reinterpret_cast<uintptr_t>(value);
+      }
+    }
+  }
+  if ((i->opcode->flags & OPCODE_FLAG_COMMUNATIVE) &&
+      expression.operands[1] < expression.operands[0]) {
+    std::swap(expression.operands[0], expression.operands[1]);
+  }
+  return expression;
+}
+
+void GlobalValueNumberingPass::PopExpressions(size_t mark) {
+  while (expression_stack_.size() > mark) {
+    expressions_.erase(expression_stack_.back());
+    expression_stack_.pop_back();
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_GLOBAL_VALUE_NUMBERING_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_GLOBAL_VALUE_NUMBERING_PASS_H_
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/dominator_tree.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Dominator-scoped common subexpression elimination.
+// Instructions computing the same operation on the same values as one that
+// dominates them are replaced with an assignment of the earlier result, which
+// SimplificationPass then folds away. Guest memory loads are only reused
+// within a block and as long as nothing in between may write memory.
+class GlobalValueNumberingPass : public CompilerPass {
+ public:
+  // Totals across all instances, for logging on shutdown.
+  struct Stats {
+    std::atomic<uint64_t> instrs_scanned = {0};
+    std::atomic<uint64_t> instrs_eliminated = {0};
+    std::atomic<uint64_t> loads_eliminated = {0};
+  };
+  static Stats& stats();
+
+  GlobalValueNumberingPass();
+  ~GlobalValueNumberingPass() override;
+
+  const char* name() const override { return "global_value_numbering"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  struct Operand {
+    // Value pointer, or the type of a constant plus one.
+    uintptr_t value;
+    uint64_t low;
+    uint64_t high;
+    bool operator==(const Operand& other) const {
+      return value == other.value && low == other.low && high == other.high;
+    }
+    bool operator<(const Operand& other) const {
+      if (value != other.value) return value < other.value;
+      if (low != other.low) return low < other.low;
+      return high < other.high;
+    }
+  };
+  struct Expression {
+    const hir::OpcodeInfo* opcode;
+    uint32_t flags;
+    uint32_t memory_epoch;
+    Operand operands[3];
+    bool operator==(const Expression& other) const {
+      return opcode == other.opcode && flags == other.flags &&
+             memory_epoch == other.memory_epoch &&
+             operands[0] == other.operands[0] &&
+             operands[1] == other.operands[1] &&
+             operands[2] == other.operands[2];
+    }
+  };
+  struct ExpressionHasher {
+    size_t operator()(const Expression& expression) const;
+  };
+
+  static bool WritesMemory(const hir::Instr* i);
+  static bool IsCandidate(const hir::Instr* i);
+
+  size_t NumberBlock(hir::Block* block);
+  Expression BuildExpression(const hir::Instr* i) const;
+  void PopExpressions(size_t mark);
+
+ private:
+  DominatorTree dominators_;
+
+  // Expressions available at the current point of the dominator tree walk.
+  std::unordered_map<Expression, hir::Value*, ExpressionHasher> expressions_;
+  std::vector<Expression> expression_stack_;
+  // Changes whenever guest memory may have been written.
+  uint32_t memory_epoch_ = 0;
+
+  uint32_t instrs_scanned_ = 0;
+  uint32_t instrs_eliminated_ = 0;
+  uint32_t loads_eliminated_ = 0;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_GLOBAL_VALUE_NUMBERING_PASS_H_
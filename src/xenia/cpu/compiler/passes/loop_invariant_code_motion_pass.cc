@@ -0,0 +1,225 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/loop_invariant_code_motion_pass.h"
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::OpcodeSignatureType;
+using xe::cpu::hir::Value;
+
+LoopInvariantCodeMotionPass::LoopInvariantCodeMotionPass() : CompilerPass() {}
+
+LoopInvariantCodeMotionPass::~LoopInvariantCodeMotionPass() {}
+
+bool LoopInvariantCodeMotionPass::Initialize(Compiler* compiler) {
+  if (!CompilerPass::Initialize(compiler)) {
+    return false;
+  }
+
+  loop_context_stores_.resize(static_cast<uint32_t>(sizeof(ppc::PPCContext)));
+
+  return true;
+}
+
+bool LoopInvariantCodeMotionPass::Run(HIRBuilder* builder) {
+  SCOPE_profile_cpu_f("cpu");
+
+  if (!builder->first_block()) {
+    return true;
+  }
+  dominators_.Build(builder);
+  loop_analysis_.Build(dominators_);
+  next_block_ordinal_ = static_cast<uint16_t>(dominators_.blocks().size());
+
+  // Inner loops first so that what they hoist into their preheader can be
+  // considered again for the loops around them.
+  for (auto& loop : loop_analysis_.loops()) {
+    ScanLoop(loop.get());
+    hoisted_instrs_.clear();
+    hoisted_set_.clear();
+    for (auto block : loop->blocks) {
+      // Only the start of the header is certain to run whenever the loop is
+      // entered.
+      bool always_executed = block == loop->header;
+      for (auto i = block->instr_head; i; i = i->next) {
+        if (DominatorTree::GetBranchTarget(i)) {
+          always_executed = false;
+          continue;
+        }
+        if (IsInvariant(i, loop.get(), always_executed)) {
+          hoisted_instrs_.push_back(i);
+          hoisted_set_.insert(i);
+        }
+      }
+    }
+    if (hoisted_instrs_.empty()) {
+      continue;
+    }
+
+    // Dominators come first in the loop, so operands are hoisted before
+    // their uses.
+    auto preheader = CreatePreheader(builder, loop.get());
+    for (auto i : hoisted_instrs_) {
+      i->MoveBefore(preheader->instr_tail);
+    }
+  }
+
+  return true;
+}
+
+void LoopInvariantCodeMotionPass::ScanLoop(const LoopAnalysis::Loop* loop) {
+  loop_has_escape_ = false;
+  loop_context_stores_.reset();
+  for (auto block : loop->blocks) {
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (DominatorTree::GetBranchTarget(i)) {
+        continue;
+      }
+      if ((i->opcode->flags & OPCODE_FLAG_VOLATILE) ||
+          i->opcode == &OPCODE_CONTEXT_BARRIER_info) {
+        // Calls, traps, etc may touch any of the context.
+        loop_has_escape_ = true;
+      } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        uint32_t offset = static_cast<uint32_t>(i->src1.offset);
+        loop_context_stores_.set(
+            offset,
+            offset + static_cast<uint32_t>(GetTypeSize(i->src2.value->type)));
+      }
+    }
+  }
+}
+
+bool LoopInvariantCodeMotionPass::IsInvariant(const Instr* i,
+                                              const LoopAnalysis::Loop* loop,
+                                              bool always_executed) const {
+  if (!i->dest) {
+    return false;
+  }
+  if (i->opcode->flags &
+      (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH | OPCODE_FLAG_IGNORE |
+       OPCODE_FLAG_PAIRED_PREV | OPCODE_FLAG_MEMORY)) {
+    return false;
+  }
+  if (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  if (i->opcode == &OPCODE_LOAD_CLOCK_info ||
+      i->opcode == &OPCODE_LOAD_LOCAL_info) {
+    return false;
+  }
+  if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+    if (loop_has_escape_) {
+      return false;
+    }
+    uint32_t offset = static_cast<uint32_t>(i->src1.offset);
+    uint32_t end = offset + static_cast<uint32_t>(GetTypeSize(i->dest->type));
+    for (uint32_t n = offset; n < end; ++n) {
+      if (loop_context_stores_.test(n)) {
+        return false;
+      }
+    }
+  } else if (i->opcode == &OPCODE_DIV_info && i->dest->type <= INT64_TYPE &&
+             !always_executed) {
+    // Integer division faults on zero, which the loop may be guarding.
+    return false;
+  }
+
+  uint32_t signature = i->opcode->signature;
+  OpcodeSignatureType src_types[] = {GET_OPCODE_SIG_TYPE_SRC1(signature),
+                                     GET_OPCODE_SIG_TYPE_SRC2(signature),
+                                     GET_OPCODE_SIG_TYPE_SRC3(signature)};
+  const Value* src_values[] = {i->src1.value, i->src2.value, i->src3.value};
+  for (size_t n = 0; n < 3; ++n) {
+    if (src_types[n] == OPCODE_SIG_TYPE_L ||
+        src_types[n] == OPCODE_SIG_TYPE_S) {
+      return false;
+    } else if (src_types[n] != OPCODE_SIG_TYPE_V) {
+      continue;
+    }
+    auto value = src_values[n];
+    if (value->IsConstant()) {
+      continue;
+    }
+    auto def = value->def;
+    if (!def) {
+      return false;
+    }
+    if (LoopAnalysis::Contains(loop, def->block) && !hoisted_set_.count(def)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Block* LoopInvariantCodeMotionPass::CreatePreheader(HIRBuilder* builder,
+                                                    LoopAnalysis::Loop* loop) {
+  auto header = loop->header;
+
+  // Append and then move into place just before the header. Whatever branched
+  // to the header from outside of the loop branches here instead.
+  auto preheader = builder->AppendBlock();
+  builder->Branch(header);
+  std::vector<Block*> order;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    if (block == preheader) {
+      continue;
+    }
+    if (block == header) {
+      order.push_back(preheader);
+    }
+    order.push_back(block);
+  }
+  builder->ReorderBlocks(order);
+  auto label = builder->NewLabel();
+  builder->MarkLabel(label, preheader);
+
+  preheader->ordinal = next_block_ordinal_++;
+  if (loop->parent) {
+    loop_analysis_.AddBlock(loop->parent, preheader, header);
+  }
+
+  for (auto block : order) {
+    if (block == preheader || LoopAnalysis::Contains(loop, block)) {
+      continue;
+    }
+    for (auto i = block->instr_head; i; i = i->next) {
+      if (i->opcode == &OPCODE_BRANCH_info) {
+        if (i->src1.label->block == header) {
+          i->src1.label = label;
+        }
+      } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &OPCODE_BRANCH_FALSE_info) {
+        if (i->src2.label->block == header) {
+          i->src2.label = label;
+        }
+      }
+    }
+  }
+
+  return preheader;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
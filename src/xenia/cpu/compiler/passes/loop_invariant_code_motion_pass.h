@@ -0,0 +1,78 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/platform.h"
+#include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/compiler/dominator_tree.h"
+#include "xenia/cpu/compiler/loop_analysis.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// Moves computations that produce the same value on every iteration of a
+// natural loop into a preheader block created in front of the loop header.
+// Pure operations on values defined outside of the loop are hoisted, as are
+// context loads when nothing in the loop may write that part of the context.
+// Guest memory loads are never hoisted as other threads may be changing the
+// memory the loop is polling.
+class LoopInvariantCodeMotionPass : public CompilerPass {
+ public:
+  LoopInvariantCodeMotionPass();
+  ~LoopInvariantCodeMotionPass() override;
+
+  bool Initialize(Compiler* compiler) override;
+
+  const char* name() const override { return "loop_invariant_code_motion"; }
+
+  bool Run(hir::HIRBuilder* builder) override;
+
+ private:
+  void ScanLoop(const LoopAnalysis::Loop* loop);
+  bool IsInvariant(const hir::Instr* i, const LoopAnalysis::Loop* loop,
+                   bool always_executed) const;
+  hir::Block* CreatePreheader(hir::HIRBuilder* builder,
+                              LoopAnalysis::Loop* loop);
+
+ private:
+  DominatorTree dominators_;
+  LoopAnalysis loop_analysis_;
+  uint16_t next_block_ordinal_ = 0;
+
+  // Summary of the loop being processed.
+  bool loop_has_escape_ = false;
+  llvm::BitVector loop_context_stores_;
+
+  std::vector<hir::Instr*> hoisted_instrs_;
+  std::unordered_set<const hir::Instr*> hoisted_set_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
@@ -15,7 +15,20 @@
 #include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/function_profile.h"
+
+#if XE_COMPILER_MSVC
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#pragma warning(disable : 4267)
+#include <llvm/ADT/BitVector.h>
+#pragma warning(pop)
+#else
+#include <llvm/ADT/BitVector.h>
+#endif  // XE_COMPILER_MSVC
 
 namespace xe {
 namespace cpu {
@@ -35,6 +48,17 @@ using xe::cpu::hir::Value;
 
 #define ASSERT_NO_CYCLES 0
 
+namespace {
+// Returns the first instruction after the given one that isn't paired with it.
+Instr* NextUnpairedInstr(Instr* instr) {
+  auto next = instr->next;
+  while (next && next->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+    next = next->next;
+  }
+  return next;
+}
+}  // namespace
+
 RegisterAllocationPass::RegisterAllocationPass(const MachineInfo* machine_info)
     : CompilerPass() {
   // Initialize register sets.
@@ -71,11 +95,47 @@ RegisterAllocationPass::~RegisterAllocationPass() {
 }
 
 bool RegisterAllocationPass::Run(HIRBuilder* builder) {
-  // Simple per-block allocator that operates on SSA form.
-  // Registers do not move across blocks, though this could be
-  // optimized with some intra-block analysis (dominators/etc).
-  // Really, it'd just be nice to have someone who knew what they
-  // were doing lower SSA and do this right.
+  SCOPE_profile_cpu_f("cpu");
+
+  // Linear scan over live intervals covering the whole function. Values live
+  // across blocks (and loops) keep one register for their entire lifetime, so
+  // no moves are needed on edges.
+  // Values that don't fit are spilled everywhere: stored to a local right
+  // after their def and reloaded right before each use. The reloads have
+  // minimal intervals, so rerunning allocation on the rewritten HIR converges
+  // quickly (usually after a single spill round).
+  while (true) {
+    NumberInstructions(builder);
+    BuildIntervals(builder);
+    ExtendLiveIntervals();
+    if (!AllocateIntervals()) {
+      return false;
+    }
+    if (spilled_values_.empty()) {
+      break;
+    }
+    for (auto value : spilled_values_) {
+      SpillValue(builder, value);
+    }
+  }
+
+  return true;
+}
+
+void RegisterAllocationPass::NumberInstructions(HIRBuilder* builder) {
+  blocks_.clear();
+  block_starts_.clear();
+  block_ends_.clear();
+  block_weights_.clear();
+  clobbers_.clear();
+
+  // Blocks are weighted as in BlockLayoutPass: by how often their first guest
+  // instruction executed, or like the block before if they have none.
+  auto profile = compiler_->profile();
+  if (profile && !profile->has_instruction_counts()) {
+    profile = nullptr;
+  }
+  uint64_t weight = profile ? profile->call_count() : 0;
 
   uint16_t block_ordinal = 0;
   uint32_t instr_ordinal = 0;
@@ -83,392 +143,378 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
   while (block) {
     // Sequential block ordinals.
     block->ordinal = block_ordinal++;
+    blocks_.push_back(block);
 
-    // Reset all state.
-    PrepareBlockState();
-
-    // Renumber all instructions in the block. This is required so that
-    // we can sort the usage pointers below.
+    // Sequential global instruction ordinals.
+    // Empty blocks share the position of the instruction following them.
+    block_starts_.push_back(instr_ordinal);
+    bool has_weight = false;
     auto instr = block->instr_head;
     while (instr) {
-      // Sequential global instruction ordinals.
       instr->ordinal = instr_ordinal++;
+      if (profile && !has_weight &&
+          instr->opcode == &OPCODE_SOURCE_OFFSET_info) {
+        auto address = uint32_t(instr->src1.offset);
+        if (address >= profile->address() &&
+            address <= profile->end_address()) {
+          weight = profile->instruction_count(address);
+        }
+        has_weight = true;
+      }
+      // Guest code doesn't preserve any registers across calls.
+      if (instr->opcode == &OPCODE_CALL_info ||
+          instr->opcode == &OPCODE_CALL_TRUE_info ||
+          instr->opcode == &OPCODE_CALL_INDIRECT_info ||
+          instr->opcode == &OPCODE_CALL_INDIRECT_TRUE_info ||
+          instr->opcode == &OPCODE_CALL_EXTERN_info) {
+        clobbers_.push_back(instr->ordinal);
+      }
       instr = instr->next;
     }
+    block_ends_.push_back(block->instr_tail ? instr_ordinal - 1
+                                            : instr_ordinal);
+    if (profile) {
+      block_weights_.push_back(weight);
+    }
+    block = block->next;
+  }
+}
 
-    instr = block->instr_head;
-    while (instr) {
-      const auto info = instr->opcode;
-      uint32_t signature = info->signature;
-
-      // Update the register use heaps.
-      AdvanceUses(instr);
-
-      // Check sources for retirement. If any are unused after this instruction
-      // we can eagerly evict them to speed up register allocation.
-      // Since X64 (and other platforms) can often take advantage of dest==src1
-      // register mappings we track retired src1 so that we can attempt to
-      // reuse it.
-      // NOTE: these checks require that the usage list be sorted!
-      bool has_preferred_reg = false;
-      RegAssignment preferred_reg = {0};
-      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
-          !instr->src1.value->IsConstant()) {
-        if (!instr->src1_use->next) {
-          // Pull off preferred register. We will try to reuse this for the
-          // dest.
-          // NOTE: set may be null if this is a store local.
-          if (preferred_reg.set) {
-            has_preferred_reg = true;
-            preferred_reg = instr->src1.value->reg;
-          }
-        }
-      }
+void RegisterAllocationPass::BuildIntervals(HIRBuilder* builder) {
+  intervals_.clear();
+  live_intervals_.clear();
 
-      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
-        // Must not have been set already.
-        assert_null(instr->dest->reg.set);
-
-        // Sort the usage list. We depend on this in future uses of this
-        // variable.
-        SortUsageList(instr->dest);
-
-        // If we have a preferred register, use that.
-        // This way we can help along the stupid X86 two opcode instructions.
-        bool allocated;
-        if (has_preferred_reg) {
-          // Allocate with the given preferred register. If the register is in
-          // the wrong set it will not be reused.
-          allocated = TryAllocateRegister(instr->dest, preferred_reg);
-        } else {
-          // Allocate a register. This will either reserve a free one or
-          // spill and reuse an active one.
-          allocated = TryAllocateRegister(instr->dest);
+  for (auto block : blocks_) {
+    auto instr = block->instr_head;
+    while (instr) {
+      if (GET_OPCODE_SIG_TYPE_DEST(instr->opcode->signature) ==
+          OPCODE_SIG_TYPE_V) {
+        auto value = instr->dest;
+        value->reg.set = nullptr;
+        value->reg.index = -1;
+
+        Interval interval;
+        interval.value = value;
+        interval.start = instr->ordinal * 2 + 1;
+        interval.end = interval.start;
+        interval.spill_cost = 0;
+        bool is_live_across_blocks = false;
+        auto store_point = block_weights_.empty()
+                               ? nullptr
+                               : NextUnpairedInstr(instr);
+        if (store_point) {
+          interval.spill_cost = block_weights_[block->ordinal];
         }
-        if (!allocated) {
-          // Failed to allocate register -- need to spill and try again.
-          // We spill only those registers we aren't using.
-          if (!SpillOneRegister(builder, block, instr->dest->type)) {
-            // Unable to spill anything - this shouldn't happen.
-            XELOGE("Unable to spill any registers");
-            assert_always();
-            return false;
+        auto use = value->use_head;
+        while (use) {
+          interval.end = std::max(interval.end, use->instr->ordinal * 2);
+          if (use->instr->block != block) {
+            is_live_across_blocks = true;
           }
-
-          // Demand allocation.
-          if (!TryAllocateRegister(instr->dest)) {
-            // Boned.
-            XELOGE("Register allocation failed");
-            assert_always();
-            return false;
+          if (store_point &&
+              IsReloadableUse(value, use->instr, store_point)) {
+            interval.spill_cost += block_weights_[use->instr->block->ordinal];
           }
+          use = use->next;
+        }
+        if (is_live_across_blocks) {
+          live_intervals_.push_back(intervals_.size());
         }
+        intervals_.push_back(interval);
       }
-
       instr = instr->next;
     }
-    block = block->next;
   }
-
-  return true;
 }
 
-void RegisterAllocationPass::DumpUsage(const char* name) {
-#if 0
-  fprintf(stdout, "\n%s:\n", name);
-  for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
-    auto usage_set = usage_sets_.all_sets[i];
-    if (usage_set) {
-      fprintf(stdout, "set %s:\n", usage_set->set->name);
-      fprintf(stdout, "  avail: %s\n",
-              usage_set->availability.to_string().c_str());
-      fprintf(stdout, "  upcoming uses:\n");
-      for (auto it = usage_set->upcoming_uses.begin();
-           it != usage_set->upcoming_uses.end(); ++it) {
-        fprintf(stdout, "    v%d, used at %d\n",
-                it->value->ordinal,
-                it->use->instr->ordinal);
+void RegisterAllocationPass::ExtendLiveIntervals() {
+  // Most values never leave their block, so liveness is only tracked for the
+  // few that do.
+  size_t live_count = live_intervals_.size();
+  if (!live_count) {
+    return;
+  }
+  size_t block_count = blocks_.size();
+  std::vector<llvm::BitVector> defined(block_count,
+                                       llvm::BitVector(uint32_t(live_count)));
+  std::vector<llvm::BitVector> used(block_count,
+                                    llvm::BitVector(uint32_t(live_count)));
+  std::vector<llvm::BitVector> live_in(block_count,
+                                       llvm::BitVector(uint32_t(live_count)));
+  for (size_t n = 0; n < live_count; ++n) {
+    auto value = intervals_[live_intervals_[n]].value;
+    auto def_block = value->def->block;
+    defined[def_block->ordinal].set(uint32_t(n));
+    auto use = value->use_head;
+    while (use) {
+      if (use->instr->block != def_block) {
+        used[use->instr->block->ordinal].set(uint32_t(n));
       }
+      use = use->next;
+    }
+  }
+
+  // Iterate live_in = used | (live_out & ~defined) to a fixed point. Walking
+  // backwards converges in a couple of rounds for reducible CFGs.
+  llvm::BitVector live_out(static_cast<uint32_t>(live_count));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t n = block_count; n-- > 0;) {
+      live_out.reset();
+      auto edge = blocks_[n]->outgoing_edge_head;
+      while (edge) {
+        live_out |= live_in[edge->dest->ordinal];
+        edge = edge->outgoing_next;
+      }
+      live_out.reset(defined[n]);
+      live_out |= used[n];
+      if (live_out != live_in[n]) {
+        live_in[n] = live_out;
+        changed = true;
+      }
+    }
+  }
+
+  // Stretch intervals over every block they are live in or out of.
+  for (size_t n = 0; n < block_count; ++n) {
+    live_out.reset();
+    auto edge = blocks_[n]->outgoing_edge_head;
+    while (edge) {
+      live_out |= live_in[edge->dest->ordinal];
+      edge = edge->outgoing_next;
+    }
+    for (int k = live_in[n].find_first(); k != -1;
+         k = live_in[n].find_next(k)) {
+      auto& interval = intervals_[live_intervals_[k]];
+      interval.start = std::min(interval.start, block_starts_[n] * 2);
+    }
+    for (int k = live_out.find_first(); k != -1; k = live_out.find_next(k)) {
+      auto& interval = intervals_[live_intervals_[k]];
+      interval.end = std::max(interval.end, block_ends_[n] * 2 + 1);
     }
   }
-  fflush(stdout);
-#endif
 }
 
-void RegisterAllocationPass::PrepareBlockState() {
+bool RegisterAllocationPass::AllocateIntervals() {
+  spilled_values_.clear();
   for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
     auto usage_set = usage_sets_.all_sets[i];
     if (usage_set) {
       usage_set->availability.set();
-      usage_set->upcoming_uses.clear();
+      usage_set->active.clear();
     }
   }
-  DumpUsage("PrepareBlockState");
+
+  std::sort(intervals_.begin(), intervals_.end(),
+            [](const Interval& a, const Interval& b) {
+              return a.start < b.start;
+            });
+  for (auto& interval : intervals_) {
+    ExpireIntervals(interval.start);
+
+    if (CrossesClobber(interval)) {
+      // Must live in memory across the call.
+      spilled_values_.push_back(interval.value);
+      continue;
+    }
+
+    auto usage_set = RegisterSetForValue(interval.value);
+    int32_t index = -1;
+
+    // Prefer the register of src1, if it was freed by this instruction.
+    // This way we can help along the stupid X86 two opcode instructions.
+    auto def = interval.value->def;
+    if (GET_OPCODE_SIG_TYPE_SRC1(def->opcode->signature) ==
+        OPCODE_SIG_TYPE_V) {
+      auto& src1_reg = def->src1.value->reg;
+      if (src1_reg.set == usage_set->set &&
+          usage_set->availability.test(src1_reg.index)) {
+        index = src1_reg.index;
+      }
+    }
+
+    if (index == -1) {
+      // Find the first free register, if any.
+      // We have to ensure it's a valid one (in our count).
+      uint32_t first_unused = 0;
+      bool any_unused = xe::bit_scan_forward(
+          static_cast<uint32_t>(usage_set->availability.to_ulong()),
+          &first_unused);
+      if (any_unused && first_unused < usage_set->count) {
+        index = first_unused;
+      }
+    }
+
+    if (index == -1) {
+      // None available! Spill whichever interval ends furthest away or, with
+      // a profile, whichever would add the fewest executed loads and stores.
+      Interval* victim = IsSpillable(interval) ? &interval : nullptr;
+      for (auto active : usage_set->active) {
+        if ((!victim || IsBetterSpill(*active, *victim)) &&
+            IsSpillable(*active)) {
+          victim = active;
+        }
+      }
+      if (!victim) {
+        // Boned.
+        XELOGE("Register allocation failed");
+        assert_always();
+        return false;
+      }
+      spilled_values_.push_back(victim->value);
+      if (victim == &interval) {
+        continue;
+      }
+      index = victim->value->reg.index;
+      victim->value->reg.set = nullptr;
+      victim->value->reg.index = -1;
+      usage_set->active.erase(std::find(usage_set->active.begin(),
+                                        usage_set->active.end(), victim));
+    }
+
+    interval.value->reg.set = usage_set->set;
+    interval.value->reg.index = index;
+    usage_set->availability.set(index, false);
+    usage_set->active.push_back(&interval);
+  }
+
+  return true;
 }
 
-void RegisterAllocationPass::AdvanceUses(Instr* instr) {
+void RegisterAllocationPass::ExpireIntervals(uint32_t position) {
   for (size_t i = 0; i < xe::countof(usage_sets_.all_sets); ++i) {
     auto usage_set = usage_sets_.all_sets[i];
     if (!usage_set) {
       break;
     }
-    auto& upcoming_uses = usage_set->upcoming_uses;
-    for (size_t j = 0; j < upcoming_uses.size();) {
-      auto& upcoming_use = upcoming_uses.at(j);
-      if (!upcoming_use.use) {
-        // No uses at all - we can remove right away.
-        // This comes up from instructions where the dest is never used,
-        // like the ATOMIC ops.
-        MarkRegAvailable(upcoming_use.value->reg);
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        // i remains the same.
-        continue;
-      }
-      if (upcoming_use.use->instr != instr) {
-        // Not yet at this instruction.
-        ++j;
-        continue;
-      }
-      // The use is from this instruction.
-      if (!upcoming_use.use->next) {
-        // Last use of the value. We can retire it now.
-        MarkRegAvailable(upcoming_use.value->reg);
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        // i remains the same.
-        continue;
+    auto& active = usage_set->active;
+    for (size_t j = 0; j < active.size();) {
+      if (active[j]->end < position) {
+        usage_set->availability.set(active[j]->value->reg.index, true);
+        active[j] = active.back();
+        active.pop_back();
       } else {
-        // Used again. Push back the next use.
-        // Note that we may be used multiple times this instruction, so
-        // eat those.
-        auto next_use = upcoming_use.use->next;
-        while (next_use->next && next_use->instr == instr) {
-          next_use = next_use->next;
-        }
-        // Remove the iterator.
-        auto value = upcoming_use.value;
-        upcoming_uses.erase(upcoming_uses.begin() + j);
-        assert_true(next_use->instr->block == instr->block);
-        assert_true(value->def->block == instr->block);
-        upcoming_uses.emplace_back(value, next_use);
-        // i remains the same.
-        continue;
+        ++j;
       }
     }
   }
-  DumpUsage("AdvanceUses");
 }
 
-bool RegisterAllocationPass::IsRegInUse(const RegAssignment& reg) {
-  RegisterSetUsage* usage_set;
-  if (reg.set == usage_sets_.int_set->set) {
-    usage_set = usage_sets_.int_set;
-  } else if (reg.set == usage_sets_.float_set->set) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
+bool RegisterAllocationPass::IsBetterSpill(const Interval& a,
+                                           const Interval& b) const {
+  if (a.spill_cost != b.spill_cost) {
+    return a.spill_cost < b.spill_cost;
   }
-  return !usage_set->availability.test(reg.index);
+  return a.end > b.end;
 }
 
-RegisterAllocationPass::RegisterSetUsage* RegisterAllocationPass::MarkRegUsed(
-    const RegAssignment& reg, Value* value, Value::Use* use) {
-  auto usage_set = RegisterSetForValue(value);
-  usage_set->availability.set(reg.index, false);
-  usage_set->upcoming_uses.emplace_back(value, use);
-  DumpUsage("MarkRegUsed");
-  return usage_set;
+bool RegisterAllocationPass::CrossesClobber(const Interval& interval) const {
+  // Live both before (read) and after (write) the call.
+  auto it = std::lower_bound(clobbers_.begin(), clobbers_.end(),
+                             (interval.start + 1) / 2);
+  return it != clobbers_.end() && *it * 2 + 1 <= interval.end;
 }
 
-RegisterAllocationPass::RegisterSetUsage*
-RegisterAllocationPass::MarkRegAvailable(const hir::RegAssignment& reg) {
-  RegisterSetUsage* usage_set;
-  if (reg.set == usage_sets_.int_set->set) {
-    usage_set = usage_sets_.int_set;
-  } else if (reg.set == usage_sets_.float_set->set) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
+bool RegisterAllocationPass::IsSpillable(const Interval& interval) const {
+  if (interval.end - interval.start <= 1) {
+    // Used right after it is defined - spilling can't free anything.
+    return false;
   }
-  usage_set->availability.set(reg.index, true);
-  return usage_set;
-}
-
-bool RegisterAllocationPass::TryAllocateRegister(
-    Value* value, const RegAssignment& preferred_reg) {
-  // If the preferred register matches type and is available, use it.
-  auto usage_set = RegisterSetForValue(value);
-  if (usage_set->set == preferred_reg.set) {
-    // Check if available.
-    if (!IsRegInUse(preferred_reg)) {
-      // Mark as in-use and return. Best case.
-      MarkRegUsed(preferred_reg, value, value->use_head);
-      value->reg = preferred_reg;
+  auto value = interval.value;
+  auto def = value->def;
+  if (def->opcode == &OPCODE_LOAD_LOCAL_info && value->local_slot) {
+    // Already a reload.
+    return false;
+  }
+  auto store_point = NextUnpairedInstr(def);
+  auto use = value->use_head;
+  while (use) {
+    if (IsReloadableUse(value, use->instr, store_point)) {
       return true;
     }
+    use = use->next;
   }
-
-  // Otherwise, fallback to allocating like normal.
-  return TryAllocateRegister(value);
+  return false;
 }
 
-bool RegisterAllocationPass::TryAllocateRegister(Value* value) {
-  // Get the set this register is in.
-  RegisterSetUsage* usage_set = RegisterSetForValue(value);
-
-  // Find the first free register, if any.
-  // We have to ensure it's a valid one (in our count).
-  uint32_t first_unused = 0;
-  bool none_used = xe::bit_scan_forward(
-      static_cast<uint32_t>(usage_set->availability.to_ulong()), &first_unused);
-  if (none_used && first_unused < usage_set->count) {
-    // Available! Use it!
-    value->reg.set = usage_set->set;
-    value->reg.index = first_unused;
-    MarkRegUsed(value->reg, value, value->use_head);
+bool RegisterAllocationPass::IsReloadableUse(const Value* value,
+                                             const Instr* instr,
+                                             const Instr* store_point) const {
+  if (value->local_slot && instr->opcode == &OPCODE_STORE_LOCAL_info &&
+      instr->src1.value == value->local_slot) {
+    // The spill store itself.
+    return false;
+  }
+  if (instr->block != value->def->block) {
     return true;
   }
-
-  // None available! Spill required.
-  return false;
+  // Instructions paired with the def must use it directly.
+  return store_point && instr->ordinal >= store_point->ordinal;
 }
 
-bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
-                                              TypeName required_type) {
-  // Get the set that we will be picking from.
-  RegisterSetUsage* usage_set;
-  if (required_type <= INT64_TYPE) {
-    usage_set = usage_sets_.int_set;
-  } else if (required_type <= FLOAT64_TYPE) {
-    usage_set = usage_sets_.float_set;
-  } else {
-    usage_set = usage_sets_.vec_set;
+void RegisterAllocationPass::SpillValue(HIRBuilder* builder, Value* value) {
+  auto store_point = NextUnpairedInstr(value->def);
+  assert_not_null(store_point);
+
+  if (!value->local_slot) {
+    // Store right after the def, or as soon after as we can (respecting
+    // PAIRED flags).
+    value->local_slot = builder->AllocLocal(value->type);
+    builder->StoreLocal(value->local_slot, value);
+    builder->last_instr()->MoveBefore(store_point);
   }
 
-  DumpUsage("SpillOneRegister (pre)");
-  // Pick the one with the furthest next use.
-  assert_true(!usage_set->upcoming_uses.empty());
-  auto furthest_usage = std::max_element(usage_set->upcoming_uses.begin(),
-                                         usage_set->upcoming_uses.end(),
-                                         RegisterUsage::Comparer());
-  assert_true(furthest_usage->value->def->block == block);
-  assert_true(furthest_usage->use->instr->block == block);
-  auto spill_value = furthest_usage->value;
-  Value::Use* prev_use = furthest_usage->use->prev;
-  Value::Use* next_use = furthest_usage->use;
-  assert_not_null(next_use);
-  usage_set->upcoming_uses.erase(furthest_usage);
-  DumpUsage("SpillOneRegister (post)");
-  const auto reg = spill_value->reg;
-
-  // We know the spill_value use list is sorted, so we can cut it right now.
-  // This makes it easier down below.
-  auto new_head_use = next_use;
-
-  // Allocate local.
-  if (spill_value->local_slot) {
-    // Value is already assigned a slot. Since we allocate in order and this is
-    // all SSA we know the stored value will be exactly what we want. Yay,
-    // we can prevent the redundant store!
-    // In fact, we may even want to pin this spilled value so that we always
-    // use the spilled value and prevent the need for more locals.
-  } else {
-    // Allocate a local slot.
-    spill_value->local_slot = builder->AllocLocal(spill_value->type);
-
-    // Add store.
-    builder->StoreLocal(spill_value->local_slot, spill_value);
-    auto spill_store = builder->last_instr();
-    auto spill_store_use = spill_store->src2_use;
-    assert_null(spill_store_use->prev);
-    if (prev_use && prev_use->instr->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
-      // Instruction is paired. This is bad. We will insert the spill after the
-      // paired instruction.
-      assert_not_null(prev_use->instr->next);
-      spill_store->MoveBefore(prev_use->instr->next);
-
-      // Update last use.
-      spill_value->last_use = spill_store;
-    } else if (prev_use) {
-      // We insert the store immediately before the previous use.
-      // If we were smarter we could then re-run allocation and reuse the
-      // register
-      // once dropped.
-      spill_store->MoveBefore(prev_use->instr);
-
-      // Update last use.
-      spill_value->last_use = prev_use->instr;
-    } else {
-      // This is the first use, so the only thing we have is the define.
-      // Move the store to right after that.
-      spill_store->MoveBefore(spill_value->def->next);
-
-      // Update last use.
-      spill_value->last_use = spill_store;
+  // Gather first, as renaming sources modifies the use list.
+  reload_instrs_.clear();
+  auto use = value->use_head;
+  while (use) {
+    if (IsReloadableUse(value, use->instr, store_point)) {
+      reload_instrs_.push_back(use->instr);
     }
+    use = use->next;
   }
 
-#if ASSERT_NO_CYCLES
-  builder->AssertNoCycles();
-  spill_value->def->block->AssertNoCycles();
-#endif  // ASSERT_NO_CYCLES
-
-  // Add load.
-  // Inserted immediately before the next use. Since by definition the next
-  // use is after the instruction requesting the spill we know we haven't
-  // done allocation for that code yet and can let that be handled
-  // automatically when we get to it.
-  auto new_value = builder->LoadLocal(spill_value->local_slot);
-  auto spill_load = builder->last_instr();
-  spill_load->MoveBefore(next_use->instr);
-// Note: implicit first use added.
-
-#if ASSERT_NO_CYCLES
-  builder->AssertNoCycles();
-  spill_value->def->block->AssertNoCycles();
-#endif  // ASSERT_NO_CYCLES
+  // Reload right before each use and rename the use to the reloaded value.
+  for (auto instr : reload_instrs_) {
+    uint32_t signature = instr->opcode->signature;
+    bool src1_uses = GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+                     instr->src1.value == value;
+    bool src2_uses = GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+                     instr->src2.value == value;
+    bool src3_uses = GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+                     instr->src3.value == value;
+    if (!src1_uses && !src2_uses && !src3_uses) {
+      // Already renamed via another use in the same instruction.
+      continue;
+    }
 
-  // Set the local slot of the new value to our existing one. This way we will
-  // reuse that same memory if needed.
-  new_value->local_slot = spill_value->local_slot;
+    // Loads can't be placed between paired instructions.
+    auto insert_point = instr;
+    while (insert_point->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
+      insert_point = insert_point->prev;
+    }
+    auto new_value = builder->LoadLocal(value->local_slot);
+    builder->last_instr()->MoveBefore(insert_point);
 
-  // Rename all future uses of the SSA value to the new value as loaded
-  // from the local.
-  // We can quickly do this by walking the use list. Because the list is
-  // already sorted we know we are going to end up with a sorted list.
-  auto walk_use = new_head_use;
-  auto new_use_tail = walk_use;
-  while (walk_use) {
-    auto next_walk_use = walk_use->next;
-    auto instr = walk_use->instr;
+    // Set the local slot of the new value to our existing one. This way we will
+    // reuse that same memory if needed.
+    new_value->local_slot = value->local_slot;
 
-    uint32_t signature = instr->opcode->signature;
-    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src1.value == spill_value) {
-        instr->set_src1(new_value);
-      }
+    if (src1_uses) {
+      instr->set_src1(new_value);
     }
-    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src2.value == spill_value) {
-        instr->set_src2(new_value);
-      }
+    if (src2_uses) {
+      instr->set_src2(new_value);
     }
-    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src3.value == spill_value) {
-        instr->set_src3(new_value);
-      }
-    }
-
-    walk_use = next_walk_use;
-    if (walk_use) {
-      new_use_tail = walk_use;
+    if (src3_uses) {
+      instr->set_src3(new_value);
     }
   }
-  new_value->last_use = new_use_tail->instr;
-
-  // Update tracking.
-  MarkRegAvailable(reg);
 
-  return true;
+#if ASSERT_NO_CYCLES
+  builder->AssertNoCycles();
+#endif  // ASSERT_NO_CYCLES
 }
 
 RegisterAllocationPass::RegisterSetUsage*
@@ -482,93 +528,6 @@ RegisterAllocationPass::RegisterSetForValue(const Value* value) {
   }
 }
 
-namespace {
-int CompareValueUse(const Value::Use* a, const Value::Use* b) {
-  return a->instr->ordinal - b->instr->ordinal;
-}
-}  // namespace
-void RegisterAllocationPass::SortUsageList(Value* value) {
-  // Modified in-place linked list sort from:
-  // http://www.chiark.greenend.org.uk/~sgtatham/algorithms/listsort.c
-  if (!value->use_head) {
-    return;
-  }
-  Value::Use* head = value->use_head;
-  Value::Use* tail = nullptr;
-  int insize = 1;
-  while (true) {
-    auto p = head;
-    head = nullptr;
-    tail = nullptr;
-    // count number of merges we do in this pass
-    int nmerges = 0;
-    while (p) {
-      // there exists a merge to be done
-      nmerges++;
-      // step 'insize' places along from p
-      auto q = p;
-      int psize = 0;
-      for (int i = 0; i < insize; i++) {
-        psize++;
-        q = q->next;
-        if (!q) break;
-      }
-      // if q hasn't fallen off end, we have two lists to merge
-      int qsize = insize;
-      // now we have two lists; merge them
-      while (psize > 0 || (qsize > 0 && q)) {
-        // decide whether next element of merge comes from p or q
-        Value::Use* e = nullptr;
-        if (psize == 0) {
-          // p is empty; e must come from q
-          e = q;
-          q = q->next;
-          qsize--;
-        } else if (qsize == 0 || !q) {
-          // q is empty; e must come from p
-          e = p;
-          p = p->next;
-          psize--;
-        } else if (CompareValueUse(p, q) <= 0) {
-          // First element of p is lower (or same); e must come from p
-          e = p;
-          p = p->next;
-          psize--;
-        } else {
-          // First element of q is lower; e must come from q
-          e = q;
-          q = q->next;
-          qsize--;
-        }
-        // add the next element to the merged list
-        if (tail) {
-          tail->next = e;
-        } else {
-          head = e;
-        }
-        // Maintain reverse pointers in a doubly linked list.
-        e->prev = tail;
-        tail = e;
-      }
-      // now p has stepped 'insize' places along, and q has too
-      p = q;
-    }
-    if (tail) {
-      tail->next = nullptr;
-    }
-    // If we have done only one merge, we're finished
-    if (nmerges <= 1) {
-      // allow for nmerges==0, the empty list case
-      break;
-    }
-    // Otherwise repeat, merging lists twice the size
-    insize *= 2;
-  }
-
-  value->use_head = head;
-  value->last_use = tail->instr;
-}
-
 }  // namespace passes
 }  // namespace compiler
 }  // namespace cpu
@@ -10,9 +10,7 @@
 #ifndef XENIA_CPU_COMPILER_PASSES_REGISTER_ALLOCATION_PASS_H_
 #define XENIA_CPU_COMPILER_PASSES_REGISTER_ALLOCATION_PASS_H_
 
-#include <algorithm>
 #include <bitset>
-#include <functional>
 #include <vector>
 
 #include "xenia/cpu/backend/machine_info.h"
@@ -23,54 +21,52 @@ namespace cpu {
 namespace compiler {
 namespace passes {
 
+// Linear scan allocator over live intervals spanning the whole function.
+// Requires the CFG built by ControlFlowAnalysisPass to be current.
 class RegisterAllocationPass : public CompilerPass {
  public:
   explicit RegisterAllocationPass(const backend::MachineInfo* machine_info);
   ~RegisterAllocationPass() override;
 
+  const char* name() const override { return "register_allocation"; }
+
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
-  // TODO(benvanik): rewrite all this set shit -- too much indirection, the
-  // complexity is not needed.
-  struct RegisterUsage {
+  // Range of positions over which a value must be kept in its register.
+  // Each instruction has two positions: sources are read at the even one and
+  // the dest is written at the odd one, so a dest may reuse the register of a
+  // source whose last use is the same instruction.
+  struct Interval {
     hir::Value* value;
-    hir::Value::Use* use;
-    RegisterUsage() : value(nullptr), use(nullptr) {}
-    RegisterUsage(hir::Value* value_, hir::Value::Use* use_)
-        : value(value_), use(use_) {}
-    struct Comparer : std::binary_function<RegisterUsage, RegisterUsage, bool> {
-      bool operator()(const RegisterUsage& a, const RegisterUsage& b) const {
-        return a.use->instr->ordinal < b.use->instr->ordinal;
-      }
-    };
+    uint32_t start;
+    uint32_t end;
+    // How often the spill store and reloads would execute, going by the
+    // function profile. 0 without one.
+    uint64_t spill_cost;
   };
   struct RegisterSetUsage {
     const backend::MachineInfo::RegisterSet* set = nullptr;
     uint32_t count = 0;
     std::bitset<32> availability = 0;
-    // TODO(benvanik): another data type.
-    std::vector<RegisterUsage> upcoming_uses;
+    std::vector<Interval*> active;
   };
 
-  void DumpUsage(const char* name);
-  void PrepareBlockState();
-  void AdvanceUses(hir::Instr* instr);
-  bool IsRegInUse(const hir::RegAssignment& reg);
-  RegisterSetUsage* MarkRegUsed(const hir::RegAssignment& reg,
-                                hir::Value* value, hir::Value::Use* use);
-  RegisterSetUsage* MarkRegAvailable(const hir::RegAssignment& reg);
-
-  bool TryAllocateRegister(hir::Value* value,
-                           const hir::RegAssignment& preferred_reg);
-  bool TryAllocateRegister(hir::Value* value);
-  bool SpillOneRegister(hir::HIRBuilder* builder, hir::Block* block,
-                        hir::TypeName required_type);
+  void NumberInstructions(hir::HIRBuilder* builder);
+  void BuildIntervals(hir::HIRBuilder* builder);
+  void ExtendLiveIntervals();
+  bool AllocateIntervals();
+  void ExpireIntervals(uint32_t position);
+  // Whether spilling interval a is cheaper than spilling interval b.
+  bool IsBetterSpill(const Interval& a, const Interval& b) const;
+  bool CrossesClobber(const Interval& interval) const;
+  bool IsSpillable(const Interval& interval) const;
+  bool IsReloadableUse(const hir::Value* value, const hir::Instr* instr,
+                       const hir::Instr* store_point) const;
+  void SpillValue(hir::HIRBuilder* builder, hir::Value* value);
 
   RegisterSetUsage* RegisterSetForValue(const hir::Value* value);
 
-  void SortUsageList(hir::Value* value);
-
  private:
   struct {
     RegisterSetUsage* int_set = nullptr;
@@ -78,6 +74,22 @@ class RegisterAllocationPass : public CompilerPass {
     RegisterSetUsage* vec_set = nullptr;
     RegisterSetUsage* all_sets[3];
   } usage_sets_;
+
+  // Reset each iteration:
+  std::vector<hir::Block*> blocks_;
+  // Ordinals of the first and last instruction in each block.
+  std::vector<uint32_t> block_starts_;
+  std::vector<uint32_t> block_ends_;
+  // How often each block executed in the function profile, if there is one
+  // with per-instruction counts.
+  std::vector<uint64_t> block_weights_;
+  // Ordinals of instructions that clobber all registers (guest calls).
+  std::vector<uint32_t> clobbers_;
+  std::vector<Interval> intervals_;
+  // Values used outside of the block defining them, and their intervals.
+  std::vector<size_t> live_intervals_;
+  std::vector<hir::Value*> spilled_values_;
+  std::vector<hir::Instr*> reload_instrs_;
 };
 
 }  // namespace passes
@@ -75,11 +75,7 @@ bool ValidationPass::ValidateInstruction(Block* block, Instr* instr) {
 
   if (instr->dest) {
     assert_true(instr->dest->def == instr);
-    auto use = instr->dest->use_head;
-    while (use) {
-      assert_true(use->instr->block == block);
-      use = use->next;
-    }
+    // Values may be used in other blocks, as long as the def dominates them.
   }
 
   uint32_t signature = instr->opcode->signature;
@@ -22,6 +22,8 @@ class ValueReductionPass : public CompilerPass {
   ValueReductionPass();
   ~ValueReductionPass() override;
 
+  const char* name() const override { return "value_reduction"; }
+
   bool Run(hir::HIRBuilder* builder) override;
 
  private:
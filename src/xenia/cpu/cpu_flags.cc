@@ -34,6 +34,64 @@ DEFINE_bool(
 
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.");
+DEFINE_bool(compile_stats, false,
+            "Collect per-pass timing, instruction counts, and memory use "
+            "during compilation and log them on shutdown.");
+DEFINE_int32(max_pass_group_iterations, 4,
+             "Maximum number of times a group of optimization passes is rerun "
+             "while it keeps changing the function.");
+
+DEFINE_string(float_precision, "fast",
+              "Guest floating-point precision [fast, strict]. strict keeps the "
+              "single rounding of guest multiply-add on hosts without FMA, at "
+              "the cost of a call per operation.");
+
+DEFINE_int32(background_compile_threads, 0,
+             "Maximum number of host threads used to translate guest functions "
+             "ahead of time. 0 disables background compilation, -1 picks a "
+             "count based on the number of host cores.");
+
+DEFINE_bool(tiered_compilation, false,
+            "Compile functions with a minimal pass set first and recompile "
+            "them with all optimizations once they become hot.");
+DEFINE_int32(tiered_compilation_threshold, 1000,
+             "Number of calls after which a baseline function is recompiled "
+             "with all optimizations.");
+DEFINE_bool(interpret_cold_functions, false,
+            "Run functions by interpreting their HIR until they have been "
+            "called often enough to be worth compiling.");
+DEFINE_int32(interpreter_threshold, 50,
+             "Number of calls after which an interpreted function is "
+             "compiled. Functions are compiled on first use if below 1.");
+
+DEFINE_bool(inline_calls, false,
+            "Emit the bodies of small leaf functions in place of calls to "
+            "them. Breakpoints in inlined functions are only hit if they were "
+            "set before the caller was compiled.");
+DEFINE_int32(inline_max_instructions, 16,
+             "Maximum number of instructions in a function for it to be "
+             "inlined.");
+
+DEFINE_bool(learn_mmio_sites, true,
+            "Retranslate functions whose loads and stores fault on MMIO "
+            "ranges so that those accesses call the range directly. Only "
+            "32-bit accesses are learned, as they are the only ones the fault "
+            "handler emulates.");
+DEFINE_bool(mmio_access_stats, false,
+            "Count MMIO accesses made directly by generated code and log them "
+            "on shutdown. Costs an atomic increment per access.");
+
+DEFINE_string(host_routine_signatures, "",
+              "File of guest function signatures to replace with host "
+              "routines, one '<prologue hash> <body hash> <instruction count> "
+              "<memcpy|memset|strlen>' per line.");
+DEFINE_bool(log_function_signatures, false,
+            "Log the signature of every scanned function, in the format "
+            "host_routine_signatures takes.");
+DEFINE_bool(verify_host_routines, false,
+            "Also run the guest code of replaced functions and log any "
+            "difference from the host routine. Unreliable if other threads "
+            "touch the same memory.");
 
 // Breakpoints:
 DEFINE_uint64(break_on_instruction, 0,
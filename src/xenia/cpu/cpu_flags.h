@@ -26,6 +26,27 @@ DECLARE_bool(trace_function_data);
 DECLARE_bool(disable_global_lock);
 
 DECLARE_bool(validate_hir);
+DECLARE_bool(compile_stats);
+DECLARE_int32(max_pass_group_iterations);
+
+DECLARE_string(float_precision);
+
+DECLARE_int32(background_compile_threads);
+
+DECLARE_bool(tiered_compilation);
+DECLARE_int32(tiered_compilation_threshold);
+DECLARE_bool(interpret_cold_functions);
+DECLARE_int32(interpreter_threshold);
+
+DECLARE_bool(inline_calls);
+DECLARE_int32(inline_max_instructions);
+
+DECLARE_bool(learn_mmio_sites);
+DECLARE_bool(mmio_access_stats);
+
+DECLARE_string(host_routine_signatures);
+DECLARE_bool(log_function_signatures);
+DECLARE_bool(verify_host_routines);
 
 DECLARE_uint64(break_on_instruction);
 DECLARE_int32(break_condition_gpr);
@@ -9,79 +9,205 @@
 
 #include "xenia/cpu/entry_table.h"
 
+#include <algorithm>
+
+#include "xenia/base/assert.h"
 #include "xenia/base/profiling.h"
-#include "xenia/base/threading.h"
+#include "xenia/cpu/function.h"
 
 namespace xe {
 namespace cpu {
 
-EntryTable::EntryTable() = default;
+// Must be a power of two.
+static const size_t kInitialTableCapacity = 16 * 1024;
+
+EntryTable::Table::Table(size_t capacity)
+    : capacity(capacity), slots(new Slot[capacity]) {
+  for (size_t i = 0; i < capacity; ++i) {
+    slots[i].address.store(kEmptyAddress, std::memory_order_relaxed);
+    slots[i].entry.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+EntryTable::EntryTable() {
+  tables_.emplace_back(new Table(kInitialTableCapacity));
+  table_.store(tables_.back().get(), std::memory_order_release);
+}
 
 EntryTable::~EntryTable() {
   auto global_lock = global_critical_region_.Acquire();
-  for (auto it : map_) {
-    Entry* entry = it.second;
-    delete entry;
+  range_map_.clear();
+  entries_.clear();
+  table_.store(nullptr, std::memory_order_release);
+  tables_.clear();
+}
+
+Entry* EntryTable::Find(uint32_t address) const {
+  const Table* table;
+  do {
+    table = table_.load(std::memory_order_acquire);
+    size_t mask = table->capacity - 1;
+    for (size_t i = HashAddress(address, table->capacity);;
+         i = (i + 1) & mask) {
+      uint32_t slot_address =
+          table->slots[i].address.load(std::memory_order_acquire);
+      if (slot_address == address) {
+        // The entry is always published before the address.
+        return table->slots[i].entry.load(std::memory_order_acquire);
+      } else if (slot_address == kEmptyAddress) {
+        break;
+      }
+    }
+    // Not found. If the table was swapped out from under us the entry may
+    // only exist in the new one.
+  } while (table != table_.load(std::memory_order_acquire));
+  return nullptr;
+}
+
+void EntryTable::Insert(Entry* entry) {
+  // Global lock must be held.
+  Table* table = table_.load(std::memory_order_relaxed);
+  if ((entries_.size() + 1) * 4 > table->capacity * 3) {
+    // Over 75% full - grow. Readers may still be using the old table so it is
+    // kept around until we are destroyed.
+    tables_.emplace_back(new Table(table->capacity * 2));
+    Table* new_table = tables_.back().get();
+    size_t mask = new_table->capacity - 1;
+    for (auto& existing_entry : entries_) {
+      size_t i = HashAddress(existing_entry->address, new_table->capacity);
+      while (new_table->slots[i].address.load(std::memory_order_relaxed) !=
+             kEmptyAddress) {
+        i = (i + 1) & mask;
+      }
+      new_table->slots[i].entry.store(existing_entry.get(),
+                                      std::memory_order_relaxed);
+      new_table->slots[i].address.store(existing_entry->address,
+                                        std::memory_order_relaxed);
+    }
+    table_.store(new_table, std::memory_order_release);
+    table = new_table;
   }
+
+  size_t mask = table->capacity - 1;
+  size_t i = HashAddress(entry->address, table->capacity);
+  while (table->slots[i].address.load(std::memory_order_relaxed) !=
+         kEmptyAddress) {
+    i = (i + 1) & mask;
+  }
+  table->slots[i].entry.store(entry, std::memory_order_release);
+  table->slots[i].address.store(entry->address, std::memory_order_release);
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
+  Entry* entry = Find(address);
   if (entry) {
     // TODO(benvanik): wait if needed?
-    if (entry->status != Entry::STATUS_READY) {
+    if (entry->status.load(std::memory_order_acquire) != Entry::STATUS_READY) {
       entry = nullptr;
     }
   }
   return entry;
 }
 
+void EntryTable::WaitForEntry(Entry* entry) {
+  xe::threading::Event* ready_event;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    if (entry->status.load(std::memory_order_acquire) !=
+        Entry::STATUS_COMPILING) {
+      return;
+    }
+    // Complete() signals under the lock, so checking the status and creating
+    // the event here can't miss the wakeup.
+    if (!entry->ready_event) {
+      entry->ready_event = xe::threading::Event::CreateManualResetEvent(false);
+    }
+    ready_event = entry->ready_event.get();
+  }
+  xe::threading::Wait(ready_event, false);
+}
+
 Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
-  // TODO(benvanik): replace with a map with wait-free for find.
-  // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
+  // Fast path: the entry exists and is done compiling.
+  Entry* entry = Find(address);
+  if (!entry) {
+    auto global_lock = global_critical_region_.Acquire();
+    // Check again now that we hold the lock, as another thread may have
+    // beaten us to it.
+    entry = Find(address);
+    if (!entry) {
+      // Create and return for initialization.
+      auto new_entry = std::make_unique<Entry>();
+      new_entry->address = address;
+      new_entry->end_address = 0;
+      new_entry->status = Entry::STATUS_COMPILING;
+      new_entry->function = nullptr;
+      entry = new_entry.get();
+      Insert(entry);
+      entries_.push_back(std::move(new_entry));
+      global_lock.unlock();
+      *out_entry = entry;
+      return Entry::STATUS_NEW;
+    }
+  }
+
+  // If we aren't ready yet block until the compiling thread finishes.
+  if (entry->status.load(std::memory_order_acquire) ==
+      Entry::STATUS_COMPILING) {
+    WaitForEntry(entry);
+  }
+  *out_entry = entry;
+  return entry->status.load(std::memory_order_acquire);
+}
 
+void EntryTable::Complete(Entry* entry, Entry::Status status) {
+  assert_true(status == Entry::STATUS_READY ||
+              status == Entry::STATUS_FAILED);
   auto global_lock = global_critical_region_.Acquire();
-  const auto& it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : nullptr;
-  Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // Still compiling, so spin.
-      do {
-        global_lock.unlock();
-        // TODO(benvanik): sleep for less time?
-        xe::threading::Sleep(std::chrono::microseconds(10));
-        global_lock.lock();
-      } while (entry->status == Entry::STATUS_COMPILING);
+  entry->status.store(status, std::memory_order_release);
+  if (status == Entry::STATUS_READY) {
+    range_map_[entry->address] = entry;
+    if (entry->end_address > entry->address) {
+      max_entry_size_ =
+          std::max(max_entry_size_, entry->end_address - entry->address);
     }
-    status = entry->status;
-  } else {
-    // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_[address] = entry;
-    status = Entry::STATUS_NEW;
   }
-  global_lock.unlock();
-  *out_entry = entry;
-  return status;
+  if (entry->ready_event) {
+    entry->ready_event->Set();
+  }
+}
+
+bool EntryTable::ReplaceFunction(Function* function, Function* replacement) {
+  assert_true(function->address() == replacement->address());
+  auto global_lock = global_critical_region_.Acquire();
+  Entry* entry = Find(function->address());
+  if (!entry ||
+      entry->status.load(std::memory_order_acquire) != Entry::STATUS_READY ||
+      entry->function.load(std::memory_order_relaxed) != function) {
+    return false;
+  }
+  entry->end_address = replacement->end_address();
+  if (entry->end_address > entry->address) {
+    max_entry_size_ =
+        std::max(max_entry_size_, entry->end_address - entry->address);
+  }
+  entry->function.store(replacement, std::memory_order_release);
+  return true;
 }
 
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
   auto global_lock = global_critical_region_.Acquire();
   std::vector<Function*> fns;
-  for (auto& it : map_) {
-    Entry* entry = it.second;
+  // Only entries starting within the largest function size below the address
+  // can contain it.
+  uint32_t low_address =
+      address > max_entry_size_ ? address - max_entry_size_ : 0;
+  auto it = range_map_.lower_bound(low_address);
+  auto end_it = range_map_.upper_bound(address);
+  for (; it != end_it; ++it) {
+    Entry* entry = it->second;
     if (address >= entry->address && address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
-        fns.push_back(entry->function);
-      }
+      fns.push_back(entry->function.load(std::memory_order_acquire));
     }
   }
   return fns;
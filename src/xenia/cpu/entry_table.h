@@ -10,10 +10,13 @@
 #ifndef XENIA_CPU_ENTRY_TABLE_H_
 #define XENIA_CPU_ENTRY_TABLE_H_
 
-#include <unordered_map>
+#include <atomic>
+#include <map>
+#include <memory>
 #include <vector>
 
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 
 namespace xe {
 namespace cpu {
@@ -30,10 +33,16 @@ typedef struct Entry_t {
 
   uint32_t address;
   uint32_t end_address;
-  Status status;
-  Function* function;
+  std::atomic<Status> status;
+  // Current version of the function. Swapped when the function is replaced.
+  std::atomic<Function*> function;
+  // Created on demand when a thread has to wait for compilation to finish.
+  std::unique_ptr<xe::threading::Event> ready_event;
 } Entry;
 
+// Maps guest addresses to the functions defined at them.
+// Lookups of existing entries are lock-free; only inserting new entries and
+// waiting on entries still being compiled take the global lock.
 class EntryTable {
  public:
   EntryTable();
@@ -42,12 +51,50 @@ class EntryTable {
   Entry* Get(uint32_t address);
   Entry::Status GetOrCreate(uint32_t address, Entry** out_entry);
 
+  // Transitions an entry returned as STATUS_NEW by GetOrCreate to its final
+  // status and wakes any threads waiting on it.
+  void Complete(Entry* entry, Entry::Status status);
+
+  // Makes the replacement the function of the ready entry at its address, if
+  // that is still the given function. The given function is left untouched,
+  // as other threads may still be using it.
+  bool ReplaceFunction(Function* function, Function* replacement);
+
   std::vector<Function*> FindWithAddress(uint32_t address);
 
  private:
+  // Guest addresses are always 4b aligned, so this can never be a real key.
+  static const uint32_t kEmptyAddress = 0xFFFFFFFF;
+
+  struct Slot {
+    std::atomic<uint32_t> address;
+    std::atomic<Entry*> entry;
+  };
+  struct Table {
+    explicit Table(size_t capacity);
+    size_t capacity;
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  static size_t HashAddress(uint32_t address, size_t capacity) {
+    return ((address >> 2) * 2654435761u) & (capacity - 1);
+  }
+
+  // Lock-free probe of the current table. May miss entries inserted during a
+  // concurrent resize, so callers must re-check under the lock on a miss.
+  Entry* Find(uint32_t address) const;
+  void Insert(Entry* entry);
+  void WaitForEntry(Entry* entry);
+
   xe::global_critical_region global_critical_region_;
-  // TODO(benvanik): replace with a better data structure.
-  std::unordered_map<uint32_t, Entry*> map_;
+  std::atomic<Table*> table_;
+  // All tables ever allocated. Old tables are kept alive as readers may still
+  // be probing them.
+  std::vector<std::unique_ptr<Table>> tables_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+  // Ready entries sorted by start address, used for range queries.
+  std::map<uint32_t, Entry*> range_map_;
+  uint32_t max_entry_size_ = 0;
 };
 
 }  // namespace cpu
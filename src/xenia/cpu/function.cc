@@ -10,6 +10,7 @@
 #include "xenia/cpu/function.h"
 
 #include "xenia/base/logging.h"
+#include "xenia/base/mutex.h"
 #include "xenia/cpu/symbol.h"
 #include "xenia/cpu/thread_state.h"
 
@@ -129,6 +130,10 @@ bool GuestFunction::Call(ThreadState* thread_state, uint32_t return_address) {
     ThreadState::Bind(thread_state);
   }
 
+  // Generated code takes the global lock inline as this thread.
+  thread_state->context()->host_thread_token =
+      xe::global_mutex::current_thread_token();
+
   bool result = CallImpl(thread_state, return_address);
 
   if (original_thread_state != thread_state) {
@@ -32,6 +32,12 @@ struct SourceMapEntry {
   uint32_t code_offset;    // Offset from emitted code start.
 };
 
+// Inclusive range of guest instructions.
+struct GuestCodeRange {
+  uint32_t address;
+  uint32_t end_address;
+};
+
 class Function : public Symbol {
  public:
   enum class Behavior {
@@ -95,6 +101,20 @@ class BuiltinFunction : public Function {
   void* arg1_ = nullptr;
 };
 
+// Which compiler pipeline produced the current machine code of a function.
+enum class CompilationTier {
+  // Not yet compiled.
+  kNone = 0,
+  // Run by the interpreter through a thunk, until called often enough to be
+  // compiled.
+  kInterpreted,
+  // Minimal pass set, instrumented to count calls so that hot functions can be
+  // recompiled.
+  kBaseline,
+  // Full optimizing pass set.
+  kOptimized,
+};
+
 class GuestFunction : public Function {
  public:
   typedef void (*ExternHandler)(ppc::PPCContext* ppc_context,
@@ -111,12 +131,34 @@ class GuestFunction : public Function {
   virtual uint8_t* machine_code() const = 0;
   virtual size_t machine_code_length() const = 0;
 
+  CompilationTier tier() const { return tier_; }
+  void set_tier(CompilationTier value) { tier_ = value; }
+
   FunctionDebugInfo* debug_info() const { return debug_info_.get(); }
   void set_debug_info(std::unique_ptr<FunctionDebugInfo> debug_info) {
     debug_info_ = std::move(debug_info);
   }
   FunctionTraceData& trace_data() { return trace_data_; }
   std::vector<SourceMapEntry>& source_map() { return source_map_; }
+  // Guest code of other functions that the machine code was generated from,
+  // such as inlined callees.
+  std::vector<GuestCodeRange>& inlined_ranges() { return inlined_ranges_; }
+
+  // Builtin that runs a host implementation in place of the guest code, set
+  // when the scanner recognizes the function as a known routine.
+  Function* host_replacement() const { return host_replacement_; }
+  void set_host_replacement(Function* value) { host_replacement_ = value; }
+  // Whether the scanner may give the function a host replacement.
+  bool allows_host_replacement() const { return allows_host_replacement_; }
+  void set_allows_host_replacement(bool value) {
+    allows_host_replacement_ = value;
+  }
+  // Set on the copies used to run the guest code of replaced functions. They
+  // are only called directly by the frontend, so their code never takes over
+  // the address through the indirection table or linked calls, and is neither
+  // persisted nor restored.
+  bool is_private_copy() const { return is_private_copy_; }
+  void set_is_private_copy(bool value) { is_private_copy_ = value; }
 
   ExternHandler extern_handler() const { return extern_handler_; }
   Export* export_data() const { return export_data_; }
@@ -139,6 +181,11 @@ class GuestFunction : public Function {
   std::unique_ptr<FunctionDebugInfo> debug_info_;
   FunctionTraceData trace_data_;
   std::vector<SourceMapEntry> source_map_;
+  std::vector<GuestCodeRange> inlined_ranges_;
+  CompilationTier tier_ = CompilationTier::kNone;
+  Function* host_replacement_ = nullptr;
+  bool allows_host_replacement_ = true;
+  bool is_private_copy_ = false;
   ExternHandler extern_handler_ = nullptr;
   Export* export_data_ = nullptr;
 };
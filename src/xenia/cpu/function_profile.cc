@@ -0,0 +1,146 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/function_profile.h"
+
+#include <cstring>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/function.h"
+
+#include "third_party/xxhash/xxhash.h"
+
+namespace xe {
+namespace cpu {
+
+uint64_t FunctionProfile::instruction_count(uint32_t address) const {
+  if (address < address_ || address > end_address_) {
+    return 0;
+  }
+  size_t index = (address - address_) / 4;
+  return index < instruction_counts_.size() ? instruction_counts_[index] : 0;
+}
+
+bool ExecutionProfile::Save(const std::wstring& path, Memory* memory,
+                            const std::vector<GuestFunction*>& functions) {
+  xe::filesystem::CreateParentFolder(path);
+  auto file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Unable to open function profile file for writing");
+    return false;
+  }
+
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = xe::byte_swap('XPRF');
+  header.version = kVersion;
+  for (auto function : functions) {
+    if (function->trace_data().is_valid()) {
+      ++header.function_count;
+    }
+  }
+  fwrite(&header, sizeof(header), 1, file);
+  for (auto function : functions) {
+    auto& trace_data = function->trace_data();
+    if (trace_data.is_valid()) {
+      uint64_t guest_code_hash = HashGuestCode(memory, function->address(),
+                                               function->end_address());
+      fwrite(&guest_code_hash, sizeof(guest_code_hash), 1, file);
+      fwrite(trace_data.header(), trace_data.header()->data_size, 1, file);
+    }
+  }
+  fclose(file);
+
+  XELOGI("Wrote profiles for %u functions", header.function_count);
+  return true;
+}
+
+bool ExecutionProfile::Load(const std::wstring& path) {
+  auto file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("Unable to open function profile file");
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  std::vector<uint8_t> data(static_cast<size_t>(ftell(file)));
+  fseek(file, 0, SEEK_SET);
+  bool read_ok = !data.empty() && fread(data.data(), data.size(), 1, file) == 1;
+  fclose(file);
+
+  auto header = reinterpret_cast<const FileHeader*>(data.data());
+  if (!read_ok || data.size() < sizeof(FileHeader) ||
+      header->magic != xe::byte_swap('XPRF') || header->version != kVersion) {
+    XELOGE("Function profile file is invalid or from an incompatible version");
+    return false;
+  }
+
+  size_t offset = sizeof(FileHeader);
+  for (uint32_t i = 0; i < header->function_count; ++i) {
+    if (offset + sizeof(uint64_t) + FunctionTraceData::SizeOfHeader() >
+        data.size()) {
+      break;
+    }
+    uint64_t guest_code_hash =
+        *reinterpret_cast<const uint64_t*>(data.data() + offset);
+    offset += sizeof(uint64_t);
+    auto trace_header = reinterpret_cast<const FunctionTraceData::Header*>(
+        data.data() + offset);
+    if (trace_header->data_size < FunctionTraceData::SizeOfHeader() ||
+        offset + trace_header->data_size > data.size()) {
+      break;
+    }
+
+    auto& profile = functions_[trace_header->start_address];
+    profile.address_ = trace_header->start_address;
+    profile.end_address_ = trace_header->end_address;
+    profile.guest_code_hash_ = guest_code_hash;
+    profile.call_count_ = trace_header->function_call_count;
+    profile.instruction_counts_.clear();
+    size_t count_size =
+        trace_header->data_size - FunctionTraceData::SizeOfHeader();
+    if (count_size) {
+      auto counts = reinterpret_cast<const uint64_t*>(trace_header + 1);
+      profile.instruction_counts_.assign(counts,
+                                         counts + count_size / sizeof(uint64_t));
+    }
+
+    offset += trace_header->data_size;
+  }
+
+  XELOGI("Loaded profiles for %d functions", int(functions_.size()));
+  return true;
+}
+
+uint64_t ExecutionProfile::HashGuestCode(Memory* memory, uint32_t address,
+                                         uint32_t end_address) {
+  return XXH64(memory->TranslateVirtual(address), end_address - address + 4,
+               0);
+}
+
+const FunctionProfile* ExecutionProfile::Lookup(Memory* memory,
+                                                uint32_t address,
+                                                uint32_t end_address) const {
+  auto it = functions_.find(address);
+  if (it == functions_.end()) {
+    return nullptr;
+  }
+  // The title may have been patched or updated since the profile was made.
+  auto& profile = it->second;
+  if (profile.end_address() != end_address ||
+      profile.guest_code_hash() !=
+          HashGuestCode(memory, address, end_address)) {
+    return nullptr;
+  }
+  return &profile;
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,91 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_FUNCTION_PROFILE_H_
+#define XENIA_CPU_FUNCTION_PROFILE_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/cpu/function_trace_data.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace cpu {
+
+class GuestFunction;
+
+// Execution counts recorded for a single guest function in a previous run.
+class FunctionProfile {
+ public:
+  uint32_t address() const { return address_; }
+  uint32_t end_address() const { return end_address_; }
+  // Hash of the guest instructions in [address, end_address] when recorded.
+  uint64_t guest_code_hash() const { return guest_code_hash_; }
+  uint64_t call_count() const { return call_count_; }
+
+  // True if per-instruction counts were recorded
+  // (--trace_function_coverage).
+  bool has_instruction_counts() const { return !instruction_counts_.empty(); }
+
+  // Number of times the instruction at the given guest address executed, or 0
+  // if unknown.
+  uint64_t instruction_count(uint32_t address) const;
+
+ private:
+  friend class ExecutionProfile;
+
+  uint32_t address_ = 0;
+  uint32_t end_address_ = 0;
+  uint64_t guest_code_hash_ = 0;
+  uint64_t call_count_ = 0;
+  std::vector<uint64_t> instruction_counts_;
+};
+
+// Function profiles for a whole run.
+// Files are a small header followed by the FunctionTraceData of every traced
+// function, exactly as laid out in memory, each preceded by a hash of the
+// function's guest code. They can be written from any run with function
+// tracing or tiered compilation enabled.
+class ExecutionProfile {
+ public:
+  // Writes the trace data of all given functions to the file.
+  static bool Save(const std::wstring& path, Memory* memory,
+                   const std::vector<GuestFunction*>& functions);
+  static uint64_t HashGuestCode(Memory* memory, uint32_t address,
+                                uint32_t end_address);
+
+  bool Load(const std::wstring& path);
+
+  // Returns the profile of the function starting at the given address, if it
+  // was recorded for the same guest code it now has.
+  const FunctionProfile* Lookup(Memory* memory, uint32_t address,
+                                uint32_t end_address) const;
+
+  size_t function_count() const { return functions_.size(); }
+
+ private:
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t function_count;
+    uint32_t reserved;
+    // { uint64_t guest_code_hash; FunctionTraceData data; }
+    //     functions[function_count];
+  };
+  static const uint32_t kVersion = 2;
+
+  std::unordered_map<uint32_t, FunctionProfile> functions_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_FUNCTION_PROFILE_H_
@@ -629,6 +629,18 @@ void HIRBuilder::MergeAdjacentBlocks(Block* left, Block* right) {
   }
 }
 
+void HIRBuilder::ReorderBlocks(const std::vector<Block*>& order) {
+  if (order.empty()) {
+    return;
+  }
+  block_head_ = order.front();
+  block_tail_ = order.back();
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i]->prev = i ? order[i - 1] : nullptr;
+    order[i]->next = i + 1 < order.size() ? order[i + 1] : nullptr;
+  }
+}
+
 Block* HIRBuilder::AppendBlock() {
   Block* block = arena_->Alloc<Block>();
   block->ordinal = UINT16_MAX;
@@ -1587,38 +1599,46 @@ Value* HIRBuilder::Div(Value* value1, Value* value2,
   return i->dest;
 }
 
-Value* HIRBuilder::MulAdd(Value* value1, Value* value2, Value* value3) {
+Value* HIRBuilder::MulAdd(Value* value1, Value* value2, Value* value3,
+                          uint32_t arithmetic_flags) {
   ASSERT_TYPES_EQUAL(value1, value2);
   ASSERT_TYPES_EQUAL(value1, value3);
 
+  // Splitting out a constant multiply rounds twice, so fused operations are
+  // left for constant propagation to fold once all operands are known.
   bool c1 = value1->IsConstant();
   bool c2 = value2->IsConstant();
-  if (c1 && c2) {
+  if (c1 && c2 && !(arithmetic_flags & ARITHMETIC_FUSED)) {
     Value* dest = CloneValue(value1);
     dest->Mul(value2);
     return Add(dest, value3);
   }
 
-  Instr* i = AppendInstr(OPCODE_MUL_ADD_info, 0, AllocValue(value1->type));
+  Instr* i = AppendInstr(OPCODE_MUL_ADD_info, arithmetic_flags,
+                         AllocValue(value1->type));
   i->set_src1(value1);
   i->set_src2(value2);
   i->set_src3(value3);
   return i->dest;
 }
 
-Value* HIRBuilder::MulSub(Value* value1, Value* value2, Value* value3) {
+Value* HIRBuilder::MulSub(Value* value1, Value* value2, Value* value3,
+                          uint32_t arithmetic_flags) {
   ASSERT_TYPES_EQUAL(value1, value2);
   ASSERT_TYPES_EQUAL(value1, value3);
 
+  // Splitting out a constant multiply rounds twice, so fused operations are
+  // left for constant propagation to fold once all operands are known.
   bool c1 = value1->IsConstant();
   bool c2 = value2->IsConstant();
-  if (c1 && c2) {
+  if (c1 && c2 && !(arithmetic_flags & ARITHMETIC_FUSED)) {
     Value* dest = CloneValue(value1);
     dest->Mul(value2);
     return Sub(dest, value3);
   }
 
-  Instr* i = AppendInstr(OPCODE_MUL_SUB_info, 0, AllocValue(value1->type));
+  Instr* i = AppendInstr(OPCODE_MUL_SUB_info, arithmetic_flags,
+                         AllocValue(value1->type));
   i->set_src1(value1);
   i->set_src2(value2);
   i->set_src3(value3);
@@ -64,6 +64,9 @@ class HIRBuilder {
   void RemoveEdge(Edge* edge);
   void RemoveBlock(Block* block);
   void MergeAdjacentBlocks(Block* left, Block* right);
+  // Relinks the blocks in the given order, which must contain every block.
+  // Only valid after Finalize, once no block falls through to the next.
+  void ReorderBlocks(const std::vector<Block*>& order);
 
   // static allocations:
   // Value* AllocStatic(size_t length);
@@ -190,8 +193,10 @@ class HIRBuilder {
   Value* Mul(Value* value1, Value* value2, uint32_t arithmetic_flags = 0);
   Value* MulHi(Value* value1, Value* value2, uint32_t arithmetic_flags = 0);
   Value* Div(Value* value1, Value* value2, uint32_t arithmetic_flags = 0);
-  Value* MulAdd(Value* value1, Value* value2, Value* value3);  // (1 * 2) + 3
-  Value* MulSub(Value* value1, Value* value2, Value* value3);  // (1 * 2) - 3
+  Value* MulAdd(Value* value1, Value* value2, Value* value3,
+                uint32_t arithmetic_flags = 0);  // (1 * 2) + 3
+  Value* MulSub(Value* value1, Value* value2, Value* value3,
+                uint32_t arithmetic_flags = 0);  // (1 * 2) - 3
   Value* Neg(Value* value);
   Value* Abs(Value* value);
   Value* Sqrt(Value* value);
@@ -36,6 +36,9 @@ enum RoundMode {
 
 enum LoadStoreFlags {
   LOAD_STORE_BYTE_SWAP = 1 << 0,
+  // The guest instruction has faulted on an MMIO range before, so the address
+  // is checked at runtime instead of accessing memory directly.
+  LOAD_STORE_MMIO = 1 << 1,
 };
 
 enum PrefetchFlags {
@@ -46,6 +49,9 @@ enum PrefetchFlags {
 enum ArithmeticFlags {
   ARITHMETIC_UNSIGNED = (1 << 2),
   ARITHMETIC_SATURATE = (1 << 3),
+  // MUL_ADD/MUL_SUB must round once, as the guest does, even when the host
+  // has no fused multiply-add.
+  ARITHMETIC_FUSED = (1 << 4),
 };
 
 constexpr uint32_t MakePermuteMask(uint32_t sel_x, uint32_t x, uint32_t sel_y,
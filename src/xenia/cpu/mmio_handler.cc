@@ -9,17 +9,23 @@
 
 #include "xenia/cpu/mmio_handler.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <utility>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/exception_handler.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/cpu/cpu_flags.h"
 
 namespace xe {
 namespace cpu {
 
 MMIOHandler* MMIOHandler::global_handler_ = nullptr;
+MMIOAccessCounters MMIOHandler::access_counters_ = {{0}, {0}};
 
 std::unique_ptr<MMIOHandler> MMIOHandler::Install(uint8_t* virtual_membase,
                                                   uint8_t* physical_membase,
@@ -43,6 +49,16 @@ std::unique_ptr<MMIOHandler> MMIOHandler::Install(uint8_t* virtual_membase,
 MMIOHandler::~MMIOHandler() {
   ExceptionHandler::Uninstall(ExceptionCallbackThunk, this);
 
+  if (FLAGS_mmio_access_stats) {
+    XELOGI("MMIO: %" PRIu64 " accesses made directly (faults avoided), %" PRIu64
+           " faulted, %d learned access sites",
+           uint64_t(access_counters_.direct),
+           uint64_t(access_counters_.faulted), int(access_sites_.size()));
+  } else {
+    XELOGI("MMIO: %" PRIu64 " accesses faulted, %d learned access sites",
+           uint64_t(access_counters_.faulted), int(access_sites_.size()));
+  }
+
   assert_true(global_handler_ == this);
   global_handler_ = nullptr;
 }
@@ -87,6 +103,53 @@ bool MMIOHandler::CheckStore(uint32_t virtual_address, uint32_t value) {
   return false;
 }
 
+void MMIOHandler::RecordAccessFault(uint64_t host_pc) {
+  if (!record_access_faults_) {
+    return;
+  }
+  size_t slot = size_t((host_pc * 0x9E3779B97F4A7C15ull) >> 56);
+  for (size_t n = 0; n < kAccessFaultSlotCount; ++n) {
+    auto& entry = access_faults_[(slot + n) % kAccessFaultSlotCount];
+    uint64_t expected = 0;
+    if (entry.compare_exchange_strong(expected, host_pc) ||
+        expected == host_pc) {
+      // Flagged after the slot is filled, so that a taker clearing the flag
+      // either sees the address or leaves the flag set for the next one.
+      has_access_faults_ = true;
+      return;
+    }
+  }
+}
+
+std::vector<uint64_t> MMIOHandler::TakeAccessFaults() {
+  std::vector<uint64_t> host_pcs;
+  if (!has_access_faults_.exchange(false)) {
+    return host_pcs;
+  }
+  for (auto& entry : access_faults_) {
+    uint64_t host_pc = entry.exchange(0);
+    if (host_pc) {
+      host_pcs.push_back(host_pc);
+    }
+  }
+  return host_pcs;
+}
+
+bool MMIOHandler::AddAccessSite(uint32_t guest_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  return access_sites_.insert(guest_address).second;
+}
+
+bool MMIOHandler::IsAccessSite(uint32_t guest_address) {
+  auto global_lock = global_critical_region_.Acquire();
+  return access_sites_.count(guest_address) != 0;
+}
+
+size_t MMIOHandler::access_site_count() {
+  auto global_lock = global_critical_region_.Acquire();
+  return access_sites_.size();
+}
+
 uintptr_t MMIOHandler::AddPhysicalWriteWatch(uint32_t guest_address,
                                              size_t length,
                                              WriteWatchCallback callback,
@@ -99,82 +162,109 @@ uintptr_t MMIOHandler::AddPhysicalWriteWatch(uint32_t guest_address,
   // This means we need to round up, which will cause spurious access
   // violations and invalidations.
   // TODO(benvanik): only invalidate if actually within the region?
-  length = xe::round_up(length + (base_address % xe::memory::page_size()),
-                        xe::memory::page_size());
-  base_address = base_address - (base_address % xe::memory::page_size());
+  uint32_t page_size = uint32_t(xe::memory::page_size());
+  length = xe::round_up(length + (base_address % page_size), page_size);
+  base_address = base_address - (base_address % page_size);
 
-  // Add to table. The slot reservation may evict a previous watch, which
-  // could include our target, so we do it first.
   auto entry = new WriteWatchEntry();
   entry->address = base_address;
   entry->length = uint32_t(length);
   entry->callback = callback;
   entry->callback_context = callback_context;
   entry->callback_data = callback_data;
-  global_critical_region_.mutex().lock();
-  write_watches_.push_back(entry);
-  global_critical_region_.mutex().unlock();
 
-  // Make the desired range read only under all address spaces.
-  memory::Protect(physical_membase_ + entry->address, entry->length,
-                  xe::memory::PageAccess::kReadOnly, nullptr);
-  memory::Protect(virtual_membase_ + 0xA0000000 + entry->address, entry->length,
-                  xe::memory::PageAccess::kReadOnly, nullptr);
-  memory::Protect(virtual_membase_ + 0xC0000000 + entry->address, entry->length,
-                  xe::memory::PageAccess::kReadOnly, nullptr);
-  memory::Protect(virtual_membase_ + 0xE0000000 + entry->address, entry->length,
-                  xe::memory::PageAccess::kReadOnly, nullptr);
+  // Protect while holding the lock so that a watch ending on another thread
+  // can't make the pages writable again in between.
+  auto global_lock = global_critical_region_.Acquire();
+  write_watches_.insert(entry);
+  write_watch_index_.Insert(entry, entry->address / page_size,
+                            entry->length / page_size);
+  ProtectPhysicalPages(entry->address / page_size, entry->length / page_size,
+                       xe::memory::PageAccess::kReadOnly);
 
   return reinterpret_cast<uintptr_t>(entry);
 }
 
-void MMIOHandler::ClearWriteWatch(WriteWatchEntry* entry) {
-  memory::Protect(physical_membase_ + entry->address, entry->length,
-                  xe::memory::PageAccess::kReadWrite, nullptr);
-  memory::Protect(virtual_membase_ + 0xA0000000 + entry->address, entry->length,
-                  xe::memory::PageAccess::kReadWrite, nullptr);
-  memory::Protect(virtual_membase_ + 0xC0000000 + entry->address, entry->length,
-                  xe::memory::PageAccess::kReadWrite, nullptr);
-  memory::Protect(virtual_membase_ + 0xE0000000 + entry->address, entry->length,
-                  xe::memory::PageAccess::kReadWrite, nullptr);
+void MMIOHandler::ProtectPhysicalPages(uint32_t first_page,
+                                       uint32_t page_count,
+                                       xe::memory::PageAccess access) {
+  size_t page_size = xe::memory::page_size();
+  uint32_t address = uint32_t(first_page * page_size);
+  size_t length = page_count * page_size;
+  memory::Protect(physical_membase_ + address, length, access, nullptr);
+  memory::Protect(virtual_membase_ + 0xA0000000 + address, length, access,
+                  nullptr);
+  memory::Protect(virtual_membase_ + 0xC0000000 + address, length, access,
+                  nullptr);
+  memory::Protect(virtual_membase_ + 0xE0000000 + address, length, access,
+                  nullptr);
+}
+
+void MMIOHandler::RemoveWriteWatches(
+    const std::vector<WriteWatchEntry*>& entries) {
+  uint32_t page_size = uint32_t(xe::memory::page_size());
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  for (auto entry : entries) {
+    write_watches_.erase(entry);
+    write_watch_index_.Remove(entry, entry->address / page_size,
+                              entry->length / page_size);
+    ranges.emplace_back(entry->address / page_size,
+                        (entry->address + entry->length) / page_size);
+  }
+
+  // Watches usually overlap or sit next to each other, so merge their ranges
+  // to change the protection of each page at most once.
+  std::sort(ranges.begin(), ranges.end());
+  for (size_t n = 0; n < ranges.size();) {
+    uint32_t first_page = ranges[n].first;
+    uint32_t end_page = ranges[n].second;
+    for (++n; n < ranges.size() && ranges[n].first <= end_page; ++n) {
+      end_page = std::max(end_page, ranges[n].second);
+    }
+    write_watch_index_.ForEachUncoveredRun(
+        first_page, end_page - first_page,
+        [this](uint32_t run_first_page, uint32_t run_page_count) {
+          ProtectPhysicalPages(run_first_page, run_page_count,
+                               xe::memory::PageAccess::kReadWrite);
+        });
+  }
 }
 
 void MMIOHandler::CancelWriteWatch(uintptr_t watch_handle) {
   auto entry = reinterpret_cast<WriteWatchEntry*>(watch_handle);
 
-  // Allow access to the range again.
-  ClearWriteWatch(entry);
-
-  // Remove from table.
-  global_critical_region_.mutex().lock();
-  auto it = std::find(write_watches_.begin(), write_watches_.end(), entry);
-  if (it != write_watches_.end()) {
-    write_watches_.erase(it);
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    if (!write_watches_.count(entry)) {
+      // Already fired and deleted.
+      return;
+    }
+    // Allow access to the range again.
+    RemoveWriteWatches({entry});
   }
-  global_critical_region_.mutex().unlock();
 
   delete entry;
 }
 
 void MMIOHandler::InvalidateRange(uint32_t physical_address, size_t length) {
-  auto lock = global_critical_region_.Acquire();
-
-  for (auto it = write_watches_.begin(); it != write_watches_.end();) {
-    auto entry = *it;
-    if ((entry->address <= physical_address &&
-         entry->address + entry->length > physical_address) ||
-        (entry->address >= physical_address &&
-         entry->address < physical_address + length)) {
-      // This watch lies within the range. End it.
-      ClearWriteWatch(entry);
-      entry->callback(entry->callback_context, entry->callback_data,
-                      entry->address);
-
-      it = write_watches_.erase(it);
-      continue;
-    }
-
-    ++it;
+  uint32_t page_size = uint32_t(xe::memory::page_size());
+  uint32_t first_page = physical_address / page_size;
+  size_t end_address = physical_address + std::max(length, size_t(1));
+  uint32_t end_page =
+      uint32_t(xe::round_up(end_address, size_t(page_size)) / page_size);
+
+  // All watches within the range end.
+  std::vector<WriteWatchEntry*> pending_invalidates;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    write_watch_index_.FindOverlapping(first_page, end_page - first_page,
+                                       &pending_invalidates);
+    RemoveWriteWatches(pending_invalidates);
+  }
+  for (auto entry : pending_invalidates) {
+    entry->callback(entry->callback_context, entry->callback_data,
+                    entry->address);
+    delete entry;
   }
 }
 
@@ -183,7 +273,7 @@ bool MMIOHandler::CheckWriteWatch(uint64_t fault_address) {
   if (physical_address > 0x1FFFFFFF) {
     physical_address &= 0x1FFFFFFF;
   }
-  std::list<WriteWatchEntry*> pending_invalidates;
+  std::vector<WriteWatchEntry*> pending_invalidates;
   global_critical_region_.mutex().lock();
   // Now that we hold the lock, recheck and see if the pages are still
   // protected.
@@ -197,27 +287,17 @@ bool MMIOHandler::CheckWriteWatch(uint64_t fault_address) {
     return true;
   }
 
-  for (auto it = write_watches_.begin(); it != write_watches_.end();) {
-    auto entry = *it;
-    if (entry->address <= physical_address &&
-        entry->address + entry->length > physical_address) {
-      // Hit! Remove the writewatch.
-      pending_invalidates.push_back(entry);
-
-      ClearWriteWatch(entry);
-      it = write_watches_.erase(it);
-      continue;
-    }
-    ++it;
-  }
+  // Hit! Remove every watch on the page.
+  write_watch_index_.FindCovering(
+      physical_address / uint32_t(xe::memory::page_size()),
+      &pending_invalidates);
+  RemoveWriteWatches(pending_invalidates);
   global_critical_region_.mutex().unlock();
   if (pending_invalidates.empty()) {
     // Rethrow access violation - range was not being watched.
     return false;
   }
-  while (!pending_invalidates.empty()) {
-    auto entry = pending_invalidates.back();
-    pending_invalidates.pop_back();
+  for (auto entry : pending_invalidates) {
     entry->callback(entry->callback_context, entry->callback_data,
                     physical_address);
     delete entry;
@@ -460,6 +540,9 @@ bool MMIOHandler::ExceptionCallback(Exception* ex) {
   // Advance RIP to the next instruction so that we resume properly.
   ex->set_resume_pc(rip + mov.length);
 
+  ++access_counters_.faulted;
+  RecordAccessFault(rip);
+
   return true;
 }
 
@@ -10,11 +10,14 @@
 #ifndef XENIA_CPU_MMIO_HANDLER_H_
 #define XENIA_CPU_MMIO_HANDLER_H_
 
-#include <list>
+#include <atomic>
 #include <memory>
+#include <unordered_set>
 #include <vector>
 
+#include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/page_interval_index.h"
 
 namespace xe {
 class Exception;
@@ -41,6 +44,15 @@ struct MMIORange {
   MMIOWriteCallback write;
 };
 
+// Guest accesses to MMIO ranges, by how they reached the range callbacks.
+struct MMIOAccessCounters {
+  // Emulated after the host instruction faulted.
+  std::atomic<uint64_t> faulted;
+  // Made by generated code calling the range directly. Each one is a fault
+  // avoided. Only counted with --mmio_access_stats.
+  std::atomic<uint64_t> direct;
+};
+
 // NOTE: only one can exist at a time!
 class MMIOHandler {
  public:
@@ -51,6 +63,9 @@ class MMIOHandler {
                                               uint8_t* membase_end);
   static MMIOHandler* global_handler() { return global_handler_; }
 
+  // Incremented by generated code, so these live with the host image.
+  static MMIOAccessCounters* access_counters() { return &access_counters_; }
+
   bool RegisterRange(uint32_t virtual_address, uint32_t mask, uint32_t size,
                      void* context, MMIOReadCallback read_callback,
                      MMIOWriteCallback write_callback);
@@ -59,6 +74,20 @@ class MMIOHandler {
   bool CheckLoad(uint32_t virtual_address, uint32_t* out_value);
   bool CheckStore(uint32_t virtual_address, uint32_t value);
 
+  // While enabled, the host addresses of instructions whose faults have been
+  // handled as MMIO accesses are recorded, so that the code making them can be
+  // retranslated. Recording is lock-free as it happens in the exception
+  // handler, and everything else is left to whoever takes the addresses.
+  void set_record_access_faults(bool value) { record_access_faults_ = value; }
+  // Returns the addresses recorded since the last call, each once.
+  std::vector<uint64_t> TakeAccessFaults();
+
+  // Guest instructions known to access MMIO ranges through an address that
+  // isn't constant. Returns false if the site was already known.
+  bool AddAccessSite(uint32_t guest_address);
+  bool IsAccessSite(uint32_t guest_address);
+  size_t access_site_count();
+
   uintptr_t AddPhysicalWriteWatch(uint32_t guest_address, size_t length,
                                   WriteWatchCallback callback,
                                   void* callback_context, void* callback_data);
@@ -67,6 +96,7 @@ class MMIOHandler {
 
  protected:
   struct WriteWatchEntry {
+    // Physical address and length, both rounded out to host pages.
     uint32_t address;
     uint32_t length;
     WriteWatchCallback callback;
@@ -78,12 +108,21 @@ class MMIOHandler {
               uint8_t* membase_end)
       : virtual_membase_(virtual_membase),
         physical_membase_(physical_membase),
-        memory_end_(membase_end) {}
+        memory_end_(membase_end),
+        write_watch_index_(0x20000000 / uint32_t(xe::memory::page_size())) {}
 
   static bool ExceptionCallbackThunk(Exception* ex, void* data);
   bool ExceptionCallback(Exception* ex);
-
-  void ClearWriteWatch(WriteWatchEntry* entry);
+  // Async-signal-safe.
+  void RecordAccessFault(uint64_t host_pc);
+
+  // Changes the protection of a run of physical pages in all of the views
+  // they are mapped to.
+  void ProtectPhysicalPages(uint32_t first_page, uint32_t page_count,
+                            xe::memory::PageAccess access);
+  // Ends the watches, and then makes the pages that no other watch covers
+  // writable again with one protection change per contiguous run.
+  void RemoveWriteWatches(const std::vector<WriteWatchEntry*>& entries);
   bool CheckWriteWatch(uint64_t fault_address);
 
   uint8_t* virtual_membase_;
@@ -93,10 +132,21 @@ class MMIOHandler {
   std::vector<MMIORange> mapped_ranges_;
 
   xe::global_critical_region global_critical_region_;
-  // TODO(benvanik): data structure magic.
-  std::list<WriteWatchEntry*> write_watches_;
+  // Watches by the physical pages they cover.
+  PageIntervalIndex<WriteWatchEntry*> write_watch_index_;
+  // Every watch still active, so handles to ones that have fired are ignored.
+  std::unordered_set<WriteWatchEntry*> write_watches_;
+  std::unordered_set<uint32_t> access_sites_;
+
+  // Open addressed by host address. Faults are dropped while it's full, and
+  // recorded again the next time they happen.
+  static const size_t kAccessFaultSlotCount = 256;
+  std::atomic<bool> record_access_faults_ = {false};
+  std::atomic<bool> has_access_faults_ = {false};
+  std::atomic<uint64_t> access_faults_[kAccessFaultSlotCount] = {};
 
   static MMIOHandler* global_handler_;
+  static MMIOAccessCounters access_counters_;
 };
 
 }  // namespace cpu
@@ -16,13 +16,18 @@
 
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/processor.h"
 
 namespace xe {
 namespace cpu {
 
 Module::Module(Processor* processor)
-    : processor_(processor), memory_(processor->memory()) {}
+    : processor_(processor), memory_(processor->memory()) {
+  if (FLAGS_float_precision == "strict") {
+    float_precision_mode_ = FloatPrecisionMode::kStrict;
+  }
+}
 
 Module::~Module() = default;
 
@@ -147,10 +152,21 @@ Symbol::Status Module::DefineVariable(Symbol* symbol) {
   return DefineSymbol(symbol);
 }
 
+void Module::ReplaceFunction(std::unique_ptr<Function> replacement) {
+  auto global_lock = global_critical_region_.Acquire();
+  map_[replacement->address()] = replacement.get();
+  list_.emplace_back(std::move(replacement));
+}
+
 void Module::ForEachFunction(std::function<void(Function*)> callback) {
   auto global_lock = global_critical_region_.Acquire();
   for (auto& symbol : list_) {
-    if (symbol->type() == Symbol::Type::kFunction) {
+    if (symbol->type() != Symbol::Type::kFunction) {
+      continue;
+    }
+    // Replaced functions stay in the list but not in the map.
+    auto it = map_.find(symbol->address());
+    if (it != map_.end() && it->second == symbol.get()) {
       Function* info = static_cast<Function*>(symbol.get());
       callback(info);
     }
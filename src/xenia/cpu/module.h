@@ -26,6 +26,16 @@ namespace cpu {
 
 class Processor;
 
+// How closely guest floating-point results are reproduced where the host
+// differs.
+enum class FloatPrecisionMode {
+  // Whatever is fastest on the host. Multiply-add is fused when FMA is
+  // available and otherwise computed as a separate multiply and add.
+  kFast,
+  // Multiply-add always rounds once, as on the guest.
+  kStrict,
+};
+
 class Module {
  public:
   explicit Module(Processor* processor);
@@ -35,6 +45,15 @@ class Module {
 
   virtual const std::string& name() const = 0;
 
+  // Defaults to --float_precision. Must be set before the module is added to
+  // the processor, as translated code depends on it.
+  FloatPrecisionMode float_precision_mode() const {
+    return float_precision_mode_;
+  }
+  void set_float_precision_mode(FloatPrecisionMode mode) {
+    float_precision_mode_ = mode;
+  }
+
   virtual bool ContainsAddress(uint32_t address);
 
   Symbol* LookupSymbol(uint32_t address, bool wait = true);
@@ -45,6 +64,11 @@ class Module {
   Symbol::Status DefineFunction(Function* symbol);
   Symbol::Status DefineVariable(Symbol* symbol);
 
+  // Makes a fully defined replacement the function returned for its address.
+  // The function it replaces is kept alive, but is no longer enumerated, as
+  // threads may still be running its code.
+  void ReplaceFunction(std::unique_ptr<Function> replacement);
+
   void ForEachFunction(std::function<void(Function*)> callback);
   void ForEachSymbol(size_t start_index, size_t end_index,
                      std::function<void(Symbol*)> callback);
@@ -57,6 +81,7 @@ class Module {
 
   Processor* processor_ = nullptr;
   Memory* memory_ = nullptr;
+  FloatPrecisionMode float_precision_mode_ = FloatPrecisionMode::kFast;
 
  private:
   Symbol::Status DeclareSymbol(Symbol::Type type, uint32_t address,
@@ -66,6 +91,8 @@ class Module {
   xe::global_critical_region global_critical_region_;
   // TODO(benvanik): replace with a better data structure.
   std::unordered_map<uint32_t, Symbol*> map_;
+  // All symbols ever created, including replaced functions. Only those still
+  // in map_ are current.
   std::vector<std::unique_ptr<Symbol>> list_;
 };
 
@@ -407,9 +407,10 @@ typedef struct PPCContext_s {
   // Thread ID assigned to this context.
   uint32_t thread_id;
 
-  // Global interrupt lock, held while interrupts are disabled or interrupts are
-  // executing. This is shared among all threads and comes from the processor.
-  std::recursive_mutex* global_mutex;
+  // Identifies the host thread running this context as an owner of the global
+  // interrupt lock (xe::global_mutex), which is held while interrupts are
+  // disabled or interrupts are executing. Set whenever guest code is entered.
+  uintptr_t host_thread_token;
 
   // Used to shuttle data into externs. Contents volatile.
   uint64_t scratch;
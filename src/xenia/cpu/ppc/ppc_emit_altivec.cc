@@ -802,7 +802,8 @@ int InstrEmit_vlogefp128(PPCHIRBuilder& f, const InstrData& i) {
 int InstrEmit_vmaddfp_(PPCHIRBuilder& f, uint32_t vd, uint32_t va, uint32_t vb,
                        uint32_t vc) {
   // (VD) <- ((VA) * (VC)) + (VB)
-  Value* v = f.MulAdd(f.LoadVR(va), f.LoadVR(vc), f.LoadVR(vb));
+  Value* v = f.MulAdd(f.LoadVR(va), f.LoadVR(vc), f.LoadVR(vb),
+                      f.fused_arithmetic_flags());
   f.StoreVR(vd, v);
   return 0;
 }
@@ -820,7 +821,7 @@ int InstrEmit_vmaddfp128(PPCHIRBuilder& f, const InstrData& i) {
 int InstrEmit_vmaddcfp128(PPCHIRBuilder& f, const InstrData& i) {
   // (VD) <- ((VA) * (VD)) + (VB)
   Value* v = f.MulAdd(f.LoadVR(VX128_VA128), f.LoadVR(VX128_VD128),
-                      f.LoadVR(VX128_VB128));
+                      f.LoadVR(VX128_VB128), f.fused_arithmetic_flags());
   f.StoreVR(VX128_VD128, v);
   return 0;
 }
@@ -1135,9 +1136,10 @@ int InstrEmit_vmulfp128(PPCHIRBuilder& f, const InstrData& i) {
 int InstrEmit_vnmsubfp_(PPCHIRBuilder& f, uint32_t vd, uint32_t va, uint32_t vb,
                         uint32_t vc) {
   // (VD) <- -(((VA) * (VC)) - (VB))
-  // NOTE: only one rounding should take place, but that's hard...
-  // This really needs VFNMSUB132PS/VFNMSUB213PS/VFNMSUB231PS but that's AVX.
-  Value* v = f.Neg(f.MulSub(f.LoadVR(va), f.LoadVR(vc), f.LoadVR(vb)));
+  // NOTE: only one rounding takes place. Negating the result is exact, so
+  // this matches as long as the MulSub is fused.
+  Value* v = f.Neg(f.MulSub(f.LoadVR(va), f.LoadVR(vc), f.LoadVR(vb),
+                            f.fused_arithmetic_flags()));
   f.StoreVR(vd, v);
   return 0;
 }
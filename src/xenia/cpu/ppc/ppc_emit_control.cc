@@ -30,6 +30,13 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
                      bool expect_true = true, bool nia_is_lr = false) {
   uint32_t call_flags = 0;
 
+  // Calls to small leaf functions are replaced with their body.
+  if (lk && !cond && nia->IsConstant() &&
+      f.EmitInlinedCall(uint32_t(cia),
+                        uint32_t(nia->AsUint64() & 0xFFFFFFFF))) {
+    return 0;
+  }
+
   // TODO(benvanik): this may be wrong and overwrite LRs when not desired!
   // The docs say always, though...
   // Note that we do the update before we branch/call as we need it to
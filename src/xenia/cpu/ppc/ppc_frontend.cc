@@ -9,7 +9,18 @@
 
 #include "xenia/cpu/ppc/ppc_frontend.h"
 
-#include "xenia/base/atomic.h"
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/mutex.h"
+#include "xenia/cpu/backend/backend.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/compiler/passes/global_value_numbering_pass.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_emit.h"
 #include "xenia/cpu/ppc/ppc_opcode_info.h"
@@ -43,39 +54,91 @@ void CleanupOnShutdown() {}
 
 PPCFrontend::PPCFrontend(Processor* processor) : processor_(processor) {
   InitializeIfNeeded();
+  if (FLAGS_interpret_cold_functions) {
+    interpreter_.reset(new backend::interpreter::Interpreter(processor));
+  }
 }
 
 PPCFrontend::~PPCFrontend() {
   // Force cleanup now before we deinit.
   translator_pool_.Reset();
+
+  auto ticks_to_ms = [](uint64_t ticks) {
+    return double(ticks) * 1000.0 / double(Clock::host_tick_frequency());
+  };
+  if (interpreter_) {
+    XELOGI("Lowered %u interpreted functions in %.2fms, %u compiled since",
+           interpreted_stats_.count.load(),
+           ticks_to_ms(interpreted_stats_.host_ticks),
+           interpreter_->promoted_count());
+  }
+  if (FLAGS_tiered_compilation || FLAGS_interpret_cold_functions) {
+    XELOGI("Translated %u baseline functions in %.2fms",
+           baseline_stats_.count.load(),
+           ticks_to_ms(baseline_stats_.host_ticks));
+    XELOGI("Translated %u optimized functions in %.2fms",
+           optimized_stats_.count.load(),
+           ticks_to_ms(optimized_stats_.host_ticks));
+  }
+
+  auto& gvn_stats = compiler::passes::GlobalValueNumberingPass::stats();
+  if (gvn_stats.instrs_scanned) {
+    XELOGI("Value numbering eliminated %" PRIu64 " of %" PRIu64
+           " instructions (%" PRIu64 " loads)",
+           gvn_stats.instrs_eliminated.load(), gvn_stats.instrs_scanned.load(),
+           gvn_stats.loads_eliminated.load());
+  }
+
+  if (FLAGS_compile_stats) {
+    compiler::Compiler::LogStatistics();
+  }
 }
 
 Memory* PPCFrontend::memory() const { return processor_->memory(); }
 
+// The x64 backend emits the uncontended paths of these inline (see
+// X64Emitter::EmitGlobalLockFastPath), so they must be kept in sync.
+
 // Checks the state of the global lock and sets scratch to the current MSR
 // value.
 void CheckGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
-  auto global_mutex = reinterpret_cast<std::recursive_mutex*>(arg0);
+  auto mutex = reinterpret_cast<xe::global_mutex*>(arg0);
   auto global_lock_count = reinterpret_cast<int32_t*>(arg1);
-  std::lock_guard<std::recursive_mutex> lock(*global_mutex);
+  std::lock_guard<xe::global_mutex> lock(*mutex);
   ppc_context->scratch = *global_lock_count ? 0 : 0x8000;
 }
 
 // Enters the global lock. Safe to recursion.
 void EnterGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
-  auto global_mutex = reinterpret_cast<std::recursive_mutex*>(arg0);
+  auto mutex = reinterpret_cast<xe::global_mutex*>(arg0);
   auto global_lock_count = reinterpret_cast<int32_t*>(arg1);
-  global_mutex->lock();
-  xe::atomic_inc(global_lock_count);
+  mutex->lock();
+  // Only changed while holding the lock.
+  ++*global_lock_count;
 }
 
 // Leaves the global lock. Safe to recursion.
 void LeaveGlobalLock(PPCContext* ppc_context, void* arg0, void* arg1) {
-  auto global_mutex = reinterpret_cast<std::recursive_mutex*>(arg0);
+  auto mutex = reinterpret_cast<xe::global_mutex*>(arg0);
   auto global_lock_count = reinterpret_cast<int32_t*>(arg1);
-  auto new_lock_count = xe::atomic_dec(global_lock_count);
+  auto new_lock_count = --*global_lock_count;
   assert_true(new_lock_count >= 0);
-  global_mutex->unlock();
+  mutex->unlock();
+}
+
+// Runs the host routine replacing a guest function.
+void RunReplacedFunction(PPCContext* ppc_context, void* arg0, void* arg1) {
+  auto frontend = reinterpret_cast<PPCFrontend*>(arg0);
+  auto routine = static_cast<HostRoutine>(reinterpret_cast<uintptr_t>(arg1));
+  frontend->CallHostRoutine(ppc_context, routine);
+}
+
+// Runs the interpreter program of a cold function.
+void RunInterpretedFunction(PPCContext* ppc_context, void* arg0, void* arg1) {
+  auto interpreter = reinterpret_cast<backend::interpreter::Interpreter*>(arg0);
+  auto program = reinterpret_cast<backend::interpreter::InterpreterProgram*>(
+      ppc_context->scratch);
+  interpreter->Execute(program, ppc_context);
 }
 
 bool PPCFrontend::Initialize() {
@@ -87,6 +150,21 @@ bool PPCFrontend::Initialize() {
       processor_->DefineBuiltin("EnterGlobalLock", EnterGlobalLock, arg0, arg1);
   builtins_.leave_global_lock =
       processor_->DefineBuiltin("LeaveGlobalLock", LeaveGlobalLock, arg0, arg1);
+  for (uint32_t n = 1; n < kHostRoutineCount; ++n) {
+    auto routine = static_cast<HostRoutine>(n);
+    builtins_.host_routines[n] = processor_->DefineBuiltin(
+        std::string("Host_") + GetHostRoutineName(routine),
+        RunReplacedFunction, this, reinterpret_cast<void*>(uintptr_t(n)));
+  }
+  if (interpreter_) {
+    builtins_.interpret = processor_->DefineBuiltin(
+        "Interpret", RunInterpretedFunction, interpreter_.get(), nullptr);
+  }
+
+  if (!FLAGS_host_routine_signatures.empty() &&
+      !host_routine_signatures_.LoadFile(FLAGS_host_routine_signatures)) {
+    return false;
+  }
   return true;
 }
 
@@ -107,6 +185,105 @@ bool PPCFrontend::DefineFunction(GuestFunction* function,
   return result;
 }
 
+void PPCFrontend::CallHostRoutine(PPCContext* ppc_context,
+                                  HostRoutine routine) {
+  uint32_t address = uint32_t(ppc_context->scratch);
+  if (FLAGS_verify_host_routines) {
+    VerifyHostRoutine(ppc_context, routine, address);
+  } else if (!RunHostRoutine(routine, memory(), ppc_context)) {
+    CallGuestOriginal(ppc_context, address);
+  }
+}
+
+bool PPCFrontend::CallGuestOriginal(PPCContext* ppc_context,
+                                    uint32_t address) {
+  GuestFunction* original = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(guest_originals_mutex_);
+    auto it = guest_originals_.find(address);
+    if (it != guest_originals_.end()) {
+      original = it->second.get();
+    } else {
+      auto function =
+          static_cast<GuestFunction*>(processor_->QueryFunction(address));
+      assert_not_null(function);
+      auto copy = processor_->backend()->CreateGuestFunction(function->module(),
+                                                             address);
+      copy->set_end_address(function->end_address());
+      copy->set_name(function->name());
+      copy->set_allows_host_replacement(false);
+      copy->set_is_private_copy(true);
+      if (DefineFunction(copy.get(), 0)) {
+        copy->set_status(Symbol::Status::kDefined);
+        original = copy.get();
+        guest_originals_[address] = std::move(copy);
+      }
+    }
+  }
+  if (!original) {
+    XELOGE("Unable to translate the guest code of replaced function %.8X",
+           address);
+    return false;
+  }
+  return original->Call(ppc_context->thread_state, uint32_t(ppc_context->lr));
+}
+
+void PPCFrontend::VerifyHostRoutine(PPCContext* ppc_context,
+                                    HostRoutine routine, uint32_t address) {
+  // Only memcpy and memset write memory, to [r3, r3 + r5).
+  uint32_t dest = uint32_t(ppc_context->r[3]);
+  uint32_t size = routine == HostRoutine::kStrlen
+                      ? 0
+                      : uint32_t(ppc_context->r[5]);
+  uint8_t* dest_ptr = memory()->TranslateVirtual(dest);
+  std::vector<uint8_t> original_bytes(dest_ptr, dest_ptr + size);
+  uint64_t args[3] = {ppc_context->r[3], ppc_context->r[4], ppc_context->r[5]};
+
+  if (!CallGuestOriginal(ppc_context, address)) {
+    return;
+  }
+  uint64_t guest_result = ppc_context->r[3];
+  std::vector<uint8_t> guest_bytes(dest_ptr, dest_ptr + size);
+
+  // Rerun on the original inputs. The guest results are kept either way.
+  std::memcpy(dest_ptr, original_bytes.data(), size);
+  std::memcpy(&ppc_context->r[3], args, sizeof(args));
+  if (!RunHostRoutine(routine, memory(), ppc_context)) {
+    std::memcpy(dest_ptr, guest_bytes.data(), size);
+    ppc_context->r[3] = guest_result;
+    return;
+  }
+  uint64_t host_result = ppc_context->r[3];
+  bool memory_matches = !std::memcmp(dest_ptr, guest_bytes.data(), size);
+  if (uint32_t(host_result) != uint32_t(guest_result) || !memory_matches) {
+    XELOGE("Host %s differs from the guest code of %.8X: r3 %.8X vs %.8X, "
+           "memory %s",
+           GetHostRoutineName(routine), address, uint32_t(host_result),
+           uint32_t(guest_result), memory_matches ? "matches" : "differs");
+    std::memcpy(dest_ptr, guest_bytes.data(), size);
+  }
+  ppc_context->r[3] = guest_result;
+}
+
+void PPCFrontend::RecordTranslation(CompilationTier tier, uint64_t host_ticks,
+                                    uint64_t hir_arena_bytes) {
+  auto& stats = tier == CompilationTier::kInterpreted
+                    ? interpreted_stats_
+                    : tier == CompilationTier::kBaseline ? baseline_stats_
+                                                         : optimized_stats_;
+  ++stats.count;
+  stats.host_ticks += host_ticks;
+  stats.hir_arena_bytes += hir_arena_bytes;
+}
+
+const PPCFrontend::TierStats& PPCFrontend::tier_stats(
+    CompilationTier tier) const {
+  return tier == CompilationTier::kInterpreted
+             ? interpreted_stats_
+             : tier == CompilationTier::kBaseline ? baseline_stats_
+                                                  : optimized_stats_;
+}
+
 }  // namespace ppc
 }  // namespace cpu
 }  // namespace xe
@@ -10,10 +10,15 @@
 #ifndef XENIA_CPU_PPC_PPC_FRONTEND_H_
 #define XENIA_CPU_PPC_PPC_FRONTEND_H_
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "xenia/base/type_pool.h"
+#include "xenia/cpu/backend/interpreter/interpreter.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/ppc/ppc_host_routines.h"
 #include "xenia/memory.h"
 
 namespace xe {
@@ -33,6 +38,10 @@ struct PPCBuiltins {
   Function* check_global_lock;
   Function* enter_global_lock;
   Function* leave_global_lock;
+  // Runs the interpreter program whose pointer is in the context scratch.
+  Function* interpret;
+  // Replacements for recognized guest routines, indexed by HostRoutine.
+  Function* host_routines[kHostRoutineCount];
 };
 
 class PPCFrontend {
@@ -45,13 +54,54 @@ class PPCFrontend {
   Processor* processor() const { return processor_; }
   Memory* memory() const;
   PPCBuiltins* builtins() { return &builtins_; }
+  // Null unless cold functions are interpreted.
+  backend::interpreter::Interpreter* interpreter() const {
+    return interpreter_.get();
+  }
+
+  // Signatures of guest functions that are replaced by host routines.
+  PPCSignatureTable* host_routine_signatures() {
+    return &host_routine_signatures_;
+  }
 
   bool DeclareFunction(GuestFunction* function);
   bool DefineFunction(GuestFunction* function, uint32_t debug_info_flags);
 
+  // Handles a call to a function replaced by the host routine. The address of
+  // the function is in the context scratch. The guest code is run instead if
+  // the routine can't handle the arguments, and in addition to it when
+  // verifying host routines.
+  void CallHostRoutine(PPCContext* ppc_context, HostRoutine routine);
+
+  struct TierStats {
+    std::atomic<uint32_t> count = {0};
+    std::atomic<uint64_t> host_ticks = {0};
+    // HIR arena used by each function once fully compiled.
+    std::atomic<uint64_t> hir_arena_bytes = {0};
+  };
+
+  // Accumulates per-tier translation statistics, logged on shutdown.
+  void RecordTranslation(CompilationTier tier, uint64_t host_ticks,
+                         uint64_t hir_arena_bytes);
+  const TierStats& tier_stats(CompilationTier tier) const;
+
  private:
+  bool CallGuestOriginal(PPCContext* ppc_context, uint32_t address);
+  void VerifyHostRoutine(PPCContext* ppc_context, HostRoutine routine,
+                         uint32_t address);
+
   Processor* processor_;
   PPCBuiltins builtins_ = {0};
+  PPCSignatureTable host_routine_signatures_;
+  // Unregistered copies of replaced functions that run their guest code,
+  // translated on first use.
+  std::mutex guest_originals_mutex_;
+  std::unordered_map<uint32_t, std::unique_ptr<GuestFunction>>
+      guest_originals_;
+  std::unique_ptr<backend::interpreter::Interpreter> interpreter_;
+  TierStats interpreted_stats_;
+  TierStats baseline_stats_;
+  TierStats optimized_stats_;
   TypePool<PPCTranslator, PPCFrontend*> translator_pool_;
 };
 
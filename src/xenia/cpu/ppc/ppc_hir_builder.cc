@@ -17,6 +17,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/hir/label.h"
+#include "xenia/cpu/mmio_handler.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
@@ -68,25 +69,40 @@ void PPCHIRBuilder::Reset() {
   instr_offset_list_ = NULL;
   label_list_ = NULL;
   with_debug_info_ = false;
+  inline_calls_ = false;
+  strict_float_ = false;
+  profile_ = nullptr;
   HIRBuilder::Reset();
 }
 
-bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
+bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags,
+                         const FunctionProfile* profile) {
   SCOPE_profile_cpu_f("cpu");
 
   Memory* memory = frontend_->memory();
 
   function_ = function;
+  function_->inlined_ranges().clear();
   start_address_ = function_->address();
   instr_count_ = (function_->end_address() - function_->address()) / 4 + 1;
 
   with_debug_info_ = (flags & EMIT_DEBUG_COMMENTS) == EMIT_DEBUG_COMMENTS;
+  inline_calls_ = (flags & EMIT_INLINE_CALLS) == EMIT_INLINE_CALLS;
+  strict_float_ = (flags & EMIT_STRICT_FLOAT) == EMIT_STRICT_FLOAT;
+  profile_ = profile;
   if (with_debug_info_) {
     CommentFormat("%s fn %.8X-%.8X %s", function_->module()->name().c_str(),
                   function_->address(), function_->end_address(),
                   function_->name().c_str());
   }
 
+  // Recognized routines only call their host replacement, which needs to know
+  // what it replaced.
+  if (function_->host_replacement()) {
+    return EmitBuiltinThunk(function_, function_->host_replacement(),
+                            function_->address());
+  }
+
   // Allocate offset list.
   // This is used to quickly map labels to instructions.
   // The list is built as the instructions are traversed, with the values
@@ -102,6 +118,11 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   // Always mark entry with label.
   label_list_[0] = NewLabel();
 
+  // Instructions that faulted on MMIO when this function last ran.
+  auto mmio_handler = MMIOHandler::global_handler();
+  check_mmio_sites_ = FLAGS_learn_mmio_sites && mmio_handler &&
+                      mmio_handler->access_site_count();
+
   uint32_t start_address = function_->address();
   uint32_t end_address = function_->end_address();
   for (uint32_t address = start_address, offset = 0; address <= end_address;
@@ -184,6 +205,8 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
              disasm_info.name);
       Comment("UNIMPLEMENTED!");
       DebugBreak();
+    } else if (check_mmio_sites_ && mmio_handler->IsAccessSite(address)) {
+      MarkMmioAccesses(first_instr);
     }
   }
 
@@ -194,6 +217,33 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
   return Finalize();
 }
 
+bool PPCHIRBuilder::EmitBuiltinThunk(GuestFunction* function,
+                                     Function* builtin, uint64_t scratch) {
+  function_ = function;
+  start_address_ = function_->address();
+
+  SourceOffset(start_address_);
+  StoreContext(offsetof(PPCContext, scratch), LoadConstantUint64(scratch));
+  CallExtern(builtin);
+  Return();
+  return Finalize();
+}
+
+void PPCHIRBuilder::MarkMmioAccesses(Instr* first_instr) {
+  // The guest instruction may have been emitted across several blocks.
+  for (auto block = first_instr->block; block; block = block->next) {
+    auto i = block == first_instr->block ? first_instr->next
+                                         : block->instr_head;
+    for (; i; i = i->next) {
+      if ((i->opcode == &OPCODE_LOAD_info && i->dest->type == INT32_TYPE) ||
+          (i->opcode == &OPCODE_STORE_info &&
+           i->src2.value->type == INT32_TYPE)) {
+        i->flags |= LOAD_STORE_MMIO;
+      }
+    }
+  }
+}
+
 void PPCHIRBuilder::AnnotateLabel(uint32_t address, Label* label) {
   char name_buffer[13];
   snprintf(name_buffer, xe::countof(name_buffer), "loc_%.8X", address);
@@ -205,6 +255,140 @@ Function* PPCHIRBuilder::LookupFunction(uint32_t address) {
   return frontend_->processor()->LookupFunction(address);
 }
 
+uint32_t PPCHIRBuilder::ScanInlineCandidate(uint32_t address,
+                                            uint32_t max_instructions) {
+  Memory* memory = frontend_->memory();
+  for (uint32_t n = 0; n < max_instructions; ++n) {
+    uint32_t instr_address = address + n * 4;
+    if (instr_address == FLAGS_break_on_instruction) {
+      return 0;
+    }
+    InstrData i;
+    i.address = instr_address;
+    i.code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(instr_address));
+    i.opcode = LookupOpcode(i.code);
+    if (i.opcode == PPCOpcode::kInvalid) {
+      return 0;
+    }
+    auto& opcode_info = GetOpcodeInfo(i.opcode);
+    if (!opcode_info.emit) {
+      return 0;
+    }
+    if (opcode_info.group == PPCOpcodeGroup::kB) {
+      // Anything that transfers control (branches, calls, syscalls) other than
+      // the final unconditional blr makes this more than a straight-line leaf.
+      if (i.code == 0x4E800020) {
+        return n + 1;
+      }
+      return 0;
+    }
+    if (i.opcode == PPCOpcode::mtspr) {
+      // The blr would no longer return to the caller.
+      const uint32_t spr =
+          ((i.XFX.spr & 0x1F) << 5) | ((i.XFX.spr >> 5) & 0x1F);
+      if (spr == 8) {
+        return 0;
+      }
+    }
+  }
+  // Too large.
+  return 0;
+}
+
+bool PPCHIRBuilder::EmitInlinedCall(uint32_t call_address,
+                                    uint32_t target_address) {
+  if (!inline_calls_) {
+    return false;
+  }
+  if (target_address >= start_address_ &&
+      target_address <= function_->end_address()) {
+    return false;
+  }
+  // Import thunks and builtins must be called.
+  auto target_function = LookupFunction(target_address);
+  if (!target_function ||
+      target_function->behavior() != Function::Behavior::kDefault) {
+    return false;
+  }
+  // With per-instruction counts from a previous run, calls that never ran are
+  // left alone, and larger callees are worth copying into calls that ran
+  // more often than the function was entered.
+  uint32_t max_instructions = uint32_t(FLAGS_inline_max_instructions);
+  if (profile_ && profile_->has_instruction_counts()) {
+    uint64_t call_count = profile_->instruction_count(call_address);
+    if (!call_count) {
+      return false;
+    }
+    if (call_count > profile_->call_count()) {
+      max_instructions *= 2;
+    }
+  }
+  uint32_t instr_count = ScanInlineCandidate(target_address, max_instructions);
+  if (!instr_count) {
+    return false;
+  }
+
+  if (with_debug_info_) {
+    CommentFormat("inlined %.8X %s", target_address,
+                  target_function->name().c_str());
+  }
+
+  function_->inlined_ranges().push_back(
+      {target_address, target_address + (instr_count - 1) * 4});
+
+  // The callee sees LR as if it had been called. As the body is straight-line
+  // code LR still holds the same value after the final blr.
+  StoreLR(LoadConstantUint64(call_address + 4));
+
+  // Inlined instructions have source offsets of their own, so faults in them
+  // (such as MMIO accesses to learn) map to the callee's guest address. The
+  // guest stack still has no frame for the callee, so a stack walk shows the
+  // caller at the callee's address.
+  auto mmio_handler = MMIOHandler::global_handler();
+  Memory* memory = frontend_->memory();
+  for (uint32_t n = 0; n < instr_count - 1; ++n) {
+    trace_info_.dest_count = 0;
+    uint32_t address = target_address + n * 4;
+    uint32_t code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    auto opcode = LookupOpcode(code);
+    auto& opcode_info = GetOpcodeInfo(opcode);
+    Instr* first_instr = nullptr;
+    if (with_debug_info_) {
+      comment_buffer_.Reset();
+      comment_buffer_.AppendFormat("%.8X %.8X ", address, code);
+      DisasmPPC(address, code, &comment_buffer_);
+      Comment(comment_buffer_);
+      first_instr = last_instr();
+    }
+    SourceOffset(address);
+    if (!first_instr) {
+      first_instr = last_instr();
+    }
+    ++opcode_translation_counts[static_cast<int>(opcode)];
+    if (opcode_info.type == PPCOpcodeType::kSync) {
+      ContextBarrier();
+    }
+
+    InstrData i;
+    i.address = address;
+    i.code = code;
+    i.opcode = opcode;
+    i.opcode_info = &opcode_info;
+    if (opcode_info.emit(*this, i)) {
+      auto& disasm_info = GetOpcodeDisasmInfo(opcode);
+      XELOGE("Unimplemented instr %.8llX %.8X %s", address, code,
+             disasm_info.name);
+      Comment("UNIMPLEMENTED!");
+      DebugBreak();
+    } else if (check_mmio_sites_ && mmio_handler->IsAccessSite(address)) {
+      MarkMmioAccesses(first_instr);
+    }
+  }
+  return true;
+}
+
 Label* PPCHIRBuilder::LookupLabel(uint32_t address) {
   if (address < start_address_) {
     return nullptr;
@@ -12,6 +12,7 @@
 
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/function_profile.h"
 #include "xenia/cpu/hir/hir_builder.h"
 
 namespace xe {
@@ -37,13 +38,33 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   enum EmitFlags {
     // Emit comment nodes.
     EMIT_DEBUG_COMMENTS = 1 << 0,
+    // Inline calls to small leaf functions.
+    EMIT_INLINE_CALLS = 1 << 1,
+    // Multiply-add must round once even if the host can't fuse it.
+    EMIT_STRICT_FLOAT = 1 << 2,
   };
-  bool Emit(GuestFunction* function, uint32_t flags);
+  // The profile, if any, guides which calls are inlined.
+  bool Emit(GuestFunction* function, uint32_t flags,
+            const FunctionProfile* profile = nullptr);
+  // Emits a body for the function that only calls the builtin, with the
+  // scratch value in the context scratch for it to find.
+  bool EmitBuiltinThunk(GuestFunction* function, Function* builtin,
+                        uint64_t scratch);
 
   GuestFunction* function() const { return function_; }
   Function* LookupFunction(uint32_t address);
   Label* LookupLabel(uint32_t address);
 
+  // Arithmetic flags for MulAdd/MulSub of guest multiply-add instructions.
+  uint32_t fused_arithmetic_flags() const {
+    return strict_float_ ? hir::ARITHMETIC_FUSED : 0;
+  }
+
+  // Emits the body of the function at target_address in place of a bl to it
+  // from call_address, if the function is a small straight-line leaf.
+  // Returns false if the call must be emitted normally.
+  bool EmitInlinedCall(uint32_t call_address, uint32_t target_address);
+
   Value* LoadLR();
   void StoreLR(Value* value);
   Value* LoadCTR();
@@ -83,6 +104,11 @@ class PPCHIRBuilder : public hir::HIRBuilder {
 
  private:
   void AnnotateLabel(uint32_t address, Label* label);
+  // Flags the 32-bit loads and stores emitted after first_instr as MMIO.
+  void MarkMmioAccesses(Instr* first_instr);
+  // Returns the number of instructions (including the final blr) in the
+  // function at the given address if it can be inlined, or 0 if it cannot.
+  uint32_t ScanInlineCandidate(uint32_t address, uint32_t max_instructions);
 
   PPCFrontend* frontend_;
 
@@ -91,6 +117,12 @@ class PPCHIRBuilder : public hir::HIRBuilder {
 
   // Reset each Emit:
   bool with_debug_info_;
+  bool inline_calls_;
+  // Whether any instructions are known to access MMIO, and have their loads
+  // and stores marked.
+  bool check_mmio_sites_;
+  bool strict_float_;
+  const FunctionProfile* profile_;
   GuestFunction* function_;
   uint64_t start_address_;
   uint64_t instr_count_;
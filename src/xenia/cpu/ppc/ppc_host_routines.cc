@@ -0,0 +1,265 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/ppc/ppc_host_routines.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/cpu/ppc/ppc_decode_data.h"
+#include "xenia/cpu/ppc/ppc_opcode_info.h"
+
+#include "third_party/xxhash/xxhash.h"
+
+namespace xe {
+namespace cpu {
+namespace ppc {
+
+static const char* kHostRoutineNames[kHostRoutineCount] = {
+    "none", "memcpy", "memset", "strlen",
+};
+
+const char* GetHostRoutineName(HostRoutine routine) {
+  return kHostRoutineNames[static_cast<uint32_t>(routine)];
+}
+
+HostRoutine LookupHostRoutine(const std::string& name) {
+  for (uint32_t n = 1; n < kHostRoutineCount; ++n) {
+    if (name == kHostRoutineNames[n]) {
+      return static_cast<HostRoutine>(n);
+    }
+  }
+  return HostRoutine::kNone;
+}
+
+PPCFunctionSignature ComputeFunctionSignature(Memory* memory,
+                                              uint32_t start_address,
+                                              uint32_t end_address) {
+  std::vector<uint32_t> words;
+  words.reserve((end_address - start_address) / 4 + 1);
+  for (uint32_t address = start_address; address <= end_address;
+       address += 4) {
+    uint32_t code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    auto opcode = LookupOpcode(code);
+    PPCDecodeData d;
+    d.address = address;
+    d.code = code;
+    if (opcode == PPCOpcode::bx) {
+      uint32_t target = d.I.ADDR();
+      if (d.I.LK() || target < start_address || target > end_address) {
+        code &= ~0x03FFFFFCu;
+      }
+    } else if (opcode == PPCOpcode::bcx) {
+      uint32_t target = d.B.ADDR();
+      if (d.B.LK() || target < start_address || target > end_address) {
+        code &= ~0x0000FFFCu;
+      }
+    }
+    words.push_back(code);
+  }
+
+  PPCFunctionSignature signature;
+  signature.instruction_count = uint32_t(words.size());
+  signature.prologue_hash = XXH64(
+      words.data(),
+      std::min(words.size(), size_t(PPCFunctionSignature::kPrologueLength)) *
+          sizeof(uint32_t),
+      0);
+  signature.body_hash = XXH64(words.data(), words.size() * sizeof(uint32_t), 0);
+  return signature;
+}
+
+void PPCSignatureTable::Add(const PPCFunctionSignature& signature,
+                            HostRoutine routine) {
+  entries_.emplace(signature.prologue_hash, Entry(signature, routine));
+}
+
+bool PPCSignatureTable::LoadFile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    XELOGE("Unable to open function signature file %s", path.c_str());
+    return false;
+  }
+  std::string line;
+  uint32_t line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    line = line.substr(0, line.find('#'));
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    std::istringstream stream(line);
+    std::string prologue_hash;
+    std::string body_hash;
+    PPCFunctionSignature signature;
+    std::string routine_name;
+    stream >> prologue_hash >> body_hash >> signature.instruction_count >>
+        routine_name;
+    auto routine = LookupHostRoutine(routine_name);
+    if (!stream || routine == HostRoutine::kNone) {
+      XELOGE("%s:%u: malformed function signature", path.c_str(),
+             line_number);
+      return false;
+    }
+    signature.prologue_hash = std::strtoull(prologue_hash.c_str(), nullptr, 16);
+    signature.body_hash = std::strtoull(body_hash.c_str(), nullptr, 16);
+    Add(signature, routine);
+  }
+  return true;
+}
+
+HostRoutine PPCSignatureTable::Lookup(
+    const PPCFunctionSignature& signature) const {
+  auto range = entries_.equal_range(signature.prologue_hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.first == signature) {
+      return it->second.second;
+    }
+  }
+  return HostRoutine::kNone;
+}
+
+namespace {
+
+// Whether the guest range is ordinary memory that host code can access
+// directly. Mapped ranges are at least a page, so checking the ends suffices.
+bool IsPlainMemory(Memory* memory, uint32_t address, uint32_t size) {
+  if (!size) {
+    return true;
+  }
+  uint32_t last_address = address + size - 1;
+  if (last_address < address) {
+    return false;
+  }
+  return !memory->LookupVirtualMappedRange(address) &&
+         !memory->LookupVirtualMappedRange(last_address);
+}
+
+// Smallest page size of any guest heap.
+const uint32_t kMinPageSize = 4096;
+
+// Whether the page at the address is ordinary memory that host code can read.
+bool IsReadablePage(Memory* memory, uint32_t address) {
+  auto heap = memory->LookupHeap(address);
+  uint32_t protect = 0;
+  return heap && heap->QueryProtect(address, &protect) &&
+         (protect & kMemoryProtectRead) &&
+         !memory->LookupVirtualMappedRange(address);
+}
+
+// Returns the offset of the first zero byte in [str, page_end), or the size of
+// the range if there is none. page_end must be 16b aligned, so that aligned
+// 16b loads stay within the page and reading past the terminator can't fault.
+size_t FindTerminator(const uint8_t* str, const uint8_t* page_end) {
+  auto str_address = reinterpret_cast<uintptr_t>(str);
+  auto block = reinterpret_cast<const __m128i*>(str_address & ~uintptr_t(15));
+  auto end_block = reinterpret_cast<const __m128i*>(page_end);
+  const __m128i zero = _mm_setzero_si128();
+  uint32_t mask = uint32_t(
+      _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block), zero)));
+  // Ignore the bytes before the start of the string.
+  mask >>= str_address & 15;
+  uint32_t index;
+  if (xe::bit_scan_forward(mask, &index)) {
+    return index;
+  }
+  for (++block; block < end_block; ++block) {
+    mask = uint32_t(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(block), zero)));
+    if (xe::bit_scan_forward(mask, &index)) {
+      return reinterpret_cast<uintptr_t>(block) - str_address + index;
+    }
+  }
+  return page_end - str;
+}
+
+// Measures the guest string a page at a time, checking each page before it is
+// read. Returns false if the string runs into memory the host can't read
+// directly, which the guest code then handles as it would have.
+bool HostStrlen(Memory* memory, uint32_t address, uint32_t* out_length) {
+  uint32_t length = 0;
+  while (true) {
+    uint32_t page_address = address + length;
+    if (page_address < address || !IsReadablePage(memory, page_address)) {
+      return false;
+    }
+    // Wraps to 0 for the last page, which the subtraction below still handles.
+    uint32_t page_end = (page_address & ~(kMinPageSize - 1)) + kMinPageSize;
+    uint32_t page_remaining = page_end - page_address;
+    auto str = memory->TranslateVirtual(page_address);
+    size_t offset = FindTerminator(str, str + page_remaining);
+    length += uint32_t(offset);
+    if (offset < page_remaining) {
+      *out_length = length;
+      return true;
+    }
+  }
+}
+
+}  // namespace
+
+bool RunHostRoutine(HostRoutine routine, Memory* memory,
+                    PPCContext* ppc_context) {
+  uint32_t dest = uint32_t(ppc_context->r[3]);
+  switch (routine) {
+    case HostRoutine::kMemcpy: {
+      uint32_t src = uint32_t(ppc_context->r[4]);
+      uint32_t size = uint32_t(ppc_context->r[5]);
+      if (!IsPlainMemory(memory, dest, size) ||
+          !IsPlainMemory(memory, src, size)) {
+        return false;
+      }
+      // Guest copies go forward a chunk at a time, which no host copy matches
+      // when the ranges overlap, so those are left to the guest code.
+      if (uint64_t(dest) < uint64_t(src) + size &&
+          uint64_t(src) < uint64_t(dest) + size) {
+        return false;
+      }
+      // The host CRT copy is already vectorized.
+      std::memcpy(memory->TranslateVirtual(dest),
+                  memory->TranslateVirtual(src), size);
+      return true;
+    }
+    case HostRoutine::kMemset: {
+      uint32_t size = uint32_t(ppc_context->r[5]);
+      if (!IsPlainMemory(memory, dest, size)) {
+        return false;
+      }
+      std::memset(memory->TranslateVirtual(dest),
+                  uint8_t(ppc_context->r[4]), size);
+      return true;
+    }
+    case HostRoutine::kStrlen: {
+      uint32_t length;
+      if (!HostStrlen(memory, dest, &length)) {
+        return false;
+      }
+      ppc_context->r[3] = length;
+      return true;
+    }
+    default:
+      assert_unhandled_case(routine);
+      return false;
+  }
+}
+
+}  // namespace ppc
+}  // namespace cpu
+}  // namespace xe
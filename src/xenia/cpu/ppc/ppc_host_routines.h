@@ -0,0 +1,97 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_PPC_PPC_HOST_ROUTINES_H_
+#define XENIA_CPU_PPC_PPC_HOST_ROUTINES_H_
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace cpu {
+namespace ppc {
+
+// Guest CRT routines that can be replaced by host implementations.
+enum class HostRoutine : uint32_t {
+  kNone = 0,
+  // r3 = dest, r4 = src, r5 = size. Returns dest.
+  kMemcpy,
+  // r3 = dest, r4 = fill byte, r5 = size. Returns dest.
+  kMemset,
+  // r3 = string. Returns its length.
+  kStrlen,
+};
+const uint32_t kHostRoutineCount = 4;
+
+const char* GetHostRoutineName(HostRoutine routine);
+HostRoutine LookupHostRoutine(const std::string& name);
+
+// Identifies the code of a function independently of where it was linked:
+// the targets of branches leaving the function (calls and tail calls) are
+// masked out before hashing. Data references are not, as the routines worth
+// matching don't make any.
+struct PPCFunctionSignature {
+  static const uint32_t kPrologueLength = 8;
+
+  // Hash of the first kPrologueLength instructions, or all of them if there
+  // are fewer.
+  uint64_t prologue_hash;
+  // Hash of all instructions.
+  uint64_t body_hash;
+  uint32_t instruction_count;
+
+  bool operator==(const PPCFunctionSignature& other) const {
+    return prologue_hash == other.prologue_hash &&
+           body_hash == other.body_hash &&
+           instruction_count == other.instruction_count;
+  }
+};
+
+// Computes the signature of the code in [start_address, end_address].
+PPCFunctionSignature ComputeFunctionSignature(Memory* memory,
+                                              uint32_t start_address,
+                                              uint32_t end_address);
+
+// Known function signatures and the routines they implement. Lookups are
+// indexed by the prologue hash and confirmed with the rest.
+// Not threadsafe; populate before functions are translated.
+class PPCSignatureTable {
+ public:
+  bool empty() const { return entries_.empty(); }
+
+  void Add(const PPCFunctionSignature& signature, HostRoutine routine);
+
+  // Adds the signatures listed in a file, one per line as:
+  //   <prologue hash> <body hash> <instruction count> <routine name>
+  // with the hashes in hex. Anything after a # is ignored.
+  bool LoadFile(const std::string& path);
+
+  HostRoutine Lookup(const PPCFunctionSignature& signature) const;
+
+ private:
+  typedef std::pair<PPCFunctionSignature, HostRoutine> Entry;
+  std::unordered_multimap<uint64_t, Entry> entries_;
+};
+
+// Runs the host implementation of the routine on the arguments in the context
+// and sets its return value. Returns false without touching anything if the
+// routine can't be run on the host for these arguments (they touch MMIO), in
+// which case the guest code must be run instead.
+bool RunHostRoutine(HostRoutine routine, Memory* memory,
+                    PPCContext* ppc_context);
+
+}  // namespace ppc
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_PPC_PPC_HOST_ROUTINES_H_
@@ -10,13 +10,16 @@
 #include "xenia/cpu/ppc/ppc_scanner.h"
 
 #include <algorithm>
+#include <cinttypes>
 #include <map>
 
 #include "xenia/base/logging.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/ppc/ppc_host_routines.h"
 #include "xenia/cpu/ppc/ppc_opcode_info.h"
 #include "xenia/cpu/processor.h"
 
@@ -280,6 +283,28 @@ bool PPCScanner::Scan(GuestFunction* function, FunctionDebugInfo* debug_info) {
   // - if present, flag function as needing a stack
   // - record prolog/epilog lengths/stack size/etc
 
+  // Recognize routines that can be replaced by host implementations.
+  auto signatures = frontend_->host_routine_signatures();
+  if (function->allows_host_replacement() &&
+      (!signatures->empty() || FLAGS_log_function_signatures)) {
+    auto signature = ComputeFunctionSignature(memory, start_address, address);
+    if (FLAGS_log_function_signatures) {
+      XELOGCPU("%.16" PRIX64 " %.16" PRIX64 " %u # %.8X %s",
+               signature.prologue_hash, signature.body_hash,
+               signature.instruction_count, start_address,
+               function->name().c_str());
+    }
+    auto routine = signatures->Lookup(signature);
+    if (routine != HostRoutine::kNone) {
+      XELOGCPU("Replacing %.8X %s with host %s", start_address,
+               function->name().c_str(), GetHostRoutineName(routine));
+      function->set_host_replacement(
+          frontend_->builtins()->host_routines[static_cast<uint32_t>(routine)]);
+    } else {
+      function->set_host_replacement(nullptr);
+    }
+  }
+
   if (debug_info) {
     debug_info->set_address_reference_count(address_reference_count);
     debug_info->set_instruction_result_count(instruction_result_count);
@@ -359,6 +384,37 @@ std::vector<BlockInfo> PPCScanner::FindBlocks(GuestFunction* function) {
   return blocks;
 }
 
+std::vector<uint32_t> PPCScanner::FindCallTargets(GuestFunction* function) {
+  Memory* memory = frontend_->memory();
+
+  std::vector<uint32_t> targets;
+  uint32_t start_address = function->address();
+  uint32_t end_address = function->end_address();
+  for (uint32_t address = start_address; address <= end_address; address += 4) {
+    PPCDecodeData d;
+    d.address = address;
+    d.code = xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    if (!d.code) {
+      continue;
+    }
+    auto opcode = xe::cpu::ppc::LookupOpcode(d.code);
+    uint32_t target;
+    if (opcode == PPCOpcode::bx && d.I.LK()) {
+      target = d.I.ADDR();
+    } else if (opcode == PPCOpcode::bcx && d.B.LK()) {
+      target = d.B.ADDR();
+    } else {
+      continue;
+    }
+    if (target < start_address || target > end_address) {
+      targets.push_back(target);
+    }
+  }
+  std::sort(targets.begin(), targets.end());
+  targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+  return targets;
+}
+
 }  // namespace ppc
 }  // namespace cpu
 }  // namespace xe
@@ -35,6 +35,10 @@ class PPCScanner {
 
   std::vector<BlockInfo> FindBlocks(GuestFunction* function);
 
+  // Returns the targets of all direct calls (bl/bla/bcl/bcla) made from
+  // within the function. The function must already have been scanned.
+  std::vector<uint32_t> FindCallTargets(GuestFunction* function);
+
  private:
   bool IsRestGprLr(uint32_t address);
 
@@ -13,6 +13,7 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/reset_scope.h"
@@ -47,15 +48,21 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   // The CFG is required for simplification and dirtied by it.
   compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
   compiler_->AddPass(std::make_unique<passes::ControlFlowSimplificationPass>());
+  compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
 
   // Passes are executed in the order they are added. Multiple of the same
   // pass type may be used.
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
-  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  compiler_->AddPass(std::make_unique<passes::ConstantPropagationPass>());
+  {
+    // Folding constants exposes more conversions and assignments to
+    // simplify, and the other way around.
+    auto group = std::make_unique<passes::ConditionalGroupPass>();
+    group->AddPass(std::make_unique<passes::SimplificationPass>());
+    group->AddPass(std::make_unique<passes::ConstantPropagationPass>());
+    compiler_->AddPass(std::move(group));
+  }
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   if (backend->machine_info()->supports_extended_load_store) {
     // Backend supports the advanced LOAD/STORE instructions.
@@ -65,12 +72,28 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
     if (validate)
       compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   }
+  // Reuse repeated computations. Leaves assignments for simplification.
+  compiler_->AddPass(std::make_unique<passes::GlobalValueNumberingPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
-  // if (validate)
-  // compiler_->AddPass(std::make_unique<passes::ValidationPass>());
-  compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
+  compiler_->AddPass(std::make_unique<passes::LoopInvariantCodeMotionPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  {
+    // Hoisting and value numbering leave constants to fold again, and dead
+    // code elimination can turn assignments into values worth refolding.
+    auto group = std::make_unique<passes::ConditionalGroupPass>();
+    group->AddPass(std::make_unique<passes::ConstantPropagationPass>());
+    group->AddPass(std::make_unique<passes::SimplificationPass>());
+    group->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
+    compiler_->AddPass(std::move(group));
+  }
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+
+  // Lay out blocks by recorded execution counts, if a profile is available.
+  compiler_->AddPass(std::make_unique<passes::BlockLayoutPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
   //// Removes all unneeded variables. Try not to add new ones after this.
@@ -81,12 +104,32 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   // Will modify the HIR to add loads/stores.
   // This should be the last pass before finalization, as after this all
   // registers are assigned and ready to be emitted.
+  // Allocation spans blocks and needs an up to date CFG.
+  compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
   compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
       backend->machine_info()));
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+
+  // Baseline tier: only what is needed to produce correct code. Constant
+  // propagation stays as the backend can't lower operations whose sources are
+  // all constant.
+  baseline_compiler_.reset(new Compiler(frontend->processor()));
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::ConstantPropagationPass>());
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(
+      std::make_unique<passes::ControlFlowAnalysisPass>());
+  baseline_compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
+      backend->machine_info()));
+  if (validate) {
+    baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+  baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
 }
 
 PPCTranslator::~PPCTranslator() = default;
@@ -98,6 +141,7 @@ bool PPCTranslator::Translate(GuestFunction* function,
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
   xe::make_reset_scope(compiler_);
+  xe::make_reset_scope(baseline_compiler_);
   xe::make_reset_scope(assembler_);
   xe::make_reset_scope(&string_buffer_);
 
@@ -122,13 +166,82 @@ bool PPCTranslator::Translate(GuestFunction* function,
     debug_info.reset(new FunctionDebugInfo());
   }
 
-  // Scan the function to find its extents and gather debug data.
-  if (!scanner_->Scan(function, debug_info.get())) {
+  // Scan the function to find its extents and gather debug data. Host
+  // replacements are found while scanning, so when there are any to find this
+  // has to happen before a persisted translation is restored.
+  bool scanned = false;
+  if (!frontend_->host_routine_signatures()->empty()) {
+    if (!scanner_->Scan(function, debug_info.get())) {
+      return false;
+    }
+    scanned = true;
+  }
+
+  if (!debug_info_flags && function->tier() == CompilationTier::kNone &&
+      !function->host_replacement() && !function->is_private_copy() &&
+      frontend_->processor()->backend()->RestoreFunction(function)) {
+    // Restored a previous translation from the persistent cache. Functions
+    // being retranslated skip this as the cache holds their current code, and
+    // copies running the guest code of replaced functions as restored code
+    // takes over the address.
+    function->set_tier(CompilationTier::kOptimized);
+    return true;
+  }
+
+  // With tiered compilation the first compile of a normal function uses the
+  // baseline pipeline. Instrumented functions always get the full pipeline so
+  // that their tracing isn't disturbed.
+  // Interpreted functions compiled once warm go through the same tiers as
+  // any other.
+  // Private copies can't be replaced once hot, so they are always optimized.
+  bool is_baseline = FLAGS_tiered_compilation && !debug_info_flags &&
+                     (function->tier() == CompilationTier::kNone ||
+                      function->tier() == CompilationTier::kInterpreted) &&
+                     function->behavior() == Function::Behavior::kDefault &&
+                     !function->is_private_copy();
+  // Cold functions may be interpreted first instead, unless they are being
+  // debugged or traced. A threshold below 1 compiles them right away.
+  bool is_interpreted = frontend_->interpreter() &&
+                        FLAGS_interpreter_threshold > 0 && !debug_info_flags &&
+                        function->tier() == CompilationTier::kNone &&
+                        function->behavior() == Function::Behavior::kDefault &&
+                        !function->is_private_copy();
+  uint64_t start_ticks = Clock::QueryHostTickCount();
+
+  if (!scanned && !scanner_->Scan(function, debug_info.get())) {
     return false;
   }
+  if (function->host_replacement()) {
+    // Nothing to gain from recompiling.
+    is_baseline = false;
+    is_interpreted = false;
+  }
+
+  // Profiles are only used if they were recorded for the same code.
+  auto profile = frontend_->processor()->LookupFunctionProfile(function);
+  if (is_baseline && profile &&
+      profile->call_count() >= uint64_t(FLAGS_tiered_compilation_threshold)) {
+    // Known to be hot; skip straight to the optimized tier.
+    is_baseline = false;
+  }
+  if (is_interpreted && profile) {
+    // Called before, so likely to be again.
+    is_interpreted = false;
+  }
 
   // Setup trace data, if needed.
-  if (debug_info_flags & DebugInfoFlags::kDebugInfoTraceFunctions) {
+  if (is_baseline) {
+    // Baseline code only uses the call count from the trace data header.
+    if (!function->trace_data().is_valid()) {
+      size_t counter_data_size = FunctionTraceData::SizeOfHeader();
+      uint8_t* counter_data =
+          frontend_->processor()->AllocateFunctionCounterData(
+              counter_data_size);
+      function->trace_data().Reset(counter_data, counter_data_size,
+                                   function->address(),
+                                   function->end_address());
+    }
+  } else if (debug_info_flags & DebugInfoFlags::kDebugInfoTraceFunctions) {
     // Base trace data.
     size_t trace_data_size = FunctionTraceData::SizeOfHeader();
     if (debug_info_flags & DebugInfoFlags::kDebugInfoTraceFunctionCoverage) {
@@ -160,7 +273,22 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (debug_info) {
     emit_flags |= PPCHIRBuilder::EMIT_DEBUG_COMMENTS;
   }
-  if (!builder_->Emit(function, emit_flags)) {
+  // Inlining hides calls from function tracing and is of little use to code
+  // that will be recompiled once hot. Breakpoints are only set in the
+  // callee's own code, so they would never be hit in inlined copies.
+  const uint32_t call_trace_flags =
+      DebugInfoFlags::kDebugInfoTraceFunctions |
+      DebugInfoFlags::kDebugInfoTraceFunctionReferences;
+  if (FLAGS_inline_calls && !is_baseline && !is_interpreted &&
+      !(debug_info_flags & call_trace_flags) &&
+      frontend_->processor()->breakpoints().empty()) {
+    emit_flags |= PPCHIRBuilder::EMIT_INLINE_CALLS;
+  }
+  if (function->module()->float_precision_mode() ==
+      FloatPrecisionMode::kStrict) {
+    emit_flags |= PPCHIRBuilder::EMIT_STRICT_FLOAT;
+  }
+  if (!builder_->Emit(function, emit_flags, profile)) {
     return false;
   }
 
@@ -171,8 +299,19 @@ bool PPCTranslator::Translate(GuestFunction* function,
     string_buffer_.Reset();
   }
 
+  if (is_interpreted) {
+    // Functions using anything the interpreter doesn't support are compiled
+    // as usual.
+    auto program = backend::interpreter::InterpreterProgram::Lower(
+        builder_.get(), function);
+    if (program) {
+      return TranslateInterpreted(function, std::move(program), start_ticks);
+    }
+  }
+
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
+  auto& compiler = is_baseline ? baseline_compiler_ : compiler_;
+  if (!compiler->Compile(builder_.get(), profile)) {
     return false;
   }
 
@@ -184,11 +323,42 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Assemble to backend machine code.
+  function->set_tier(is_baseline ? CompilationTier::kBaseline
+                                 : CompilationTier::kOptimized);
   if (!assembler_->Assemble(function, builder_.get(), debug_info_flags,
                             std::move(debug_info))) {
     return false;
   }
 
+  frontend_->RecordTranslation(function->tier(),
+                               Clock::QueryHostTickCount() - start_ticks,
+                               builder_->arena()->CalculateSize());
+  return true;
+}
+
+bool PPCTranslator::TranslateInterpreted(
+    GuestFunction* function,
+    std::unique_ptr<backend::interpreter::InterpreterProgram> program,
+    uint64_t start_ticks) {
+  // The generated code is only a thunk into the interpreter.
+  auto program_ptr = frontend_->interpreter()->AddProgram(std::move(program));
+  builder_->Reset();
+  if (!builder_->EmitBuiltinThunk(
+          function, frontend_->builtins()->interpret,
+          reinterpret_cast<uintptr_t>(program_ptr))) {
+    return false;
+  }
+  if (!baseline_compiler_->Compile(builder_.get(), nullptr)) {
+    return false;
+  }
+  function->set_tier(CompilationTier::kInterpreted);
+  if (!assembler_->Assemble(function, builder_.get(), 0, nullptr)) {
+    return false;
+  }
+
+  frontend_->RecordTranslation(function->tier(),
+                               Clock::QueryHostTickCount() - start_ticks,
+                               builder_->arena()->CalculateSize());
   return true;
 }
 
@@ -14,6 +14,7 @@
 
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/backend/assembler.h"
+#include "xenia/cpu/backend/interpreter/interpreter.h"
 #include "xenia/cpu/compiler/compiler.h"
 #include "xenia/cpu/function.h"
 
@@ -33,12 +34,20 @@ class PPCTranslator {
   bool Translate(GuestFunction* function, uint32_t debug_info_flags);
 
  private:
+  // Emits a thunk running the program in place of compiled code.
+  bool TranslateInterpreted(
+      GuestFunction* function,
+      std::unique_ptr<backend::interpreter::InterpreterProgram> program,
+      uint64_t start_ticks);
   void DumpSource(GuestFunction* function, StringBuffer* string_buffer);
 
   PPCFrontend* frontend_;
   std::unique_ptr<PPCScanner> scanner_;
   std::unique_ptr<PPCHIRBuilder> builder_;
   std::unique_ptr<compiler::Compiler> compiler_;
+  // Minimal pipeline used for the first compile of functions when tiered
+  // compilation is enabled.
+  std::unique_ptr<compiler::Compiler> baseline_compiler_;
   std::unique_ptr<backend::Assembler> assembler_;
 
   StringBuffer string_buffer_;
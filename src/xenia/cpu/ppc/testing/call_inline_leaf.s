@@ -0,0 +1,18 @@
+the_leaf:
+  add r3, r3, r4
+  mfspr r5, lr
+  blr
+
+test_call_inline_leaf:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 7
+  mfspr r12, lr
+  bl the_leaf
+  bl the_leaf
+  mfspr r6, lr
+  subf r7, r5, r6
+  mtspr lr, r12
+  blr
+  #_ REGISTER_OUT r3 19
+  #_ REGISTER_OUT r4 7
+  #_ REGISTER_OUT r7 0
@@ -45,3 +45,17 @@ test_fmadd_4:
   #_ REGISTER_OUT f2 9999.99
   #_ REGISTER_OUT f3 9999.99
   #_ REGISTER_OUT f4 9999.99
+
+test_fmadd_5:
+  # (1 + 2^-30)^2 - (1 + 2^-29) = 2^-60, which is lost if the product is
+  # rounded before the add.
+  #_ REGISTER_IN f1 0.0
+  #_ REGISTER_IN f2 0x3FF0000000400000
+  #_ REGISTER_IN f3 0x3FF0000000400000
+  #_ REGISTER_IN f4 0xBFF0000000800000
+  fmadd f1, f2, f3, f4
+  blr
+  #_ REGISTER_OUT f1 0x3C30000000000000
+  #_ REGISTER_OUT f2 0x3FF0000000400000
+  #_ REGISTER_OUT f3 0x3FF0000000400000
+  #_ REGISTER_OUT f4 0xBFF0000000800000
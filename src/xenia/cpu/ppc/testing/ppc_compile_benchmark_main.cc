@@ -0,0 +1,236 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdlib>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/main.h"
+#include "xenia/base/string.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/ppc/ppc_scanner.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/raw_module.h"
+#include "xenia/cpu/xex_module.h"
+
+DEFINE_string(raw_base_address, "0x82000000",
+              "Address raw binaries are loaded at, also compiled first.");
+DEFINE_int32(compile_threads, 1, "Threads compiling functions in parallel.");
+
+namespace xe {
+namespace cpu {
+namespace test {
+
+// Loads a module without a kernel, so XEX imports are left unlinked. Modules
+// that aren't XEX files are loaded as raw code.
+Module* LoadModule(Processor* processor, const std::wstring& path) {
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    XELOGE("Unable to open module %ls", path.c_str());
+    return nullptr;
+  }
+  fseek(file, 0, SEEK_END);
+  std::vector<uint8_t> data(size_t(ftell(file)));
+  fseek(file, 0, SEEK_SET);
+  size_t read_length = fread(data.data(), 1, data.size(), file);
+  fclose(file);
+  if (read_length != data.size()) {
+    XELOGE("Unable to read module %ls", path.c_str());
+    return nullptr;
+  }
+
+  Module* module = nullptr;
+  if (data.size() >= 4 && xe::load_and_swap<uint32_t>(data.data()) == 'XEX2') {
+    auto xex_module = std::make_unique<XexModule>(processor, nullptr);
+    if (!xex_module->Load(xe::to_string(xe::find_name_from_path(path)),
+                          xe::to_string(path), data.data(), data.size())) {
+      XELOGE("Unable to load XEX %ls", path.c_str());
+      return nullptr;
+    }
+    module = xex_module.get();
+    processor->AddModule(std::move(xex_module));
+  } else {
+    uint32_t base_address =
+        uint32_t(std::strtoul(FLAGS_raw_base_address.c_str(), nullptr, 0));
+    auto raw_module = std::make_unique<RawModule>(processor);
+    if (!raw_module->LoadFile(base_address, path)) {
+      XELOGE("Unable to load raw module %ls", path.c_str());
+      return nullptr;
+    }
+    if (!FLAGS_load_module_map.empty() &&
+        !raw_module->ReadMap(FLAGS_load_module_map.c_str())) {
+      return nullptr;
+    }
+    // Nothing else is known about raw code until its call graph is walked.
+    processor->LookupFunction(raw_module.get(), base_address);
+    module = raw_module.get();
+    processor->AddModule(std::move(raw_module));
+  }
+  return module;
+}
+
+struct BenchmarkResults {
+  std::atomic<uint32_t> compiled_count = {0};
+  std::atomic<uint32_t> failed_count = {0};
+  std::atomic<uint64_t> code_bytes = {0};
+  uint64_t host_ticks = 0;
+  uint64_t hir_arena_bytes = 0;
+  // Translations and their time by tier, indexed by CompilationTier, to
+  // compare the time to get all code running with and without tiering.
+  uint32_t tier_counts[4] = {0};
+  uint64_t tier_host_ticks[4] = {0};
+};
+
+// Compiles every function reachable through direct calls from those declared
+// by the module, a wave of newly found call targets at a time. Functions of a
+// wave are spread across the threads.
+void CompileModule(Processor* processor, Module* module, uint32_t thread_count,
+                   BenchmarkResults* results) {
+  std::vector<uint32_t> wave;
+  module->ForEachFunction([&wave](Function* function) {
+    if (function->is_guest()) {
+      wave.push_back(function->address());
+    }
+  });
+  std::unordered_set<uint32_t> queued_addresses(wave.begin(), wave.end());
+
+  uint64_t start_ticks = Clock::QueryHostTickCount();
+  while (!wave.empty()) {
+    std::atomic<size_t> next_index = {0};
+    std::vector<std::vector<uint32_t>> call_targets(thread_count);
+    auto compile_wave = [&](uint32_t thread_index) {
+      ppc::PPCScanner scanner(processor->frontend());
+      size_t index;
+      while ((index = next_index++) < wave.size()) {
+        auto function = processor->ResolveFunction(wave[index]);
+        if (!function || !function->is_guest()) {
+          ++results->failed_count;
+          continue;
+        }
+        auto guest_function = static_cast<GuestFunction*>(function);
+        ++results->compiled_count;
+        results->code_bytes += guest_function->machine_code_length();
+        for (auto address : scanner.FindCallTargets(guest_function)) {
+          if (module->ContainsAddress(address)) {
+            call_targets[thread_index].push_back(address);
+          }
+        }
+      }
+    };
+
+    // The calling thread takes part as well.
+    std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+    for (uint32_t i = 1; i < thread_count; ++i) {
+      auto thread = xe::threading::Thread::Create(
+          {}, [&compile_wave, i]() { compile_wave(i); });
+      if (thread) {
+        threads.push_back(std::move(thread));
+      }
+    }
+    compile_wave(0);
+    for (auto& thread : threads) {
+      xe::threading::Wait(thread.get(), false);
+    }
+
+    wave.clear();
+    for (auto& targets : call_targets) {
+      for (auto address : targets) {
+        if (queued_addresses.insert(address).second) {
+          wave.push_back(address);
+        }
+      }
+    }
+  }
+  results->host_ticks = Clock::QueryHostTickCount() - start_ticks;
+
+  for (auto tier : {CompilationTier::kInterpreted, CompilationTier::kBaseline,
+                    CompilationTier::kOptimized}) {
+    auto& stats = processor->frontend()->tier_stats(tier);
+    results->hir_arena_bytes += stats.hir_arena_bytes;
+    results->tier_counts[size_t(tier)] = stats.count;
+    results->tier_host_ticks[size_t(tier)] = stats.host_ticks;
+  }
+}
+
+void LogResults(const BenchmarkResults& results) {
+  double seconds =
+      double(results.host_ticks) / double(Clock::host_tick_frequency());
+  XELOGI("Compiled %u functions (%u failed) in %.3fs: %.1f functions/s",
+         results.compiled_count.load(), results.failed_count.load(), seconds,
+         seconds > 0 ? results.compiled_count / seconds : 0.0);
+  XELOGI("HIR arena: %" PRIu64 " KB, %" PRIu64 " bytes/function",
+         results.hir_arena_bytes / 1024,
+         results.compiled_count
+             ? results.hir_arena_bytes / results.compiled_count
+             : 0);
+  XELOGI("Generated code: %" PRIu64 " KB, %" PRIu64 " bytes/function",
+         results.code_bytes.load() / 1024,
+         results.compiled_count ? results.code_bytes / results.compiled_count
+                                : 0);
+  const char* tier_names[] = {"none", "interpreted", "baseline", "optimized"};
+  for (size_t i = size_t(CompilationTier::kInterpreted);
+       i <= size_t(CompilationTier::kOptimized); ++i) {
+    XELOGI("  %-12s %8u functions %10.2f ms", tier_names[i],
+           results.tier_counts[i],
+           double(results.tier_host_ticks[i]) * 1000.0 /
+               double(Clock::host_tick_frequency()));
+  }
+}
+
+int main(const std::vector<std::wstring>& args) {
+  if (args.size() < 2) {
+    XELOGE("No module specified");
+    return 1;
+  }
+  uint32_t thread_count = uint32_t(std::max(1, FLAGS_compile_threads));
+
+  // Compiles are only timed per pass when asked, and must all happen here.
+  // The pass statistics are logged along with the frontend's when the
+  // processor is destroyed.
+  FLAGS_compile_stats = true;
+  FLAGS_background_compile_threads = 0;
+
+  BenchmarkResults results;
+  auto memory = std::make_unique<Memory>();
+  memory->Initialize();
+  {
+    auto processor = std::make_unique<Processor>(memory.get(), nullptr);
+    if (!processor->Setup()) {
+      XELOGE("Unable to setup processor");
+      return 1;
+    }
+    auto module = LoadModule(processor.get(), args[1]);
+    if (!module) {
+      return 1;
+    }
+    CompileModule(processor.get(), module, thread_count, &results);
+  }
+  LogResults(results);
+  return 0;
+}
+
+}  // namespace test
+}  // namespace cpu
+}  // namespace xe
+
+DEFINE_ENTRY_POINT(L"xenia-cpu-ppc-compile-benchmark",
+                   L"xenia-cpu-ppc-compile-benchmark some.xex",
+                   xe::cpu::test::main);
@@ -9,12 +9,22 @@
 
 #include <gflags/gflags.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/clock.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/main.h"
 #include "xenia/base/math.h"
 #include "xenia/base/platform.h"
+#include "xenia/base/string.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/processor.h"
@@ -28,6 +38,12 @@ DEFINE_string(test_path, "src/xenia/cpu/ppc/testing/",
               "Directory scanned for test files.");
 DEFINE_string(test_bin_path, "src/xenia/cpu/ppc/testing/bin/",
               "Directory with binary outputs of the test files.");
+DEFINE_bool(benchmark, false,
+            "Times each passing test in a loop instead of only checking it.");
+DEFINE_int32(benchmark_iterations, 100000,
+             "Calls of each test function timed in benchmark mode.");
+DEFINE_string(benchmark_json, "",
+              "Writes benchmark results to the given JSON file.");
 
 namespace xe {
 namespace cpu {
@@ -191,7 +207,16 @@ class TestRunner {
     // Setup a fresh processor.
     processor.reset(new Processor(memory.get(), nullptr));
     processor->Setup();
-    processor->set_debug_info_flags(DebugInfoFlags::kDebugInfoAll);
+    // Debug info would have the generated code trace itself, and functions
+    // with it are never interpreted. Calls aren't inlined while tracing them,
+    // so only disassembly is kept when inlining.
+    uint32_t debug_info_flags = DebugInfoFlags::kDebugInfoAll;
+    if (FLAGS_benchmark || FLAGS_interpret_cold_functions) {
+      debug_info_flags = DebugInfoFlags::kDebugInfoNone;
+    } else if (FLAGS_inline_calls) {
+      debug_info_flags = DebugInfoFlags::kDebugInfoAllDisasm;
+    }
+    processor->set_debug_info_flags(debug_info_flags);
 
     // Load the binary module.
     auto module = std::make_unique<xe::cpu::RawModule>(processor.get());
@@ -199,6 +224,9 @@ class TestRunner {
       XELOGE("Unable to load test binary %ls", suite.bin_file_path.c_str());
       return false;
     }
+    // Expected results are guest results, so don't let the host round
+    // differently.
+    module->set_float_precision_mode(xe::cpu::FloatPrecisionMode::kStrict);
     processor->AddModule(std::move(module));
 
     processor->backend()->CommitExecutableRange(START_ADDRESS,
@@ -242,14 +270,94 @@ class TestRunner {
     bool result = CheckTestResults(test_case);
     if (!result) {
       // Also dump all disasm/etc.
+      // Debug info is off when benchmarking or interpreting.
       if (fn->is_guest()) {
-        static_cast<xe::cpu::GuestFunction*>(fn)->debug_info()->Dump();
+        auto guest_function = static_cast<xe::cpu::GuestFunction*>(fn);
+        if (guest_function->debug_info()) {
+          guest_function->debug_info()->Dump();
+        }
       }
     }
 
     return result;
   }
 
+  // Times calls of the test function, starting each from the test inputs so
+  // that any loops in it run the same number of times. The inputs are the
+  // registers and all memory named by the test, which it may write. Restoring
+  // them is timed separately and subtracted.
+  bool Benchmark(TestCase& test_case, double* out_ns_per_iteration) {
+    if (!SetupTestState(test_case)) {
+      XELOGE("Test setup failed");
+      return false;
+    }
+    auto fn = processor->ResolveFunction(test_case.address);
+    if (!fn) {
+      XELOGE("Entry function not found");
+      return false;
+    }
+
+    auto ctx = thread_state->context();
+    ctx->lr = 0xBCBCBCBC;
+    auto initial_context = std::make_unique<PPCContext>(*ctx);
+    std::vector<std::pair<uint8_t*, std::vector<uint8_t>>> initial_memory;
+    for (auto& it : test_case.annotations) {
+      if (it.first == "MEMORY_IN" || it.first == "MEMORY_OUT") {
+        uint32_t address;
+        size_t length;
+        ParseMemoryAnnotation(it.second, &address, &length);
+        auto p = memory->TranslateVirtual(address);
+        initial_memory.emplace_back(p, std::vector<uint8_t>(p, p + length));
+      }
+    }
+    // Read after each restore so that restores can't be optimized away when
+    // nothing is called.
+    volatile uint64_t restored_value = 0;
+    auto time_iterations = [&](int32_t iteration_count, bool call) {
+      uint64_t start_ticks = Clock::QueryHostTickCount();
+      for (int32_t i = 0; i < iteration_count; ++i) {
+        std::memcpy(ctx, initial_context.get(), sizeof(PPCContext));
+        for (auto& range : initial_memory) {
+          std::memcpy(range.first, range.second.data(), range.second.size());
+        }
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        restored_value = ctx->r[3];
+        if (call) {
+          fn->Call(thread_state.get(), uint32_t(ctx->lr));
+        }
+      }
+      return Clock::QueryHostTickCount() - start_ticks;
+    };
+
+    int32_t iteration_count = std::max(1, FLAGS_benchmark_iterations);
+    time_iterations(std::max(1, iteration_count / 10), true);
+    uint64_t call_ticks = time_iterations(iteration_count, true);
+    uint64_t restore_ticks = time_iterations(iteration_count, false);
+    uint64_t ticks =
+        call_ticks > restore_ticks ? call_ticks - restore_ticks : 0;
+    *out_ns_per_iteration = double(ticks) * 1000000000.0 /
+                            double(Clock::host_tick_frequency()) /
+                            iteration_count;
+    return true;
+  }
+
+  // Splits a MEMORY_IN or MEMORY_OUT annotation into its address and the
+  // number of bytes it lists.
+  static void ParseMemoryAnnotation(const std::string& annotation,
+                                    uint32_t* out_address,
+                                    size_t* out_length) {
+    size_t space_pos = annotation.find(" ");
+    *out_address =
+        std::strtoul(annotation.substr(0, space_pos).c_str(), nullptr, 16);
+    size_t digit_count = 0;
+    for (size_t i = space_pos + 1; i < annotation.size(); ++i) {
+      if (annotation[i] != ' ') {
+        ++digit_count;
+      }
+    }
+    *out_length = digit_count / 2;
+  }
+
   bool SetupTestState(TestCase& test_case) {
     auto ppc_context = thread_state->context();
     for (auto& it : test_case.annotations) {
@@ -384,6 +492,48 @@ void ProtectedRunTest(TestSuite& test_suite, TestRunner& runner,
 #endif  // XE_COMPILER_MSVC
 }
 
+// Nanoseconds per iteration of each benchmarked test, by suite and test name.
+// Each suite covers one instruction family.
+typedef std::map<std::string, std::map<std::string, double>> BenchmarkResults;
+
+double MeanOfTests(const std::map<std::string, double>& test_results) {
+  double total = 0;
+  for (auto& it : test_results) {
+    total += it.second;
+  }
+  return test_results.empty() ? 0 : total / test_results.size();
+}
+
+bool WriteBenchmarkJson(const std::wstring& path,
+                        const BenchmarkResults& results) {
+  auto file = xe::filesystem::OpenFile(path, "w");
+  if (!file) {
+    XELOGE("Unable to open benchmark results file for writing");
+    return false;
+  }
+  fprintf(file, "{\n  \"iterations\": %d,\n  \"families\": {",
+          std::max(1, FLAGS_benchmark_iterations));
+  bool first_suite = true;
+  for (auto& suite : results) {
+    fprintf(file, "%s\n    \"%s\": {\n", first_suite ? "" : ",",
+            suite.first.c_str());
+    fprintf(file, "      \"ns_per_iteration\": %.3f,\n",
+            MeanOfTests(suite.second));
+    fprintf(file, "      \"tests\": {");
+    bool first_test = true;
+    for (auto& test : suite.second) {
+      fprintf(file, "%s\n        \"%s\": %.3f", first_test ? "" : ",",
+              test.first.c_str(), test.second);
+      first_test = false;
+    }
+    fprintf(file, "\n      }\n    }");
+    first_suite = false;
+  }
+  fprintf(file, "\n  }\n}\n");
+  fclose(file);
+  return true;
+}
+
 bool RunTests(const std::wstring& test_name) {
   int result_code = 1;
   int failed_count = 0;
@@ -421,13 +571,23 @@ bool RunTests(const std::wstring& test_name) {
   }
 
   TestRunner runner;
+  BenchmarkResults benchmark_results;
   for (auto& test_suite : test_suites) {
     XELOGI("%ls.s:", test_suite.name.c_str());
 
     for (auto& test_case : test_suite.test_cases) {
       XELOGI("  - %s", test_case.name.c_str());
+      int previous_passed_count = passed_count;
       ProtectedRunTest(test_suite, runner, test_case, failed_count,
                        passed_count);
+      // Only tests that pass are worth timing.
+      double ns_per_iteration;
+      if (FLAGS_benchmark && passed_count != previous_passed_count &&
+          runner.Benchmark(test_case, &ns_per_iteration)) {
+        XELOGI("    %.2f ns/iteration", ns_per_iteration);
+        benchmark_results[xe::to_string(test_suite.name)][test_case.name] =
+            ns_per_iteration;
+      }
     }
 
     XELOGI("");
@@ -438,6 +598,20 @@ bool RunTests(const std::wstring& test_name) {
   XELOGI("Passed: %d", passed_count);
   XELOGI("Failed: %d", failed_count);
 
+  if (FLAGS_benchmark) {
+    XELOGI("");
+    XELOGI("Mean ns/iteration by family:");
+    for (auto& suite : benchmark_results) {
+      XELOGI("  %-32s %10.2f", suite.first.c_str(),
+             MeanOfTests(suite.second));
+    }
+    if (!FLAGS_benchmark_json.empty() &&
+        !WriteBenchmarkJson(xe::to_wstring(FLAGS_benchmark_json),
+                            benchmark_results)) {
+      return false;
+    }
+  }
+
   return failed_count ? false : true;
 }
 
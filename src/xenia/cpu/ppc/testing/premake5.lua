@@ -35,3 +35,32 @@ project("xenia-cpu-ppc-tests")
       "2>&1",
       "1>scratch/stdout-testing.txt",
     })
+
+group("tests")
+project("xenia-cpu-ppc-compile-benchmark")
+  uuid("dd973aaf-5a17-4342-b325-5683406f5b62")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "gflags",
+    "xenia-base",
+    "xenia-core",
+    "xenia-cpu",
+    "xenia-cpu-backend-x64",
+    -- Only for the processor and XEX loader, which refer to kernel types.
+    "xenia-kernel",
+  })
+  files({
+    "ppc_compile_benchmark_main.cc",
+    "../../../base/main_"..platform_suffix..".cc",
+  })
+  includedirs({
+    project_root.."/third_party/gflags/src",
+  })
+  filter("platforms:Windows")
+    debugdir(project_root)
+    debugargs({
+      "--flagfile=scratch/flags.txt",
+      "2>&1",
+      "1>scratch/stdout-compile-benchmark.txt",
+    })
@@ -0,0 +1,927 @@
+test_cmpw_blt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpw r3, r4
+  blt cmpw_blt_taken
+  li r12, 1
+  blr
+cmpw_blt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_bge:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpw r3, r4
+  bge cmpw_bge_taken
+  li r12, 1
+  blr
+cmpw_bge_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_bgt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpw r3, r4
+  bgt cmpw_bgt_taken
+  li r12, 1
+  blr
+cmpw_bgt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_ble:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpw r3, r4
+  ble cmpw_ble_taken
+  li r12, 1
+  blr
+cmpw_ble_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_beq:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpw r3, r4
+  beq cmpw_beq_taken
+  li r12, 1
+  blr
+cmpw_beq_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_bne:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpw r3, r4
+  bne cmpw_bne_taken
+  li r12, 1
+  blr
+cmpw_bne_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplw_blt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplw r3, r4
+  blt cmplw_blt_taken
+  li r12, 1
+  blr
+cmplw_blt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmplw_bge:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplw r3, r4
+  bge cmplw_bge_taken
+  li r12, 1
+  blr
+cmplw_bge_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplw_bgt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplw r3, r4
+  bgt cmplw_bgt_taken
+  li r12, 1
+  blr
+cmplw_bgt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplw_ble:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplw r3, r4
+  ble cmplw_ble_taken
+  li r12, 1
+  blr
+cmplw_ble_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmplw_beq:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplw r3, r4
+  beq cmplw_beq_taken
+  li r12, 1
+  blr
+cmplw_beq_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmplw_bne:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplw r3, r4
+  bne cmplw_bne_taken
+  li r12, 1
+  blr
+cmplw_bne_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpd_blt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpd r3, r4
+  blt cmpd_blt_taken
+  li r12, 1
+  blr
+cmpd_blt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpd_bge:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpd r3, r4
+  bge cmpd_bge_taken
+  li r12, 1
+  blr
+cmpd_bge_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpd_bgt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpd r3, r4
+  bgt cmpd_bgt_taken
+  li r12, 1
+  blr
+cmpd_bgt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpd_ble:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpd r3, r4
+  ble cmpd_ble_taken
+  li r12, 1
+  blr
+cmpd_ble_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpd_beq:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpd r3, r4
+  beq cmpd_beq_taken
+  li r12, 1
+  blr
+cmpd_beq_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpd_bne:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpd r3, r4
+  bne cmpd_bne_taken
+  li r12, 1
+  blr
+cmpd_bne_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpld_blt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpld r3, r4
+  blt cmpld_blt_taken
+  li r12, 1
+  blr
+cmpld_blt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpld_bge:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpld r3, r4
+  bge cmpld_bge_taken
+  li r12, 1
+  blr
+cmpld_bge_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpld_bgt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpld r3, r4
+  bgt cmpld_bgt_taken
+  li r12, 1
+  blr
+cmpld_bgt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpld_ble:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpld r3, r4
+  ble cmpld_ble_taken
+  li r12, 1
+  blr
+cmpld_ble_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpld_beq:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpld r3, r4
+  beq cmpld_beq_taken
+  li r12, 1
+  blr
+cmpld_beq_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpld_bne:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpld r3, r4
+  bne cmpld_bne_taken
+  li r12, 1
+  blr
+cmpld_bne_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpwi_blt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpwi r3, 1
+  blt cmpwi_blt_taken
+  li r12, 1
+  blr
+cmpwi_blt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpwi_bge:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpwi r3, 1
+  bge cmpwi_bge_taken
+  li r12, 1
+  blr
+cmpwi_bge_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpwi_bgt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpwi r3, 1
+  bgt cmpwi_bgt_taken
+  li r12, 1
+  blr
+cmpwi_bgt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpwi_ble:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpwi r3, 1
+  ble cmpwi_ble_taken
+  li r12, 1
+  blr
+cmpwi_ble_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpwi_beq:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpwi r3, 1
+  beq cmpwi_beq_taken
+  li r12, 1
+  blr
+cmpwi_beq_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpwi_bne:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpwi r3, 1
+  bne cmpwi_bne_taken
+  li r12, 1
+  blr
+cmpwi_bne_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplwi_blt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplwi r3, 1
+  blt cmplwi_blt_taken
+  li r12, 1
+  blr
+cmplwi_blt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmplwi_bge:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplwi r3, 1
+  bge cmplwi_bge_taken
+  li r12, 1
+  blr
+cmplwi_bge_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplwi_bgt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplwi r3, 1
+  bgt cmplwi_bgt_taken
+  li r12, 1
+  blr
+cmplwi_bgt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplwi_ble:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplwi r3, 1
+  ble cmplwi_ble_taken
+  li r12, 1
+  blr
+cmplwi_ble_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmplwi_beq:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplwi r3, 1
+  beq cmplwi_beq_taken
+  li r12, 1
+  blr
+cmplwi_beq_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmplwi_bne:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmplwi r3, 1
+  bne cmplwi_bne_taken
+  li r12, 1
+  blr
+cmplwi_bne_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_blt_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpw r3, r4
+  blt cmpw_blt_equal_taken
+  li r12, 1
+  blr
+cmpw_blt_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_bge_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpw r3, r4
+  bge cmpw_bge_equal_taken
+  li r12, 1
+  blr
+cmpw_bge_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_bgt_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpw r3, r4
+  bgt cmpw_bgt_equal_taken
+  li r12, 1
+  blr
+cmpw_bgt_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_ble_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpw r3, r4
+  ble cmpw_ble_equal_taken
+  li r12, 1
+  blr
+cmpw_ble_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_beq_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpw r3, r4
+  beq cmpw_beq_equal_taken
+  li r12, 1
+  blr
+cmpw_beq_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_bne_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpw r3, r4
+  bne cmpw_bne_equal_taken
+  li r12, 1
+  blr
+cmpw_bne_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpld_blt_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpld r3, r4
+  blt cmpld_blt_equal_taken
+  li r12, 1
+  blr
+cmpld_blt_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpld_bge_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpld r3, r4
+  bge cmpld_bge_equal_taken
+  li r12, 1
+  blr
+cmpld_bge_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpld_bgt_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpld r3, r4
+  bgt cmpld_bgt_equal_taken
+  li r12, 1
+  blr
+cmpld_bgt_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpld_ble_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpld r3, r4
+  ble cmpld_ble_equal_taken
+  li r12, 1
+  blr
+cmpld_ble_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpld_beq_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpld r3, r4
+  beq cmpld_beq_equal_taken
+  li r12, 1
+  blr
+cmpld_beq_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpld_bne_equal:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpld r3, r4
+  bne cmpld_bne_equal_taken
+  li r12, 1
+  blr
+cmpld_bne_equal_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_blt_constant:
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  li r3, 5
+  cmpw r3, r4
+  blt cmpw_blt_constant_taken
+  li r12, 1
+  blr
+cmpw_blt_constant_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_bgt_constant:
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  li r3, 5
+  cmpw r3, r4
+  bgt cmpw_bgt_constant_taken
+  li r12, 1
+  blr
+cmpw_bgt_constant_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_ble_constant:
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  li r3, 5
+  cmpw r3, r4
+  ble cmpw_ble_constant_taken
+  li r12, 1
+  blr
+cmpw_ble_constant_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_bge_constant:
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  li r3, 5
+  cmpw r3, r4
+  bge cmpw_bge_constant_taken
+  li r12, 1
+  blr
+cmpw_bge_constant_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplw_blt_constant:
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  li r3, 5
+  cmplw r3, r4
+  blt cmplw_blt_constant_taken
+  li r12, 1
+  blr
+cmplw_blt_constant_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplw_bgt_constant:
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  li r3, 5
+  cmplw r3, r4
+  bgt cmplw_bgt_constant_taken
+  li r12, 1
+  blr
+cmplw_bgt_constant_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmplw_ble_constant:
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  li r3, 5
+  cmplw r3, r4
+  ble cmplw_ble_constant_taken
+  li r12, 1
+  blr
+cmplw_ble_constant_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmplw_bge_constant:
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  li r3, 5
+  cmplw r3, r4
+  bge cmplw_bge_constant_taken
+  li r12, 1
+  blr
+cmplw_bge_constant_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_cmpw_cr6_bgt_live:
+  #_ REGISTER_IN r3 7
+  #_ REGISTER_IN r4 3
+  cmpw cr6, r3, r4
+  bgt cr6, cmpw_cr6_bgt_live_taken
+  li r11, 1
+  mfcr r12
+  blr
+cmpw_cr6_bgt_live_taken:
+  li r11, 2
+  mfcr r12
+  blr
+  #_ REGISTER_OUT r11 2
+  #_ REGISTER_OUT r12 0x40
+
+test_cmpw_cr6_ble_live:
+  #_ REGISTER_IN r3 7
+  #_ REGISTER_IN r4 3
+  cmpw cr6, r3, r4
+  ble cr6, cmpw_cr6_ble_live_taken
+  li r11, 1
+  mfcr r12
+  blr
+cmpw_cr6_ble_live_taken:
+  li r11, 2
+  mfcr r12
+  blr
+  #_ REGISTER_OUT r11 1
+  #_ REGISTER_OUT r12 0x40
+
+test_record_add_blt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFD
+  #_ REGISTER_IN r4 1
+  add. r5, r3, r4
+  blt record_add_blt_taken
+  li r12, 1
+  blr
+record_add_blt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_record_add_bgt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFD
+  #_ REGISTER_IN r4 1
+  add. r5, r3, r4
+  bgt record_add_bgt_taken
+  li r12, 1
+  blr
+record_add_bgt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_record_and_beq:
+  #_ REGISTER_IN r3 0xF0
+  #_ REGISTER_IN r4 0x0F
+  and. r5, r3, r4
+  beq record_and_beq_taken
+  li r12, 1
+  blr
+record_and_beq_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_record_and_bne:
+  #_ REGISTER_IN r3 0xF0
+  #_ REGISTER_IN r4 0x0F
+  and. r5, r3, r4
+  bne record_and_bne_taken
+  li r12, 1
+  blr
+record_and_bne_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_record_subf_bge:
+  #_ REGISTER_IN r3 3
+  #_ REGISTER_IN r4 3
+  subf. r5, r4, r3
+  bge record_subf_bge_taken
+  li r12, 1
+  blr
+record_subf_bge_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_record_or_ble:
+  #_ REGISTER_IN r3 0x10
+  #_ REGISTER_IN r4 0
+  or. r5, r3, r4
+  ble record_or_ble_taken
+  li r12, 1
+  blr
+record_or_ble_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_fcmpu_blt:
+  #_ REGISTER_IN f1 1.0
+  #_ REGISTER_IN f2 2.0
+  fcmpu cr1, f1, f2
+  blt cr1, fcmpu_blt_taken
+  li r12, 1
+  blr
+fcmpu_blt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_fcmpu_bge:
+  #_ REGISTER_IN f1 1.0
+  #_ REGISTER_IN f2 2.0
+  fcmpu cr1, f1, f2
+  bge cr1, fcmpu_bge_taken
+  li r12, 1
+  blr
+fcmpu_bge_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_fcmpu_bgt:
+  #_ REGISTER_IN f1 1.0
+  #_ REGISTER_IN f2 2.0
+  fcmpu cr1, f1, f2
+  bgt cr1, fcmpu_bgt_taken
+  li r12, 1
+  blr
+fcmpu_bgt_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_fcmpu_ble:
+  #_ REGISTER_IN f1 1.0
+  #_ REGISTER_IN f2 2.0
+  fcmpu cr1, f1, f2
+  ble cr1, fcmpu_ble_taken
+  li r12, 1
+  blr
+fcmpu_ble_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_fcmpu_beq:
+  #_ REGISTER_IN f1 1.0
+  #_ REGISTER_IN f2 2.0
+  fcmpu cr1, f1, f2
+  beq cr1, fcmpu_beq_taken
+  li r12, 1
+  blr
+fcmpu_beq_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_fcmpu_bne:
+  #_ REGISTER_IN f1 1.0
+  #_ REGISTER_IN f2 2.0
+  fcmpu cr1, f1, f2
+  bne cr1, fcmpu_bne_taken
+  li r12, 1
+  blr
+fcmpu_bne_taken:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_bltlr:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  li r12, 2
+  cmpw r3, r4
+  bltlr
+  li r12, 1
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_cmpw_bgelr:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  li r12, 2
+  cmpw r3, r4
+  bgelr
+  li r12, 1
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_three_way_lt:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpw r3, r4
+  blt three_way_lt_lt
+  bgt three_way_lt_gt
+  li r12, 3
+  blr
+three_way_lt_lt:
+  li r12, 1
+  blr
+three_way_lt_gt:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 1
+
+test_three_way_gt:
+  #_ REGISTER_IN r3 1
+  #_ REGISTER_IN r4 0xFFFFFFFFFFFFFFFF
+  cmpw r3, r4
+  blt three_way_gt_lt
+  bgt three_way_gt_gt
+  li r12, 3
+  blr
+three_way_gt_lt:
+  li r12, 1
+  blr
+three_way_gt_gt:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 2
+
+test_three_way_eq:
+  #_ REGISTER_IN r3 5
+  #_ REGISTER_IN r4 5
+  cmpw r3, r4
+  blt three_way_eq_lt
+  bgt three_way_eq_gt
+  li r12, 3
+  blr
+three_way_eq_lt:
+  li r12, 1
+  blr
+three_way_eq_gt:
+  li r12, 2
+  blr
+  #_ REGISTER_OUT r12 3
+
+test_cmpw_dead_cr:
+  #_ REGISTER_IN r3 0xFFFFFFFFFFFFFFFF
+  #_ REGISTER_IN r4 1
+  cmpw r3, r4
+  bge cmpw_dead_cr_taken
+  li r12, 1
+  cmpw r4, r4
+  blr
+cmpw_dead_cr_taken:
+  li r12, 2
+  cmpw r4, r4
+  blr
+  #_ REGISTER_OUT r12 1
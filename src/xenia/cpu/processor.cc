@@ -11,6 +11,9 @@
 
 #include <gflags/gflags.h>
 
+#include <algorithm>
+#include <cstring>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/byte_order.h"
@@ -21,12 +24,15 @@
 #include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/cpu/backend/code_cache.h"
 #include "xenia/cpu/breakpoint.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
+#include "xenia/cpu/mmio_handler.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
+#include "xenia/cpu/sampling_profiler.h"
 #include "xenia/cpu/stack_walker.h"
 #include "xenia/cpu/thread_state.h"
 #include "xenia/cpu/xex_module.h"
@@ -46,6 +52,19 @@
 DEFINE_bool(debug, DEFAULT_DEBUG_FLAG,
             "Allow debugging and retain debug information.");
 DEFINE_string(trace_function_data_path, "", "File to write trace data to.");
+DEFINE_string(dump_function_profile, "",
+              "Writes the recorded trace data of all functions to the given "
+              "file on exit, for use with --load_function_profile.");
+DEFINE_string(load_function_profile, "",
+              "Guides optimization with function profiles written by "
+              "--dump_function_profile in a previous run.");
+DEFINE_string(sampling_profile, "",
+              "Samples where guest code spends CPU time and writes the guest "
+              "call stacks to the given file on exit, in the folded format "
+              "read by flamegraph.pl.");
+DEFINE_int32(sampling_profile_interval, 1000,
+             "Microseconds of CPU time between --sampling_profile samples. "
+             "On Windows, threads are sampled at most once a millisecond.");
 DEFINE_bool(break_on_start, false, "Break into the debugger on startup.");
 
 namespace xe {
@@ -78,6 +97,37 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver)
     : memory_(memory), export_resolver_(export_resolver) {}
 
 Processor::~Processor() {
+  if (FLAGS_learn_mmio_sites && MMIOHandler::global_handler()) {
+    MMIOHandler::global_handler()->set_record_access_faults(false);
+  }
+
+  // Stop translating before anything it depends on goes away.
+  background_compiler_.reset();
+
+  // Samples are resolved to functions, so write them while those exist.
+  if (sampling_profiler_) {
+    sampling_profiler_->Stop();
+    sampling_profiler_->WriteFoldedStacks(
+        xe::to_wstring(FLAGS_sampling_profile));
+    sampling_profiler_.reset();
+  }
+
+  if (!FLAGS_dump_function_profile.empty()) {
+    std::vector<GuestFunction*> functions;
+    {
+      auto global_lock = global_critical_region_.Acquire();
+      for (const auto& module : modules_) {
+        module->ForEachFunction([&functions](Function* function) {
+          if (function->is_guest()) {
+            functions.push_back(static_cast<GuestFunction*>(function));
+          }
+        });
+      }
+    }
+    ExecutionProfile::Save(xe::to_wstring(FLAGS_dump_function_profile),
+                           memory_, functions);
+  }
+
   {
     auto global_lock = global_critical_region_.Acquire();
     modules_.clear();
@@ -146,6 +196,47 @@ bool Processor::Setup() {
     return false;
   }
 
+  if (!FLAGS_sampling_profile.empty()) {
+    sampling_profiler_ =
+        std::make_unique<SamplingProfiler>(backend_->code_cache());
+    if (!sampling_profiler_->Start(
+            std::chrono::microseconds(FLAGS_sampling_profile_interval))) {
+      sampling_profiler_.reset();
+    }
+  }
+
+  // Load profiles from a previous run before anything is translated.
+  if (!FLAGS_load_function_profile.empty()) {
+    execution_profile_ = std::make_unique<ExecutionProfile>();
+    if (!execution_profile_->Load(
+            xe::to_wstring(FLAGS_load_function_profile))) {
+      execution_profile_.reset();
+    }
+  }
+
+  // Start translating functions in the background, if requested.
+  int32_t background_compile_threads = FLAGS_background_compile_threads;
+  if (background_compile_threads < 0) {
+    // Leave most of the host for the guest threads.
+    background_compile_threads =
+        std::max(1, int32_t(xe::threading::logical_processor_count()) / 4);
+  }
+  if (background_compile_threads > 0) {
+    background_compiler_ = std::make_unique<BackgroundCompiler>(this);
+    if (!background_compiler_->Initialize(
+            uint32_t(background_compile_threads))) {
+      XELOGE("Unable to start background compiler");
+      background_compiler_.reset();
+    }
+  }
+
+  // Learn which guest instructions fault on MMIO so that they can be
+  // retranslated to call the ranges directly.
+  auto mmio_handler = MMIOHandler::global_handler();
+  if (FLAGS_learn_mmio_sites && mmio_handler) {
+    mmio_handler->set_record_access_faults(true);
+  }
+
   // Open the trace data path, if requested.
   functions_trace_path_ = xe::to_wstring(FLAGS_trace_function_data_path);
   if (!functions_trace_path_.empty()) {
@@ -169,8 +260,14 @@ void Processor::PreLaunch() {
 }
 
 bool Processor::AddModule(std::unique_ptr<Module> module) {
-  auto global_lock = global_critical_region_.Acquire();
-  modules_.push_back(std::move(module));
+  Module* added_module = module.get();
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    modules_.push_back(std::move(module));
+  }
+  if (background_compiler_) {
+    background_compiler_->QueueModule(added_module);
+  }
   return true;
 }
 
@@ -232,17 +329,23 @@ Function* Processor::ResolveFunction(uint32_t address) {
     // Grab symbol declaration.
     auto function = LookupFunction(address);
     if (!function) {
-      entry->status = Entry::STATUS_FAILED;
+      entry_table_.Complete(entry, Entry::STATUS_FAILED);
       return nullptr;
     }
 
     if (!DemandFunction(function)) {
-      entry->status = Entry::STATUS_FAILED;
+      entry_table_.Complete(entry, Entry::STATUS_FAILED);
       return nullptr;
     }
     entry->function = function;
     entry->end_address = function->end_address();
-    status = entry->status = Entry::STATUS_READY;
+    entry_table_.Complete(entry, Entry::STATUS_READY);
+    status = Entry::STATUS_READY;
+
+    // Get a head start on whatever it is likely to call next.
+    if (background_compiler_) {
+      background_compiler_->QueueCallTargets(function);
+    }
   }
   if (status == Entry::STATUS_READY) {
     // Ready to use.
@@ -294,7 +397,107 @@ Function* Processor::LookupFunction(Module* module, uint32_t address) {
   return function;
 }
 
+void Processor::TierUpFunction(GuestFunction* function) {
+  if (background_compiler_) {
+    background_compiler_->QueueOptimization(function);
+  } else {
+    OptimizeFunction(function);
+  }
+}
+
+bool Processor::OptimizeFunction(GuestFunction* function) {
+  return ReplaceFunction(function, true);
+}
+
+bool Processor::RetranslateFunction(GuestFunction* function) {
+  return ReplaceFunction(function, false);
+}
+
+bool Processor::ReplaceFunction(GuestFunction* function,
+                                bool only_if_unoptimized) {
+  std::lock_guard<std::mutex> lock(replace_function_mutex_);
+
+  // Old versions of the function may still be running and ask for this, so
+  // always start from the current one.
+  auto entry = entry_table_.Get(function->address());
+  if (!entry) {
+    return false;
+  }
+  auto current = static_cast<GuestFunction*>(entry->function.load());
+  if (!current->is_guest() ||
+      current->behavior() == Function::Behavior::kExtern) {
+    return false;
+  }
+  if (only_if_unoptimized &&
+      current->tier() != CompilationTier::kInterpreted &&
+      current->tier() != CompilationTier::kBaseline) {
+    // Already optimized.
+    return true;
+  }
+
+  // Everything known about the function before it was translated carries
+  // over. The translator picks the next tier from the current one.
+  auto module = current->module();
+  auto replacement =
+      backend_->CreateGuestFunction(module, current->address());
+  replacement->set_name(current->name());
+  replacement->set_end_address(current->end_address());
+  replacement->set_behavior(current->behavior());
+  replacement->set_tier(current->tier());
+  replacement->set_host_replacement(current->host_replacement());
+  replacement->set_allows_host_replacement(
+      current->allows_host_replacement());
+  // Shares the call counters, so that profiles see all calls.
+  replacement->trace_data() = current->trace_data();
+  replacement->set_status(Symbol::Status::kDefining);
+
+  if (!frontend_->DefineFunction(replacement.get(), debug_info_flags_)) {
+    XELOGE("Unable to retranslate function %.8X", current->address());
+    return false;
+  }
+
+  // Breakpoints need to be installed in the new code.
+  OnFunctionDefined(replacement.get());
+  replacement->set_status(Symbol::Status::kDefined);
+
+  // The new code already took over the indirection table and linked calls
+  // once assembled. Lookups by address now return the new function too.
+  bool replaced = entry_table_.ReplaceFunction(current, replacement.get());
+  assert_true(replaced);
+  module->ReplaceFunction(std::move(replacement));
+  return replaced;
+}
+
+void Processor::ProcessMmioAccessFaults() {
+  auto mmio_handler = MMIOHandler::global_handler();
+  if (!FLAGS_learn_mmio_sites || !mmio_handler) {
+    return;
+  }
+  for (auto host_pc : mmio_handler->TakeAccessFaults()) {
+    // Code that has since been replaced is still found, as it is only retired.
+    auto function = backend_->code_cache()->LookupFunction(host_pc);
+    if (!function) {
+      continue;
+    }
+    uint32_t guest_address = function->MapMachineCodeToGuestAddress(host_pc);
+    if (!mmio_handler->AddAccessSite(guest_address)) {
+      continue;
+    }
+    XELOGCPU("MMIO access site learned at %.8X in %.8X", guest_address,
+             function->address());
+    if (background_compiler_) {
+      background_compiler_->QueueRetranslation(function);
+    } else {
+      RetranslateFunction(function);
+    }
+  }
+}
+
 bool Processor::DemandFunction(Function* function) {
+  if (!background_compiler_) {
+    ProcessMmioAccessFaults();
+  }
+
   // Lock function for generation. If it's already being generated
   // by another thread this will block and return DECLARED.
   auto module = function->module();
@@ -471,6 +674,22 @@ uint8_t* Processor::AllocateFunctionTraceData(size_t size) {
   return functions_trace_file_->Allocate(size);
 }
 
+const FunctionProfile* Processor::LookupFunctionProfile(
+    GuestFunction* function) const {
+  if (!execution_profile_) {
+    return nullptr;
+  }
+  return execution_profile_->Lookup(memory_, function->address(),
+                                    function->end_address());
+}
+
+uint8_t* Processor::AllocateFunctionCounterData(size_t size) {
+  auto global_lock = global_critical_region_.Acquire();
+  auto data = reinterpret_cast<uint8_t*>(function_counter_arena_.Alloc(size));
+  std::memset(data, 0, size);
+  return data;
+}
+
 void Processor::OnFunctionDefined(Function* function) {
   auto global_lock = global_critical_region_.Acquire();
   for (auto breakpoint : breakpoints_) {
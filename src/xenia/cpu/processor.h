@@ -14,16 +14,20 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "xenia/base/arena.h"
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/mutex.h"
+#include "xenia/cpu/background_compiler.h"
 #include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/debug_listener.h"
 #include "xenia/cpu/entry_table.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/function_profile.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/thread_debug_info.h"
@@ -36,6 +40,7 @@ namespace xe {
 namespace cpu {
 
 class Breakpoint;
+class SamplingProfiler;
 class StackWalker;
 class XexModule;
 
@@ -69,6 +74,9 @@ class Processor {
   StackWalker* stack_walker() const { return stack_walker_.get(); }
   ppc::PPCFrontend* frontend() const { return frontend_.get(); }
   backend::Backend* backend() const { return backend_.get(); }
+  BackgroundCompiler* background_compiler() const {
+    return background_compiler_.get();
+  }
   ExportResolver* export_resolver() const { return export_resolver_; }
 
   bool Setup();
@@ -116,6 +124,29 @@ class Processor {
   Function* LookupFunction(Module* module, uint32_t address);
   Function* ResolveFunction(uint32_t address);
 
+  // Called from baseline code once the function has become hot, or from the
+  // interpreter once it has been called often enough. Schedules it to be
+  // recompiled at the next tier.
+  void TierUpFunction(GuestFunction* function);
+  // Synchronously recompiles an interpreted or baseline function at the next
+  // tier. The new code replaces the old in the indirection table; callers
+  // still running the old code are unaffected.
+  bool OptimizeFunction(GuestFunction* function);
+  // Synchronously retranslates a defined function so that the new code picks
+  // up what has been learned about it since, such as its MMIO access sites.
+  // The result is optimized, except that interpreted functions get baseline
+  // code when tiered compilation is enabled.
+  // Either way the function is translated into a new Function object that
+  // replaces it once complete. The one given, which may already have been
+  // replaced, is never modified, as other threads may be running its code or
+  // reading its source map.
+  bool RetranslateFunction(GuestFunction* function);
+  // Learns the guest instructions that have faulted on MMIO since the last
+  // call and retranslates the functions containing them, which the exception
+  // handler recording the faults can't do itself. Done by the background
+  // compiler, or before translating functions if there is none.
+  void ProcessMmioAccessFaults();
+
   bool Execute(ThreadState* thread_state, uint32_t address);
   bool ExecuteRaw(ThreadState* thread_state, uint32_t address);
   uint64_t Execute(ThreadState* thread_state, uint32_t address, uint64_t args[],
@@ -199,6 +230,11 @@ class Processor {
   bool OnThreadBreakpointHit(Exception* ex);
 
   uint8_t* AllocateFunctionTraceData(size_t size);
+  // Returns the profile of the function recorded in a previous run, if one
+  // was loaded with --load_function_profile and its guest code is unchanged.
+  const FunctionProfile* LookupFunctionProfile(GuestFunction* function) const;
+  // Allocates zeroed memory for the call counters of baseline functions.
+  uint8_t* AllocateFunctionCounterData(size_t size);
 
  private:
   // Synchronously demands a debug listener.
@@ -236,6 +272,7 @@ class Processor {
                                          uint32_t current_pc);
 
   bool DemandFunction(Function* function);
+  bool ReplaceFunction(GuestFunction* function, bool only_if_unoptimized);
 
   Memory* memory_ = nullptr;
   std::unique_ptr<StackWalker> stack_walker_;
@@ -248,12 +285,22 @@ class Processor {
   // If specified, the file trace data gets written to when running.
   std::wstring functions_trace_path_;
   std::unique_ptr<ChunkedMappedMemoryWriter> functions_trace_file_;
+  // Profiles recorded in a previous run, if any.
+  std::unique_ptr<ExecutionProfile> execution_profile_;
+  // Running when --sampling_profile is set.
+  std::unique_ptr<SamplingProfiler> sampling_profiler_;
+  // Call counters for baseline functions. Allocations are never freed.
+  xe::Arena function_counter_arena_;
 
   std::unique_ptr<ppc::PPCFrontend> frontend_;
   std::unique_ptr<backend::Backend> backend_;
+  std::unique_ptr<BackgroundCompiler> background_compiler_;
   ExportResolver* export_resolver_ = nullptr;
 
   EntryTable entry_table_;
+  // Held while a function is being replaced, so that two translations of the
+  // same function can't race to publish their code.
+  std::mutex replace_function_mutex_;
   xe::global_critical_region global_critical_region_;
   ExecutionState execution_state_ = ExecutionState::kPaused;
   std::vector<std::unique_ptr<Module>> modules_;
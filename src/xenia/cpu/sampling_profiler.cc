@@ -0,0 +1,213 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/sampling_profiler.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/string.h"
+#include "xenia/cpu/backend/code_cache.h"
+
+namespace xe {
+namespace cpu {
+
+std::atomic<SamplingProfiler*> SamplingProfiler::active_profiler_ = {nullptr};
+
+SamplingProfiler::SamplingProfiler(backend::CodeCache* code_cache)
+    : code_cache_(code_cache) {
+  code_cache_min_ = code_cache_->base_address();
+  code_cache_max_ = code_cache_->base_address() + code_cache_->total_size();
+}
+
+SamplingProfiler::~SamplingProfiler() { Stop(); }
+
+bool SamplingProfiler::Start(std::chrono::microseconds interval) {
+  if (active_profiler_) {
+    XELOGE("Only one sampling profiler may run at a time");
+    return false;
+  }
+
+  ring_.reset(new Sample[kRingSize]);
+  stop_event_ = xe::threading::Event::CreateManualResetEvent(false);
+  if (!stop_event_) {
+    return false;
+  }
+  worker_thread_ =
+      xe::threading::Thread::Create({}, [this]() { WorkerThread(); });
+  if (!worker_thread_) {
+    XELOGE("Unable to create sampling profiler thread");
+    return false;
+  }
+  worker_thread_->set_name("Sampling Profiler");
+
+  active_profiler_ = this;
+  running_ = true;
+  if (!StartCapture(interval)) {
+    Stop();
+    return false;
+  }
+  return true;
+}
+
+void SamplingProfiler::Stop() {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  stop_event_->Set();
+  StopCapture();
+  xe::threading::Wait(worker_thread_.get(), false);
+  worker_thread_.reset();
+  DrainSamples();
+  active_profiler_ = nullptr;
+}
+
+void SamplingProfiler::CaptureSample(uint64_t host_pc, uint64_t host_sp,
+                                     uint64_t stack_limit) {
+  // Claim a free slot, or drop the sample if the worker has fallen behind.
+  uint64_t index = write_index_.load();
+  do {
+    if (index - read_index_.load() >= kRingSize) {
+      ++dropped_sample_count_;
+      return;
+    }
+  } while (!write_index_.compare_exchange_weak(index, index + 1));
+  auto& sample = ring_[index % kRingSize];
+
+  sample.frame_host_pcs[0] = host_pc;
+  sample.frame_count = 1;
+  while (stack_limit && sample.frame_count < kMaxFrames &&
+         host_sp < stack_limit) {
+    if (!code_cache_->UnwindFrame(&host_pc, &host_sp) &&
+        !FindGuestReturnAddress(&host_pc, &host_sp, stack_limit)) {
+      break;
+    }
+    sample.frame_host_pcs[sample.frame_count++] = host_pc;
+  }
+
+  sample.ready = true;
+}
+
+bool SamplingProfiler::FindGuestReturnAddress(uint64_t* host_pc,
+                                              uint64_t* host_sp,
+                                              uint64_t stack_limit) {
+  // Host code can't be unwound here, so scan for what looks like the return
+  // address of a call from a guest function. Stale stack contents may
+  // occasionally match, costing only the accuracy of that sample.
+  uint64_t scan_end = std::min(stack_limit, *host_sp + kMaxHostStackScan);
+  for (uint64_t sp = *host_sp; sp + 8 <= scan_end; sp += 8) {
+    uint64_t value = *reinterpret_cast<const uint64_t*>(sp);
+    if (IsGuestReturnAddress(value)) {
+      *host_pc = value;
+      *host_sp = sp + 8;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SamplingProfiler::IsGuestReturnAddress(uint64_t host_pc) {
+  if (host_pc < code_cache_min_ + 5 || host_pc >= code_cache_max_ ||
+      !code_cache_->LookupFunction(host_pc)) {
+    return false;
+  }
+  // Preceded by call rel32 or call reg.
+  auto code = reinterpret_cast<const uint8_t*>(host_pc);
+  return code[-5] == 0xE8 || (code[-2] == 0xFF && (code[-1] & 0xF8) == 0xD0);
+}
+
+void SamplingProfiler::WorkerThread() {
+  while (running_) {
+    xe::threading::Wait(stop_event_.get(), false,
+                        std::chrono::milliseconds(50));
+    DrainSamples();
+  }
+}
+
+void SamplingProfiler::DrainSamples() {
+  uint64_t index = read_index_;
+  while (index < write_index_) {
+    auto& sample = ring_[index % kRingSize];
+    if (!sample.ready) {
+      // Still being captured.
+      break;
+    }
+    auto folded_stack = FoldStack(sample);
+    {
+      std::lock_guard<std::mutex> lock(folded_stacks_mutex_);
+      ++folded_stacks_[folded_stack];
+    }
+    ++sample_count_;
+    sample.ready = false;
+    read_index_ = ++index;
+  }
+}
+
+std::string SamplingProfiler::FoldStack(const Sample& sample) {
+  std::string folded_stack;
+  auto append_frame = [&folded_stack](const std::string& name) {
+    if (!folded_stack.empty()) {
+      folded_stack += ';';
+    }
+    folded_stack += name;
+  };
+  for (size_t i = sample.frame_count; i-- > 0;) {
+    uint64_t host_pc = sample.frame_host_pcs[i];
+    GuestFunction* function = nullptr;
+    if (host_pc >= code_cache_min_ && host_pc < code_cache_max_) {
+      function = code_cache_->LookupFunction(host_pc);
+    }
+    if (!function) {
+      // Only the leaf may be in host code. Other frames are thunks between
+      // host and guest code.
+      if (!i) {
+        append_frame("[host]");
+      }
+      continue;
+    }
+    if (function->name().empty()) {
+      append_frame(xe::format_string("sub_%.8X", function->address()));
+    } else {
+      append_frame(function->name());
+    }
+    if (!i) {
+      append_frame(xe::format_string(
+          "%.8X", function->MapMachineCodeToGuestAddress(host_pc)));
+    }
+  }
+  return folded_stack;
+}
+
+bool SamplingProfiler::WriteFoldedStacks(const std::wstring& path) {
+  xe::filesystem::CreateParentFolder(path);
+  auto file = xe::filesystem::OpenFile(path, "w");
+  if (!file) {
+    XELOGE("Unable to open sampling profile file for writing");
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(folded_stacks_mutex_);
+    for (auto& it : folded_stacks_) {
+      fprintf(file, "%s %llu\n", it.first.c_str(),
+              static_cast<unsigned long long>(it.second));
+    }
+  }
+  fclose(file);
+
+  XELOGI("Wrote %llu samples (%llu dropped)",
+         static_cast<unsigned long long>(sample_count_.load()),
+         static_cast<unsigned long long>(dropped_sample_count_.load()));
+  return true;
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,119 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_SAMPLING_PROFILER_H_
+#define XENIA_CPU_SAMPLING_PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+class CodeCache;
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+namespace xe {
+namespace cpu {
+
+// Periodically samples the host PC of threads using CPU time and attributes
+// each sample to the guest call stack it was taken in, without instrumenting
+// generated code.
+// Samples are captured asynchronously (from a signal handler on Linux, and by
+// suspending each thread from a capture thread on Windows) into a fixed ring
+// and aggregated by a worker thread. Only one profiler may be running within a
+// process.
+class SamplingProfiler {
+ public:
+  explicit SamplingProfiler(backend::CodeCache* code_cache);
+  ~SamplingProfiler();
+
+  // Starts sampling after every interval of CPU time used by the process.
+  bool Start(std::chrono::microseconds interval);
+  void Stop();
+
+  // Writes the samples taken so far in the folded stack format read by
+  // flamegraph.pl and speedscope: one "frame;frame;frame count" line per
+  // distinct stack, outermost frame first. Guest frames are named after their
+  // function and the leaf frame is followed by the guest instruction address.
+  bool WriteFoldedStacks(const std::wstring& path);
+
+  uint64_t sample_count() const { return sample_count_; }
+  uint64_t dropped_sample_count() const { return dropped_sample_count_; }
+
+ private:
+  static const size_t kMaxFrames = 128;
+  static const size_t kRingSize = 4096;
+  // How far above the stack pointer of host code to look for the guest frame
+  // that called it.
+  static const uint64_t kMaxHostStackScan = 64 * 1024;
+
+  struct Sample {
+    std::atomic<bool> ready = {false};
+    // Host PCs, innermost first. Any but the first are return addresses.
+    uint32_t frame_count;
+    uint64_t frame_host_pcs[kMaxFrames];
+  };
+
+  // Implemented per platform. Once StopCapture returns no sample is being
+  // captured anymore.
+  bool StartCapture(std::chrono::microseconds interval);
+  void StopCapture();
+
+  // Walks the guest stack of the interrupted code and queues it as a sample.
+  // Called from the capture, possibly within a signal handler. The stack
+  // isn't walked at or above stack_limit.
+  void CaptureSample(uint64_t host_pc, uint64_t host_sp, uint64_t stack_limit);
+  // Searches the host stack for the return address of the guest frame that
+  // (eventually) called into the current host code.
+  bool FindGuestReturnAddress(uint64_t* host_pc, uint64_t* host_sp,
+                              uint64_t stack_limit);
+  bool IsGuestReturnAddress(uint64_t host_pc);
+
+  void WorkerThread();
+  void DrainSamples();
+  std::string FoldStack(const Sample& sample);
+
+  static std::atomic<SamplingProfiler*> active_profiler_;
+
+  backend::CodeCache* code_cache_ = nullptr;
+  uint64_t code_cache_min_ = 0;
+  uint64_t code_cache_max_ = 0;
+
+  bool running_ = false;
+  std::unique_ptr<xe::threading::Thread> worker_thread_;
+  // Samples the other threads, on platforms without profiling signals.
+  std::unique_ptr<xe::threading::Thread> capture_thread_;
+  std::unique_ptr<xe::threading::Event> stop_event_;
+
+  // Samples are claimed by incrementing the write index and are consumed in
+  // order by the worker once marked ready.
+  std::unique_ptr<Sample[]> ring_;
+  std::atomic<uint64_t> write_index_ = {0};
+  std::atomic<uint64_t> read_index_ = {0};
+  std::atomic<uint64_t> sample_count_ = {0};
+  std::atomic<uint64_t> dropped_sample_count_ = {0};
+
+  std::mutex folded_stacks_mutex_;
+  std::unordered_map<std::string, uint64_t> folded_stacks_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_SAMPLING_PROFILER_H_
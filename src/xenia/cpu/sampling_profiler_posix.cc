@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/sampling_profiler.h"
+
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
+#include "xenia/cpu/thread_state.h"
+
+namespace xe {
+namespace cpu {
+
+static struct sigaction original_sigprof_action_;
+// Signal handlers that may be using the active profiler.
+static std::atomic<uint32_t> in_flight_handler_count_ = {0};
+
+bool SamplingProfiler::StartCapture(std::chrono::microseconds interval) {
+  // SIGPROF is delivered to whichever thread is using CPU time when the
+  // process-wide profiling timer expires, so idle threads are never sampled.
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  action.sa_sigaction = [](int signal_number, siginfo_t* signal_info,
+                           void* signal_context) {
+    int saved_errno = errno;
+    ++in_flight_handler_count_;
+    auto profiler = active_profiler_.load();
+    if (profiler) {
+      // Threads that never ran guest code have no guest stack to walk.
+      auto context = reinterpret_cast<ucontext_t*>(signal_context);
+      profiler->CaptureSample(uint64_t(context->uc_mcontext.gregs[REG_RIP]),
+                              uint64_t(context->uc_mcontext.gregs[REG_RSP]),
+                              ThreadState::GetHostStackLimit());
+    }
+    --in_flight_handler_count_;
+    errno = saved_errno;
+  };
+  if (sigaction(SIGPROF, &action, &original_sigprof_action_)) {
+    XELOGE("Unable to install the sampling profiler signal handler");
+    return false;
+  }
+
+  itimerval timer;
+  timer.it_interval.tv_sec = time_t(interval.count() / 1000000);
+  timer.it_interval.tv_usec = suseconds_t(interval.count() % 1000000);
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr)) {
+    XELOGE("Unable to start the sampling profiler timer");
+    sigaction(SIGPROF, &original_sigprof_action_, nullptr);
+    return false;
+  }
+  return true;
+}
+
+void SamplingProfiler::StopCapture() {
+  itimerval timer;
+  std::memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  sigaction(SIGPROF, &original_sigprof_action_, nullptr);
+
+  // Handlers that were already running on other threads may still be writing
+  // samples. Any handler starting from now on sees no profiler.
+  active_profiler_ = nullptr;
+  while (in_flight_handler_count_) {
+    xe::threading::MaybeYield();
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
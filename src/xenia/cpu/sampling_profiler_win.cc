@@ -0,0 +1,119 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/sampling_profiler.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/platform_win.h"
+
+// Must be included after platform_win.h:
+#include <tlhelp32.h>  // NOLINT(build/include_order)
+
+namespace xe {
+namespace cpu {
+
+namespace {
+
+// Kernel and user time used by the thread so far, in 100ns units.
+uint64_t QueryThreadCpuTime(HANDLE thread) {
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (!GetThreadTimes(thread, &creation_time, &exit_time, &kernel_time,
+                      &user_time)) {
+    return 0;
+  }
+  return (uint64_t(kernel_time.dwHighDateTime) << 32 |
+          kernel_time.dwLowDateTime) +
+         (uint64_t(user_time.dwHighDateTime) << 32 | user_time.dwLowDateTime);
+}
+
+}  // namespace
+
+bool SamplingProfiler::StartCapture(std::chrono::microseconds interval) {
+  // There are no profiling signals, so a capture thread wakes up every
+  // interval (at the scheduler's millisecond granularity) and samples each
+  // thread that has used CPU time since, suspending it while its stack is
+  // walked. Idle threads are never sampled, as with SIGPROF.
+  auto tick = std::max(
+      std::chrono::milliseconds(1),
+      std::chrono::duration_cast<std::chrono::milliseconds>(interval));
+  capture_thread_ = xe::threading::Thread::Create({}, [this, tick]() {
+    DWORD process_id = GetCurrentProcessId();
+    DWORD capture_thread_id = GetCurrentThreadId();
+    std::unordered_map<DWORD, uint64_t> cpu_times;
+    std::unordered_map<DWORD, uint64_t> last_cpu_times;
+    while (xe::threading::Wait(stop_event_.get(), false, tick) ==
+           xe::threading::WaitResult::kTimeout) {
+      HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+      if (snapshot == INVALID_HANDLE_VALUE) {
+        continue;
+      }
+      THREADENTRY32 entry;
+      entry.dwSize = sizeof(entry);
+      for (BOOL found = Thread32First(snapshot, &entry); found;
+           found = Thread32Next(snapshot, &entry)) {
+        if (entry.th32OwnerProcessID != process_id ||
+            entry.th32ThreadID == capture_thread_id) {
+          continue;
+        }
+        HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT |
+                                       THREAD_QUERY_LIMITED_INFORMATION,
+                                   FALSE, entry.th32ThreadID);
+        if (!thread) {
+          continue;
+        }
+        uint64_t cpu_time = QueryThreadCpuTime(thread);
+        cpu_times[entry.th32ThreadID] = cpu_time;
+        auto it = last_cpu_times.find(entry.th32ThreadID);
+        if (it != last_cpu_times.end() && it->second != cpu_time &&
+            SuspendThread(thread) != DWORD(-1)) {
+          // Until the thread is resumed, nothing that may take a lock it
+          // holds can be called.
+          CONTEXT context;
+          context.ContextFlags = CONTEXT_CONTROL;
+          MEMORY_BASIC_INFORMATION stack_info;
+          // The stack is committed from the page of the stack pointer up to
+          // its base.
+          if (GetThreadContext(thread, &context) &&
+              VirtualQuery(reinterpret_cast<void*>(context.Rsp), &stack_info,
+                           sizeof(stack_info))) {
+            CaptureSample(
+                context.Rip, context.Rsp,
+                uint64_t(stack_info.BaseAddress) + stack_info.RegionSize);
+          }
+          ResumeThread(thread);
+        }
+        CloseHandle(thread);
+      }
+      CloseHandle(snapshot);
+      // Threads that have exited are forgotten.
+      std::swap(cpu_times, last_cpu_times);
+      cpu_times.clear();
+    }
+  });
+  if (!capture_thread_) {
+    XELOGE("Unable to create sampling profiler capture thread");
+    return false;
+  }
+  capture_thread_->set_name("Sampling Profiler Capture");
+  return true;
+}
+
+void SamplingProfiler::StopCapture() {
+  // Stopped along with the worker.
+  if (capture_thread_) {
+    xe::threading::Wait(capture_thread_.get(), false);
+    capture_thread_.reset();
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -288,9 +288,9 @@ class Win32StackWalker : public StackWalker {
   static DWORD64 WINAPI XSymGetModuleBase64(_In_ HANDLE hProcess,
                                             _In_ DWORD64 dwAddr) {
     if (dwAddr >= code_cache_min_ && dwAddr < code_cache_max_) {
-      // In our generated range all addresses are relative to the code cache
-      // base.
-      return code_cache_min_;
+      // In our generated range addresses are relative to the segment of the
+      // code cache the unwind info is in.
+      return code_cache_->LookupUnwindBase(dwAddr);
     }
     // Normal module base lookup.
     return sym_get_module_base_64_(hProcess, dwAddr);
@@ -45,11 +45,23 @@ TestModule::TestModule(Processor* processor, const std::string& name,
   // Passes are executed in the order they are added. Multiple of the same
   // pass type may be used.
   compiler_->AddPass(std::make_unique<passes::ContextPromotionPass>());
+  {
+    auto group = std::make_unique<passes::ConditionalGroupPass>();
+    group->AddPass(std::make_unique<passes::SimplificationPass>());
+    group->AddPass(std::make_unique<passes::ConstantPropagationPass>());
+    compiler_->AddPass(std::move(group));
+  }
+  compiler_->AddPass(std::make_unique<passes::GlobalValueNumberingPass>());
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
-  compiler_->AddPass(std::make_unique<passes::ConstantPropagationPass>());
-  compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
-  // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
-  compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
+  compiler_->AddPass(std::make_unique<passes::LoopInvariantCodeMotionPass>());
+  compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
+  {
+    auto group = std::make_unique<passes::ConditionalGroupPass>();
+    group->AddPass(std::make_unique<passes::ConstantPropagationPass>());
+    group->AddPass(std::make_unique<passes::SimplificationPass>());
+    group->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
+    compiler_->AddPass(std::move(group));
+  }
 
   //// Removes all unneeded variables. Try not to add new ones after this.
   // compiler_->AddPass(new passes::ValueReductionPass());
@@ -58,6 +70,8 @@ TestModule::TestModule(Processor* processor, const std::string& name,
   // Will modify the HIR to add loads/stores.
   // This should be the last pass before finalization, as after this all
   // registers are assigned and ready to be emitted.
+  // Allocation spans blocks and needs an up to date CFG.
+  compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
   compiler_->AddPass(std::make_unique<passes::RegisterAllocationPass>(
       processor->backend()->machine_info()));
 
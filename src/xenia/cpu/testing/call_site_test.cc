@@ -0,0 +1,99 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/cpu_flags.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+namespace {
+
+const uint32_t kRangeAddress = 0x7FC80000;
+
+const uint32_t kCallerOffset = 0x00;
+const uint32_t kCalleeOffset = 0x14;
+const uint32_t kCode[] = {
+    // Caller: returns callee() + 1.
+    0x7D8802A6,  // mflr   r12
+    0x48000011,  // bl     callee
+    0x7D8803A6,  // mtlr   r12
+    0x38630001,  // addi   r3, r3, 1
+    0x4E800020,  // blr
+    // Callee: returns the device register.
+    0x3C807FC8,  // lis    r4, 0x7FC8
+    0x80640000,  // lwz    r3, 0(r4)
+    0x4E800020,  // blr
+};
+
+// A device register whose reads change the code the caller's call site
+// targets, while the call through it is still in progress.
+struct CallSitePatcher {
+  Processor* processor = nullptr;
+  uint32_t read_count = 0;
+
+  static uint32_t Read(void* ppc_context, void* callback_context,
+                       uint32_t addr) {
+    auto patcher = reinterpret_cast<CallSitePatcher*>(callback_context);
+    auto processor = patcher->processor;
+    uint32_t callee_address = TestCode::kBaseAddress + kCalleeOffset;
+    if (patcher->read_count++ % 2) {
+      // Back to calling through the indirection table.
+      auto code_cache = static_cast<backend::x64::X64CodeCache*>(
+          processor->backend()->code_cache());
+      code_cache->UnlinkCallSites(callee_address);
+    } else {
+      // Linked to new code, with the code running now retired.
+      processor->RetranslateFunction(static_cast<GuestFunction*>(
+          processor->QueryFunction(callee_address)));
+    }
+    return 41;
+  }
+  static void Write(void* ppc_context, void* callback_context, uint32_t addr,
+                    uint32_t value) {}
+};
+
+}  // namespace
+
+TEST_CASE("CALL_SITE_PATCHED_DURING_CALL", "[call_site]") {
+  // The callee must be called rather than inlined, and only compiled once
+  // first called.
+  ScopedFlags flags;
+  flags.Set(&FLAGS_inline_calls, false)
+      .Set(&FLAGS_background_compile_threads, 0);
+
+  TestCode test(kCode, xe::countof(kCode));
+  CallSitePatcher patcher;
+  patcher.processor = test.processor.get();
+  REQUIRE(test.memory->AddVirtualMappedRange(
+      kRangeAddress, 0xFFFF0000, 0xFFFF, &patcher, CallSitePatcher::Read,
+      CallSitePatcher::Write));
+
+  // The first call links the site to the callee once it is compiled, and
+  // each call after that changes it again before the callee returns. The
+  // callee has to return to the same place whichever form the site was in
+  // when it was called.
+  Function* first_callee = nullptr;
+  for (uint32_t n = 0; n < 6; ++n) {
+    auto ctx = test.Run(kCallerOffset);
+    REQUIRE(ctx->r[3] == 42);
+    if (!first_callee) {
+      first_callee = test.processor->QueryFunction(TestCode::kBaseAddress +
+                                                   kCalleeOffset);
+      REQUIRE(first_callee);
+    }
+  }
+  REQUIRE(patcher.read_count == 6);
+  REQUIRE(test.processor->QueryFunction(TestCode::kBaseAddress +
+                                        kCalleeOffset) != first_callee);
+}
@@ -0,0 +1,265 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "xenia/base/threading.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/cpu_flags.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::backend::x64::X64CodeCache;
+using xe::cpu::backend::x64::X64Function;
+using xe::cpu::ppc::PPCContext;
+
+namespace {
+
+const uint32_t kFillerOffset = 0x08;
+const uint32_t kCallerOffset = 0x0C;
+const uint32_t kExternOffset = 0x20;
+const uint32_t kCode[] = {
+    0x3860002A,  // li     r3, 42
+    0x4E800020,  // blr
+    // Never run. Its address only has code placed and replaced for it.
+    0x60000000,  // nop
+    // Caller: returns extern() + 1.
+    0x7D8802A6,  // mflr   r12
+    0x48000011,  // bl     extern
+    0x7D8803A6,  // mtlr   r12
+    0x38630001,  // addi   r3, r3, 1
+    0x4E800020,  // blr
+    // Extern: calls out to the host, as kernel imports do.
+    0x44000002,  // sc
+    0x4E800020,  // blr
+};
+
+// Lets the test hold a guest thread in a call out to the host.
+struct ParkedCall {
+  std::unique_ptr<xe::threading::Event> parked_event;
+  std::unique_ptr<xe::threading::Event> resume_event;
+};
+ParkedCall* parked_call = nullptr;
+
+void ParkingExtern(PPCContext* ppc_context,
+                   kernel::KernelState* kernel_state) {
+  parked_call->parked_event->Set();
+  xe::threading::Wait(parked_call->resume_event.get(), false);
+  ppc_context->r[3] = 41;
+}
+
+X64CodeCache* GetCodeCache(TestCode& test) {
+  return static_cast<X64CodeCache*>(test.processor->backend()->code_cache());
+}
+
+// Places and replaces code for the filler address until the segment being
+// filled is full and another one is started. All but the last of the code is
+// retired.
+void FillSegment(TestCode& test,
+                 std::vector<std::unique_ptr<GuestFunction>>* functions) {
+  auto code_cache = GetCodeCache(test);
+  uint32_t address = TestCode::kBaseAddress + kFillerOffset;
+  uint8_t code[] = {0xC3};  // ret
+  uint32_t free_segment_count = code_cache->free_segment_count();
+  while (code_cache->free_segment_count() == free_segment_count) {
+    auto function =
+        test.processor->backend()->CreateGuestFunction(nullptr, address);
+    auto machine_code = reinterpret_cast<uint8_t*>(code_cache->PlaceGuestCode(
+        address, code, sizeof(code), 0, function.get()));
+    REQUIRE(machine_code);
+    static_cast<X64Function*>(function.get())->Setup(machine_code,
+                                                     sizeof(code));
+    code_cache->PublishGuestCode(address, machine_code);
+    functions->push_back(std::move(function));
+  }
+}
+
+// Has functions compiled once, on the calling thread.
+void SetCodeCacheFlags(ScopedFlags* flags) {
+  flags->Set(&FLAGS_interpret_cold_functions, false)
+      .Set(&FLAGS_tiered_compilation, false)
+      .Set(&FLAGS_background_compile_threads, 0);
+}
+
+}  // namespace
+
+TEST_CASE("CODE_CACHE_RECLAIMS_RETIRED_SEGMENTS", "[code_cache]") {
+  ScopedFlags flags;
+  SetCodeCacheFlags(&flags);
+  TestCode test(kCode, xe::countof(kCode));
+  auto code_cache = GetCodeCache(test);
+  std::vector<std::unique_ptr<GuestFunction>> fillers;
+
+  // Start a segment holding no thunks, and have the function compiled into it
+  // before filling it up.
+  FillSegment(test, &fillers);
+  test.thread_state->context()->r[3] = 0;
+  REQUIRE(test.Run(0)->r[3] == 42);
+  auto old_function = static_cast<GuestFunction*>(
+      test.processor->QueryFunction(TestCode::kBaseAddress));
+  FillSegment(test, &fillers);
+
+  // Only the function is still live in the full segment, so it is moved out.
+  auto candidates = code_cache->QueryEvacuationCandidates(0.25);
+  REQUIRE(std::find(candidates.begin(), candidates.end(),
+                    TestCode::kBaseAddress) != candidates.end());
+  REQUIRE(test.processor->RetranslateFunction(old_function));
+  REQUIRE(test.processor->QueryFunction(TestCode::kBaseAddress) !=
+          old_function);
+
+  uint32_t free_segment_count = code_cache->free_segment_count();
+  REQUIRE(code_cache->ReclaimRetiredCode());
+  REQUIRE(code_cache->free_segment_count() == free_segment_count + 1);
+
+  // Anything still holding the old function ends up calling the new one.
+  auto ctx = test.thread_state->context();
+  ctx->r[3] = 0;
+  ctx->lr = 0xBCBCBCBC;
+  REQUIRE(old_function->Call(test.thread_state.get(), uint32_t(ctx->lr)));
+  REQUIRE(ctx->r[3] == 42);
+  REQUIRE(test.Run(0)->r[3] == 42);
+}
+
+TEST_CASE("CODE_CACHE_NOT_RECLAIMED_IN_GUEST_CODE", "[code_cache]") {
+  ScopedFlags flags;
+  SetCodeCacheFlags(&flags);
+  TestCode test(kCode, xe::countof(kCode));
+  auto code_cache = GetCodeCache(test);
+  std::vector<std::unique_ptr<GuestFunction>> fillers;
+
+  // The last code placed while filling the first segment started the next,
+  // which is then filled and left holding only retired code.
+  FillSegment(test, &fillers);
+  auto retired_function = fillers.back().get();
+  FillSegment(test, &fillers);
+  uint32_t free_segment_count = code_cache->free_segment_count();
+
+  // As if the thread were running the retired code.
+  auto thread = reinterpret_cast<X64CodeCache::GuestThread*>(
+      test.thread_state->backend_data());
+  REQUIRE(X64CodeCache::EnterGuestCode(thread));
+  REQUIRE(!code_cache->ReclaimRetiredCode());
+  REQUIRE(code_cache->free_segment_count() == free_segment_count);
+  REQUIRE(code_cache->IsCurrentCode(fillers.back().get(),
+                                    fillers.back()->machine_code()));
+  REQUIRE(!code_cache->IsCurrentCode(retired_function,
+                                     retired_function->machine_code()));
+  X64CodeCache::LeaveGuestCode(thread);
+
+  REQUIRE(code_cache->ReclaimRetiredCode());
+  REQUIRE(code_cache->free_segment_count() == free_segment_count + 1);
+}
+
+TEST_CASE("CODE_CACHE_RECLAIMED_WHILE_PARKED", "[code_cache]") {
+  ScopedFlags flags;
+  SetCodeCacheFlags(&flags);
+  TestCode test(kCode, xe::countof(kCode));
+  auto code_cache = GetCodeCache(test);
+  std::vector<std::unique_ptr<GuestFunction>> fillers;
+  uint32_t caller_address = TestCode::kBaseAddress + kCallerOffset;
+  uint32_t extern_address = TestCode::kBaseAddress + kExternOffset;
+
+  // The extern and the caller are compiled into different segments, and the
+  // segment after them is left holding only retired code.
+  auto extern_function = static_cast<GuestFunction*>(
+      test.processor->LookupFunction(extern_address));
+  REQUIRE(extern_function);
+  extern_function->SetupExtern(ParkingExtern);
+  FillSegment(test, &fillers);
+  REQUIRE(test.processor->ResolveFunction(extern_address));
+  FillSegment(test, &fillers);
+  auto old_caller = static_cast<GuestFunction*>(
+      test.processor->ResolveFunction(caller_address));
+  REQUIRE(old_caller);
+  FillSegment(test, &fillers);
+  FillSegment(test, &fillers);
+
+  // Another thread blocks in the extern, with frames of both on its stack.
+  ParkedCall call;
+  call.parked_event = xe::threading::Event::CreateManualResetEvent(false);
+  call.resume_event = xe::threading::Event::CreateManualResetEvent(false);
+  parked_call = &call;
+  auto thread_state =
+      std::make_unique<ThreadState>(test.processor.get(), 0x101);
+  auto ctx = thread_state->context();
+  ctx->r[3] = 0;
+  ctx->lr = 0xBCBCBCBC;
+  std::thread guest_thread([&]() {
+    old_caller->Call(thread_state.get(), uint32_t(ctx->lr));
+  });
+  REQUIRE(xe::threading::Wait(call.parked_event.get(), false) ==
+          xe::threading::WaitResult::kSuccess);
+
+  // The segment of the replaced caller is left in place while the thread can
+  // return into it. The segment holding only filler code is reclaimed.
+  REQUIRE(test.processor->RetranslateFunction(old_caller));
+  uint32_t free_segment_count = code_cache->free_segment_count();
+  REQUIRE(code_cache->ReclaimRetiredCode());
+  REQUIRE(code_cache->free_segment_count() == free_segment_count + 1);
+
+  call.resume_event->Set();
+  guest_thread.join();
+  parked_call = nullptr;
+  REQUIRE(ctx->r[3] == 42);
+  REQUIRE(code_cache->ReclaimRetiredCode());
+  REQUIRE(code_cache->free_segment_count() == free_segment_count + 2);
+}
+
+TEST_CASE("CODE_CACHE_UNWINDS_GUEST_FRAMES", "[code_cache]") {
+  ScopedFlags flags;
+  SetCodeCacheFlags(&flags);
+  TestCode test(kCode, xe::countof(kCode));
+  auto code_cache = GetCodeCache(test);
+
+  const size_t kStackSize = 0x28;
+  uint8_t code[] = {
+      0x48, 0x83, 0xEC, 0x28,        // sub rsp, 0x28
+      0x90,                          // nop
+      0x48, 0x83, 0xC4, 0x28,        // add rsp, 0x28
+      0xE9, 0x00, 0x00, 0x00, 0x00,  // jmp rel32 (tail call)
+  };
+  auto function = test.processor->backend()->CreateGuestFunction(
+      nullptr, TestCode::kBaseAddress + kFillerOffset);
+  auto machine_code = reinterpret_cast<uint8_t*>(code_cache->PlaceGuestCode(
+      function->address(), code, sizeof(code), kStackSize, function.get()));
+  REQUIRE(machine_code);
+
+  uint64_t stack[kStackSize / 8 + 1] = {0};
+  stack[0] = 0x1111;
+  stack[kStackSize / 8] = 0x2222;
+  uint64_t stack_base = reinterpret_cast<uint64_t>(stack);
+
+  // Within the frame.
+  uint64_t host_pc = reinterpret_cast<uint64_t>(machine_code + 4);
+  uint64_t host_sp = stack_base;
+  REQUIRE(code_cache->UnwindFrame(&host_pc, &host_sp));
+  REQUIRE(host_pc == 0x2222);
+  REQUIRE(host_sp == stack_base + kStackSize + 8);
+
+  // At a tail call, once the frame has been popped.
+  host_pc = reinterpret_cast<uint64_t>(machine_code + 9);
+  host_sp = stack_base;
+  REQUIRE(code_cache->UnwindFrame(&host_pc, &host_sp));
+  REQUIRE(host_pc == 0x1111);
+  REQUIRE(host_sp == stack_base + 8);
+
+  // In the thunk an unlinked tail call site jumps to.
+  host_pc = code_cache->call_site_thunk();
+  host_sp = stack_base;
+  REQUIRE(code_cache->UnwindFrame(&host_pc, &host_sp));
+  REQUIRE(host_pc == 0x1111);
+  REQUIRE(host_sp == stack_base + 8);
+}
@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("DEAD_STORE_ACROSS_BRANCH", "[dse]") {
+  TestFunction test([](HIRBuilder& b) {
+    // Overwritten on both paths; only the second stores are observable.
+    StoreGPR(b, 3, b.LoadConstantUint64(1));
+    StoreGPR(b, 4, b.LoadConstantUint64(2));
+    auto else_label = b.NewLabel();
+    auto end_label = b.NewLabel();
+    b.BranchFalse(b.IsTrue(LoadGPR(b, 5)), else_label);
+    StoreGPR(b, 3, b.Add(LoadGPR(b, 4), b.LoadConstantUint64(10)));
+    b.Branch(end_label);
+    b.MarkLabel(else_label);
+    StoreGPR(b, 3, b.LoadConstantUint64(20));
+    b.MarkLabel(end_label);
+    // Available on both paths, but with different values.
+    StoreGPR(b, 4, b.Add(LoadGPR(b, 3), LoadGPR(b, 4)));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->r[5] = 1; },
+           [](PPCContext* ctx) {
+             REQUIRE(ctx->r[3] == 12);
+             REQUIRE(ctx->r[4] == 14);
+           });
+  test.Run([](PPCContext* ctx) { ctx->r[5] = 0; },
+           [](PPCContext* ctx) {
+             REQUIRE(ctx->r[3] == 20);
+             REQUIRE(ctx->r[4] == 22);
+           });
+}
+
+TEST_CASE("DEAD_STORE_LOOP", "[dse]") {
+  TestFunction test([](HIRBuilder& b) {
+    // The store in the loop is read by the next iteration and after it.
+    auto loop_label = b.NewLabel();
+    b.MarkLabel(loop_label);
+    StoreGPR(b, 3, b.Add(LoadGPR(b, 3), LoadGPR(b, 4)));
+    auto count = b.Sub(LoadGPR(b, 5), b.LoadConstantUint64(1));
+    StoreGPR(b, 5, count);
+    b.BranchTrue(b.IsTrue(count), loop_label);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 1;
+        ctx->r[4] = 3;
+        ctx->r[5] = 4;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 13);
+        REQUIRE(ctx->r[5] == 0);
+      });
+}
@@ -0,0 +1,44 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("GLOBAL_VALUE_NUMBERING_DOMINATED", "[gvn]") {
+  TestFunction test([](HIRBuilder& b) {
+    auto a = LoadGPR(b, 4);
+    auto c = LoadGPR(b, 5);
+    StoreGPR(b, 3, b.Add(a, b.Shl(c, int8_t(2))));
+    auto skip_label = b.NewLabel();
+    b.BranchTrue(b.IsTrue(LoadGPR(b, 6)), skip_label);
+    // Same expression with the operands swapped, in a dominated block.
+    StoreGPR(b, 7, b.Add(b.Shl(c, int8_t(2)), a));
+    b.MarkLabel(skip_label);
+    StoreGPR(b, 8, b.Xor(a, c));
+    b.Return();
+  });
+  for (uint64_t skip = 0; skip < 2; ++skip) {
+    test.Run(
+        [skip](PPCContext* ctx) {
+          ctx->r[4] = 5;
+          ctx->r[5] = 3;
+          ctx->r[6] = skip;
+          ctx->r[7] = 0;
+        },
+        [skip](PPCContext* ctx) {
+          REQUIRE(ctx->r[3] == 17);
+          REQUIRE(ctx->r[7] == (skip ? 0 : 17));
+          REQUIRE(ctx->r[8] == 6);
+        });
+  }
+}
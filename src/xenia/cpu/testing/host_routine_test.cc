@@ -0,0 +1,187 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include <cstring>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/cpu/ppc/ppc_host_routines.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::ppc;
+
+namespace {
+
+// strlen as a byte loop.
+const uint32_t kStrlenCode[] = {
+    0x7C641B78,  // mr     r4, r3
+    0x88A40000,  // lbz    r5, 0(r4)
+    0x38840001,  // addi   r4, r4, 1
+    0x2C050000,  // cmpwi  r5, 0
+    0x4082FFF4,  // bne    -12
+    0x7C632050,  // subf   r3, r3, r4
+    0x3863FFFF,  // addi   r3, r3, -1
+    0x4E800020,  // blr
+};
+
+// Writes the code at the address, returning the address of its last
+// instruction.
+uint32_t WriteCode(Memory* memory, uint32_t address, const uint32_t* code,
+                   size_t count) {
+  for (size_t n = 0; n < count; ++n) {
+    xe::store_and_swap<uint32_t>(memory->TranslateVirtual(address + n * 4),
+                                 code[n]);
+  }
+  return address + uint32_t(count - 1) * 4;
+}
+
+// A wrapper that calls the function at target.
+uint32_t WriteCallWrapper(Memory* memory, uint32_t address, uint32_t target) {
+  const uint32_t code[] = {
+      0x7D8802A6,  // mflr   r12
+      0x48000001 | ((target - address - 4) & 0x03FFFFFC),  // bl target
+      0x7D8803A6,  // mtlr   r12
+      0x4E800020,  // blr
+  };
+  return WriteCode(memory, address, code, xe::countof(code));
+}
+
+uint32_t ReadMmio(void* ppc_context, void* callback_context, uint32_t addr) {
+  return 0;
+}
+void WriteMmio(void* ppc_context, void* callback_context, uint32_t addr,
+               uint32_t value) {}
+
+}  // namespace
+
+TEST_CASE("PPC_FUNCTION_SIGNATURE", "[host_routines]") {
+  Memory memory;
+  memory.Initialize();
+  uint32_t code_a = memory.SystemHeapAlloc(0x100);
+  uint32_t code_b = memory.SystemHeapAlloc(0x100);
+
+  // The same code hashes the same wherever it is.
+  auto end_a =
+      WriteCode(&memory, code_a, kStrlenCode, xe::countof(kStrlenCode));
+  auto end_b =
+      WriteCode(&memory, code_b, kStrlenCode, xe::countof(kStrlenCode));
+  auto strlen_a = ComputeFunctionSignature(&memory, code_a, end_a);
+  REQUIRE(strlen_a == ComputeFunctionSignature(&memory, code_b, end_b));
+  REQUIRE(strlen_a.instruction_count == xe::countof(kStrlenCode));
+
+  // Including calls out of it.
+  end_a = WriteCallWrapper(&memory, code_a, 0x82000000);
+  end_b = WriteCallWrapper(&memory, code_b, 0x82000000);
+  auto wrapper_a = ComputeFunctionSignature(&memory, code_a, end_a);
+  REQUIRE(wrapper_a == ComputeFunctionSignature(&memory, code_b, end_b));
+
+  // A change after the prologue only changes the body hash.
+  const uint32_t kNops[] = {0x60000000, 0x60000000, 0x60000000, 0x60000000};
+  WriteCode(&memory, code_a, kNops, xe::countof(kNops));
+  end_a = WriteCode(&memory, code_a + sizeof(kNops), kStrlenCode,
+                    xe::countof(kStrlenCode));
+  auto padded = ComputeFunctionSignature(&memory, code_a, end_a);
+  xe::store_and_swap<uint32_t>(memory.TranslateVirtual(end_a - 4), 0x3863FFFE);
+  auto changed = ComputeFunctionSignature(&memory, code_a, end_a);
+  REQUIRE(changed.prologue_hash == padded.prologue_hash);
+  REQUIRE(changed.body_hash != padded.body_hash);
+
+  PPCSignatureTable table;
+  table.Add(strlen_a, HostRoutine::kStrlen);
+  table.Add(padded, HostRoutine::kStrlen);
+  REQUIRE(table.Lookup(strlen_a) == HostRoutine::kStrlen);
+  REQUIRE(table.Lookup(padded) == HostRoutine::kStrlen);
+  REQUIRE(table.Lookup(changed) == HostRoutine::kNone);
+  REQUIRE(table.Lookup(wrapper_a) == HostRoutine::kNone);
+
+  memory.SystemHeapFree(code_b);
+  memory.SystemHeapFree(code_a);
+}
+
+TEST_CASE("HOST_ROUTINES", "[host_routines]") {
+  Memory memory;
+  memory.Initialize();
+  std::unique_ptr<PPCContext> ctx(new PPCContext());
+  std::memset(ctx.get(), 0, sizeof(PPCContext));
+  uint32_t buffer = memory.SystemHeapAlloc(0x100);
+  uint8_t* buffer_ptr = memory.TranslateVirtual(buffer);
+
+  // strlen at every alignment, with the terminator in and past the first
+  // 16b block.
+  for (uint32_t offset = 0; offset < 32; ++offset) {
+    for (uint32_t length = 0; length < 40; ++length) {
+      std::memset(buffer_ptr, 0xCC, 0x100);
+      buffer_ptr[offset + length] = 0;
+      ctx->r[3] = buffer + offset;
+      REQUIRE(RunHostRoutine(HostRoutine::kStrlen, &memory, ctx.get()));
+      REQUIRE(ctx->r[3] == length);
+    }
+  }
+
+  ctx->r[3] = buffer + 3;
+  ctx->r[4] = 0x1234567A;
+  ctx->r[5] = 37;
+  REQUIRE(RunHostRoutine(HostRoutine::kMemset, &memory, ctx.get()));
+  REQUIRE(ctx->r[3] == buffer + 3);
+  REQUIRE(buffer_ptr[2] == 0xCC);
+  REQUIRE(buffer_ptr[3] == 0x7A);
+  REQUIRE(buffer_ptr[39] == 0x7A);
+  REQUIRE(buffer_ptr[40] == 0xCC);
+
+  for (uint32_t n = 0; n < 0x80; ++n) {
+    buffer_ptr[n] = uint8_t(n);
+  }
+  ctx->r[3] = buffer + 0x81;
+  ctx->r[4] = buffer + 1;
+  ctx->r[5] = 0x70;
+  REQUIRE(RunHostRoutine(HostRoutine::kMemcpy, &memory, ctx.get()));
+  REQUIRE(ctx->r[3] == buffer + 0x81);
+  REQUIRE(std::memcmp(buffer_ptr + 0x81, buffer_ptr + 1, 0x70) == 0);
+  REQUIRE(buffer_ptr[0x81 + 0x70] == 0xCC);
+
+  // Ranges the host can't access directly are left to the guest code.
+  const uint32_t kRangeAddress = 0x7FC80000;
+  REQUIRE(memory.AddVirtualMappedRange(kRangeAddress, 0xFFFF0000, 0xFFFF,
+                                       nullptr, ReadMmio, WriteMmio));
+  ctx->r[3] = kRangeAddress;
+  ctx->r[4] = 0;
+  ctx->r[5] = 16;
+  REQUIRE_FALSE(RunHostRoutine(HostRoutine::kMemset, &memory, ctx.get()));
+  ctx->r[3] = buffer;
+  ctx->r[4] = kRangeAddress - 8;
+  REQUIRE_FALSE(RunHostRoutine(HostRoutine::kMemcpy, &memory, ctx.get()));
+  ctx->r[3] = kRangeAddress;
+  REQUIRE_FALSE(RunHostRoutine(HostRoutine::kStrlen, &memory, ctx.get()));
+
+  // As are overlapping copies, which the guest makes forward.
+  ctx->r[3] = buffer + 8;
+  ctx->r[4] = buffer;
+  ctx->r[5] = 16;
+  REQUIRE_FALSE(RunHostRoutine(HostRoutine::kMemcpy, &memory, ctx.get()));
+
+  // And strings running off the end of allocated memory, wherever they start.
+  const uint32_t kPageAddress = 0x40000000;
+  REQUIRE(memory.LookupHeap(kPageAddress)
+              ->AllocFixed(kPageAddress, 0x10000, 0,
+                           kMemoryAllocationReserve | kMemoryAllocationCommit,
+                           kMemoryProtectRead | kMemoryProtectWrite));
+  uint8_t* page_ptr = memory.TranslateVirtual(kPageAddress);
+  std::memset(page_ptr, 0xCC, 0x10000);
+  ctx->r[3] = kPageAddress + 0xFFF0;
+  REQUIRE_FALSE(RunHostRoutine(HostRoutine::kStrlen, &memory, ctx.get()));
+  ctx->r[3] = kPageAddress + 0x100;
+  REQUIRE_FALSE(RunHostRoutine(HostRoutine::kStrlen, &memory, ctx.get()));
+  page_ptr[0xFFFF] = 0;
+  REQUIRE(RunHostRoutine(HostRoutine::kStrlen, &memory, ctx.get()));
+  REQUIRE(ctx->r[3] == 0xFFFF - 0x100);
+
+  memory.SystemHeapFree(buffer);
+}
@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include "xenia/cpu/cpu_flags.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+namespace {
+
+const uint32_t kCallOffset = 0x04;
+const uint32_t kCalleeOffset = 0x18;
+const uint32_t kCode[] = {
+    // Caller: returns callee(r3) + 1, and the LR the callee saw in r4.
+    0x7D8802A6,  // mflr   r12
+    0x48000015,  // bl     callee
+    0x7C8802A6,  // mflr   r4
+    0x7D8803A6,  // mtlr   r12
+    0x38630001,  // addi   r3, r3, 1
+    0x4E800020,  // blr
+    // Callee: returns r3 + 41.
+    0x38630029,  // addi   r3, r3, 41
+    0x4E800020,  // blr
+};
+
+}  // namespace
+
+TEST_CASE("INLINE_LEAF_CALL", "[inline]") {
+  // Calls to leaf functions are inlined, with debug info that doesn't trace
+  // calls.
+  ScopedFlags flags;
+  flags.Set(&FLAGS_inline_calls, true)
+      .Set(&FLAGS_tiered_compilation, false)
+      .Set(&FLAGS_interpret_cold_functions, false);
+  TestCode test(kCode, xe::countof(kCode));
+  test.processor->set_debug_info_flags(DebugInfoFlags::kDebugInfoAllDisasm);
+
+  test.thread_state->context()->r[3] = 1;
+  auto ctx = test.Run(0);
+  REQUIRE(ctx->r[3] == 43);
+  REQUIRE(ctx->r[4] == TestCode::kBaseAddress + kCallOffset + 4);
+  REQUIRE(ctx->lr == 0xBCBCBCBC);
+
+  // The callee was never called, so it was never compiled either.
+  uint32_t callee_address = TestCode::kBaseAddress + kCalleeOffset;
+  auto callee = test.processor->QueryFunction(callee_address);
+  REQUIRE((!callee || callee->status() != Symbol::Status::kDefined));
+
+  // The callee's instruction maps into the caller's code, after the call.
+  auto caller = static_cast<GuestFunction*>(
+      test.processor->QueryFunction(TestCode::kBaseAddress));
+  auto call_entry =
+      caller->LookupGuestAddress(TestCode::kBaseAddress + kCallOffset);
+  auto callee_entry = caller->LookupGuestAddress(callee_address);
+  REQUIRE(call_entry);
+  REQUIRE(callee_entry);
+  REQUIRE(callee_entry->code_offset >= call_entry->code_offset);
+  // Not the final blr, which is replaced by falling through.
+  REQUIRE(!caller->LookupGuestAddress(callee_address + 4));
+}
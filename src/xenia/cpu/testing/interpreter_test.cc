@@ -0,0 +1,92 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include "xenia/cpu/cpu_flags.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+namespace {
+
+const uint32_t kCode[] = {
+    // Caller: returns callee(r3) + 1.
+    0x7D8802A6,  // mflr   r12
+    0x48000011,  // bl     callee
+    0x7D8803A6,  // mtlr   r12
+    0x38630001,  // addi   r3, r3, 1
+    0x4E800020,  // blr
+    // Callee: returns r3 + 41.
+    0x38630029,  // addi   r3, r3, 41
+    0x4E800020,  // blr
+};
+
+CompilationTier QueryTier(TestCode& test) {
+  auto function = test.processor->QueryFunction(TestCode::kBaseAddress);
+  return static_cast<GuestFunction*>(function)->tier();
+}
+
+// Sets up for functions to be interpreted until called the given number of
+// times, and then compiled right away on the calling thread.
+void SetInterpreterFlags(ScopedFlags* flags, int32_t threshold) {
+  flags->Set(&FLAGS_interpret_cold_functions, true)
+      .Set(&FLAGS_interpreter_threshold, threshold)
+      .Set(&FLAGS_tiered_compilation, false)
+      .Set(&FLAGS_inline_calls, false)
+      .Set(&FLAGS_background_compile_threads, 0);
+}
+
+}  // namespace
+
+TEST_CASE("INTERPRETER_PROMOTES_AT_THRESHOLD", "[interpreter]") {
+  ScopedFlags flags;
+  SetInterpreterFlags(&flags, 3);
+  TestCode test(kCode, xe::countof(kCode));
+  REQUIRE(test.processor->frontend()->interpreter());
+
+  for (uint64_t n = 0; n < 2; ++n) {
+    test.thread_state->context()->r[3] = n;
+    REQUIRE(test.Run(0)->r[3] == n + 42);
+    REQUIRE(QueryTier(test) == CompilationTier::kInterpreted);
+  }
+
+  // The third call crosses the threshold and has the caller and then the
+  // callee compiled, but both still finish in the interpreter.
+  test.thread_state->context()->r[3] = 2;
+  REQUIRE(test.Run(0)->r[3] == 44);
+  REQUIRE(QueryTier(test) == CompilationTier::kOptimized);
+  REQUIRE(test.processor->frontend()->interpreter()->promoted_count() == 2);
+
+  test.thread_state->context()->r[3] = 3;
+  REQUIRE(test.Run(0)->r[3] == 45);
+}
+
+TEST_CASE("INTERPRETER_THRESHOLD_BELOW_ONE_COMPILES", "[interpreter]") {
+  ScopedFlags flags;
+  SetInterpreterFlags(&flags, 0);
+  TestCode test(kCode, xe::countof(kCode));
+
+  test.thread_state->context()->r[3] = 0;
+  REQUIRE(test.Run(0)->r[3] == 42);
+  REQUIRE(QueryTier(test) == CompilationTier::kOptimized);
+  REQUIRE(test.processor->frontend()->interpreter()->program_count() == 0);
+}
+
+TEST_CASE("INTERPRETER_NOT_CREATED_BY_DEFAULT", "[interpreter]") {
+  ScopedFlags flags;
+  flags.Set(&FLAGS_interpret_cold_functions, false);
+  TestCode test(kCode, xe::countof(kCode));
+  REQUIRE(!test.processor->frontend()->interpreter());
+
+  test.thread_state->context()->r[3] = 0;
+  REQUIRE(test.Run(0)->r[3] == 42);
+}
@@ -0,0 +1,64 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("LOOP_INVARIANT_HOIST", "[licm]") {
+  TestFunction test([](HIRBuilder& b) {
+    auto loop_label = b.NewLabel();
+    b.MarkLabel(loop_label);
+    // r4 and r5 are never written in the loop, so the product is invariant.
+    auto step = b.Mul(LoadGPR(b, 4), LoadGPR(b, 5));
+    StoreGPR(b, 3, b.Add(LoadGPR(b, 3), step));
+    auto count = b.Sub(LoadGPR(b, 6), b.LoadConstantUint64(1));
+    StoreGPR(b, 6, count);
+    b.BranchTrue(b.IsTrue(count), loop_label);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 1;
+        ctx->r[4] = 2;
+        ctx->r[5] = 3;
+        ctx->r[6] = 5;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[3] == 31);
+        REQUIRE(ctx->r[6] == 0);
+      });
+}
+
+TEST_CASE("LOOP_INVARIANT_STORED_IN_LOOP", "[licm]") {
+  TestFunction test([](HIRBuilder& b) {
+    auto loop_label = b.NewLabel();
+    b.MarkLabel(loop_label);
+    // r4 is written in the loop, so its load must stay.
+    auto value = b.Add(LoadGPR(b, 4), LoadGPR(b, 5));
+    StoreGPR(b, 4, value);
+    auto count = b.Sub(LoadGPR(b, 6), b.LoadConstantUint64(1));
+    StoreGPR(b, 6, count);
+    b.BranchTrue(b.IsTrue(count), loop_label);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = 1;
+        ctx->r[5] = 2;
+        ctx->r[6] = 4;
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->r[4] == 9);
+        REQUIRE(ctx->r[6] == 0);
+      });
+}
@@ -0,0 +1,205 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include <atomic>
+#include <thread>
+
+#include "xenia/base/byte_order.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/mmio_handler.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+namespace {
+
+const uint32_t kRangeAddress = 0x7FC80000;
+
+// A single device register that remembers the last value written to it.
+struct TestDevice {
+  uint32_t last_address = 0;
+  uint32_t value = 0;
+
+  static uint32_t Read(void* ppc_context, void* callback_context,
+                       uint32_t addr) {
+    auto device = reinterpret_cast<TestDevice*>(callback_context);
+    device->last_address = addr;
+    return device->value;
+  }
+  static void Write(void* ppc_context, void* callback_context, uint32_t addr,
+                    uint32_t value) {
+    auto device = reinterpret_cast<TestDevice*>(callback_context);
+    device->last_address = addr;
+    device->value = value;
+  }
+};
+
+}  // namespace
+
+TEST_CASE("LOAD_STORE_MMIO_SITE", "[instr]") {
+  ScopedFlags flags;
+  flags.Set(&FLAGS_mmio_access_stats, true);
+
+  // Loads and stores are made through whatever address is in r4, the way a
+  // guest instruction that has faulted on MMIO before is translated.
+  TestFunction test([](HIRBuilder& b) {
+    auto address = LoadGPR(b, 4);
+    b.Store(address, b.Truncate(LoadGPR(b, 5), INT32_TYPE),
+            LOAD_STORE_MMIO | LOAD_STORE_BYTE_SWAP);
+    StoreGPR(b, 3,
+             b.ZeroExtend(b.Load(address, INT32_TYPE,
+                                 LOAD_STORE_MMIO | LOAD_STORE_BYTE_SWAP),
+                          INT64_TYPE));
+    StoreGPR(b, 6, b.ZeroExtend(b.Load(address, INT32_TYPE, LOAD_STORE_MMIO),
+                                INT64_TYPE));
+    b.Return();
+  });
+  TestDevice device;
+  REQUIRE(test.memory->AddVirtualMappedRange(
+      kRangeAddress, 0xFFFF0000, 0xFFFF, &device, TestDevice::Read,
+      TestDevice::Write));
+  auto counters = MMIOHandler::access_counters();
+
+  // Inside the range the device sees host order values.
+  uint64_t direct_start = counters->direct;
+  uint64_t faulted_start = counters->faulted;
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[4] = kRangeAddress + 0x10;
+        ctx->r[5] = 0x11223344;
+      },
+      [&](PPCContext* ctx) {
+        REQUIRE(device.last_address == kRangeAddress + 0x10);
+        REQUIRE(device.value == 0x11223344);
+        REQUIRE(ctx->r[3] == 0x11223344);
+        REQUIRE(ctx->r[6] == 0x44332211);
+      });
+  REQUIRE(counters->direct - direct_start == 3 * test.processors.size());
+  REQUIRE(counters->faulted == faulted_start);
+
+  // Anywhere else they behave as normal memory accesses.
+  uint32_t guest_address = test.memory->SystemHeapAlloc(4);
+  test.Run(
+      [&](PPCContext* ctx) {
+        ctx->r[4] = guest_address;
+        ctx->r[5] = 0xAABBCCDD;
+      },
+      [&](PPCContext* ctx) {
+        REQUIRE(xe::load_and_swap<uint32_t>(
+                    test.memory->TranslateVirtual(guest_address)) ==
+                0xAABBCCDD);
+        REQUIRE(ctx->r[3] == 0xAABBCCDD);
+        REQUIRE(ctx->r[6] == 0xDDCCBBAA);
+      });
+  REQUIRE(device.value == 0x11223344);
+  test.memory->SystemHeapFree(guest_address);
+}
+
+namespace {
+
+// Loads the register at the address in r4.
+const uint32_t kLoadCode[] = {
+    0x80640000,  // lwz    r3, 0(r4)
+    0x4E800020,  // blr
+};
+
+}  // namespace
+
+TEST_CASE("MMIO_ACCESS_SITE_LEARNED", "[mmio]") {
+  ScopedFlags flags;
+  flags.Set(&FLAGS_background_compile_threads, 0)
+      .Set(&FLAGS_learn_mmio_sites, true)
+      .Set(&FLAGS_mmio_access_stats, true);
+  TestCode test(kLoadCode, xe::countof(kLoadCode));
+  TestDevice device;
+  device.value = 0x11223344;
+  REQUIRE(test.memory->AddVirtualMappedRange(
+      kRangeAddress, 0xFFFF0000, 0xFFFF, &device, TestDevice::Read,
+      TestDevice::Write));
+  auto mmio_handler = MMIOHandler::global_handler();
+  auto counters = MMIOHandler::access_counters();
+  test.thread_state->context()->r[4] = kRangeAddress + 0x10;
+
+  // The address isn't known when translating, so the load faults.
+  uint64_t direct_start = counters->direct;
+  uint64_t faulted_start = counters->faulted;
+  REQUIRE(test.Run(0)->r[3] == 0x11223344);
+  REQUIRE(counters->faulted - faulted_start == 1);
+  REQUIRE(counters->direct == direct_start);
+  auto faulting_function = static_cast<GuestFunction*>(
+      test.processor->QueryFunction(TestCode::kBaseAddress));
+  REQUIRE(!mmio_handler->IsAccessSite(TestCode::kBaseAddress));
+
+  // Once the fault is processed the function is replaced by one calling
+  // the range directly. The old one is left intact for anything still
+  // running it.
+  test.processor->ProcessMmioAccessFaults();
+  REQUIRE(mmio_handler->IsAccessSite(TestCode::kBaseAddress));
+  auto learned_function = test.processor->QueryFunction(TestCode::kBaseAddress);
+  REQUIRE(learned_function != faulting_function);
+  REQUIRE(faulting_function->machine_code());
+  REQUIRE(test.Run(0)->r[3] == 0x11223344);
+  REQUIRE(counters->faulted - faulted_start == 1);
+  REQUIRE(counters->direct - direct_start == 1);
+
+  // Nothing is retranslated again without new faults.
+  test.processor->ProcessMmioAccessFaults();
+  REQUIRE(test.processor->QueryFunction(TestCode::kBaseAddress) ==
+          learned_function);
+}
+
+TEST_CASE("MMIO_ACCESS_SITE_RETRANSLATED_WHILE_RUNNING", "[mmio]") {
+  ScopedFlags flags;
+  flags.Set(&FLAGS_background_compile_threads, 0)
+      .Set(&FLAGS_learn_mmio_sites, true);
+  TestCode test(kLoadCode, xe::countof(kLoadCode));
+  TestDevice device;
+  device.value = 0x11223344;
+  REQUIRE(test.memory->AddVirtualMappedRange(
+      kRangeAddress, 0xFFFF0000, 0xFFFF, &device, TestDevice::Read,
+      TestDevice::Write));
+  test.processor->ResolveFunction(TestCode::kBaseAddress);
+
+  // Another thread keeps calling the function while it is replaced, first
+  // with the learned site and then with plain retranslations.
+  std::atomic<bool> running(true);
+  std::atomic<uint32_t> mismatch_count(0);
+  std::atomic<uint32_t> call_count(0);
+  std::thread caller([&]() {
+    ThreadState thread_state(test.processor.get(), 0x101);
+    auto ctx = thread_state.context();
+    while (running || call_count < 100) {
+      ctx->r[4] = kRangeAddress + 0x10;
+      ctx->lr = 0xBCBCBCBC;
+      test.processor->ResolveFunction(TestCode::kBaseAddress)
+          ->Call(&thread_state, uint32_t(ctx->lr));
+      if (ctx->r[3] != 0x11223344) {
+        ++mismatch_count;
+      }
+      ++call_count;
+    }
+  });
+  while (call_count < 10) {
+    std::this_thread::yield();
+  }
+  for (uint32_t n = 0; n < 20; ++n) {
+    test.processor->ProcessMmioAccessFaults();
+    test.processor->RetranslateFunction(static_cast<GuestFunction*>(
+        test.processor->QueryFunction(TestCode::kBaseAddress)));
+  }
+  running = false;
+  caller.join();
+  REQUIRE(mismatch_count == 0);
+  REQUIRE(MMIOHandler::global_handler()->IsAccessSite(TestCode::kBaseAddress));
+}
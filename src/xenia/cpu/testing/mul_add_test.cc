@@ -0,0 +1,260 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+#include <cmath>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+// Inputs where rounding the product before the add loses the result:
+// (1 + 2^-30)^2 - (1 + 2^-29) = 2^-60 and (1 + 2^-12)^2 - (1 + 2^-11) = 2^-24.
+static const double kF64A = 1.0 + std::ldexp(1.0, -30);
+static const double kF64C = 1.0 + std::ldexp(1.0, -29);
+static const double kF64Result = std::ldexp(1.0, -60);
+static const float kF32A = 1.0f + std::ldexp(1.0f, -12);
+static const float kF32C = 1.0f + std::ldexp(1.0f, -11);
+static const float kF32Result = std::ldexp(1.0f, -24);
+
+TEST_CASE("MUL_ADD_F64_FUSED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreFPR(b, 3, b.MulAdd(LoadFPR(b, 4), LoadFPR(b, 5), LoadFPR(b, 6),
+                            ARITHMETIC_FUSED));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->f[4] = kF64A;
+        ctx->f[5] = kF64A;
+        ctx->f[6] = -kF64C;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->f[3];
+        REQUIRE(result == kF64Result);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->f[4] = 5.0;
+        ctx->f[5] = 5.0;
+        ctx->f[6] = 15.0;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->f[3];
+        REQUIRE(result == 40.0);
+      });
+}
+
+TEST_CASE("MUL_ADD_F64_FUSED_CONSTANT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreFPR(b, 3, b.MulAdd(b.LoadConstantFloat64(kF64A),
+                            b.LoadConstantFloat64(kF64A), LoadFPR(b, 6),
+                            ARITHMETIC_FUSED));
+    StoreFPR(b, 4, b.MulAdd(b.LoadConstantFloat64(kF64A),
+                            b.LoadConstantFloat64(kF64A),
+                            b.LoadConstantFloat64(-kF64C), ARITHMETIC_FUSED));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->f[6] = -kF64C; },
+           [](PPCContext* ctx) {
+             REQUIRE(ctx->f[3] == kF64Result);
+             REQUIRE(ctx->f[4] == kF64Result);
+           });
+}
+
+TEST_CASE("MUL_SUB_F64_FUSED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreFPR(b, 3, b.MulSub(LoadFPR(b, 4), LoadFPR(b, 5), LoadFPR(b, 6),
+                            ARITHMETIC_FUSED));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->f[4] = kF64A;
+        ctx->f[5] = kF64A;
+        ctx->f[6] = kF64C;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->f[3];
+        REQUIRE(result == kF64Result);
+      });
+}
+
+TEST_CASE("MUL_ADD_F32_FUSED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    auto v = b.MulAdd(b.Convert(LoadFPR(b, 4), FLOAT32_TYPE),
+                      b.Convert(LoadFPR(b, 5), FLOAT32_TYPE),
+                      b.Convert(LoadFPR(b, 6), FLOAT32_TYPE), ARITHMETIC_FUSED);
+    StoreFPR(b, 3, b.Convert(v, FLOAT64_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->f[4] = kF32A;
+        ctx->f[5] = kF32A;
+        ctx->f[6] = -kF32C;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->f[3];
+        REQUIRE(result == kF32Result);
+      });
+}
+
+TEST_CASE("MUL_SUB_F32_FUSED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    auto v = b.MulSub(b.Convert(LoadFPR(b, 4), FLOAT32_TYPE),
+                      b.Convert(LoadFPR(b, 5), FLOAT32_TYPE),
+                      b.Convert(LoadFPR(b, 6), FLOAT32_TYPE), ARITHMETIC_FUSED);
+    StoreFPR(b, 3, b.Convert(v, FLOAT64_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->f[4] = kF32A;
+        ctx->f[5] = kF32A;
+        ctx->f[6] = kF32C;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->f[3];
+        REQUIRE(result == kF32Result);
+      });
+}
+
+TEST_CASE("MUL_ADD_V128", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.MulAdd(LoadVR(b, 4), LoadVR(b, 5), LoadVR(b, 6)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(1.0f, 5.0f, 1.5f, -2.0f);
+        ctx->v[5] = vec128f(1.0f, 5.0f, 2.0f, 0.25f);
+        ctx->v[6] = vec128f(1.0f, 1.0f, 0.0f, 1.0f);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128f(2.0f, 26.0f, 3.0f, 0.5f));
+      });
+}
+
+TEST_CASE("MUL_ADD_V128_FUSED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.MulAdd(LoadVR(b, 4), LoadVR(b, 5), LoadVR(b, 6),
+                           ARITHMETIC_FUSED));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(kF32A, 1.1f, 1.0f, 5.0f);
+        ctx->v[5] = vec128f(kF32A, 1.1f, 1.0f, 5.0f);
+        ctx->v[6] = vec128f(-kF32C, 1.1f, 1.0f, 1.0f);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        // 1.1 * 1.1 + 1.1 is 0x4013D70A when rounded twice.
+        REQUIRE(result == vec128i(0x33800000, 0x4013D70B, 0x40000000,
+                                  0x41D00000));
+      });
+}
+
+TEST_CASE("MUL_SUB_V128_FUSED", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.MulSub(LoadVR(b, 4), LoadVR(b, 5), LoadVR(b, 6),
+                           ARITHMETIC_FUSED));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(kF32A, 1.1f, 1.0f, 5.0f);
+        ctx->v[5] = vec128f(kF32A, 1.1f, 1.0f, 5.0f);
+        ctx->v[6] = vec128f(kF32C, 1.1f, 1.0f, 1.0f);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        // 1.1 * 1.1 - 1.1 is 0x3DE147B0 when rounded twice.
+        REQUIRE(result == vec128i(0x33800000, 0x3DE147B2, 0x00000000,
+                                  0x41C00000));
+      });
+}
+
+// Not run by default; select with "[benchmark]". Times a long dependent chain
+// of vector multiply-adds on each host extension level, with and without
+// ARITHMETIC_FUSED, and checks the results against std::fma.
+TEST_CASE("MUL_ADD_V128_THROUGHPUT", "[.][benchmark]") {
+  const int kChainLength = 64;
+  const uint64_t kIterations = 100000;
+  const uint32_t kModes[] = {0, ARITHMETIC_FUSED};
+  for (auto flags : kModes) {
+    TestFunction test([=](HIRBuilder& b) {
+      // r3 counts down the iterations; v3 carries the chain between them.
+      auto loop_label = b.NewLabel();
+      b.MarkLabel(loop_label);
+      auto v = LoadVR(b, 3);
+      for (int n = 0; n < kChainLength; ++n) {
+        v = b.MulAdd(v, LoadVR(b, 4), LoadVR(b, 5), flags);
+      }
+      StoreVR(b, 3, v);
+      auto counter = b.Sub(LoadGPR(b, 3), b.LoadConstantUint64(1));
+      StoreGPR(b, 3, counter);
+      b.BranchTrue(counter, loop_label);
+      b.Return();
+    });
+
+    // Reference, rounded once per step as on the guest.
+    float expected[4] = {1.0f, 2.0f, -3.0f, 1.1f};
+    const float multiplier[4] = {0.5f, 0.75f, 0.9f, 0.99f};
+    const float addend[4] = {1.1f, -0.3f, 0.7f, -1.0f};
+    for (uint64_t n = 0; n < kIterations * kChainLength; ++n) {
+      for (int m = 0; m < 4; ++m) {
+        expected[m] = std::fma(expected[m], multiplier[m], addend[m]);
+      }
+    }
+
+    size_t processor_index = 0;
+    uint64_t start_ticks = 0;
+    test.Run(
+        [&](PPCContext* ctx) {
+          ctx->r[3] = kIterations;
+          ctx->v[3] = vec128f(1.0f, 2.0f, -3.0f, 1.1f);
+          ctx->v[4] = vec128f(multiplier[0], multiplier[1], multiplier[2],
+                              multiplier[3]);
+          ctx->v[5] = vec128f(addend[0], addend[1], addend[2], addend[3]);
+          start_ticks = Clock::QueryHostTickCount();
+        },
+        [&](PPCContext* ctx) {
+          uint64_t ticks = Clock::QueryHostTickCount() - start_ticks;
+          auto& processor = test.processors[processor_index++];
+          auto backend =
+              static_cast<backend::x64::X64Backend*>(processor->backend());
+          int mismatches = 0;
+          for (int m = 0; m < 4; ++m) {
+            if (ctx->v[3].f32[m] != expected[m]) {
+              ++mismatches;
+            }
+          }
+          double ns_per_op = double(ticks) * 1000000000.0 /
+                             double(Clock::host_tick_frequency()) /
+                             double(kIterations * kChainLength);
+          XELOGI(
+              "MUL_ADD_V128 %-5s features %.8X: %6.3f ns/op, %d/4 lanes "
+              "differ from fused",
+              flags & ARITHMETIC_FUSED ? "fused" : "fast",
+              backend->emitter_feature_flags(), ns_per_op, mismatches);
+          if (flags & ARITHMETIC_FUSED) {
+            REQUIRE(mismatches == 0);
+          }
+        });
+  }
+}
@@ -111,3 +111,90 @@ TEST_CASE("PACK_SHORT_2", "[instr]") {
         REQUIRE(result == vec128i(0, 0, 0, 0x80018001));
       });
 }
+
+TEST_CASE("PACK_UINT_2101010", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Pack(LoadVR(b, 4), PACK_TYPE_UINT_2101010));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x40400001, 0x403FFFFF, 0x7FC00000, 0x40400002);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(0, 0, 0, 0xA00FFC01));
+      });
+  // Saturation of out of range values, negative floats, and infinities.
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x40500000, 0xBF800000, 0x7F800000, 0x40000000);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128i(0, 0, 0, 0x1FF805FF));
+      });
+}
+
+TEST_CASE("PACK_8_IN_16_UN_UN", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                         PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                             PACK_TYPE_OUT_UNSIGNED));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x0000, 0x0001, 0x00FF, 0x0100, 0x7FFF, 0x8000,
+                            0xFFFF, 0x0080);
+        ctx->v[5] = vec128s(0x0012, 0x1234, 0x00FE, 0xFF00, 0x0000, 0x00FF,
+                            0x0101, 0x007F);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0x00, 0x01, 0xFF, 0x00, 0xFF, 0x00, 0xFF,
+                                  0x80, 0x12, 0x34, 0xFE, 0x00, 0x00, 0xFF,
+                                  0x01, 0x7F));
+      });
+}
+
+TEST_CASE("PACK_8_IN_16_UN_UN_SAT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                         PACK_TYPE_8_IN_16 | PACK_TYPE_IN_UNSIGNED |
+                             PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0x0000, 0x0001, 0x00FF, 0x0100, 0x7FFF, 0x8000,
+                            0xFFFF, 0x0080);
+        ctx->v[5] = vec128s(0x0012, 0x1234, 0x00FE, 0xFF00, 0x0000, 0x00FF,
+                            0x0101, 0x007F);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                  0x80, 0x12, 0xFF, 0xFE, 0xFF, 0x00, 0xFF,
+                                  0xFF, 0x7F));
+      });
+}
+
+TEST_CASE("PACK_16_IN_32_UN_UN_SAT", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Pack(LoadVR(b, 4), LoadVR(b, 5),
+                         PACK_TYPE_16_IN_32 | PACK_TYPE_IN_UNSIGNED |
+                             PACK_TYPE_OUT_UNSIGNED | PACK_TYPE_OUT_SATURATE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128i(0x00000000, 0x0000FFFF, 0x00010000, 0xFFFFFFFF);
+        ctx->v[5] = vec128i(0x00001234, 0x80000000, 0x7FFFFFFF, 0x00000001);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128s(0x0000, 0xFFFF, 0xFFFF, 0xFFFF, 0x1234,
+                                  0xFFFF, 0xFFFF, 0x0001));
+      });
+}
@@ -149,3 +149,27 @@ TEST_CASE("PERMUTE_V128_BY_V128", "[instr]") {
                                   20, 19, 18, 17, 16));
       });
 }
+
+TEST_CASE("PERMUTE_V128_BY_V128_INTERLEAVE", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Permute(LoadVR(b, 3), LoadVR(b, 4), LoadVR(b, 5), INT8_TYPE));
+    b.Return();
+  });
+  // Only the low 5 bits of each control byte are used.
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[3] = vec128b(0x80, 0xF0, 1, 17, 2, 18, 3, 19, 31, 15, 30, 14,
+                            29, 13, 28, 12);
+        ctx->v[4] = vec128b(0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+                            0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F);
+        ctx->v[5] = vec128b(0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+                            0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0x40, 0x60, 0x41, 0x61, 0x42, 0x62, 0x43,
+                                  0x63, 0x6F, 0x4F, 0x6E, 0x4E, 0x6D, 0x4D,
+                                  0x6C, 0x4C));
+      });
+}
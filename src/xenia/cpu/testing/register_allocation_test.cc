@@ -0,0 +1,74 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2016 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("REGISTER_ALLOCATION_ACROSS_BRANCH", "[regalloc]") {
+  TestFunction test([](HIRBuilder& b) {
+    // More values live across the branch than there are host registers.
+    std::vector<Value*> values;
+    for (int n = 0; n < 8; ++n) {
+      values.push_back(b.Add(LoadGPR(b, 4 + n), b.LoadConstantUint64(n)));
+    }
+    auto skip_label = b.NewLabel();
+    b.BranchTrue(b.IsTrue(LoadGPR(b, 12)), skip_label);
+    StoreGPR(b, 4, b.LoadZeroInt64());
+    b.MarkLabel(skip_label);
+    Value* sum = values[0];
+    for (int n = 1; n < 8; ++n) {
+      sum = b.Add(sum, values[n]);
+    }
+    StoreGPR(b, 3, sum);
+    b.Return();
+  });
+  for (uint64_t skip = 0; skip < 2; ++skip) {
+    test.Run(
+        [skip](PPCContext* ctx) {
+          for (int n = 0; n < 8; ++n) {
+            ctx->r[4 + n] = n * 10;
+          }
+          ctx->r[12] = skip;
+        },
+        [](PPCContext* ctx) {
+          auto result = ctx->r[3];
+          REQUIRE(result == 308);
+        });
+  }
+}
+
+TEST_CASE("REGISTER_ALLOCATION_LOOP", "[regalloc]") {
+  TestFunction test([](HIRBuilder& b) {
+    // Defined before the loop and live across its back edge.
+    auto step = b.Add(LoadGPR(b, 4), LoadGPR(b, 5));
+    auto loop_label = b.NewLabel();
+    b.MarkLabel(loop_label);
+    StoreGPR(b, 3, b.Add(LoadGPR(b, 3), step));
+    auto count = b.Sub(LoadGPR(b, 6), b.LoadConstantUint64(1));
+    StoreGPR(b, 6, count);
+    b.BranchTrue(b.IsTrue(count), loop_label);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->r[3] = 0;
+        ctx->r[4] = 2;
+        ctx->r[5] = 3;
+        ctx->r[6] = 10;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->r[3];
+        REQUIRE(result == 50);
+        REQUIRE(ctx->r[6] == 0);
+      });
+}
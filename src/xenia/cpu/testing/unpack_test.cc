@@ -65,6 +65,26 @@ TEST_CASE("UNPACK_FLOAT16_2", "[instr]") {
            });
 }
 
+TEST_CASE("UNPACK_FLOAT16_3", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.Unpack(LoadVR(b, 4), PACK_TYPE_FLOAT16_3));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->v[4] = vec128i(0); },
+           [](PPCContext* ctx) {
+             auto result = ctx->v[3];
+             REQUIRE(result == vec128f(0.0f, 0.0f, 0.0f, 1.0f));
+           });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128s(0, 0, 0, 0, 0, 0x3C00, 0xC000, 0x3800);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128f(1.0f, -2.0f, 0.5f, 1.0f));
+      });
+}
+
 TEST_CASE("UNPACK_FLOAT16_4", "[instr]") {
   TestFunction test([](HIRBuilder& b) {
     StoreVR(b, 3, b.Unpack(LoadVR(b, 4), PACK_TYPE_FLOAT16_4));
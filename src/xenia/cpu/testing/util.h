@@ -10,14 +10,20 @@
 #ifndef XENIA_CPU_TESTING_UTIL_H_
 #define XENIA_CPU_TESTING_UTIL_H_
 
+#include <algorithm>
+#include <functional>
 #include <vector>
 
+#include "xenia/base/byte_order.h"
 #include "xenia/base/main.h"
+#include "xenia/cpu/backend/interpreter/interpreter.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/hir/hir_builder.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/cpu/raw_module.h"
 #include "xenia/cpu/test_module.h"
 
 #include "third_party/catch/single_include/catch.hpp"
@@ -30,6 +36,31 @@ namespace testing {
 
 using xe::cpu::ppc::PPCContext;
 
+// Overrides flags for as long as it is in scope, restoring their previous
+// values in reverse order when destroyed, even if a test fails partway.
+class ScopedFlags {
+ public:
+  ScopedFlags() = default;
+  ScopedFlags(const ScopedFlags&) = delete;
+  ScopedFlags& operator=(const ScopedFlags&) = delete;
+  ~ScopedFlags() {
+    for (auto it = restores_.rbegin(); it != restores_.rend(); ++it) {
+      (*it)();
+    }
+  }
+
+  template <typename T, typename U>
+  ScopedFlags& Set(T* flag, U value) {
+    T old_value = *flag;
+    restores_.push_back([flag, old_value]() { *flag = old_value; });
+    *flag = static_cast<T>(value);
+    return *this;
+  }
+
+ private:
+  std::vector<std::function<void()>> restores_;
+};
+
 class TestFunction {
  public:
   TestFunction(std::function<void(hir::HIRBuilder& b)> generator) {
@@ -39,9 +70,33 @@ class TestFunction {
 
 #if XENIA_TEST_X64
     {
-      auto processor = std::make_unique<Processor>(memory.get(), nullptr);
-      processor->Setup();
-      processors.emplace_back(std::move(processor));
+      // One processor for each level of host instruction set extensions,
+      // from none (the reference paths) to everything the host supports, so
+      // that every variant is checked against the same expectations. Levels
+      // the host can't tell apart are skipped.
+      using namespace xe::cpu::backend::x64;
+      const uint32_t extension_masks[] = {
+          0,
+          ~uint32_t(kX64EmitAVX512BW | kX64EmitAVX512VBMI),
+          ~uint32_t(kX64EmitAVX512VBMI),
+          ~0u,
+      };
+      auto old_extension_mask = FLAGS_x64_extension_mask;
+      std::vector<uint32_t> feature_flags;
+      for (auto extension_mask : extension_masks) {
+        FLAGS_x64_extension_mask = int32_t(extension_mask);
+        auto processor = std::make_unique<Processor>(memory.get(), nullptr);
+        processor->Setup();
+        auto backend = static_cast<X64Backend*>(processor->backend());
+        if (std::find(feature_flags.begin(), feature_flags.end(),
+                      backend->emitter_feature_flags()) !=
+            feature_flags.end()) {
+          continue;
+        }
+        feature_flags.push_back(backend->emitter_feature_flags());
+        processors.emplace_back(std::move(processor));
+      }
+      FLAGS_x64_extension_mask = old_extension_mask;
     }
 #endif  // XENIA_TEST_X64
 
@@ -56,9 +111,26 @@ class TestFunction {
       processor->AddModule(std::move(module));
       processor->backend()->CommitExecutableRange(0x80000000, 0x80010000);
     }
+
+    if (!processors.empty()) {
+      // The interpreter runs the HIR as the frontend emits it, before any
+      // passes. Tests using anything it doesn't support, such as vectors, are
+      // only run compiled.
+      hir::HIRBuilder builder;
+      generator(builder);
+      builder.Finalize();
+      auto program =
+          backend::interpreter::InterpreterProgram::Lower(&builder, nullptr);
+      if (program) {
+        interpreter.reset(
+            new backend::interpreter::Interpreter(processors[0].get()));
+        interpreter_program = interpreter->AddProgram(std::move(program));
+      }
+    }
   }
 
   ~TestFunction() {
+    interpreter.reset();
     processors.clear();
     memory.reset();
   }
@@ -82,11 +154,73 @@ class TestFunction {
 
       post_call(ctx);
     }
+
+    if (interpreter) {
+      auto thread_state =
+          std::make_unique<ThreadState>(processors[0].get(), 0x100);
+      auto ctx = thread_state->context();
+      ctx->lr = 0xBCBCBCBC;
+
+      pre_call(ctx);
+
+      interpreter->Execute(interpreter_program, ctx);
+
+      post_call(ctx);
+    }
   }
 
   uint32_t memory_size;
   std::unique_ptr<Memory> memory;
   std::vector<std::unique_ptr<Processor>> processors;
+  std::unique_ptr<backend::interpreter::Interpreter> interpreter;
+  backend::interpreter::InterpreterProgram* interpreter_program = nullptr;
+};
+
+// Guest code translated by the PPC frontend, for testing how whole functions
+// are compiled, called and replaced. Functions must not use the stack.
+class TestCode {
+ public:
+  static const uint32_t kBaseAddress = 0x82000000;
+
+  TestCode(const uint32_t* code, size_t count) {
+    memory.reset(new Memory());
+    memory->Initialize();
+    uint32_t size = uint32_t(count * 4);
+    memory->LookupHeap(kBaseAddress)
+        ->AllocFixed(kBaseAddress, size, 0,
+                     kMemoryAllocationReserve | kMemoryAllocationCommit,
+                     kMemoryProtectRead | kMemoryProtectWrite);
+    for (size_t n = 0; n < count; ++n) {
+      xe::store_and_swap<uint32_t>(
+          memory->TranslateVirtual(kBaseAddress + uint32_t(n * 4)), code[n]);
+    }
+
+    processor.reset(new Processor(memory.get(), nullptr));
+    processor->Setup();
+    auto module = std::make_unique<RawModule>(processor.get());
+    module->SetAddressRange(kBaseAddress, size);
+    processor->AddModule(std::move(module));
+    thread_state.reset(new ThreadState(processor.get(), 0x100));
+  }
+
+  ~TestCode() {
+    thread_state.reset();
+    processor.reset();
+    memory.reset();
+  }
+
+  // Calls the function at the offset from the base address.
+  PPCContext* Run(uint32_t offset) {
+    auto fn = processor->ResolveFunction(kBaseAddress + offset);
+    auto ctx = thread_state->context();
+    ctx->lr = 0xBCBCBCBC;
+    fn->Call(thread_state.get(), uint32_t(ctx->lr));
+    return ctx;
+  }
+
+  std::unique_ptr<Memory> memory;
+  std::unique_ptr<Processor> processor;
+  std::unique_ptr<ThreadState> thread_state;
 };
 
 inline hir::Value* LoadGPR(hir::HIRBuilder& b, int reg) {
@@ -23,6 +23,7 @@ namespace xe {
 namespace cpu {
 
 thread_local ThreadState* thread_state_ = nullptr;
+thread_local uintptr_t host_stack_limit_ = 0;
 
 ThreadState::ThreadState(Processor* processor, uint32_t thread_id,
                          uint32_t stack_base, uint32_t pcr_address)
@@ -43,7 +44,6 @@ ThreadState::ThreadState(Processor* processor, uint32_t thread_id,
   std::memset(context_, 0, sizeof(ppc::PPCContext));
 
   // Stash pointers to common structures that callbacks may need.
-  context_->global_mutex = &xe::global_critical_region::mutex();
   context_->virtual_membase = memory_->virtual_membase();
   context_->physical_membase = memory_->physical_membase();
   context_->processor = processor_;
@@ -68,6 +68,11 @@ ThreadState::~ThreadState() {
 
 void ThreadState::Bind(ThreadState* thread_state) {
   thread_state_ = thread_state;
+  // Guest code only runs below the frames of the callers binding its state.
+  auto frame_address = reinterpret_cast<uintptr_t>(&thread_state);
+  if (thread_state && frame_address > host_stack_limit_) {
+    host_stack_limit_ = frame_address;
+  }
 }
 
 ThreadState* ThreadState::Get() { return thread_state_; }
@@ -76,5 +81,7 @@ uint32_t ThreadState::GetThreadID() {
   return thread_state_ ? thread_state_->thread_id_ : 0xFFFFFFFF;
 }
 
+uintptr_t ThreadState::GetHostStackLimit() { return host_stack_limit_; }
+
 }  // namespace cpu
 }  // namespace xe
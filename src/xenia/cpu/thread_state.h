@@ -36,6 +36,9 @@ class ThreadState {
   static void Bind(ThreadState* thread_state);
   static ThreadState* Get();
   static uint32_t GetThreadID();
+  // An address on the host stack of this thread above all frames of guest
+  // code it has run. Everything from the stack pointer up to it is mapped.
+  static uintptr_t GetHostStackLimit();
 
  private:
   Processor* processor_;
@@ -22,6 +22,7 @@
 #include "xenia/kernel/xmodule.h"
 
 #include "third_party/crypto/rijndael-alg-fst.h"
+#include "third_party/xxhash/xxhash.h"
 
 namespace xe {
 namespace cpu {
@@ -268,7 +269,10 @@ bool XexModule::Load(const std::string& name, const std::string& path,
         reinterpret_cast<xex2_import_library*>(libraries_ptr + library_offset);
     size_t library_name_index = library->name_index & 0xFF;
     assert_true(library_name_index < max_string_table_index);
-    SetupLibraryImports(string_table[library_name_index], library);
+    // Modules loaded by tools without a kernel are left unlinked.
+    if (kernel_state_) {
+      SetupLibraryImports(string_table[library_name_index], library);
+    }
     library_offset += library->size;
   }
 
@@ -278,6 +282,12 @@ bool XexModule::Load(const std::string& name, const std::string& path,
     return false;
   }
 
+  // Declare the entry point so that it is known before anything calls it.
+  uint32_t entry_point = 0;
+  if (GetOptHeader(XEX_HEADER_ENTRY_POINT, &entry_point) && entry_point) {
+    processor_->LookupFunction(this, entry_point);
+  }
+
   // Load a specified module map and diff.
   if (FLAGS_load_module_map.size()) {
     if (!ReadMap(FLAGS_load_module_map.c_str())) {
@@ -285,6 +295,11 @@ bool XexModule::Load(const std::string& name, const std::string& path,
     }
   }
 
+  // Hash the code so that caches keyed on it can detect changed images.
+  image_hash_ = XXH64(memory()->TranslateVirtual(low_address_),
+                      high_address_ - low_address_, 0);
+  processor_->backend()->OnModuleLoaded(this, image_hash_);
+
   // Setup memory protection.
   auto sec_header = xex_security_info();
   auto heap = memory()->LookupHeap(sec_header->load_address);
@@ -76,6 +76,9 @@ class XexModule : public xe::cpu::Module {
 
   const std::string& name() const override { return name_; }
 
+  // Hash of the loaded code sections, stable across runs.
+  uint64_t image_hash() const { return image_hash_; }
+
   bool ContainsAddress(uint32_t address) override;
 
  protected:
@@ -97,6 +100,7 @@ class XexModule : public xe::cpu::Module {
   uint32_t base_address_ = 0;
   uint32_t low_address_ = 0;
   uint32_t high_address_ = 0;
+  uint64_t image_hash_ = 0;
 };
 
 }  // namespace cpu